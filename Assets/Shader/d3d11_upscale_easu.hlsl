@@ -0,0 +1,135 @@
+// FSR 1 style edge-adaptive upscale (EASU) of the RGB frame, see Streaming/Upscaler.h. Upscaler::easu() is the
+// CPU reference of this shader, keep them in sync.
+Texture2D<float4> source : register(t0);
+
+struct ShaderInput
+{
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+cbuffer UPSCALE_CONST_BUF : register(b0)
+{
+    float2 srcSize;   // source pixels
+    float2 scale;     // source pixels per output pixel
+    float2 dstOffset; // top left of the output rect in render target pixels
+    float sharpness;  // unused
+};
+
+float3 load(int2 p)
+{
+    return source.Load(int3(clamp(p, int2(0, 0), int2(srcSize) - 1), 0)).rgb;
+}
+
+// Luma approximation the analysis runs on, B + R halved plus G
+float luma(float3 c)
+{
+    return c.b * 0.5 + (c.r * 0.5 + c.g);
+}
+
+// Gradient direction and edge length around texel c, weighted by its bilinear weight w
+//     a
+//   b c d
+//     e
+void easuSet(inout float2 dir, inout float len, float w, float la, float lb, float lc, float ld, float le)
+{
+    float dirX = ld - lb;
+    float lenX = saturate(abs(dirX) / max(max(abs(ld - lc), abs(lc - lb)), 1.0 / 65536.0));
+    dir.x += dirX * w;
+    len += lenX * lenX * w;
+
+    float dirY = le - la;
+    float lenY = saturate(abs(dirY) / max(max(abs(le - lc), abs(lc - la)), 1.0 / 65536.0));
+    dir.y += dirY * w;
+    len += lenY * lenY * w;
+}
+
+void easuTap(inout float3 sum, inout float weights, float2 off, float2 dir, float2 len2, float lob, float clp, float3 c)
+{
+    float2 v;
+    v.x = (off.x * dir.x + off.y * dir.y) * len2.x;
+    v.y = (off.x * -dir.y + off.y * dir.x) * len2.y;
+    float d2 = min(v.x * v.x + v.y * v.y, clp);
+    // Lanczos2 approximation, (25/16 (2/5 x^2 - 1)^2 - (25/16 - 1)) (lob x^2 - 1)^2
+    float wB = 2.0 / 5.0 * d2 - 1.0;
+    float wA = lob * d2 - 1.0;
+    wB *= wB;
+    wA *= wA;
+    wB = 25.0 / 16.0 * wB - (25.0 / 16.0 - 1.0);
+    float w = wB * wA;
+    sum += c * w;
+    weights += w;
+}
+
+float4 main(ShaderInput input) : SV_TARGET
+{
+    float2 p = (input.pos.xy - dstOffset) * scale - 0.5;
+    float2 fp = floor(p);
+    float2 pp = p - fp;
+    int2 base = int2(fp);
+
+    // Taps around the sample point, f is the texel at floor(p)
+    //     b c
+    //   e f g h
+    //   i j k l
+    //     n o
+    float3 b = load(base + int2(0, -1));
+    float3 c = load(base + int2(1, -1));
+    float3 e = load(base + int2(-1, 0));
+    float3 f = load(base + int2(0, 0));
+    float3 g = load(base + int2(1, 0));
+    float3 h = load(base + int2(2, 0));
+    float3 i = load(base + int2(-1, 1));
+    float3 j = load(base + int2(0, 1));
+    float3 k = load(base + int2(1, 1));
+    float3 l = load(base + int2(2, 1));
+    float3 n = load(base + int2(0, 2));
+    float3 o = load(base + int2(1, 2));
+
+    float lB = luma(b), lC = luma(c), lE = luma(e), lF = luma(f), lG = luma(g), lH = luma(h);
+    float lI = luma(i), lJ = luma(j), lK = luma(k), lL = luma(l), lN = luma(n), lO = luma(o);
+
+    float2 dir = 0;
+    float len = 0;
+    easuSet(dir, len, (1.0 - pp.x) * (1.0 - pp.y), lB, lE, lF, lG, lJ);
+    easuSet(dir, len, pp.x * (1.0 - pp.y), lC, lF, lG, lH, lK);
+    easuSet(dir, len, (1.0 - pp.x) * pp.y, lF, lI, lJ, lK, lN);
+    easuSet(dir, len, pp.x * pp.y, lG, lJ, lK, lL, lO);
+
+    // Normalize the direction, no gradient at all samples along x
+    float dirR = dir.x * dir.x + dir.y * dir.y;
+    if (dirR < 1.0 / 32768.0) {
+        dir = float2(1.0, 0.0);
+    } else {
+        dir *= 1.0 / sqrt(dirR);
+    }
+
+    // Along an edge the kernel stretches along it and narrows across it, and its negative lobe sharpens.
+    // Flat areas get a round, soft kernel.
+    len *= 0.5;
+    len *= len;
+    float stretch = (dir.x * dir.x + dir.y * dir.y) / max(abs(dir.x), abs(dir.y));
+    float2 len2 = float2(1.0 + (stretch - 1.0) * len, 1.0 - 0.5 * len);
+    float lob = 0.5 + ((1.0 / 4.0 - 0.04) - 0.5) * len;
+    float clp = 1.0 / lob;
+
+    float3 sum = 0;
+    float weights = 0;
+    easuTap(sum, weights, float2(0, -1) - pp, dir, len2, lob, clp, b);
+    easuTap(sum, weights, float2(1, -1) - pp, dir, len2, lob, clp, c);
+    easuTap(sum, weights, float2(-1, 0) - pp, dir, len2, lob, clp, e);
+    easuTap(sum, weights, float2(0, 0) - pp, dir, len2, lob, clp, f);
+    easuTap(sum, weights, float2(1, 0) - pp, dir, len2, lob, clp, g);
+    easuTap(sum, weights, float2(2, 0) - pp, dir, len2, lob, clp, h);
+    easuTap(sum, weights, float2(-1, 1) - pp, dir, len2, lob, clp, i);
+    easuTap(sum, weights, float2(0, 1) - pp, dir, len2, lob, clp, j);
+    easuTap(sum, weights, float2(1, 1) - pp, dir, len2, lob, clp, k);
+    easuTap(sum, weights, float2(2, 1) - pp, dir, len2, lob, clp, l);
+    easuTap(sum, weights, float2(0, 2) - pp, dir, len2, lob, clp, n);
+    easuTap(sum, weights, float2(1, 2) - pp, dir, len2, lob, clp, o);
+
+    // Deringing, the result stays within the four nearest texels
+    float3 mn = min(min(f, g), min(j, k));
+    float3 mx = max(max(f, g), max(j, k));
+    return float4(min(mx, max(mn, sum / weights)), 1.0);
+}
@@ -0,0 +1,63 @@
+// Lanczos2 upscale of the RGB frame into the destination rect, see Streaming/Upscaler.h. Upscaler::lanczos()
+// is the CPU reference of this shader, keep them in sync.
+Texture2D<float4> source : register(t0);
+
+struct ShaderInput
+{
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+cbuffer UPSCALE_CONST_BUF : register(b0)
+{
+    float2 srcSize;   // source pixels
+    float2 scale;     // source pixels per output pixel
+    float2 dstOffset; // top left of the output rect in render target pixels
+    float sharpness;  // unused
+};
+
+float3 load(int2 p)
+{
+    return source.Load(int3(clamp(p, int2(0, 0), int2(srcSize) - 1), 0)).rgb;
+}
+
+float lanczos2(float x)
+{
+    x = abs(x);
+    if (x < 1e-5) {
+        return 1.0;
+    }
+    if (x >= 2.0) {
+        return 0.0;
+    }
+    float px = 3.14159265 * x;
+    return 2.0 * sin(px) * sin(px * 0.5) / (px * px);
+}
+
+float4 main(ShaderInput input) : SV_TARGET
+{
+    float2 p = (input.pos.xy - dstOffset) * scale - 0.5;
+    float2 b = floor(p);
+    float2 f = p - b;
+    int2 base = int2(b);
+
+    float3 sum = 0;
+    float weights = 0;
+    float3 mn = 1e5;
+    float3 mx = -1e5;
+    [unroll] for (int y = -1; y <= 2; y++) {
+        float wy = lanczos2(y - f.y);
+        [unroll] for (int x = -1; x <= 2; x++) {
+            float w = lanczos2(x - f.x) * wy;
+            float3 c = load(base + int2(x, y));
+            sum += c * w;
+            weights += w;
+            // Anti-ringing, the result stays within the four nearest texels
+            if (x >= 0 && x <= 1 && y >= 0 && y <= 1) {
+                mn = min(mn, c);
+                mx = max(mx, c);
+            }
+        }
+    }
+    return float4(min(max(sum / weights, mn), mx), 1.0);
+}
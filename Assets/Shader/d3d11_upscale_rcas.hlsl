@@ -0,0 +1,49 @@
+// FSR 1 style contrast adaptive sharpening (RCAS) of the EASU output, see Streaming/Upscaler.h.
+// Upscaler::rcas() is the CPU reference of this shader, keep them in sync.
+Texture2D<float4> source : register(t0);
+
+struct ShaderInput
+{
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+cbuffer UPSCALE_CONST_BUF : register(b0)
+{
+    float2 srcSize;   // source pixels, the size of the output rect
+    float2 scale;     // unused, 1
+    float2 dstOffset; // top left of the output rect in render target pixels
+    float sharpness;  // lobe scale, Upscaler::rcasScale()
+};
+
+#define RCAS_LIMIT (0.25 - 1.0 / 16.0)
+
+float3 load(int2 p)
+{
+    return source.Load(int3(clamp(p, int2(0, 0), int2(srcSize) - 1), 0)).rgb;
+}
+
+float4 main(ShaderInput input) : SV_TARGET
+{
+    int2 p = int2(input.pos.xy - dstOffset);
+
+    //   b
+    // d e f
+    //   h
+    float3 b = load(p + int2(0, -1));
+    float3 d = load(p + int2(-1, 0));
+    float3 e = load(p);
+    float3 f = load(p + int2(1, 0));
+    float3 h = load(p + int2(0, 1));
+
+    // The largest negative lobe that keeps every channel in range, limited so it can't go unstable
+    float3 mn4 = min(min(b, d), min(f, h));
+    float3 mx4 = max(max(b, d), max(f, h));
+    float3 hitMin = mn4 / max(4.0 * mx4, 1.0 / 65536.0);
+    float3 hitMax = (1.0 - mx4) / min(4.0 * mn4 - 4.0, -1.0 / 65536.0);
+    float3 lobeRGB = max(-hitMin, hitMax);
+    float lobe = max(-RCAS_LIMIT, min(max(lobeRGB.r, max(lobeRGB.g, lobeRGB.b)), 0.0)) * sharpness;
+
+    float rcpL = 1.0 / (4.0 * lobe + 1.0);
+    return float4(saturate((lobe * (b + d + f + h) + e) * rcpL), 1.0);
+}
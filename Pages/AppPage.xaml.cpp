@@ -170,10 +170,20 @@ void AppPage::Connect(int appId) {
 	config->enableSOPS = host->EnableSOPS;
 	config->framePacing = host->FramePacing;
 	config->audioBuffer = host->AudioBuffer;
+	config->latencyBudget = host->LatencyBudget;
+	config->renderMissTarget = host->RenderMissTarget;
+	config->videoDecoder = host->VideoDecoder;
+	config->decodePipeline = host->DecodePipeline;
+	config->chromaSampling = host->ChromaSampling;
+	config->replayBuffer = host->ReplayBuffer;
+	config->recordingFormat = host->RecordingFormat;
+	config->upscaler = host->Upscaler;
 	config->enableStats = host->EnableStats;
 	config->enableGraphs = host->EnableGraphs;
-	if (config->enableHDR) {
+	if (config->enableHDR && host->VideoCodec == "H.264") {
+		// HDR needs a 10-bit codec, AV1 has one too
 		host->VideoCodec = "HEVC (H.265)";
+		config->videoCodec = host->VideoCodec;
 	}
 	bool result = this->Frame->Navigate(Windows::UI::Xaml::Interop::TypeName(StreamPage::typeid), config);
 	if (!result) {
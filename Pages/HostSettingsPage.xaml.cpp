@@ -53,11 +53,13 @@ void HostSettingsPage::OnNavigatedTo(Windows::UI::Xaml::Navigation::NavigationEv
 	AvailableFPS->Append(120);
 	AvailableVideoCodecs->Append("H.264");
 	AvailableVideoCodecs->Append("HEVC (H.265)");
+	AvailableVideoCodecs->Append("AV1");
 	AvailableAudioConfigs->Append("Stereo");
 	AvailableAudioConfigs->Append("Surround 5.1");
 	AvailableAudioConfigs->Append("Surround 7.1");
 	AvailableFramePacing->Append("Immediate");
 	AvailableFramePacing->Append("Display-locked");
+	AvailableFramePacing->Append("Latency budget");
 	CurrentResolutionIndex = 0;
 	for (int i = 0; i < AvailableResolutions->Size; i++) {
 		if (host->Resolution->Width == AvailableResolutions->GetAt(i)->Width &&
@@ -102,6 +104,89 @@ void HostSettingsPage::OnNavigatedTo(Windows::UI::Xaml::Navigation::NavigationEv
 		}
 	}
 
+	// Latency budget options, only used by the latency budget frame pacing mode
+	AvailableLatencyBudgets->Append("4 ms");
+	AvailableLatencyBudgets->Append("6 ms");
+	AvailableLatencyBudgets->Append("8 ms");
+	AvailableLatencyBudgets->Append("10 ms");
+	AvailableLatencyBudgets->Append("12 ms");
+	AvailableLatencyBudgets->Append("16 ms");
+	for (int i = 0; i < AvailableLatencyBudgets->Size; i++) {
+		if (host->LatencyBudget == AvailableLatencyBudgets->GetAt(i)) {
+			LatencyBudgetsComboBox->SelectedIndex = i;
+			break;
+		}
+	}
+
+	// Render deadline miss target, sets how much of each frame the render loop keeps free for rendering
+	AvailableRenderMissTargets->Append("10%");
+	AvailableRenderMissTargets->Append("5%");
+	AvailableRenderMissTargets->Append("1%");
+	AvailableRenderMissTargets->Append("0.1%");
+	for (int i = 0; i < AvailableRenderMissTargets->Size; i++) {
+		if (host->RenderMissTarget == AvailableRenderMissTargets->GetAt(i)) {
+			RenderMissTargetsComboBox->SelectedIndex = i;
+			break;
+		}
+	}
+
+	AvailableVideoDecoders->Append("Hardware");
+	AvailableVideoDecoders->Append("Software");
+	for (int i = 0; i < AvailableVideoDecoders->Size; i++) {
+		if (host->VideoDecoder == AvailableVideoDecoders->GetAt(i)) {
+			VideoDecodersComboBox->SelectedIndex = i;
+			break;
+		}
+	}
+
+	AvailableDecodePipelines->Append("Direct");
+	AvailableDecodePipelines->Append("Pipelined");
+	for (int i = 0; i < AvailableDecodePipelines->Size; i++) {
+		if (host->DecodePipeline == AvailableDecodePipelines->GetAt(i)) {
+			DecodePipelinesComboBox->SelectedIndex = i;
+			break;
+		}
+	}
+
+	AvailableChromaSamplings->Append("4:2:0");
+	AvailableChromaSamplings->Append("4:4:4");
+	for (int i = 0; i < AvailableChromaSamplings->Size; i++) {
+		if (host->ChromaSampling == AvailableChromaSamplings->GetAt(i)) {
+			ChromaSamplingsComboBox->SelectedIndex = i;
+			break;
+		}
+	}
+
+	AvailableReplayBuffers->Append("Off");
+	AvailableReplayBuffers->Append("15 s");
+	AvailableReplayBuffers->Append("30 s");
+	AvailableReplayBuffers->Append("60 s");
+	for (int i = 0; i < AvailableReplayBuffers->Size; i++) {
+		if (host->ReplayBuffer == AvailableReplayBuffers->GetAt(i)) {
+			ReplayBuffersComboBox->SelectedIndex = i;
+			break;
+		}
+	}
+
+	AvailableRecordingFormats->Append("MKV");
+	AvailableRecordingFormats->Append("MP4");
+	for (int i = 0; i < AvailableRecordingFormats->Size; i++) {
+		if (host->RecordingFormat == AvailableRecordingFormats->GetAt(i)) {
+			RecordingFormatsComboBox->SelectedIndex = i;
+			break;
+		}
+	}
+
+	AvailableUpscalers->Append("Bilinear");
+	AvailableUpscalers->Append("Lanczos");
+	AvailableUpscalers->Append("FSR 1");
+	for (int i = 0; i < AvailableUpscalers->Size; i++) {
+		if (host->Upscaler == AvailableUpscalers->GetAt(i)) {
+			UpscalersComboBox->SelectedIndex = i;
+			break;
+		}
+	}
+
 	if (info.vendorId == GAMING_DEVICE_VENDOR_ID_MICROSOFT) {
 		// Old Xbox One can only use H264, remove from settings everything else
 		if (info.deviceId == GAMING_DEVICE_DEVICE_ID_XBOX_ONE) {
@@ -193,13 +278,14 @@ void HostSettingsPage::FramePacing_SelectionChanged(Platform::Object^ sender, Wi
 {
 	auto selectedFramePacing = AvailableFramePacing->GetAt(this->FramePacingComboBox->SelectedIndex);
 
-	if (selectedFramePacing == "Immediate") {
-		FramePacingImmediateDesc->Visibility = Windows::UI::Xaml::Visibility::Visible;
-		FramePacingDisplayLockedDesc->Visibility = Windows::UI::Xaml::Visibility::Collapsed;
-	} else {
-		FramePacingImmediateDesc->Visibility = Windows::UI::Xaml::Visibility::Collapsed;
-		FramePacingDisplayLockedDesc->Visibility = Windows::UI::Xaml::Visibility::Visible;
-	}
+	auto visibleIf = [](bool visible) {
+		return visible ? Windows::UI::Xaml::Visibility::Visible : Windows::UI::Xaml::Visibility::Collapsed;
+	};
+	bool latencyBudget = selectedFramePacing == "Latency budget";
+	FramePacingImmediateDesc->Visibility = visibleIf(selectedFramePacing == "Immediate");
+	FramePacingDisplayLockedDesc->Visibility = visibleIf(selectedFramePacing == "Display-locked");
+	FramePacingLatencyBudgetDesc->Visibility = visibleIf(latencyBudget);
+	LatencyBudgetsComboBox->IsEnabled = latencyBudget;
 
 	host->FramePacing = selectedFramePacing;
 }
@@ -24,6 +24,14 @@ namespace moonlight_xbox_dx
 		Windows::Foundation::Collections::IVector<Platform::String^>^ availableVideoCodecs;
 		Windows::Foundation::Collections::IVector<Platform::String^>^ availableFramePacing;
 		Windows::Foundation::Collections::IVector<Platform::String^>^ availableAudioBuffers;
+		Windows::Foundation::Collections::IVector<Platform::String^>^ availableLatencyBudgets;
+		Windows::Foundation::Collections::IVector<Platform::String^>^ availableRenderMissTargets;
+		Windows::Foundation::Collections::IVector<Platform::String^>^ availableVideoDecoders;
+		Windows::Foundation::Collections::IVector<Platform::String^>^ availableDecodePipelines;
+		Windows::Foundation::Collections::IVector<Platform::String^>^ availableChromaSamplings;
+		Windows::Foundation::Collections::IVector<Platform::String^>^ availableReplayBuffers;
+		Windows::Foundation::Collections::IVector<Platform::String^>^ availableRecordingFormats;
+		Windows::Foundation::Collections::IVector<Platform::String^>^ availableUpscalers;
 		int currentResolutionIndex = 0;
 		int currentAppIndex = 0;
 		Windows::Foundation::EventRegistrationToken m_back_cookie;
@@ -98,6 +106,86 @@ namespace moonlight_xbox_dx
 			}
 		}
 
+		property Windows::Foundation::Collections::IVector<Platform::String^>^ AvailableLatencyBudgets {
+			Windows::Foundation::Collections::IVector<Platform::String^>^ get() {
+				if (this->availableLatencyBudgets == nullptr)
+				{
+					this->availableLatencyBudgets = ref new Platform::Collections::Vector<Platform::String^>();
+				}
+				return this->availableLatencyBudgets;
+			}
+		}
+
+		property Windows::Foundation::Collections::IVector<Platform::String^>^ AvailableRenderMissTargets {
+			Windows::Foundation::Collections::IVector<Platform::String^>^ get() {
+				if (this->availableRenderMissTargets == nullptr)
+				{
+					this->availableRenderMissTargets = ref new Platform::Collections::Vector<Platform::String^>();
+				}
+				return this->availableRenderMissTargets;
+			}
+		}
+
+		property Windows::Foundation::Collections::IVector<Platform::String^>^ AvailableVideoDecoders {
+			Windows::Foundation::Collections::IVector<Platform::String^>^ get() {
+				if (this->availableVideoDecoders == nullptr)
+				{
+					this->availableVideoDecoders = ref new Platform::Collections::Vector<Platform::String^>();
+				}
+				return this->availableVideoDecoders;
+			}
+		}
+
+		property Windows::Foundation::Collections::IVector<Platform::String^>^ AvailableDecodePipelines {
+			Windows::Foundation::Collections::IVector<Platform::String^>^ get() {
+				if (this->availableDecodePipelines == nullptr)
+				{
+					this->availableDecodePipelines = ref new Platform::Collections::Vector<Platform::String^>();
+				}
+				return this->availableDecodePipelines;
+			}
+		}
+
+		property Windows::Foundation::Collections::IVector<Platform::String^>^ AvailableChromaSamplings {
+			Windows::Foundation::Collections::IVector<Platform::String^>^ get() {
+				if (this->availableChromaSamplings == nullptr)
+				{
+					this->availableChromaSamplings = ref new Platform::Collections::Vector<Platform::String^>();
+				}
+				return this->availableChromaSamplings;
+			}
+		}
+
+		property Windows::Foundation::Collections::IVector<Platform::String^>^ AvailableReplayBuffers {
+			Windows::Foundation::Collections::IVector<Platform::String^>^ get() {
+				if (this->availableReplayBuffers == nullptr)
+				{
+					this->availableReplayBuffers = ref new Platform::Collections::Vector<Platform::String^>();
+				}
+				return this->availableReplayBuffers;
+			}
+		}
+
+		property Windows::Foundation::Collections::IVector<Platform::String^>^ AvailableRecordingFormats {
+			Windows::Foundation::Collections::IVector<Platform::String^>^ get() {
+				if (this->availableRecordingFormats == nullptr)
+				{
+					this->availableRecordingFormats = ref new Platform::Collections::Vector<Platform::String^>();
+				}
+				return this->availableRecordingFormats;
+			}
+		}
+
+		property Windows::Foundation::Collections::IVector<Platform::String^>^ AvailableUpscalers {
+			Windows::Foundation::Collections::IVector<Platform::String^>^ get() {
+				if (this->availableUpscalers == nullptr)
+				{
+					this->availableUpscalers = ref new Platform::Collections::Vector<Platform::String^>();
+				}
+				return this->availableUpscalers;
+			}
+		}
+
 		property int CurrentResolutionIndex
 		{
 			int get() { return this->currentResolutionIndex; }
@@ -7,6 +7,9 @@
 #include "StreamPage.xaml.h"
 #include "../Streaming/AudioPlayer.h"
 #include "../Streaming/FFMpegDecoder.h"
+#include "../Streaming/FrameTrace.h"
+#include "../Streaming/StreamCapture.h"
+#include "../Streaming/StreamRecorder.h"
 #include <Utils.hpp>
 #include <KeyboardControl.xaml.h>
 #include "../Common/ModalDialog.xaml.h"
@@ -323,9 +326,67 @@ void StreamPage::resetDecoder_Click(Platform::Object^ sender, Windows::UI::Xaml:
 
 void StreamPage::toggleFramePacing_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e)
 {
-	// thread safe atomic bool
-	bool isImmediate = Pacer::instance().getPacingImmediate();
-	Pacer::instance().setPacingImmediate(isImmediate ? false : true);
+	// thread safe atomic, cycles immediate -> display-locked -> latency budget
+	switch (Pacer::instance().getPacingMode()) {
+	case PacingMode::Immediate:
+		Pacer::instance().setPacingMode(PacingMode::DisplayLocked);
+		break;
+	case PacingMode::DisplayLocked:
+		Pacer::instance().setPacingMode(PacingMode::LatencyBudget);
+		break;
+	default:
+		Pacer::instance().setPacingMode(PacingMode::Immediate);
+		break;
+	}
+}
+
+void StreamPage::toggleFullClear_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e)
+{
+	// Whole back buffer or only the letterbox bars, compare the GPU render cost in the debug stats
+	m_main->ToggleFullClear();
+}
+
+void StreamPage::saveFrameTrace_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e)
+{
+	// Written in the background to the app's local folder, the path shows up in the logs
+	FrameTrace::instance().dump();
+}
+
+void StreamPage::toggleStreamCapture_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e)
+{
+	if (StreamCapture::instance().active()) {
+		StreamCapture::instance().stop();
+		toggleStreamCapture->Text = "Start stream capture";
+		return;
+	}
+	if (!StreamCapture::instance().start().empty()) {
+		// The capture starts with a keyframe, don't wait for the host to send one
+		LiRequestIdrFrame();
+		toggleStreamCapture->Text = "Stop stream capture";
+	}
+}
+
+void StreamPage::toggleRecording_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e)
+{
+	if (StreamRecorder::instance().recording()) {
+		StreamRecorder::instance().stopRecording();
+		toggleRecording->Text = "Start recording";
+		return;
+	}
+	if (StreamRecorder::instance().startRecording()) {
+		// The file starts with a keyframe
+		LiRequestIdrFrame();
+		toggleRecording->Text = "Stop recording";
+	}
+}
+
+void StreamPage::saveReplay_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e)
+{
+	// Written in the background to the app's local folder, the path shows up in the logs
+	if (StreamRecorder::instance().saveReplay()) {
+		// The replay buffer can only trim to a keyframe, the next replay starts from this one
+		LiRequestIdrFrame();
+	}
 }
 
 // Audio buffer slider
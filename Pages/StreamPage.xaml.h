@@ -157,6 +157,11 @@ namespace moonlight_xbox_dx
 		void toggleHDR_WinAltB_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e);
 		void resetDecoder_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e);
 		void toggleFramePacing_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e);
+		void toggleFullClear_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e);
+		void saveFrameTrace_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e);
+		void toggleStreamCapture_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e);
+		void toggleRecording_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e);
+		void saveReplay_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e);
 
 		Windows::UI::Xaml::Controls::Slider^ m_audioBufferSlider;
 		bool m_audioBufferSliderReady = false;
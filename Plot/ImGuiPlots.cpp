@@ -25,6 +25,8 @@ ImGuiPlots::ImGuiPlots() :
         Plot(kPlotDescs[PLOT_DROPPED_PACER]),
         Plot(kPlotDescs[PLOT_QUEUED_FRAMES]),
         Plot(kPlotDescs[PLOT_BANDWIDTH]),
+        Plot(kPlotDescs[PLOT_QUEUE_DEPTH]),
+        Plot(kPlotDescs[PLOT_QUEUE_LATENCY]),
 
         Plot(kPlotDescs[PLOT_AUDIO_BUFFER_MS]),
         Plot(kPlotDescs[PLOT_ETC]),
@@ -10,6 +10,8 @@ enum PlotType {
 	PLOT_DROPPED_PACER,
 	PLOT_QUEUED_FRAMES,
 	PLOT_BANDWIDTH,
+	PLOT_QUEUE_DEPTH,
+	PLOT_QUEUE_LATENCY,
 
 	PLOT_AUDIO_BUFFER_MS, // not displayed, used for data collection
 	PLOT_ETC,
@@ -41,6 +43,8 @@ inline constexpr std::array<PlotDesc, PlotCount> kPlotDescs = {{
     {"Dropped frames (pacing)",  PLOT_LABEL_TOTAL_INT,       "",     -1.0f, 3.0f, NULL, NULL},
 	{"Frames queued",            PLOT_LABEL_MIN_MAX_AVG_INT, "",     -1.0f, 6.0f, NULL, NULL},
     {"Video stream",             PLOT_LABEL_MIN_MAX_AVG,     "Mbps", -0.1f, 200.0f, NULL, NULL},
+	{"Queue depth",              PLOT_LABEL_MIN_MAX_AVG_INT, "",     -1.0f, 6.0f, NULL, NULL},
+	{"Queue latency",            PLOT_LABEL_MIN_MAX_AVG,     "ms",   -0.1f, 50.0f, NULL, 49.0f},
 	{"Audio buffer",             PLOT_LABEL_MIN_MAX_AVG,     "ms",    5.0f, 50.0f, NULL, NULL},
 	{"Etc...",                   PLOT_LABEL_MIN_MAX_AVG,     "ms",   -0.1f, 65.0f, NULL, 64.0f},
 }};
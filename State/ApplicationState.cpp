@@ -42,6 +42,14 @@ Concurrency::task<void> moonlight_xbox_dx::ApplicationState::Init()
 					if (a.contains("videoCodec"))h->VideoCodec = Utils::StringFromStdString(a["videoCodec"].get<std::string>());
 					if (a.contains("framePacing"))h->FramePacing = Utils::StringFromStdString(a["framePacing"].get<std::string>());
 					if (a.contains("audioBuffer"))h->AudioBuffer = Utils::StringFromStdString(a["audioBuffer"].get<std::string>());
+					if (a.contains("latencyBudget"))h->LatencyBudget = Utils::StringFromStdString(a["latencyBudget"].get<std::string>());
+					if (a.contains("renderMissTarget"))h->RenderMissTarget = Utils::StringFromStdString(a["renderMissTarget"].get<std::string>());
+					if (a.contains("videoDecoder"))h->VideoDecoder = Utils::StringFromStdString(a["videoDecoder"].get<std::string>());
+					if (a.contains("decodePipeline"))h->DecodePipeline = Utils::StringFromStdString(a["decodePipeline"].get<std::string>());
+					if (a.contains("chromaSampling"))h->ChromaSampling = Utils::StringFromStdString(a["chromaSampling"].get<std::string>());
+					if (a.contains("replayBuffer"))h->ReplayBuffer = Utils::StringFromStdString(a["replayBuffer"].get<std::string>());
+					if (a.contains("recordingFormat"))h->RecordingFormat = Utils::StringFromStdString(a["recordingFormat"].get<std::string>());
+					if (a.contains("upscaler"))h->Upscaler = Utils::StringFromStdString(a["upscaler"].get<std::string>());
 					if (a.contains("autoStartID"))h->AutostartID = a["autoStartID"];
 					if (a.contains("computername")) h->ComputerName = Utils::StringFromStdString(a["computername"].get<std::string>());
 					if (a.contains("playaudioonpc")) h->PlayAudioOnPC = a["playaudioonpc"].get<bool>();
@@ -104,6 +112,14 @@ Concurrency::task<void> moonlight_xbox_dx::ApplicationState::UpdateFile()
 			hostJson["videoCodec"] = Utils::PlatformStringToStdString(host->VideoCodec);
 			hostJson["framePacing"] = Utils::PlatformStringToStdString(host->FramePacing);
 			hostJson["audioBuffer"] = Utils::PlatformStringToStdString(host->AudioBuffer);
+			hostJson["latencyBudget"] = Utils::PlatformStringToStdString(host->LatencyBudget);
+			hostJson["renderMissTarget"] = Utils::PlatformStringToStdString(host->RenderMissTarget);
+			hostJson["videoDecoder"] = Utils::PlatformStringToStdString(host->VideoDecoder);
+			hostJson["decodePipeline"] = Utils::PlatformStringToStdString(host->DecodePipeline);
+			hostJson["chromaSampling"] = Utils::PlatformStringToStdString(host->ChromaSampling);
+			hostJson["replayBuffer"] = Utils::PlatformStringToStdString(host->ReplayBuffer);
+			hostJson["recordingFormat"] = Utils::PlatformStringToStdString(host->RecordingFormat);
+			hostJson["upscaler"] = Utils::PlatformStringToStdString(host->Upscaler);
 			hostJson["autoStartID"] = host->AutostartID;
 			hostJson["playaudioonpc"] = host->PlayAudioOnPC;
 			hostJson["enable_hdr"] = host->EnableHDR;
@@ -8,6 +8,7 @@ extern "C" {
 }
 #include <State\StreamConfiguration.h>
 #include <Streaming\AudioPlayer.h>
+#include <Streaming\StreamRecorder.h>
 #include <Utils.hpp>
 #include <atomic>
 #include <cmath>
@@ -262,13 +263,44 @@ int MoonlightClient::StartStreaming(std::shared_ptr<DX::DeviceResources> res, St
 	config.colorSpace = COLORSPACE_REC_601;
 	config.encryptionFlags = ENCFLG_AUDIO;
 	config.packetSize = 1024;
+	// 4:4:4 keeps full chroma resolution (sharp text and UI). The consoles can only decode it on the CPU, which
+	// FFMpegDecoder::Init switches to once the host actually picks a 4:4:4 format. A host that can't encode it
+	// falls back to 4:2:0 and keeps hardware decoding.
+	const bool wantYUV444 = sConfig->chromaSampling == "4:4:4";
+	const bool softwareDecode = sConfig->videoDecoder == "Software";
+
+	// The host picks the best codec we offer, so offer everything up to the selected one. H.264 is always the fallback.
+	// There's no software AV1 decoder in our FFmpeg build.
+	const bool wantAV1 = sConfig->videoCodec == "AV1" && !softwareDecode;
+	const bool wantHEVC = wantAV1 || sConfig->videoCodec != "H.264";
 	config.supportedVideoFormats = VIDEO_FORMAT_H264;
-	if (!IsXboxOneVCR()) {
+	if (!IsXboxOneVCR() && wantHEVC) {
 		config.supportedVideoFormats |= VIDEO_FORMAT_H265;
 		if (sConfig->enableHDR) {
 			config.supportedVideoFormats |= VIDEO_FORMAT_H265_MAIN10;
 		}
 	}
+	if (wantYUV444) {
+		// Offered next to the 4:2:0 formats, the host falls back to those if its encoder can't do 4:4:4
+		config.supportedVideoFormats |= VIDEO_FORMAT_H264_HIGH8_444;
+		if (!IsXboxOneVCR() && wantHEVC) {
+			config.supportedVideoFormats |= VIDEO_FORMAT_H265_REXT8_444;
+			if (sConfig->enableHDR) {
+				config.supportedVideoFormats |= VIDEO_FORMAT_H265_REXT10_444;
+			}
+		}
+	}
+	if (wantAV1) {
+		if (FFMpegDecoder::IsAV1DecodeSupported(res->GetD3DDevice(), false)) {
+			config.supportedVideoFormats |= VIDEO_FORMAT_AV1_MAIN8;
+			if (sConfig->enableHDR && FFMpegDecoder::IsAV1DecodeSupported(res->GetD3DDevice(), true)) {
+				config.supportedVideoFormats |= VIDEO_FORMAT_AV1_MAIN10;
+			}
+		} else {
+			Utils::Log("AV1 selected but this console has no AV1 hardware decoder, falling back to HEVC\n");
+		}
+	}
+	Utils::Logf("Offering video formats 0x%x\n", config.supportedVideoFormats);
 
 	config.audioConfiguration = AUDIO_CONFIGURATION_STEREO;
 	if (sConfig->audioConfig == "Surround 5.1") {
@@ -315,9 +347,40 @@ int MoonlightClient::StartStreaming(std::shared_ptr<DX::DeviceResources> res, St
 	callbacks.rumble = connection_rumble;
 	callbacks.rumbleTriggers = connection_trigger_rumble;
 
-	FFMpegDecoder::instance().CompleteInitialization(res, &config, sConfig->framePacing == "Immediate");
+	PacingMode pacingMode = PacingMode::DisplayLocked;
+	if (sConfig->framePacing == "Immediate") {
+		pacingMode = PacingMode::Immediate;
+	} else if (sConfig->framePacing == "Latency budget") {
+		pacingMode = PacingMode::LatencyBudget;
+	}
+
+	double latencyBudgetMs = 8.0;
+	if (sConfig->latencyBudget != nullptr && !sConfig->latencyBudget->IsEmpty()) {
+		try {
+			latencyBudgetMs = std::stoi(sConfig->latencyBudget->Data()); // convert from "8 ms"
+		}
+		catch (const std::exception &) {
+			Utils::Log("Invalid latency budget setting, keeping the default\n");
+		}
+	}
+
+	FFMpegDecoder::instance().CompleteInitialization(res, &config, pacingMode, latencyBudgetMs);
+	FFMpegDecoder::instance().SetPreferredBackend(softwareDecode ? DecoderBackend::Software : DecoderBackend::D3D11VA);
+	FFMpegDecoder::instance().SetSlicesForSoftwareFallback(wantYUV444);
+	FFMpegDecoder::instance().SetPipelined(sConfig->decodePipeline == "Pipelined");
 	DECODER_RENDERER_CALLBACKS rCallbacks = FFMpegDecoder::getDecoder();
 
+	int replaySeconds = 0;
+	if (sConfig->replayBuffer != nullptr && !sConfig->replayBuffer->IsEmpty() && sConfig->replayBuffer != "Off") {
+		try {
+			replaySeconds = std::stoi(sConfig->replayBuffer->Data()); // convert from "30 s"
+		}
+		catch (const std::exception &) {
+			Utils::Log("Invalid replay buffer setting, keeping it off\n");
+		}
+	}
+	StreamRecorder::instance().configure(sConfig->recordingFormat == "MP4" ? RecordingContainer::MP4 : RecordingContainer::MKV, replaySeconds);
+
 	AUDIO_RENDERER_CALLBACKS aCallbacks = AudioPlayer::getDecoder();
 
 	int k = LiStartConnection(&serverData.serverInfo, &config, &callbacks, &rCallbacks, &aCallbacks, NULL, 0, NULL, 0);
@@ -341,6 +404,7 @@ int MoonlightClient::StartStreaming(std::shared_ptr<DX::DeviceResources> res, St
 
 void MoonlightClient::StopStreaming() {
 	LiStopConnection();
+	StreamRecorder::instance().shutdown();
 }
 
 void log_message(const char *fmt, ...) {
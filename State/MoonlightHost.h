@@ -28,6 +28,14 @@ namespace moonlight_xbox_dx {
         Platform::String^ audioConfig = "Stereo";
         Platform::String^ framePacing = "";
         Platform::String^ audioBuffer = "30 ms";
+        Platform::String^ latencyBudget = "8 ms";
+        Platform::String^ renderMissTarget = "1%";
+        Platform::String^ videoDecoder = "Hardware";
+        Platform::String^ decodePipeline = "Direct";
+        Platform::String^ chromaSampling = "4:2:0";
+        Platform::String^ replayBuffer = "Off";
+        Platform::String^ recordingFormat = "MKV";
+        Platform::String^ upscaler = "Bilinear";
         bool enableHDR = false;
         bool enableSOPS = false;
         bool enableStats = false;
@@ -241,6 +249,86 @@ namespace moonlight_xbox_dx {
             }
         }
 
+        property Platform::String^ LatencyBudget
+        {
+            Platform::String^ get() { return this->latencyBudget; }
+            void set(Platform::String^ value) {
+                if (latencyBudget == value) return;
+                this->latencyBudget = value;
+                OnPropertyChanged("LatencyBudget");
+            }
+        }
+
+        property Platform::String^ RenderMissTarget
+        {
+            Platform::String^ get() { return this->renderMissTarget; }
+            void set(Platform::String^ value) {
+                if (renderMissTarget == value) return;
+                this->renderMissTarget = value;
+                OnPropertyChanged("RenderMissTarget");
+            }
+        }
+
+        property Platform::String^ VideoDecoder
+        {
+            Platform::String^ get() { return this->videoDecoder; }
+            void set(Platform::String^ value) {
+                if (videoDecoder == value) return;
+                this->videoDecoder = value;
+                OnPropertyChanged("VideoDecoder");
+            }
+        }
+
+        property Platform::String^ DecodePipeline
+        {
+            Platform::String^ get() { return this->decodePipeline; }
+            void set(Platform::String^ value) {
+                if (decodePipeline == value) return;
+                this->decodePipeline = value;
+                OnPropertyChanged("DecodePipeline");
+            }
+        }
+
+        property Platform::String^ ChromaSampling
+        {
+            Platform::String^ get() { return this->chromaSampling; }
+            void set(Platform::String^ value) {
+                if (chromaSampling == value) return;
+                this->chromaSampling = value;
+                OnPropertyChanged("ChromaSampling");
+            }
+        }
+
+        property Platform::String^ ReplayBuffer
+        {
+            Platform::String^ get() { return this->replayBuffer; }
+            void set(Platform::String^ value) {
+                if (replayBuffer == value) return;
+                this->replayBuffer = value;
+                OnPropertyChanged("ReplayBuffer");
+            }
+        }
+
+        property Platform::String^ RecordingFormat
+        {
+            Platform::String^ get() { return this->recordingFormat; }
+            void set(Platform::String^ value) {
+                if (recordingFormat == value) return;
+                this->recordingFormat = value;
+                OnPropertyChanged("RecordingFormat");
+            }
+        }
+
+        property Platform::String^ Upscaler
+        {
+            Platform::String^ get() { return this->upscaler; }
+            void set(Platform::String^ value) {
+                if (upscaler == value) return;
+                this->upscaler = value;
+                OnPropertyChanged("Upscaler");
+            }
+        }
+
         property Windows::Foundation::Collections::IVector<MoonlightApp^>^ Apps {
             Windows::Foundation::Collections::IVector<MoonlightApp^>^ get() {
                 if (this->apps == nullptr)
@@ -2,6 +2,7 @@
 #include "Stats.h"
 #include "Utils.hpp"
 #include "../Plot/ImGuiPlots.h"
+#include "../Streaming/DecodeErrorPolicy.h"
 #include "../Streaming/FFMpegDecoder.h"
 
 using namespace moonlight_xbox_dx;
@@ -15,10 +16,32 @@ Stats& Stats::instance()
 Stats::Stats() :
 	m_bwTracker(10, 250),
 	m_avgQueueSize(0.0),
+	m_queueDepth(0),
+	m_queueJitterMs(0.0),
+	m_queueLatencyCostMs(0.0),
+	m_renderBudgetMs(0.0),
+	m_renderQuantileMs(0.0),
+	m_wakeQuantileMs(0.0),
+	m_rfiRecoveries(0),
+	m_idrRecoveries(0),
+	m_totalRfiRecoveryMs(0.0),
+	m_totalIdrRecoveryMs(0.0),
+	m_errorsTolerated(0),
+	m_errorsDeferred(0),
+	m_errorIdrRequests(0),
+	m_errorFlushes(0),
+	m_errorReinits(0),
+	m_surfacePoolSize(0),
+	m_surfacePoolMb(0.0),
+	m_surfacesHeld(0),
+	m_surfacesHeldPeak(0),
+	m_surfaceStalls(0),
+	m_totalSurfaceStallMs(0.0),
 	m_avgMbpsSmoothed(0.0),
 	m_minGpuTimeMs(0.0f),
 	m_maxGpuTimeMs(0.0f),
 	m_avgGpuTimeMs(0.0f),
+	m_clearedFractionSmoothed(0.0f),
 	m_audioGlitchCount(0)
 {
 	Reset();
@@ -29,10 +52,32 @@ void Stats::Reset()
 	std::lock_guard<std::mutex> lock(m_mutex);
 	m_bwTracker.Reset();
 	m_avgQueueSize = 1.0f;
+	m_queueDepth = 0;
+	m_queueJitterMs = 0.0;
+	m_queueLatencyCostMs = 0.0;
+	m_renderBudgetMs = 0.0;
+	m_renderQuantileMs = 0.0;
+	m_wakeQuantileMs = 0.0;
+	m_rfiRecoveries = 0;
+	m_idrRecoveries = 0;
+	m_totalRfiRecoveryMs = 0.0;
+	m_totalIdrRecoveryMs = 0.0;
+	m_errorsTolerated = 0;
+	m_errorsDeferred = 0;
+	m_errorIdrRequests = 0;
+	m_errorFlushes = 0;
+	m_errorReinits = 0;
+	m_surfacePoolSize = 0;
+	m_surfacePoolMb = 0.0;
+	m_surfacesHeld = 0;
+	m_surfacesHeldPeak = 0;
+	m_surfaceStalls = 0;
+	m_totalSurfaceStallMs = 0.0;
 	m_avgMbpsSmoothed = 0.0;
 	m_minGpuTimeMs = 0.0f;
 	m_maxGpuTimeMs = 0.0f;
 	m_avgGpuTimeMs = 0.0f;
+	m_clearedFractionSmoothed = 0.0f;
 	m_audioGlitchCount = 0;
 
 	ZeroMemory(&m_ActiveWndVideoStats, sizeof(VIDEO_STATS));
@@ -141,13 +186,40 @@ void Stats::ResetAudioGlitchCount() {
 	m_audioGlitchCount = 0;
 }
 
-// Time in milliseconds we spent decoding one frame, it is added up to later be divided by decodedFrames
-void Stats::SubmitDecodeMs(double decodeMs) {
+// Time in milliseconds we spent decoding one frame, it is added up to later be divided by decodedFrames.
+// handoffMs is how long the reassembled frame waited for the decoder, only more than ~0 when pipelined.
+void Stats::SubmitDecodeMs(double decodeMs, double handoffMs) {
 	std::lock_guard<std::mutex> lock(m_mutex);
 	m_ActiveWndVideoStats.totalDecodeTime += decodeMs;
+	m_ActiveWndVideoStats.totalHandoffTimeUs += (uint64_t)(handoffMs * 1000.0);
 	m_ActiveWndVideoStats.decodedFrames++;
 }
 
+// How each decode unit was handed to FFmpeg: bytes we copied, packet buffers allocated for it,
+// and frames/MLFrameData the FramePool had to allocate for its output
+void Stats::SubmitDecodeInput(uint32_t bytesCopied, uint32_t bufferAllocs, uint32_t frameAllocs, bool zeroCopy) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_ActiveWndVideoStats.totalInputBytesCopied += bytesCopied;
+	m_ActiveWndVideoStats.inputBufferAllocs += bufferAllocs;
+	m_ActiveWndVideoStats.frameAllocs += frameAllocs;
+	m_ActiveWndVideoStats.zeroCopyInputFrames += zeroCopy ? 1 : 0;
+	m_ActiveWndVideoStats.inputFrames++;
+}
+
+// StreamRecorder: time the decoder and audio threads spent handing it a unit, and units its queue refused
+void Stats::SubmitRecorderInput(double inputMs, bool dropped) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_ActiveWndVideoStats.totalRecorderInputUs += static_cast<uint64_t>(inputMs * 1000);
+	m_ActiveWndVideoStats.recorderDroppedUnits += dropped ? 1 : 0;
+}
+
+// StreamRecorder: bytes its writer thread muxed and the time it was busy doing so
+void Stats::SubmitRecorderOutput(uint64_t bytes, double writerMs) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_ActiveWndVideoStats.recorderBytes += bytes;
+	m_ActiveWndVideoStats.totalRecorderWriterUs += static_cast<uint64_t>(writerMs * 1000);
+}
+
 void Stats::SubmitDroppedFrame(int count) {
 	std::lock_guard<std::mutex> lock(m_mutex);
 	m_ActiveWndVideoStats.pacerDroppedFrames += count;
@@ -158,6 +230,14 @@ void Stats::SubmitAvgQueueSize(float avgQueueSize) {
 	m_avgQueueSize = avgQueueSize;
 }
 
+// Queue depth chosen by Pacer's QueueDepthController, the jitter it is based on, and the latency it adds
+void Stats::SubmitQueueDepth(int depth, double jitterMs, double latencyCostMs) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_queueDepth = depth;
+	m_queueJitterMs = jitterMs;
+	m_queueLatencyCostMs = latencyCostMs;
+}
+
 // Time in microseconds we spent in the frame pacer, and time for rendering the frame.
 // Also increments the rendered frame count.
 void Stats::SubmitPacerTime(int64_t pacerTimeQpc) {
@@ -189,11 +269,88 @@ void Stats::SubmitRenderStats(double preWaitTimeMs, double renderTimeMs, double
 	m_ActiveWndVideoStats.totalPresentTimeUs += static_cast<uint64_t>(presentTimeMs * 1000);
 }
 
-void Stats::SubmitGpuTime(float minGpuTimeMs, float maxGpuTimeMs, float avgGpuTimeMs) {
+// Render loop prewait budget from RenderCostPredictor
+void Stats::SubmitRenderBudget(double budgetMs, double renderQuantileMs, double wakeQuantileMs) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_renderBudgetMs = budgetMs;
+	m_renderQuantileMs = renderQuantileMs;
+	m_wakeQuantileMs = wakeQuantileMs;
+}
+
+// Latency budget pacing mode, called for every presented frame with its estimated decode-to-photon latency
+void Stats::SubmitLatencyBudget(bool hitBudget, double latencyMs) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (hitBudget) {
+		m_ActiveWndVideoStats.latencyBudgetHits++;
+	} else {
+		m_ActiveWndVideoStats.latencyBudgetMisses++;
+	}
+	m_ActiveWndVideoStats.totalBudgetLatencyUs += static_cast<uint64_t>(latencyMs * 1000);
+}
+
+// The decoder's reference chain was repaired after frame loss, by a P-frame after RFI or by a keyframe.
+// These are counted over the whole stream, recoveries are too rare for the 1-second windows.
+void Stats::SubmitRecovery(bool idr, double recoveryMs) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (idr) {
+		m_idrRecoveries++;
+		m_totalIdrRecoveryMs += recoveryMs;
+	} else {
+		m_rfiRecoveries++;
+		m_totalRfiRecoveryMs += recoveryMs;
+	}
+}
+
+// What DecodeErrorPolicy decided about a decode error, counted over the whole stream like recoveries
+void Stats::SubmitDecodeErrorAction(int action) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	switch (static_cast<DecodeErrorPolicy::Action>(action)) {
+	case DecodeErrorPolicy::Action::Continue:
+		m_errorsTolerated++;
+		break;
+	case DecodeErrorPolicy::Action::Defer:
+		m_errorsDeferred++;
+		break;
+	case DecodeErrorPolicy::Action::RequestIdr:
+		m_errorIdrRequests++;
+		break;
+	case DecodeErrorPolicy::Action::Flush:
+		m_errorFlushes++;
+		break;
+	case DecodeErrorPolicy::Action::Reinit:
+		m_errorReinits++;
+		break;
+	}
+}
+
+// D3D11VA surface pool, 0 surfaces when decoding in software
+void Stats::SubmitSurfacePool(int surfaces, double poolMb) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_surfacePoolSize = surfaces;
+	m_surfacePoolMb = poolMb;
+	m_surfacesHeldPeak = 0;
+}
+
+// Decoder surfaces held by decoded frames on their way through FrameQueue and Pacer
+void Stats::SubmitSurfacesHeld(int held) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_surfacesHeld = held;
+	m_surfacesHeldPeak = std::max(m_surfacesHeldPeak, held);
+}
+
+// Time the decoder waited for a free surface because the pool was exhausted
+void Stats::SubmitSurfaceStall(double stallMs) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_surfaceStalls++;
+	m_totalSurfaceStallMs += stallMs;
+}
+
+void Stats::SubmitGpuTime(float minGpuTimeMs, float maxGpuTimeMs, float avgGpuTimeMs, float clearedFraction) {
 	std::lock_guard<std::mutex> lock(m_mutex);
 	m_minGpuTimeMs = minGpuTimeMs;
 	m_maxGpuTimeMs = maxGpuTimeMs;
 	m_avgGpuTimeMs = avgGpuTimeMs;
+	m_clearedFractionSmoothed = 0.95f * m_clearedFractionSmoothed + 0.05f * clearedFraction;
 }
 
 /// private methods
@@ -207,7 +364,20 @@ void Stats::addVideoStats(DX::StepTimer const& timer, VIDEO_STATS& src, VIDEO_ST
 	dst.pacerDroppedFrames += src.pacerDroppedFrames;
 	dst.hitDeadlines += src.hitDeadlines;
 	dst.missedDeadlines += src.missedDeadlines;
+	dst.latencyBudgetHits += src.latencyBudgetHits;
+	dst.latencyBudgetMisses += src.latencyBudgetMisses;
+	dst.totalBudgetLatencyUs += src.totalBudgetLatencyUs;
+	dst.totalInputBytesCopied += src.totalInputBytesCopied;
+	dst.inputBufferAllocs += src.inputBufferAllocs;
+	dst.frameAllocs += src.frameAllocs;
+	dst.zeroCopyInputFrames += src.zeroCopyInputFrames;
+	dst.inputFrames += src.inputFrames;
+	dst.recorderBytes += src.recorderBytes;
+	dst.totalRecorderInputUs += src.totalRecorderInputUs;
+	dst.totalRecorderWriterUs += src.totalRecorderWriterUs;
+	dst.recorderDroppedUnits += src.recorderDroppedUnits;
 	dst.totalReassemblyTimeUs += src.totalReassemblyTimeUs;
+	dst.totalHandoffTimeUs += src.totalHandoffTimeUs;
 	dst.totalDecodeTime += src.totalDecodeTime;
 	dst.totalPacerTimeUs += src.totalPacerTimeUs;
 	dst.totalRenderTimeUs += src.totalRenderTimeUs;
@@ -331,11 +501,13 @@ void Stats::formatVideoStats(DX::StepTimer const& timer, VIDEO_STATS& stats, cha
 	if (stats.receivedFps > 0) {
 		ret = snprintf(&output[offset],
 						length - offset,
-						"Video stream: %dx%d %.2f FPS (%s)\n",
+						"Video stream: %dx%d %.2f FPS (%s%s%s)\n",
 						ffmpeg.width,
 						ffmpeg.height,
 						stats.totalFps,
-						codecString);
+						codecString,
+						ffmpeg.GetBackend() == DecoderBackend::Software ? ", software decode" : "",
+						ffmpeg.IsPipelined() ? ", pipelined" : "");
 		if (ret < 0 || (size_t)ret >= (length - offset)) {
 			Utils::Log("Error: stringifyVideoStats length overflow\n");
 			return;
@@ -346,19 +518,45 @@ void Stats::formatVideoStats(DX::StepTimer const& timer, VIDEO_STATS& stats, cha
 		double avgVideoMbps = m_bwTracker.GetAverageMbps();
 		double peakVideoMbps = m_bwTracker.GetPeakMbps();
 
+		// Display-locked mode also shows the cadence pattern it locked to, latency budget mode its hit rate
+		char pacingString[64];
+		const PacingMode pacingMode = Pacer::instance().getPacingMode();
+		const FrameCadence &cadence = Pacer::instance().getFrameCadence();
+		const uint32_t budgetFrames = stats.latencyBudgetHits + stats.latencyBudgetMisses;
+		int cadenceFrames = 0, cadenceVblanks = 0;
+		if (pacingMode == PacingMode::DisplayLocked && cadence.lockedPattern(cadenceFrames, cadenceVblanks)) {
+			snprintf(pacingString, sizeof(pacingString), "display-locked, cadence %s, %u breaks, %u drift adj.",
+			         cadence.patternName().c_str(), cadence.patternBreaks(), cadence.driftCorrections());
+		} else if (pacingMode == PacingMode::LatencyBudget && budgetFrames > 0) {
+			snprintf(pacingString, sizeof(pacingString), "%.0f ms budget, %.1f%% hit, avg %.1f ms",
+			         Pacer::instance().getLatencyBudgetMs(),
+			         (double)stats.latencyBudgetHits / budgetFrames * 100,
+			         (double)stats.totalBudgetLatencyUs / 1000.0 / budgetFrames);
+		} else {
+			snprintf(pacingString, sizeof(pacingString), "%s", Pacer::pacingModeName(pacingMode));
+		}
+
+		// Host clock error against ours, as estimated from frame timestamps
+		char hostClockString[32] = "";
+		const HostClockEstimator &hostClock = Pacer::instance().getHostClock();
+		if (hostClock.valid()) {
+			snprintf(hostClockString, sizeof(hostClockString), " (host clock %+.1f ppm)", hostClock.skewPpm());
+		}
+
 		ret = snprintf(&output[offset],
 					   length - offset,
 					   "Bitrate: %.1f Mbps, Peak (%us): %.1f\n"
-					   "Incoming frame rate from network: %.2f FPS\n"
+					   "Incoming frame rate from network: %.2f FPS%s\n"
 					   "Decoding frame rate: %.2f FPS\n"
 					   "Rendering frame rate: %.2f FPS (%s)\n",
 					   avgVideoMbps,
 					   m_bwTracker.GetWindowSeconds(),
 					   peakVideoMbps,
 					   stats.receivedFps,
+					   hostClockString,
 					   stats.decodedFps,
 					   stats.renderedFps,
-					   Pacer::instance().getPacingImmediate() ? "immediate" : "display-locked");
+					   pacingString);
 		if (ret < 0 || (size_t)ret >= (length - offset)) {
 			Utils::Log("Error: stringifyVideoStats length overflow\n");
 			return;
@@ -408,17 +606,29 @@ void Stats::formatVideoStats(DX::StepTimer const& timer, VIDEO_STATS& stats, cha
 					   length - offset,
 					   "Frames dropped by your network connection: %.2f%%\n"
 					   "Frames dropped due to network jitter: %.2f%%\n"
+					   "Loss recovery by RFI/IDR: %u/%u (avg %.0f/%.0f ms)\n"
+					   "Decode errors: %u tolerated, %u IDR (%u deferred), %u flush, %u reinit\n"
 					   "Average network latency: %s\n"
-					   "Average reassembly/decoding time: %.2f/%.2f ms\n"
+					   "Average reassembly/handoff/decoding time: %.2f/%.2f/%.2f ms\n"
 					   "Average frames in queue: %.1f, audio: %.2f ms\n"
+					   "Queue depth: %d (jitter %.1f ms, +%.1f ms latency)\n"
 					   "Average frame queue/render/present: %.2f/%.2f/%.2f ms\n",
 					   stats.totalFrames ? (double)stats.networkDroppedFrames / stats.totalFrames * 100 : 0.0f,
 					   stats.totalFrames ? (double)stats.pacerDroppedFrames / stats.totalFrames * 100 : 0.0f,
+					   m_rfiRecoveries,
+					   m_idrRecoveries,
+					   m_rfiRecoveries ? m_totalRfiRecoveryMs / m_rfiRecoveries : 0.0,
+					   m_idrRecoveries ? m_totalIdrRecoveryMs / m_idrRecoveries : 0.0,
+					   m_errorsTolerated, m_errorIdrRequests, m_errorsDeferred, m_errorFlushes, m_errorReinits,
 					   rttString,
 					   stats.decodedFrames ? (double)stats.totalReassemblyTimeUs / 1000.0 / stats.decodedFrames : 0.0f,
+					   stats.decodedFrames ? (double)stats.totalHandoffTimeUs / 1000.0 / stats.decodedFrames : 0.0f,
 					   stats.decodedFrames ? (double)stats.totalDecodeTime / stats.decodedFrames : 0.0f,
 					   m_avgQueueSize,
 					   ImGuiPlots::instance().getAvg(PLOT_AUDIO_BUFFER_MS),
+					   m_queueDepth,
+					   m_queueJitterMs,
+					   m_queueLatencyCostMs,
 					   stats.renderedFrames ? (double)stats.totalPacerTimeUs / 1000.0 / stats.renderedFrames : 0.0f,
 					   stats.renderedFrames ? (double)stats.totalRenderTimeUs / 1000.0 / stats.renderedFrames : 0.0f,
 					   stats.renderedFrames ? (double)stats.totalPresentTimeUs / 1000.0 / stats.renderedFrames : 0.0f);
@@ -434,16 +644,33 @@ void Stats::formatVideoStats(DX::StepTimer const& timer, VIDEO_STATS& stats, cha
 	// Developer-only stats that might be too confusing
 	// If you add lines here, add more height pixels in StatsRenderer::CreateWindowSizeDependentResources()
 	if (stats.renderedFrames != 0) {
+		const double windowSeconds = std::max(timer.GetTotalSeconds() - stats.measurementStartTimestamp, 1.0);
 		ret = snprintf(&output[offset],
 					   length - offset,
 					   "------\n"
 					   "Missed present rate: %.2f%%\n"
 					   "PreWait/Render: %.2f/%.2f ms\n"
-					   "GPU render cost min/max/avg: %.2f/%.2f/%.2f ms\n",
+					   "Render budget: %.2f ms (render %.2f + wake-up %.2f)\n"
+					   "Decode input: %.1f KB copied, %.2f allocs per frame, %.0f%% zero-copy\n"
+					   "Frame pool allocations: %u\n"
+					   "Decoder surfaces: %d (%.0f MB), held %d (peak %d), stalls %u (avg %.1f ms)\n"
+					   "Recorder: %.1f MB/s, input %.2f ms/s, writer %.1f ms/s, %u dropped\n"
+					   "GPU render cost min/max/avg: %.2f/%.2f/%.2f ms, clears %.1f%% of the screen\n",
 					   stats.hitDeadlines ? ((double)stats.missedDeadlines / (stats.missedDeadlines + stats.hitDeadlines)) * 100 : 0.0f,
 					   (double)stats.totalPreWaitTimeUs / 1000.0 / stats.renderedFrames,
 					   (double)stats.totalRenderTimeUs / 1000.0 / stats.renderedFrames,
-					   m_minGpuTimeMs, m_maxGpuTimeMs, m_avgGpuTimeMs);
+					   m_renderBudgetMs, m_renderQuantileMs, m_wakeQuantileMs,
+					   stats.inputFrames ? (double)stats.totalInputBytesCopied / 1024.0 / stats.inputFrames : 0.0,
+					   stats.inputFrames ? (double)stats.inputBufferAllocs / stats.inputFrames : 0.0,
+					   stats.inputFrames ? (double)stats.zeroCopyInputFrames / stats.inputFrames * 100 : 0.0,
+					   stats.frameAllocs,
+					   m_surfacePoolSize, m_surfacePoolMb, m_surfacesHeld, m_surfacesHeldPeak,
+					   m_surfaceStalls, m_surfaceStalls ? m_totalSurfaceStallMs / m_surfaceStalls : 0.0,
+					   stats.recorderBytes / (1024.0 * 1024.0) / windowSeconds,
+					   stats.totalRecorderInputUs / 1000.0 / windowSeconds,
+					   stats.totalRecorderWriterUs / 1000.0 / windowSeconds,
+					   stats.recorderDroppedUnits,
+					   m_minGpuTimeMs, m_maxGpuTimeMs, m_avgGpuTimeMs, m_clearedFractionSmoothed * 100.0f);
 		if (ret < 0 || (size_t)ret >= (length - offset)) {
 			Utils::Log("Error: stringifyVideoStats length overflow\n");
 			return;
@@ -28,11 +28,24 @@ typedef struct _VIDEO_STATS {
 	uint32_t pacerDroppedFrames;
 	uint32_t hitDeadlines;
 	uint32_t missedDeadlines;
+	uint32_t latencyBudgetHits;
+	uint32_t latencyBudgetMisses;
+	uint64_t totalBudgetLatencyUs;
+	uint64_t totalInputBytesCopied;
+	uint32_t inputBufferAllocs;
+	uint32_t frameAllocs;
+	uint32_t zeroCopyInputFrames;
+	uint32_t inputFrames;
+	uint64_t recorderBytes;
+	uint64_t totalRecorderInputUs;
+	uint64_t totalRecorderWriterUs;
+	uint32_t recorderDroppedUnits;
 	uint16_t minHostProcessingLatency;
 	uint16_t maxHostProcessingLatency;
 	uint32_t totalHostProcessingLatency;
 	uint32_t framesWithHostProcessingLatency;
 	uint32_t totalReassemblyTimeUs;
+	uint64_t totalHandoffTimeUs;
 	double totalDecodeTime;
 	uint64_t totalPacerTimeUs;
 	uint64_t totalPreWaitTimeUs;
@@ -61,13 +74,25 @@ namespace moonlight_xbox_dx
 
 		// submitters for various types of data
 		void SubmitVideoBytesAndReassemblyTime(uint32_t length, PDECODE_UNIT decodeUnit, uint32_t droppedFrames);
-		void SubmitDecodeMs(double decodeMs);
+		void SubmitDecodeMs(double decodeMs, double handoffMs);
+		void SubmitDecodeInput(uint32_t bytesCopied, uint32_t bufferAllocs, uint32_t frameAllocs, bool zeroCopy);
+		void SubmitRecorderInput(double inputMs, bool dropped);
+		void SubmitRecorderOutput(uint64_t bytes, double writerMs);
 		void SubmitDroppedFrame(int count);
 		void SubmitAvgQueueSize(float avgQueueSize);
+		void SubmitQueueDepth(int depth, double jitterMs, double latencyCostMs);
 		void SubmitPacerTime(int64_t pacerTimeQpc);
 		void SubmitPresentPacing(double presentDisplayMs);
 		void SubmitRenderStats(double preWaitTimeMs, double renderTimeMs, double presentTimeMs, bool hitDeadline);
-		void SubmitGpuTime(float minGpuTimeMs, float maxGpuTimeMs, float avgGpuTimeMs);
+		void SubmitLatencyBudget(bool hitBudget, double latencyMs);
+		void SubmitRenderBudget(double budgetMs, double renderQuantileMs, double wakeQuantileMs);
+		// clearedFraction: share of the back buffer cleared this frame
+		void SubmitGpuTime(float minGpuTimeMs, float maxGpuTimeMs, float avgGpuTimeMs, float clearedFraction);
+		void SubmitRecovery(bool idr, double recoveryMs);
+		void SubmitDecodeErrorAction(int action); // DecodeErrorPolicy::Action
+		void SubmitSurfacePool(int surfaces, double poolMb);
+		void SubmitSurfacesHeld(int held);
+		void SubmitSurfaceStall(double stallMs);
 		void SubmitAudioGlitch();
 		uint32_t GetAudioGlitchCount();
 		void ResetAudioGlitchCount();
@@ -88,10 +113,32 @@ namespace moonlight_xbox_dx
 		VIDEO_STATS                          m_GlobalVideoStats;
 		BandwidthTracker                     m_bwTracker;
 		float                                m_avgQueueSize;
+		int                                  m_queueDepth;
+		double                               m_queueJitterMs;
+		double                               m_queueLatencyCostMs;
+		double                               m_renderBudgetMs;
+		double                               m_renderQuantileMs;
+		double                               m_wakeQuantileMs;
+		uint32_t                             m_rfiRecoveries;
+		uint32_t                             m_idrRecoveries;
+		double                               m_totalRfiRecoveryMs;
+		double                               m_totalIdrRecoveryMs;
+		uint32_t                             m_errorsTolerated;
+		uint32_t                             m_errorsDeferred;
+		uint32_t                             m_errorIdrRequests;
+		uint32_t                             m_errorFlushes;
+		uint32_t                             m_errorReinits;
+		int                                  m_surfacePoolSize;
+		double                               m_surfacePoolMb;
+		int                                  m_surfacesHeld;
+		int                                  m_surfacesHeldPeak;
+		uint32_t                             m_surfaceStalls;
+		double                               m_totalSurfaceStallMs;
 		double                               m_avgMbpsSmoothed;
 		float                                m_minGpuTimeMs;
 		float                                m_maxGpuTimeMs;
 		float                                m_avgGpuTimeMs;
+		float                                m_clearedFractionSmoothed;
 		uint32_t                             m_audioGlitchCount;
 	};
 }
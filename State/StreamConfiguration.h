@@ -16,6 +16,14 @@ namespace moonlight_xbox_dx
 		property Platform::String^ videoCodec;
 		property Platform::String^ framePacing;
 		property Platform::String^ audioBuffer;
+		property Platform::String^ latencyBudget;
+		property Platform::String^ renderMissTarget;
+		property Platform::String^ videoDecoder;
+		property Platform::String^ decodePipeline;
+		property Platform::String^ chromaSampling;
+		property Platform::String^ replayBuffer;
+		property Platform::String^ recordingFormat;
+		property Platform::String^ upscaler;
 		property bool enableHDR;
 		property bool playAudioOnPC;
 		property bool enableVsync;
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+// Sleeping on an atomic until another thread changes it, for FrameQueue and FramePool. On Windows
+// this is WaitOnAddress/WakeByAddressAll. Tools/PacerSim and Tools/FrameQueueBench build both files
+// elsewhere too, there a wait is a short sleep. Waits can return early either way, callers re-check
+// their condition.
+
+constexpr unsigned long ATOMIC_WAIT_INFINITE = 0xFFFFFFFF; // INFINITE
+
+template <typename T>
+inline void atomicWait(std::atomic<T> &value, T seen, unsigned long timeoutMs) {
+#ifdef _WIN32
+	WaitOnAddress(&value, &seen, sizeof(seen), timeoutMs);
+#else
+	if (value.load(std::memory_order_acquire) == seen) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(std::min<unsigned long>(timeoutMs, 1)));
+	}
+#endif
+}
+
+template <typename T>
+inline void atomicWakeAll(std::atomic<T> &value) {
+#ifdef _WIN32
+	WakeByAddressAll(&value);
+#else
+	(void)value;
+#endif
+}
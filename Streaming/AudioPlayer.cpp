@@ -1,5 +1,6 @@
 #include "pch.h"
 #include <Streaming\AudioPlayer.h>
+#include <Streaming\StreamRecorder.h>
 #include <Utils.hpp>
 #include "..\Plot\ImGuiPlots.h"
 #include "State\Stats.h"
@@ -24,6 +25,8 @@ namespace moonlight_xbox_dx {
 
 	static OpusMSDecoder *s_opusDecoder = nullptr;
 	static int s_channelCount = 0;
+	static int s_sampleRate = 0;
+	static int s_samplesPerFrame = 0;
 
 	static int audioInitCallback(int audioConfiguration, const POPUS_MULTISTREAM_CONFIGURATION opusConfig, void *context, int arFlags) noexcept {
 		(void)audioConfiguration;
@@ -46,6 +49,10 @@ namespace moonlight_xbox_dx {
 			return rc;
 		}
 		s_channelCount = opusConfig->channelCount;
+		s_sampleRate = opusConfig->sampleRate;
+		s_samplesPerFrame = opusConfig->samplesPerFrame;
+		StreamRecorder::instance().setAudio(opusConfig->sampleRate, opusConfig->channelCount, opusConfig->streams,
+		                                    opusConfig->coupledStreams, opusConfig->mapping);
 
 		if (!AudioPlayer::instance().prepareForPlayback(opusConfig)) {
 			return -1;
@@ -70,6 +77,11 @@ namespace moonlight_xbox_dx {
 			Utils::Logf("AudioPlayer not initialized, can't decode\n");
 			return;
 		}
+
+		// Recorded as the host sent it, a null packet is a lost one
+		int samples = sampleData ? opus_packet_get_nb_samples((unsigned char *)sampleData, sampleLength, s_sampleRate) : s_samplesPerFrame;
+		StreamRecorder::instance().submitAudio((const uint8_t *)sampleData, sampleLength, samples > 0 ? samples : s_samplesPerFrame);
+
 		int desiredBufferSize = 0; // indicates we want the optimal size
 		float *buffer = (float *)AudioPlayer::instance().getAudioBuffer(&desiredBufferSize);
 		int maxFrames = desiredBufferSize / (s_channelCount * (int)sizeof(float));
@@ -0,0 +1,97 @@
+// clang-format off
+#include "pch.h"
+// clang-format on
+// Compile-time checks of the generated CSC table, a failing one breaks the build.
+#include "ColorConversion.h"
+
+namespace {
+
+constexpr double absd(double x) {
+	return x < 0.0 ? -x : x;
+}
+
+// The published full range coefficients of R = Y + crR * Cr, G = Y - cbG * Cb - crG * Cr, B = Y + cbB * Cb,
+// rounded to four decimals as in the tables VideoRenderer used to carry
+struct Published {
+	CscColorspace colorspace;
+	double crR, cbG, crG, cbB;
+};
+
+constexpr Published kPublished[] = {
+    {CscColorspace::Rec601, 1.4020, 0.3441, 0.7141, 1.7720},
+    {CscColorspace::Rec709, 1.5748, 0.1873, 0.4681, 1.8556},
+    {CscColorspace::Rec2020, 1.4746, 0.1646, 0.5714, 1.8814},
+};
+
+// 8-bit full range needs no scaling, so its matrix is the published one
+constexpr bool matchesPublished() {
+	for (const Published &p : kPublished) {
+		const CscConstants &c = kCscTable[ColorConversion::index(p.colorspace, true, 8)];
+		const double expected[12] = {
+		    1.0, 0.0, p.crR, 0.0,       // R
+		    1.0, -p.cbG, -p.crG, 0.0,   // G
+		    1.0, p.cbB, 0.0, 0.0,       // B
+		};
+		for (int i = 0; i < 12; i++) {
+			if (absd(c.matrix[i] - expected[i]) > 1e-4) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Black and white at the ends of the range come out exactly, up to float precision
+constexpr bool hitsRangeEnds() {
+	for (int i = 0; i < ColorConversion::kVariantCount; i++) {
+		const bool fullRange = ColorConversion::fullRangeOf(i);
+		const int bits = ColorConversion::bitsPerChannelOf(i);
+		const int shift = bits - 8;
+		const int black = fullRange ? 0 : 16 << shift;
+		const int white = fullRange ? (1 << bits) - 1 : 235 << shift;
+		const int mid = 1 << (bits - 1);
+		const CscRgb k = ColorConversion::convert(kCscTable[i], black, mid, mid, bits);
+		const CscRgb w = ColorConversion::convert(kCscTable[i], white, mid, mid, bits);
+		if (absd(k.r) > 1e-5 || absd(k.g) > 1e-5 || absd(k.b) > 1e-5 ||
+		    absd(w.r - 1.0) > 1e-5 || absd(w.g - 1.0) > 1e-5 || absd(w.b - 1.0) > 1e-5) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Colors encoded by the standard's definition decode back within two code values of the output depth.
+// Rounding to code values costs up to half of one in Y, Cb and Cr, which the matrix amplifies to at most
+// about 1.7 in B.
+constexpr double kReferenceColors[][3] = {
+    {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0},   // primaries
+    {0.0, 1.0, 1.0}, {1.0, 0.0, 1.0}, {1.0, 1.0, 0.0},   // secondaries
+    {0.75, 0.75, 0.75}, {0.75, 0.75, 0.0}, {0.0, 0.75, 0.75}, // 75% bars
+    {0.5, 0.25, 0.125}, {0.9, 0.6, 0.3}, {0.1, 0.2, 0.8},
+};
+
+constexpr bool roundTripsWithin(double maxCodeValues) {
+	for (int i = 0; i < ColorConversion::kVariantCount; i++) {
+		const CscColorspace colorspace = ColorConversion::colorspaceOf(i);
+		const bool fullRange = ColorConversion::fullRangeOf(i);
+		const int bits = ColorConversion::bitsPerChannelOf(i);
+		const double bound = maxCodeValues / ((1 << bits) - 1);
+		for (const auto &color : kReferenceColors) {
+			const ColorConversion::Yuv yuv = ColorConversion::encode(colorspace, fullRange, bits, color[0], color[1], color[2]);
+			const CscRgb rgb = ColorConversion::convert(kCscTable[i], yuv.y, yuv.u, yuv.v, bits);
+			if (absd(rgb.r - color[0]) > bound || absd(rgb.g - color[1]) > bound || absd(rgb.b - color[2]) > bound) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static_assert(sizeof(CscConstants) == 15 * sizeof(float), "CscConstants is copied into CSC_CONST_BUF");
+static_assert(ColorConversion::index(CscColorspace::Rec2020, true, 10) == ColorConversion::kVariantCount - 1,
+              "Variant index out of the table");
+static_assert(matchesPublished(), "CSC matrix differs from the published coefficients");
+static_assert(hitsRangeEnds(), "CSC table misses black or white");
+static_assert(roundTripsWithin(2.0), "CSC table exceeds the round trip error bound");
+
+} // namespace
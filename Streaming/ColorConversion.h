@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+
+enum class CscColorspace {
+	Rec601,
+	Rec709,
+	Rec2020,
+};
+
+// Constants of the YUV->RGB pixel shader for one colorspace, range and bit depth
+struct CscConstants {
+	// Column-major float3x3 with each column padded to a float4, the layout of CSC_CONST_BUF's cscMatrix.
+	// Column i holds the Y, U and V coefficients of output channel i.
+	float matrix[12];
+
+	// Subtracted from the normalized Y, U and V samples before the matrix
+	float offsets[3];
+};
+
+struct CscRgb {
+	double r, g, b;
+};
+
+// YUV->RGB conversion constants generated at compile time from each standard's Kr/Kb and the range
+// definitions, for every variant the renderer can meet. VideoRenderer uploads the whole table into one
+// constant buffer once and only picks the variant per frame.
+//
+// The shader normalizes a sample by the largest code value of its bit depth (P010 is read as a 10-bit
+// sample), subtracts the offsets and multiplies by the matrix, which is scaled to expand limited range.
+// convert() is the CPU reference of that, encode() the standard's forward definition. ColorConversion.cpp
+// checks the table against both at compile time.
+
+class ColorConversion {
+  public:
+	static constexpr int kColorspaceCount = 3;
+	static constexpr int kVariantCount = kColorspaceCount * 2 * 2; // full/limited range, 8/10 bit
+
+	static constexpr double kr(CscColorspace colorspace) {
+		return colorspace == CscColorspace::Rec709 ? 0.2126 : colorspace == CscColorspace::Rec2020 ? 0.2627 : 0.299;
+	}
+	static constexpr double kb(CscColorspace colorspace) {
+		return colorspace == CscColorspace::Rec709 ? 0.0722 : colorspace == CscColorspace::Rec2020 ? 0.0593 : 0.114;
+	}
+
+	// Variant for bitsPerChannel 8 or 10, anything above 8 counts as 10
+	static constexpr int index(CscColorspace colorspace, bool fullRange, int bitsPerChannel) {
+		return ((int)colorspace * 2 + (fullRange ? 1 : 0)) * 2 + (bitsPerChannel > 8 ? 1 : 0);
+	}
+	static constexpr CscColorspace colorspaceOf(int index) {
+		return (CscColorspace)(index / 4);
+	}
+	static constexpr bool fullRangeOf(int index) {
+		return (index / 2) % 2 != 0;
+	}
+	static constexpr int bitsPerChannelOf(int index) {
+		return index % 2 ? 10 : 8;
+	}
+
+	static constexpr CscConstants make(CscColorspace colorspace, bool fullRange, int bitsPerChannel) {
+		const double r = kr(colorspace);
+		const double b = kb(colorspace);
+		const double g = 1.0 - r - b;
+
+		// Full range matrix, rows are the Y, U and V inputs, columns the R, G and B outputs
+		const double m[3][3] = {
+		    {1.0, 1.0, 1.0},
+		    {0.0, -2.0 * b * (1.0 - b) / g, 2.0 * (1.0 - b)},
+		    {2.0 * (1.0 - r), -2.0 * r * (1.0 - r) / g, 0.0},
+		};
+
+		const double channelMax = (1 << bitsPerChannel) - 1;
+		const int shift = bitsPerChannel - 8;
+		const double yMin = fullRange ? 0.0 : (16 << shift);
+		const double yMax = fullRange ? channelMax : (235 << shift);
+		const double uvMin = fullRange ? 0.0 : (16 << shift);
+		const double uvMax = fullRange ? channelMax : (240 << shift);
+		const double scale[3] = {
+		    channelMax / (yMax - yMin),
+		    channelMax / (uvMax - uvMin),
+		    channelMax / (uvMax - uvMin),
+		};
+
+		CscConstants c = {};
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				c.matrix[i * 4 + j] = (float)(m[j][i] * scale[j]);
+			}
+		}
+		c.offsets[0] = (float)(yMin / channelMax);
+		c.offsets[1] = (float)((1 << (bitsPerChannel - 1)) / channelMax);
+		c.offsets[2] = c.offsets[1];
+		return c;
+	}
+
+	static constexpr std::array<CscConstants, kVariantCount> table() {
+		std::array<CscConstants, kVariantCount> t = {};
+		for (int i = 0; i < kVariantCount; i++) {
+			t[i] = make(colorspaceOf(i), fullRangeOf(i), bitsPerChannelOf(i));
+		}
+		return t;
+	}
+
+	// CPU reference of the shader, code values of a bitsPerChannel sample to RGB
+	static constexpr CscRgb convert(const CscConstants &c, int y, int u, int v, int bitsPerChannel) {
+		const double channelMax = (1 << bitsPerChannel) - 1;
+		const double yuv[3] = {y / channelMax - c.offsets[0], u / channelMax - c.offsets[1], v / channelMax - c.offsets[2]};
+		double rgb[3] = {};
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				rgb[i] += yuv[j] * c.matrix[i * 4 + j];
+			}
+		}
+		return {rgb[0], rgb[1], rgb[2]};
+	}
+
+	// Code values of an RGB color in 0-1, from the standard's definition of Y', Cb and Cr
+	struct Yuv {
+		int y, u, v;
+	};
+	static constexpr Yuv encode(CscColorspace colorspace, bool fullRange, int bitsPerChannel, double r, double g, double b) {
+		const double kR = kr(colorspace);
+		const double kB = kb(colorspace);
+		const double luma = kR * r + (1.0 - kR - kB) * g + kB * b;
+		const double pb = (b - luma) / (2.0 * (1.0 - kB));
+		const double pr = (r - luma) / (2.0 * (1.0 - kR));
+		if (fullRange) {
+			const double channelMax = (1 << bitsPerChannel) - 1;
+			const double mid = 1 << (bitsPerChannel - 1);
+			return {roundToInt(luma * channelMax), roundToInt(pb * channelMax + mid), roundToInt(pr * channelMax + mid)};
+		}
+		const double scale = 1 << (bitsPerChannel - 8);
+		return {roundToInt((219.0 * luma + 16.0) * scale), roundToInt((224.0 * pb + 128.0) * scale),
+		        roundToInt((224.0 * pr + 128.0) * scale)};
+	}
+
+  private:
+	static constexpr int roundToInt(double x) {
+		return (int)(x < 0.0 ? x - 0.5 : x + 0.5);
+	}
+};
+
+// Every variant, indexed by ColorConversion::index()
+inline constexpr std::array<CscConstants, ColorConversion::kVariantCount> kCscTable = ColorConversion::table();
@@ -0,0 +1,147 @@
+// Built without the precompiled header, see DecodeErrorPolicy.h
+#include "DecodeErrorPolicy.h"
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+
+extern "C" {
+#include <libavutil/error.h>
+}
+
+void DecodeErrorPolicy::reset(int64_t qpcFreq) {
+	m_qpcFreq = qpcFreq > 0 ? qpcFreq : 10000000;
+	std::fill(std::begin(m_concealedQpc), std::end(m_concealedQpc), 0);
+	m_concealedNext = 0;
+	m_concealedCount = 0;
+	m_lastRequestQpc = 0;
+	m_lastErrorQpc = 0;
+	m_requested = false;
+	m_deferred = false;
+	m_recovering = false;
+	m_awaitingKeyframe = false;
+	m_attemptFailed = false;
+	m_failedRecoveries = 0;
+}
+
+DecodeErrorPolicy::Error DecodeErrorPolicy::classify(int averror) {
+	if (averror == AVERROR(EAGAIN)) {
+		return Error::Transient;
+	}
+	// Damaged or incomplete data, or no buffer for this one frame
+	if (averror == AVERROR_INVALIDDATA || averror == AVERROR(EINVAL) || averror == AVERROR(ENOMEM)) {
+		return Error::Lost;
+	}
+	return Error::Fatal;
+}
+
+DecodeErrorPolicy::Action DecodeErrorPolicy::onError(Error error, bool referenceFrame, int64_t nowQpc) {
+	switch (error) {
+	case Error::Transient:
+		return Action::Continue;
+	case Error::Concealed: {
+		m_concealedQpc[m_concealedNext] = nowQpc;
+		m_concealedNext = (m_concealedNext + 1) % kConcealLimit;
+		m_concealedCount = std::min(m_concealedCount + 1, kConcealLimit);
+		// Oldest of the last kConcealLimit, this one included
+		if (m_concealedCount < kConcealLimit || msSince(m_concealedQpc[m_concealedNext], nowQpc) > kConcealWindowMs) {
+			return Action::Continue;
+		}
+		break;
+	}
+	case Error::Lost:
+		if (!referenceFrame) {
+			return Action::Continue;
+		}
+		break;
+	case Error::Fatal:
+		m_lastErrorQpc = nowQpc;
+		return startRecovery(Action::Reinit, nowQpc);
+	}
+
+	m_lastErrorQpc = nowQpc;
+	if (m_recovering && !m_awaitingKeyframe && !m_attemptFailed && msSince(m_lastRequestQpc, nowQpc) < kRecoveryWindowMs) {
+		// The last recovery didn't hold
+		m_attemptFailed = true;
+		m_failedRecoveries++;
+	}
+	return requestRecovery(nowQpc);
+}
+
+DecodeErrorPolicy::Action DecodeErrorPolicy::frameDecoded(bool idr, int64_t nowQpc) {
+	if (idr) {
+		m_awaitingKeyframe = false;
+	}
+	if (m_recovering && msSince(std::max(m_lastRequestQpc, m_lastErrorQpc), nowQpc) >= kRecoveryWindowMs) {
+		m_recovering = false;
+		m_failedRecoveries = 0;
+	}
+	if (!m_deferred) {
+		return Action::Continue;
+	}
+	if (idr) {
+		// The keyframe came anyway, e.g. the host's answer to moonlight-common-c's own request
+		m_deferred = false;
+		return Action::Continue;
+	}
+	if (msSince(m_lastRequestQpc, nowQpc) < kMinIdrIntervalMs) {
+		return Action::Continue;
+	}
+	return requestRecovery(nowQpc);
+}
+
+DecodeErrorPolicy::Action DecodeErrorPolicy::requestRecovery(int64_t nowQpc) {
+	if (m_requested && msSince(m_lastRequestQpc, nowQpc) < kMinIdrIntervalMs) {
+		m_deferred = true;
+		return Action::Defer;
+	}
+	if (m_failedRecoveries >= kReinitAfter) {
+		return startRecovery(Action::Reinit, nowQpc);
+	}
+	if (m_failedRecoveries >= kFlushAfter) {
+		return startRecovery(Action::Flush, nowQpc);
+	}
+	return startRecovery(Action::RequestIdr, nowQpc);
+}
+
+DecodeErrorPolicy::Action DecodeErrorPolicy::startRecovery(Action action, int64_t nowQpc) {
+	if (action == Action::Reinit) {
+		m_failedRecoveries = 0;
+	}
+	m_lastRequestQpc = nowQpc;
+	m_requested = true;
+	m_deferred = false;
+	m_recovering = true;
+	m_awaitingKeyframe = true;
+	m_attemptFailed = false;
+	return action;
+}
+
+const char *DecodeErrorPolicy::name(Error error) {
+	switch (error) {
+	case Error::Transient:
+		return "transient";
+	case Error::Concealed:
+		return "concealed";
+	case Error::Lost:
+		return "lost frame";
+	case Error::Fatal:
+		return "fatal";
+	}
+	return "?";
+}
+
+const char *DecodeErrorPolicy::name(Action action) {
+	switch (action) {
+	case Action::Continue:
+		return "tolerated";
+	case Action::Defer:
+		return "IDR deferred";
+	case Action::RequestIdr:
+		return "requesting IDR";
+	case Action::Flush:
+		return "flushing decoder";
+	case Action::Reinit:
+		return "reopening decoder";
+	}
+	return "?";
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+// Decides what the decoder does about a decode error, instead of requesting an IDR for every one.
+//
+// Errors are classified by what they cost the picture:
+// - Transient: send_packet wants the decoder's output drained first, nothing is lost
+// - Concealed: the frame decoded but FFmpeg concealed damaged blocks. Tolerated while isolated, the host's
+//   intra refresh heals the artifacts, a burst of them gets an IDR
+// - Lost: the frame produced no picture. Tolerated for non-reference frames since nothing predicts from
+//   them, anything else needs an IDR
+// - Fatal: the decoder itself failed, it is reopened
+//
+// Requests are rate limited, flushes and reopens included. One requested moments ago repairs later losses
+// as well, so a new request is deferred until kMinIdrIntervalMs have passed and frameDecoded() asks for it
+// then. A recovery fails when errors come back within kRecoveryWindowMs after its keyframe, errors before
+// the keyframe are the damage it is repairing. Each request fails at most once. Repeated failures escalate
+// to flushing the decoder and then to reopening it, a clean kRecoveryWindowMs starts over from plain IDR
+// requests. A fatal error reopens the decoder right away, there is nothing to wait for.
+//
+// Nothing here depends on Windows or FFmpeg's decoders, the file builds without the precompiled header
+// and is used by Tools/DecodeBench for fault injection. Times are plain ticks of qpcFreq per second.
+// Decoder thread only.
+
+class DecodeErrorPolicy {
+  public:
+	static constexpr int kConcealLimit = 3;          // concealed frames within kConcealWindowMs that need an IDR
+	static constexpr double kConcealWindowMs = 1000.0;
+	static constexpr double kMinIdrIntervalMs = 500.0;
+	static constexpr double kRecoveryWindowMs = 2000.0;
+	static constexpr int kFlushAfter = 2;            // failed recoveries before flushing
+	static constexpr int kReinitAfter = 4;           // failed recoveries before reopening the decoder
+
+	enum class Error {
+		Transient,
+		Concealed,
+		Lost,
+		Fatal,
+	};
+
+	enum class Action {
+		Continue,   // tolerated, keep decoding
+		Defer,      // needs an IDR, but one was just requested; keep decoding until it is due
+		RequestIdr, // return DR_NEED_IDR
+		Flush,      // flush the decoder, then DR_NEED_IDR
+		Reinit,     // reopen the decoder, then DR_NEED_IDR
+	};
+
+	void reset(int64_t qpcFreq);
+
+	// Class of an AVERROR code returned by avcodec_send_packet() or avcodec_receive_frame()
+	static Error classify(int averror);
+
+	// referenceFrame: later frames may predict from the failed one, pass true when unknown
+	Action onError(Error error, bool referenceFrame, int64_t nowQpc);
+
+	// A frame decoded without errors. Returns the deferred request once it is due, Continue otherwise.
+	Action frameDecoded(bool idr, int64_t nowQpc);
+
+	static const char *name(Error error);
+	static const char *name(Action action);
+
+  private:
+	Action requestRecovery(int64_t nowQpc);
+	Action startRecovery(Action action, int64_t nowQpc);
+	double msSince(int64_t qpc, int64_t nowQpc) const {
+		return static_cast<double>(nowQpc - qpc) * 1000.0 / static_cast<double>(m_qpcFreq);
+	}
+
+	int64_t m_qpcFreq = 10000000;
+	int64_t m_concealedQpc[kConcealLimit] = {}; // ring of the last concealed frames
+	int m_concealedNext = 0;
+	int m_concealedCount = 0;
+	int64_t m_lastRequestQpc = 0;  // last IDR, flush or reinit
+	bool m_requested = false;      // m_lastRequestQpc is set
+	int64_t m_lastErrorQpc = 0;    // last error that needed a recovery
+	bool m_deferred = false;       // a request is waiting for kMinIdrIntervalMs to pass
+	bool m_recovering = false;     // a recovery was requested and hasn't been clean for kRecoveryWindowMs yet
+	bool m_awaitingKeyframe = false; // no keyframe decoded since the last request
+	bool m_attemptFailed = false;  // the current recovery was already counted as failed
+	int m_failedRecoveries = 0;
+};
@@ -1,9 +1,16 @@
 #include "pch.h"
 #include "FFMpegDecoder.h"
+#include "FramePool.h"
+#include "FrameQueue.h"
+#include "FrameTrace.h"
 #include "../Plot/ImGuiPlots.h"
 #include "StatsRenderer.h"
+#include "StreamCapture.h"
+#include "StreamRecorder.h"
 
 #include <Common\DirectXHelper.h>
+#include <algorithm>
+#include <cmath>
 #include <d3d11_1.h>
 #include "Utils.hpp"
 #include "moonlight_xbox_dxMain.h"
@@ -22,23 +29,17 @@ using namespace moonlight_xbox_dx;
 
 #define INITIAL_DECODER_BUFFER_SIZE (256 * 1024)
 
-static bool ensure_buf_size(unsigned char **buf, int *buf_size, int required_size)
-{
-	if (*buf_size >= required_size)
-		return true;
-
-	FQLog("ensure_buf_size grew from %d -> %d\n", *buf_size, required_size);
+// Decoded frames outside FrameQueue that still hold a surface: Pacer's current and held frame, and the
+// one being enqueued while the queue is full
+#define SURFACES_OUTSIDE_QUEUE 3
 
-	*buf_size = required_size;
-	*buf = (unsigned char *)realloc(*buf, *buf_size);
-	if (!*buf) {
-		return false;
-	}
-
-	return true;
-}
+// Surfaces FFmpeg's D3D11VA decoder uses beyond the references and the picture being decoded, its default
+// pool has the same slack
+#define DECODER_SURFACE_MARGIN 2
 
 namespace moonlight_xbox_dx {
+	std::atomic<uint32_t> FFMpegDecoder::s_PacketBufferAllocs{0};
+
 	FFMpegDecoder &FFMpegDecoder::instance() {
 		static FFMpegDecoder inst;
 		return inst;
@@ -50,10 +51,22 @@ namespace moonlight_xbox_dx {
 		videoFormat(0),
 		decoder(nullptr),
 		decoder_ctx(nullptr),
+		m_PreferredBackend(DecoderBackend::D3D11VA),
+		m_Backend(DecoderBackend::D3D11VA),
+		m_Pipelined(false),
+		m_SlicesForFallback(false),
+		m_HwaccelRejected(false),
+		m_SurfacePoolSize(0),
+		m_DecoderSurfaces(0),
+		m_SurfacePoolFixed(false),
+		m_SurfaceResizePending(false),
 		device_ctx(nullptr),
 		d3d11va_device_ctx(nullptr),
-		ffmpeg_buffer(nullptr),
-		ffmpeg_buffer_size(0),
+		m_Packet(nullptr),
+		m_PacketPool(nullptr),
+		m_PacketPoolSize(0),
+		m_ZeroCopyPackets(true),
+		m_ZeroCopyReleased(true),
 		m_deviceResources(nullptr),
 		m_LastFrameNumber(0) {
 	}
@@ -85,51 +98,97 @@ namespace moonlight_xbox_dx {
 		Utils::Logf(shouldPrefixThisMessage ? "[ffmpeg] %s" : "%s", lineBuffer);
 	}
 
+	// Allocator for m_PacketPool, only called when the pool has no free buffer
+	static AVBufferRef *packet_buffer_alloc(size_t size) {
+		FFMpegDecoder::s_PacketBufferAllocs.fetch_add(1, std::memory_order_relaxed);
+		return av_buffer_alloc(size);
+	}
+
+	// Free callback for zero-copy packets, the decode unit memory itself belongs to moonlight-common-c
+	static void release_decode_unit_buffer(void *opaque, uint8_t *data) {
+		*static_cast<bool *>(opaque) = true;
+	}
+
 	// ffmpeg calls this to let us pick the output pixel format. We use it as the
 	// hook to allocate a D3D11VA frame pool with D3D11_BIND_SHADER_RESOURCE so the
 	// renderer can sample decoder surfaces directly (skipping a per-frame copy).
+	// FFmpeg calls it again without AV_PIX_FMT_D3D11 if the hwaccel refuses the stream's profile, that
+	// flags the decoder for a switch to software.
 	static enum AVPixelFormat ff_get_format(AVCodecContext *avctx, const enum AVPixelFormat *pix_fmts) {
+		auto *me = reinterpret_cast<FFMpegDecoder *>(avctx->opaque);
 		for (const enum AVPixelFormat *p = pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
 			if (*p == AV_PIX_FMT_D3D11) {
-				auto *me = reinterpret_cast<FFMpegDecoder *>(avctx->opaque);
 				if (me->setupDirectSampleFramesContext(avctx)) {
 					return AV_PIX_FMT_D3D11;
 				}
-				return AV_PIX_FMT_NONE;
+				break;
 			}
 		}
+		Utils::Logf("get_format: no usable D3D11 surfaces for %s profile %d\n", avcodec_get_name(avctx->codec_id), avctx->profile);
+		me->rejectHwaccel();
 		return AV_PIX_FMT_NONE;
 	}
 
+	static int ff_get_buffer2(AVCodecContext *avctx, AVFrame *frame, int flags) {
+		return reinterpret_cast<FFMpegDecoder *>(avctx->opaque)->getSurface(avctx, frame, flags);
+	}
+
 	// Allocate the hwaccel frame pool ourselves so we can add D3D11_BIND_SHADER_RESOURCE
 	// to its textures, which the renderer requires to sample decoder surfaces directly.
 	bool FFMpegDecoder::setupDirectSampleFramesContext(AVCodecContext *avctx) {
+		// FFmpeg's default pool assumes the largest DPB the codec allows and leaves nothing for the frames
+		// FrameQueue and Pacer hold. Size it for the references the SPS declares plus the queue instead.
+		const int refs = avctx->refs > 0 ? avctx->refs : avctx->codec_id == AV_CODEC_ID_AV1 ? 8 : 16;
+		m_DecoderSurfaces = refs + avctx->has_b_frames + 1 + DECODER_SURFACE_MARGIN;
+
 		AVBufferRef *frames_ref = nullptr;
-		int err = avcodec_get_hw_frames_parameters(avctx, avctx->hw_device_ctx, AV_PIX_FMT_D3D11, &frames_ref);
-		if (err < 0 || frames_ref == nullptr) {
-			Utils::Logf("Direct sampling: avcodec_get_hw_frames_parameters failed (%d)\n", err);
-			return false;
-		}
+		int err = AVERROR(EINVAL);
+		for (bool useDefault : {false, true}) {
+			err = avcodec_get_hw_frames_parameters(avctx, avctx->hw_device_ctx, AV_PIX_FMT_D3D11, &frames_ref);
+			if (err < 0 || frames_ref == nullptr) {
+				Utils::Logf("Direct sampling: avcodec_get_hw_frames_parameters failed (%d)\n", err);
+				return false;
+			}
 
-		auto *frames_ctx = reinterpret_cast<AVHWFramesContext *>(frames_ref->data);
-		auto *d3d11_frames = reinterpret_cast<AVD3D11VAFramesContext *>(frames_ctx->hwctx);
+			auto *frames_ctx = reinterpret_cast<AVHWFramesContext *>(frames_ref->data);
+			auto *d3d11_frames = reinterpret_cast<AVD3D11VAFramesContext *>(frames_ctx->hwctx);
+			const int defaultSize = frames_ctx->initial_pool_size;
+			if (!useDefault) {
+				frames_ctx->initial_pool_size = RequiredSurfaces();
+			}
 
-		// Default is D3D11_BIND_DECODER only. Add SHADER_RESOURCE so we can create SRVs
-		// over the decoder surfaces. This keeps the pool as a single array texture
-		// (decoding requires that), just with an extra bind flag.
-		d3d11_frames->BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+			// Default is D3D11_BIND_DECODER only. Add SHADER_RESOURCE so we can create SRVs
+			// over the decoder surfaces. This keeps the pool as a single array texture
+			// (decoding requires that), just with an extra bind flag.
+			d3d11_frames->BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+
+			err = av_hwframe_ctx_init(frames_ref);
+			if (err >= 0) {
+				m_SurfacePoolFixed = useDefault;
+				break;
+			}
 
-		err = av_hwframe_ctx_init(frames_ref);
-		if (err < 0) {
 			// Most likely the driver won't allow BIND_DECODER | BIND_SHADER_RESOURCE
-			// on the same texture.
+			// on the same texture, or an array of our size.
+			const int size = frames_ctx->initial_pool_size;
 			char e[256];
 			av_strerror(err, e, sizeof(e));
-			Utils::Logf("Direct sampling unavailable (av_hwframe_ctx_init: %s)\n", e);
+			Utils::Logf("Direct sampling unavailable with %d surfaces (av_hwframe_ctx_init: %s)\n", size, e);
 			av_buffer_unref(&frames_ref);
-			return false;
+			if (useDefault || size == defaultSize) {
+				return false;
+			}
 		}
 
+		auto *frames_ctx = reinterpret_cast<AVHWFramesContext *>(frames_ref->data);
+		m_SurfacePoolSize = frames_ctx->initial_pool_size;
+		// NV12 takes 1.5 bytes per pixel, P010 twice that
+		const double surfaceBytes = (double)frames_ctx->width * frames_ctx->height * (frames_ctx->sw_format == AV_PIX_FMT_P010 ? 3.0 : 1.5);
+		const double poolMb = surfaceBytes * m_SurfacePoolSize / (1024.0 * 1024.0);
+		Utils::Logf("Decoder surface pool: %d surfaces (%d for the decoder, queue depth %d), %.0f MB\n", m_SurfacePoolSize,
+		            m_DecoderSurfaces, FrameQueue::instance().highWaterMark(), poolMb);
+		Stats::instance().SubmitSurfacePool(m_SurfacePoolSize, poolMb);
+
 		// Release any pool from a previous get_format call (e.g. a mid-stream format
 		// change) before taking ownership of the new one, so we don't leak it.
 		if (avctx->hw_frames_ctx) {
@@ -139,10 +198,10 @@ namespace moonlight_xbox_dx {
 		return true;
 	}
 
-    void FFMpegDecoder::CompleteInitialization(const std::shared_ptr<DX::DeviceResources>& res, STREAM_CONFIGURATION *config, bool framePacingImmediate) {
+    void FFMpegDecoder::CompleteInitialization(const std::shared_ptr<DX::DeviceResources>& res, STREAM_CONFIGURATION *config, PacingMode pacingMode, double latencyBudgetMs) {
 		this->m_deviceResources = res;
 		this->fps = config->fps;
-		Pacer::instance().init(res, config->fps, res->GetRefreshRate(), framePacingImmediate);
+		Pacer::instance().init(res, config->fps, res->GetRefreshRate(), pacingMode, latencyBudgetMs);
 	}
 
 	int FFMpegDecoder::Init(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags) {
@@ -152,8 +211,18 @@ namespace moonlight_xbox_dx {
 		this->fps = 60; // correctly set in CompleteInitialization
 
 		this->m_LastFrameNumber = 0;
-		this->ffmpeg_buffer_size = 0;
 		this->m_StreamEpochQpc = 0;
+		this->m_ZeroCopyPackets = true;
+		this->m_HwaccelRejected = false;
+		this->m_SurfacePoolSize = 0;
+		this->m_SurfaceResizePending = false;
+		this->m_Recovery.reset(QpcFreq());
+		this->m_ErrorPolicy.reset(QpcFreq());
+		this->m_NalScanner.reset((videoFormat & VIDEO_FORMAT_MASK_H264)   ? NalScanner::Codec::H264
+		                         : (videoFormat & VIDEO_FORMAT_MASK_H265) ? NalScanner::Codec::HEVC
+		                                                                  : NalScanner::Codec::None);
+		StreamCapture::instance().setStream(videoFormat, width, height, redrawRate);
+		StreamRecorder::instance().setVideo(videoFormat, width, height, redrawRate);
 
 
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58,10,100)
@@ -173,20 +242,58 @@ namespace moonlight_xbox_dx {
 			decoder = avcodec_find_decoder(AV_CODEC_ID_HEVC);
 			Utils::Log("Using HEVC\n");
 		}
+		else if (videoFormat & VIDEO_FORMAT_MASK_AV1) {
+			// FFmpeg's native AV1 decoder, it only decodes through the D3D11VA hwaccel picked in ff_get_format
+			decoder = avcodec_find_decoder(AV_CODEC_ID_AV1);
+			Utils::Log("Using AV1\n");
+		}
 
 		if (decoder == NULL) {
 			Utils::Log("Couldn't find decoder\n");
 			return -1;
 		}
 
+		m_Packet = av_packet_alloc();
+		m_PacketPoolSize = INITIAL_DECODER_BUFFER_SIZE + AV_INPUT_BUFFER_PADDING_SIZE;
+		m_PacketPool = av_buffer_pool_init(m_PacketPoolSize, packet_buffer_alloc);
+		if (!m_Packet || !m_PacketPool) {
+			Utils::Log("Couldn't allocate decode unit packet\n");
+			Cleanup();
+			return -1;
+		}
+
+		// No D3D11VA profile decodes 4:4:4 on the consoles, and the renderer can't sample AYUV/Y410 surfaces
+		const bool yuv444 = (videoFormat & VIDEO_FORMAT_MASK_YUV444) != 0;
+		if (m_PreferredBackend == DecoderBackend::D3D11VA && !yuv444) {
+			int err = InitHardware();
+			if (err >= 0) {
+				m_Backend = DecoderBackend::D3D11VA;
+				return 0;
+			}
+			avcodec_free_context(&decoder_ctx);
+			Utils::Logf("D3D11VA decoding unavailable (%d), falling back to software\n", err);
+		}
+
+		int err = InitSoftware();
+		if (err < 0) {
+			Cleanup();
+			return err;
+		}
+		return 0;
+	}
+
+	int FFMpegDecoder::InitHardware() {
 		decoder_ctx = avcodec_alloc_context3(decoder);
 		if (decoder_ctx == NULL) {
 			Utils::Log("Couldn't allocate context\n");
-			return -1;
+			return AVERROR(ENOMEM);
 		}
 		decoder_ctx->opaque = this;
 
 		AVBufferRef* hw_device_ctx = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_D3D11VA);
+		if (hw_device_ctx == NULL) {
+			return AVERROR(ENOMEM);
+		}
 		device_ctx = reinterpret_cast<AVHWDeviceContext*>(hw_device_ctx->data);
 		d3d11va_device_ctx = reinterpret_cast<AVD3D11VADeviceContext*>(device_ctx->hwctx);
 		d3d11va_device_ctx->device = m_deviceResources->GetD3DDevice();
@@ -197,7 +304,7 @@ namespace moonlight_xbox_dx {
 		int err2;
 		if ((err2 = av_hwdevice_ctx_init(hw_device_ctx)) < 0) {
 			Utils::Logf("Failed to create specified DirectX Video device: %d\n", err2);
-			Cleanup();
+			av_buffer_unref(&hw_device_ctx);
 			return err2;
 		}
 
@@ -206,6 +313,7 @@ namespace moonlight_xbox_dx {
 		decoder_ctx->pix_fmt = AV_PIX_FMT_D3D11;
 		// get_format lets us allocate a frame pool we can sample directly (no per-frame copy)
 		decoder_ctx->get_format = ff_get_format;
+		decoder_ctx->get_buffer2 = ff_get_buffer2;
 		decoder_ctx->sw_pix_fmt = (videoFormat & VIDEO_FORMAT_MASK_10BIT) ? AV_PIX_FMT_P010 : AV_PIX_FMT_NV12;
 		decoder_ctx->pkt_timebase.num = 1;
 		decoder_ctx->pkt_timebase.den = 90000;
@@ -224,72 +332,397 @@ namespace moonlight_xbox_dx {
     		Utils::Log("Warning: decoder did not select AV_PIX_FMT_D3D11\n");
 		}
 
-		if (!ensure_buf_size(&ffmpeg_buffer, &ffmpeg_buffer_size, INITIAL_DECODER_BUFFER_SIZE + AV_INPUT_BUFFER_PADDING_SIZE)) {
-			Utils::Log("Couldn't allocate initial ffmpeg_buffer\n");
-			Cleanup();
-			return -1;
-		}
+		return 0;
+	}
 
+	int FFMpegDecoder::InitSoftware() {
+		int err = m_Software.open(decoder->id, width, height, (videoFormat & VIDEO_FORMAT_MASK_10BIT) != 0);
+		if (err < 0) {
+			Utils::Logf("Couldn't open the software decoder: %d\n", err);
+			return err;
+		}
+		m_Backend = DecoderBackend::Software;
+		m_SurfacePoolSize = 0;
+		Stats::instance().SubmitSurfacePool(0, 0.0);
+		Utils::Logf("Using software decoding, %d slice threads\n", m_Software.threadCount());
+
+		if (m_PreferredBackend != DecoderBackend::Software && !m_SlicesForFallback) {
+			// The host was not asked for slices, so the slice threads will mostly sit idle
+			Utils::Log("Warning: software decoding without multiple slices per frame, expect higher decode times\n");
+		}
 		return 0;
 	}
 
-	void FFMpegDecoder::Cleanup() {
+	bool FFMpegDecoder::FallBackToSoftware() {
+		if (m_Backend != DecoderBackend::D3D11VA || !m_HwaccelRejected) {
+			return false;
+		}
+
+		// Decoded frames still in flight keep their surfaces alive through their own references
+		Utils::Log("D3D11VA refused the stream, switching to software decoding\n");
+		avcodec_free_context(&decoder_ctx);
+		return InitSoftware() >= 0;
+	}
+
+	bool FFMpegDecoder::ReopenDecoder() {
+		if (m_Backend == DecoderBackend::Software) {
+			m_Software.close();
+			return InitSoftware() >= 0;
+		}
+
+		// Frames still queued keep the old pool alive until they are released
+		m_SurfacePoolSize = 0;
 		avcodec_free_context(&decoder_ctx);
-		if (ffmpeg_buffer != NULL) {
-			free(ffmpeg_buffer);
-			ffmpeg_buffer = NULL;
-			ffmpeg_buffer_size = 0;
+		int err = InitHardware();
+		if (err < 0) {
+			Utils::Logf("Couldn't reopen D3D11VA (%d), switching to software decoding\n", err);
+			avcodec_free_context(&decoder_ctx);
+			return InitSoftware() >= 0;
+		}
+		return true;
+	}
+
+	int FFMpegDecoder::getSurface(AVCodecContext *avctx, AVFrame *frame, int flags) {
+		int held = FramePool::instance().surfacesHeld();
+		int err = avcodec_default_get_buffer2(avctx, frame, flags);
+		if (err != AVERROR(ENOMEM) || !avctx->hw_frames_ctx || held == 0) {
+			return err;
+		}
+
+		// Every surface is referenced, mostly by queued frames. Give the renderer up to two frame intervals
+		// to release one, failing the frame would cost an IDR.
+		const int64_t start = QpcNow();
+		const int64_t deadline = start + MsToQpc(2000.0 / std::max(fps, 1));
+		int64_t now = start;
+		while (err == AVERROR(ENOMEM) && now < deadline) {
+			FramePool::instance().waitForSurface(held, static_cast<unsigned long>(std::ceil(QpcToMs(deadline - now))));
+			held = FramePool::instance().surfacesHeld();
+			err = avcodec_default_get_buffer2(avctx, frame, flags);
+			now = QpcNow();
+		}
+
+		const double stallMs = QpcToMs(now - start);
+		Stats::instance().SubmitSurfaceStall(stallMs);
+		if (err < 0) {
+			Utils::Logf("No decoder surface after %.1f ms, %d of %d held by queued frames\n", stallMs, held, m_SurfacePoolSize);
+		} else {
+			FQLog("Waited %.2f ms for a decoder surface\n", stallMs);
+		}
+		return err;
+	}
+
+	int FFMpegDecoder::RequiredSurfaces() const {
+		// One step of headroom, so the queue controller's usual single step up needs no new pool
+		FrameQueue &queue = FrameQueue::instance();
+		const int depth = std::min(queue.highWaterMark() + 1, queue.maxCapacity());
+		return m_DecoderSurfaces + depth + SURFACES_OUTSIDE_QUEUE;
+	}
+
+	bool FFMpegDecoder::ResizeSurfacePool(PDECODE_UNIT decodeUnit) {
+		if (m_SurfacePoolSize == 0 || m_SurfacePoolFixed) {
+			return true;
+		}
+
+		const int required = RequiredSurfaces();
+		if (required == m_SurfacePoolSize) {
+			m_SurfaceResizePending = false;
+			return true;
+		}
+
+		if (decodeUnit->frameType != FRAME_TYPE_IDR) {
+			if (required > m_SurfacePoolSize && !m_SurfaceResizePending) {
+				// getSurface() waits out the shortage until the keyframe arrives
+				Utils::Logf("Queue depth %d needs %d decoder surfaces, the pool has %d, requesting IDR\n",
+				            FrameQueue::instance().highWaterMark(), required, m_SurfacePoolSize);
+				m_SurfaceResizePending = true;
+				LiRequestIdrFrame();
+			}
+			// Surfaces a shallower queue doesn't need only cost memory, they go with the host's next IDR
+			return true;
+		}
+
+		// Nothing after an IDR references older pictures, so the decoder can restart on a new pool
+		Utils::Logf("Reopening D3D11VA for %d decoder surfaces (had %d)\n", required, m_SurfacePoolSize);
+		m_SurfaceResizePending = false;
+		return ReopenDecoder();
+	}
+
+	int FFMpegDecoder::SendPacket(const AVPacket *packet) {
+		if (m_Backend == DecoderBackend::Software) {
+			return m_Software.send(packet);
+		}
+		return decoder_ctx ? avcodec_send_packet(decoder_ctx, packet) : AVERROR(EINVAL);
+	}
+
+	int FFMpegDecoder::ReceiveFrame(AVFrame *frame) {
+		if (m_Backend == DecoderBackend::Software) {
+			return m_Software.receive(frame);
+		}
+		return decoder_ctx ? avcodec_receive_frame(decoder_ctx, frame) : AVERROR(EINVAL);
+	}
+
+	AVCodecContext *FFMpegDecoder::ActiveContext() const {
+		return m_Backend == DecoderBackend::Software ? m_Software.context() : decoder_ctx;
+	}
+
+	// Only for errors in our own decoder. moonlight-common-c has no way for the decoder to request an RFI, it
+	// flushes its queue and drops everything up to the next IDR.
+	int FFMpegDecoder::RequestIdr(PDECODE_UNIT decodeUnit) {
+		m_Recovery.invalidate(decodeUnit->frameNumber, decodeUnit->frameNumber);
+		return DR_NEED_IDR;
+	}
+
+	int FFMpegDecoder::HandleDecodeError(DecodeErrorPolicy::Error error, bool referenceFrame, PDECODE_UNIT decodeUnit) {
+		// No m_Recovery.invalidate() here, a tolerated loss isn't repaired by the host and isn't an RFI recovery
+		const DecodeErrorPolicy::Action action = m_ErrorPolicy.onError(error, referenceFrame, QpcNow());
+		if (action == DecodeErrorPolicy::Action::Continue) {
+			FQLog("Frame %d: %s error on a %sreference frame, tolerated\n", decodeUnit->frameNumber, DecodeErrorPolicy::name(error),
+			      referenceFrame ? "" : "non-");
+		} else {
+			Utils::Logf("Frame %d: %s error on a %sreference frame, %s\n", decodeUnit->frameNumber, DecodeErrorPolicy::name(error),
+			            referenceFrame ? "" : "non-", DecodeErrorPolicy::name(action));
+		}
+		return ApplyErrorAction(action, decodeUnit);
+	}
+
+	int FFMpegDecoder::ApplyErrorAction(DecodeErrorPolicy::Action action, PDECODE_UNIT decodeUnit) {
+		Stats::instance().SubmitDecodeErrorAction(static_cast<int>(action));
+		switch (action) {
+		case DecodeErrorPolicy::Action::Continue:
+		case DecodeErrorPolicy::Action::Defer:
+			return DR_OK;
+		case DecodeErrorPolicy::Action::RequestIdr:
+			break;
+		case DecodeErrorPolicy::Action::Flush:
+			// Drops the reference pictures and whatever the slice or frame threads still hold
+			if (AVCodecContext *ctx = ActiveContext()) {
+				avcodec_flush_buffers(ctx);
+			}
+			break;
+		case DecodeErrorPolicy::Action::Reinit:
+			if (!ReopenDecoder()) {
+				Utils::Log("Couldn't reopen the decoder after repeated errors\n");
+			}
+			break;
 		}
+		return RequestIdr(decodeUnit);
+	}
+
+	void FFMpegDecoder::Cleanup() {
+		avcodec_free_context(&decoder_ctx);
+		m_Software.close();
+		av_packet_free(&m_Packet);
+		StreamCapture::instance().stop();
+
+		// Buffers still referenced elsewhere stay valid, the pool is freed once they are returned
+		av_buffer_pool_uninit(&m_PacketPool);
+		m_PacketPoolSize = 0;
 		m_LastFrameNumber = 0;
 
 		Pacer::instance().deinit();
+		FramePool::instance().clear();
 
 		Utils::Log("FFMpegDecoder::Cleanup\n");
 	}
 
-    static inline int frame_attach_userdata(AVFrame *frame, int64_t decodeEndQpc) {
+    static inline int frame_attach_userdata(AVFrame *frame, int64_t decodeEndQpc, uint32_t traceId, const NalFrameInfo &nal) {
 	    if (!frame) return AVERROR(EINVAL);
 
 	    if (frame->opaque_ref) {
 		    av_buffer_unref(&frame->opaque_ref);
 	    }
 
-	    AVBufferRef *buf = av_buffer_allocz(sizeof(MLFrameData));
+	    AVBufferRef *buf = FramePool::instance().acquireFrameData();
 	    if (!buf) return AVERROR(ENOMEM);
 
 	    MLFrameData *data = (MLFrameData *)buf->data;
 	    data->decodeEndQpc = decodeEndQpc;
+	    data->traceId = traceId;
+	    data->frameClass = nal.frameClass;
+	    data->changedParamSets = nal.changedParamSets;
 	    frame->opaque_ref = buf;
 
 	    return 0;
     }
 
-    // Called by the VideoDec thread
-	int FFMpegDecoder::SubmitDecodeUnit(PDECODE_UNIT decodeUnit) {
-		LARGE_INTEGER decodeStart, decodeEnd;
+	// Sets up m_Packet with a refcounted buffer, so avcodec_send_packet() takes a reference instead of
+	// copying the data again. A single-entry bufferList with enough padding is wrapped as is, anything
+	// else is gathered into a buffer from m_PacketPool.
+	bool FFMpegDecoder::PreparePacket(PDECODE_UNIT decodeUnit, uint32_t &bytesCopied, bool &zeroCopy) {
 		PLENTRY entry = decodeUnit->bufferList;
+		bytesCopied = 0;
+		zeroCopy = false;
+
+		if (DECODE_UNIT_PADDING >= AV_INPUT_BUFFER_PADDING_SIZE && m_ZeroCopyPackets && entry != NULL && entry->next == NULL) {
+			m_ZeroCopyReleased = false;
+			m_Packet->buf = av_buffer_create(reinterpret_cast<uint8_t *>(entry->data), entry->length + AV_INPUT_BUFFER_PADDING_SIZE,
+			                                 release_decode_unit_buffer, &m_ZeroCopyReleased, AV_BUFFER_FLAG_READONLY);
+			if (m_Packet->buf) {
+				m_Packet->data = m_Packet->buf->data;
+				m_Packet->size = entry->length;
+				zeroCopy = true;
+				return true;
+			}
+			m_ZeroCopyReleased = true;
+		}
+
+		const int required = decodeUnit->fullLength + AV_INPUT_BUFFER_PADDING_SIZE;
+		if (required > m_PacketPoolSize) {
+			// Buffers in flight keep the old pool alive until they are returned
+			int size = std::max(required, m_PacketPoolSize + m_PacketPoolSize / 2);
+			FQLog("PreparePacket: packet pool grew from %d -> %d\n", m_PacketPoolSize, size);
+			av_buffer_pool_uninit(&m_PacketPool);
+			m_PacketPool = av_buffer_pool_init(size, packet_buffer_alloc);
+			m_PacketPoolSize = m_PacketPool ? size : 0;
+		}
+
+		m_Packet->buf = m_PacketPool ? av_buffer_pool_get(m_PacketPool) : NULL;
+		if (!m_Packet->buf) {
+			return false;
+		}
+
+		uint8_t *dst = m_Packet->buf->data;
 		int length = 0;
+		while (entry != NULL) {
+			memcpy(dst + length, entry->data, entry->length);
+			length += entry->length;
+			entry = entry->next;
+		}
+		memset(dst + length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+		m_Packet->data = dst;
+		m_Packet->size = length;
+		bytesCopied = length;
+		return true;
+	}
+
+	int FFMpegDecoder::DrainFrames(PDECODE_UNIT decodeUnit, const NalFrameInfo &nal, uint32_t traceId, int64_t decodeStartQpc,
+	                               int64_t &decodeEndQpc) {
+		const bool referenceFrame = nal.frameClass != NAL_FRAME_NON_REFERENCE;
+		for (;;) {
+			AVFrame* frame = FramePool::instance().acquireFrame();
+			int err = ReceiveFrame(frame);
+			if (err == AVERROR(EAGAIN) || err == AVERROR_EOF) {
+				FramePool::instance().release(&frame);
+				return DR_OK;
+			}
+			else if (err < 0) {
+				char ffmpegError[1024];
+				av_strerror(err, ffmpegError, sizeof(ffmpegError));
+				Utils::Logf("avcodec_receive_frame failed: %s\n", ffmpegError);
+				FramePool::instance().release(&frame);
+				if (FallBackToSoftware()) {
+					return RequestIdr(decodeUnit);
+				}
+				// Whatever else the decoder had is picked up with the next unit
+				return HandleDecodeError(DecodeErrorPolicy::classify(err), referenceFrame, decodeUnit);
+			}
+
+			// Capture a frame timestamp to measuring pacing delay
+			decodeEndQpc = QpcNow();
+
+			if (frame->format == AV_PIX_FMT_D3D11) {
+				Stats::instance().SubmitSurfacesHeld(FramePool::instance().surfaceReceived());
+			}
+
+			const bool concealed = (frame->flags & AV_FRAME_FLAG_CORRUPT) || frame->decode_error_flags;
+			if (concealed && m_Recovery.broken()) {
+				// The host didn't encode this frame against references we have, only a keyframe helps now
+				Utils::Logf("Frame %d after invalidated frames %u-%u is corrupt\n", decodeUnit->frameNumber,
+				            m_Recovery.invalidFirst(), m_Recovery.invalidLast());
+				FramePool::instance().release(&frame);
+				return HandleDecodeError(DecodeErrorPolicy::Error::Lost, true, decodeUnit);
+			}
+
+			const uint32_t invalidFirst = m_Recovery.invalidFirst(), invalidLast = m_Recovery.invalidLast();
+			double recoveryMs;
+			RecoveryTracker::Recovery recovery =
+				m_Recovery.frameDecoded(decodeUnit->frameNumber, decodeUnit->frameType == FRAME_TYPE_IDR, decodeEndQpc, recoveryMs);
+			if (recovery != RecoveryTracker::Recovery::None) {
+				Utils::Logf("Recovered from invalidated frames %u-%u with %s frame %d after %.1f ms\n", invalidFirst, invalidLast,
+				            recovery == RecoveryTracker::Recovery::IDR ? "IDR" : "P", decodeUnit->frameNumber, recoveryMs);
+				Stats::instance().SubmitRecovery(recovery == RecoveryTracker::Recovery::IDR, recoveryMs);
+			}
+			frame_attach_userdata(frame, decodeEndQpc, traceId, nal);
+			FrameTrace::instance().mark(traceId, TRACE_DECODE_END, decodeEndQpc);
+
+			FQLog("✓ Frame decoded [pts: %.3fms] [in#: %d] [out#: %d] [lost: %d] decode time %.3fms\n",
+				frame->pts / 90.0,
+				decodeUnit->frameNumber, ActiveContext()->frame_num,
+				decodeUnit->frameNumber - ActiveContext()->frame_num,
+				QpcToMs(decodeEndQpc - decodeStartQpc));
+
+			// Queue the frame for rendering. frame is now owned by Pacer.
+			Pacer::instance().submitFrame(frame);
+
+			// A concealed frame is still shown, its artifacts are usually gone before a keyframe would arrive
+			if (concealed) {
+				int result = HandleDecodeError(DecodeErrorPolicy::Error::Concealed, referenceFrame, decodeUnit);
+				if (result != DR_OK) {
+					return result;
+				}
+			} else {
+				// A keyframe the policy deferred may be due now
+				const DecodeErrorPolicy::Action action = m_ErrorPolicy.frameDecoded(decodeUnit->frameType == FRAME_TYPE_IDR, decodeEndQpc);
+				if (action != DecodeErrorPolicy::Action::Continue) {
+					Utils::Logf("Frame %d: deferred recovery due, %s\n", decodeUnit->frameNumber, DecodeErrorPolicy::name(action));
+					int result = ApplyErrorAction(action, decodeUnit);
+					if (result != DR_OK) {
+						return result;
+					}
+				}
+			}
+
+			// Even though we have a valid frame, the ffmpeg API needs us to loop and call avcodec_receive_frame()
+			// again where we expect to get AVERROR(EAGAIN) and break out.
+		}
+	}
+
+    // Called by the receive thread, or by moonlight-common-c's VideoDec thread when pipelined
+	int FFMpegDecoder::SubmitDecodeUnit(PDECODE_UNIT decodeUnit) {
+		LARGE_INTEGER decodeStart;
 		QueryPerformanceCounter(&decodeStart);
+		int64_t decodeEndQpc = decodeStart.QuadPart; // stays there if no frame came out
 
 		if (m_StreamEpochQpc == 0) m_StreamEpochQpc = decodeStart.QuadPart;
 
-		if (!ensure_buf_size(&ffmpeg_buffer, &ffmpeg_buffer_size, decodeUnit->fullLength + AV_INPUT_BUFFER_PADDING_SIZE)) {
-			Utils::Logf("Couldn't realloc ffmpeg_buffer\n");
-			return DR_NEED_IDR;
+		if (m_Backend == DecoderBackend::D3D11VA && !ResizeSurfacePool(decodeUnit)) {
+			return RequestIdr(decodeUnit);
 		}
 
-	    while (entry != NULL) {
-		    memcpy(ffmpeg_buffer + length, entry->data, entry->length);
-		    length += entry->length;
-		    entry = entry->next;
-	    }
-		memset(ffmpeg_buffer + length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+		const uint32_t packetAllocsBefore = s_PacketBufferAllocs.load(std::memory_order_relaxed);
+		const uint32_t frameAllocsBefore = FramePool::instance().allocations();
+		uint32_t bytesCopied = 0;
+		bool zeroCopy = false;
+		if (!PreparePacket(decodeUnit, bytesCopied, zeroCopy)) {
+			Utils::Logf("Couldn't allocate a packet buffer for %d bytes\n", decodeUnit->fullLength);
+			return HandleDecodeError(DecodeErrorPolicy::Error::Lost, true, decodeUnit);
+		}
+		const int length = m_Packet->size;
+
+		// Classify the frame and spot encoder reconfigurations from the NAL headers, before FFmpeg sees it
+		const NalFrameInfo nal = m_NalScanner.scan(m_Packet->data, static_cast<size_t>(length));
+		if (nal.changedParamSets) {
+			Utils::Logf("Frame %d carries new parameter sets:%s%s%s\n", decodeUnit->frameNumber,
+			            (nal.changedParamSets & NAL_CHANGED_VPS) ? " VPS" : "", (nal.changedParamSets & NAL_CHANGED_SPS) ? " SPS" : "",
+			            (nal.changedParamSets & NAL_CHANGED_PPS) ? " PPS" : "");
+			if (nal.changedParamSets & NAL_CHANGED_SPS) {
+				Utils::Logf("SPS profile %d level %d\n", nal.profile, nal.level);
+			}
+		}
+		if ((nal.frameClass == NAL_FRAME_IDR) != (decodeUnit->frameType == FRAME_TYPE_IDR) && nal.frameClass != NAL_FRAME_UNKNOWN) {
+			FQLog("Frame %d: host frame type %d, first slice NAL type %d\n", decodeUnit->frameNumber, decodeUnit->frameType,
+			      nal.firstSliceType);
+		}
 
 		// Detect breaks in the frame sequence indicating dropped packets
 		uint32_t droppedFramesNetwork = 0;
 		if (m_LastFrameNumber > 0 && decodeUnit->frameNumber > (m_LastFrameNumber + 1)) {
 			// Any frame number greater than m_LastFrameNumber + 1 represents a dropped frame
 			droppedFramesNetwork = decodeUnit->frameNumber - (m_LastFrameNumber + 1);
+
+			// moonlight-common-c already sent the host an RFI (or IDR) request for these
+			m_Recovery.invalidate(m_LastFrameNumber + 1, decodeUnit->frameNumber - 1);
 		}
 		m_LastFrameNumber = decodeUnit->frameNumber;
 
@@ -301,61 +734,68 @@ namespace moonlight_xbox_dx {
 			decodeUnit->presentationTimeUs = (uint64_t)(ptsMs * 1000.0);
 		}
 
+		StreamCapture::instance().submit(decodeUnit->frameNumber, decodeUnit->rtpTimestamp, decodeUnit->frameType,
+		                                 decodeUnit->receiveTimeUs, decodeUnit->enqueueTimeUs, m_Packet->data, length);
+		StreamRecorder::instance().submitVideo(m_Packet->data, length, decodeUnit->frameType == FRAME_TYPE_IDR, decodeUnit->rtpTimestamp);
+
 		// track stats for a variety of things we can track at the same time
 		Stats::instance().SubmitVideoBytesAndReassemblyTime(length, decodeUnit, droppedFramesNetwork);
 
-		// ffmpeg_decode
-		AVPacket *pkt = av_packet_alloc();
-		pkt->data = ffmpeg_buffer;
-		pkt->size = length;
-		pkt->pts = (int64_t)decodeUnit->rtpTimestamp;
-		pkt->dts = pkt->pts;
-
-		int err = avcodec_send_packet(decoder_ctx, pkt);
-		av_packet_unref(pkt);
-		av_packet_free(&pkt);
+		// moonlight-common-c timestamps come from QPC on Windows, only the unit differs
+		uint32_t traceId = FrameTrace::instance().beginFrame(
+			decodeUnit->frameNumber, decodeUnit->rtpTimestamp, static_cast<uint16_t>(decodeUnit->frameType),
+			UsToQpc(decodeUnit->receiveTimeUs), UsToQpc(decodeUnit->enqueueTimeUs), decodeStart.QuadPart);
+
+		// ffmpeg_decode, the packet holds a reference so FFmpeg doesn't copy it
+		m_Packet->pts = (int64_t)decodeUnit->rtpTimestamp;
+		m_Packet->dts = m_Packet->pts;
+
+		int err = SendPacket(m_Packet);
+		int result = DR_OK;
+		if (err == AVERROR(EAGAIN)) {
+			// The decoder wants its output drained before it takes more input
+			result = DrainFrames(decodeUnit, nal, traceId, decodeStart.QuadPart, decodeEndQpc);
+			if (result == DR_OK) {
+				err = SendPacket(m_Packet);
+			}
+		}
+		av_packet_unref(m_Packet);
+		if (result != DR_OK) {
+			return result;
+		}
 		if (err < 0) {
 			char ffmpegError[1024];
 			av_strerror(err, ffmpegError, 1024);
 			Utils::Logf("avcodec_send_packet failed: %s\n", ffmpegError);
-			return DR_NEED_IDR;
-		}
-
-		while (err >= 0) {
-			AVFrame* frame = av_frame_alloc();
-			err = avcodec_receive_frame(decoder_ctx, frame);
-			if (err == AVERROR(EAGAIN) || err == AVERROR_EOF) {
-				av_frame_free(&frame);
-				break;
+			if (FallBackToSoftware()) {
+				return RequestIdr(decodeUnit);
 			}
-			else if (err < 0) {
-				char ffmpegError[1024];
-				av_strerror(err, ffmpegError, sizeof(ffmpegError));
-				Utils::Logf("avcodec_receive_frame failed: %s\n", ffmpegError);
-				av_frame_free(&frame);
-				return DR_NEED_IDR;
+			result = HandleDecodeError(DecodeErrorPolicy::classify(err), nal.frameClass != NAL_FRAME_NON_REFERENCE, decodeUnit);
+			if (result != DR_OK) {
+				return result;
 			}
+		}
 
-			// Capture a frame timestamp to measuring pacing delay
-			QueryPerformanceCounter(&decodeEnd);
-			frame_attach_userdata(frame, decodeEnd.QuadPart);
-
-			FQLog("✓ Frame decoded [pts: %.3fms] [in#: %d] [out#: %d] [lost: %d] decode time %.3fms\n",
-				frame->pts / 90.0,
-				decodeUnit->frameNumber, decoder_ctx->frame_num,
-				decodeUnit->frameNumber - decoder_ctx->frame_num,
-				QpcToMs(decodeEnd.QuadPart - decodeStart.QuadPart));
-
-			// Queue the frame for rendering. frame is now owned by Pacer.
-			Pacer::instance().submitFrame(frame);
+		result = DrainFrames(decodeUnit, nal, traceId, decodeStart.QuadPart, decodeEndQpc);
+		if (result != DR_OK) {
+			return result;
+		}
 
-			// Even though we have a valid frame, the ffmpeg API needs us to loop and call avcodec_receive_frame()
-			// again where we expect to get AVERROR(EAGAIN) and break out.
+		// moonlight-common-c frees the decode unit when we return, FFmpeg must be done with it by now
+		if (zeroCopy && !m_ZeroCopyReleased) {
+			Utils::Log("Warning: decoder kept a reference to a decode unit, disabling zero-copy packets\n");
+			m_ZeroCopyPackets = false;
 		}
 
-		double decodeTimeMs = QpcToMs(decodeEnd.QuadPart - decodeStart.QuadPart);
-		if (decodeEnd.QuadPart > decodeStart.QuadPart) {
-			Stats::instance().SubmitDecodeMs(decodeTimeMs);
+		// Heap allocations on the way in (packet buffers) and out (frame shells and MLFrameData), 0 once warmed up
+		Stats::instance().SubmitDecodeInput(bytesCopied, s_PacketBufferAllocs.load(std::memory_order_relaxed) - packetAllocsBefore,
+		                                    FramePool::instance().allocations() - frameAllocsBefore, zeroCopy);
+
+		double decodeTimeMs = QpcToMs(decodeEndQpc - decodeStart.QuadPart);
+		if (decodeEndQpc > decodeStart.QuadPart) {
+			// The hop from moonlight-common-c's queue to its decoder thread, the price of pipelining
+			const double handoffMs = std::max(0.0, QpcToMs(decodeStart.QuadPart - UsToQpc(decodeUnit->enqueueTimeUs)));
+			Stats::instance().SubmitDecodeMs(decodeTimeMs, handoffMs);
 		}
 
 		// Not the best way to handle this. BUT IT DOES FIX XBOX ONE TEARING!!!!
@@ -372,6 +812,32 @@ namespace moonlight_xbox_dx {
 		return DR_OK;
 	}
 
+	// Only advertised to the host when this passes, FFmpeg's AV1 decoder has no software fallback
+	bool FFMpegDecoder::IsAV1DecodeSupported(ID3D11Device *device, bool tenBit) {
+		if (!device) {
+			return false;
+		}
+
+		Microsoft::WRL::ComPtr<ID3D11VideoDevice> videoDevice;
+		if (FAILED(device->QueryInterface(IID_PPV_ARGS(&videoDevice)))) {
+			return false;
+		}
+
+		const UINT profileCount = videoDevice->GetVideoDecoderProfileCount();
+		for (UINT i = 0; i < profileCount; i++) {
+			GUID profile;
+			if (FAILED(videoDevice->GetVideoDecoderProfile(i, &profile)) || profile != D3D11_DECODER_PROFILE_AV1_VLD_PROFILE0) {
+				continue;
+			}
+
+			BOOL supported = FALSE;
+			if (SUCCEEDED(videoDevice->CheckVideoDecoderFormat(&profile, tenBit ? DXGI_FORMAT_P010 : DXGI_FORMAT_NV12, &supported)) && supported) {
+				return true;
+			}
+		}
+		return false;
+	}
+
 	//Helpers
 	int initCallback(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags) noexcept {
 		return FFMpegDecoder::instance().Init(videoFormat, width, height, redrawRate, context, drFlags);
@@ -391,8 +857,18 @@ namespace moonlight_xbox_dx {
 		decoder_callbacks_sdl.setup = initCallback;
 		decoder_callbacks_sdl.cleanup = cleanupCallback;
 		decoder_callbacks_sdl.submitDecodeUnit = submitDecodeUnit;
-		decoder_callbacks_sdl.capabilities = CAPABILITY_DIRECT_SUBMIT | CAPABILITY_INTRA_REFRESH;
-		//decoder_callbacks_sdl.capabilities = CAPABILITY_DIRECT_SUBMIT | CAPABILITY_REFERENCE_FRAME_INVALIDATION_HEVC;
+		// With RFI the host recovers from packet loss by encoding the next P-frame against frames we still
+		// have, instead of sending a keyframe. moonlight-common-c requests it and drops frames until then.
+		decoder_callbacks_sdl.capabilities = CAPABILITY_INTRA_REFRESH | CAPABILITY_REFERENCE_FRAME_INVALIDATION_AVC |
+		                                     CAPABILITY_REFERENCE_FRAME_INVALIDATION_HEVC;
+		if (!instance().m_Pipelined) {
+			// Decode on the thread that reassembled the frame, no handoff but the next frame waits for us
+			decoder_callbacks_sdl.capabilities |= CAPABILITY_DIRECT_SUBMIT;
+		}
+		if (instance().m_PreferredBackend == DecoderBackend::Software || instance().m_SlicesForFallback) {
+			// One slice per decoder thread, FFmpeg only threads within a frame across slices
+			decoder_callbacks_sdl.capabilities |= CAPABILITY_SLICES_PER_FRAME(SoftwareDecoder::defaultThreadCount());
+		}
 		return decoder_callbacks_sdl;
 	}
 }
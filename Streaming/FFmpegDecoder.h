@@ -1,9 +1,15 @@
 #pragma once
 
+#include <atomic>
 #include <mutex>
 #include <queue>
 #include "../Common/StepTimer.h"
+#include "DecodeErrorPolicy.h"
+#include "FrameData.h"
+#include "NalScanner.h"
 #include "Pacer.h"
+#include "RecoveryTracker.h"
+#include "SoftwareDecoder.h"
 #include "Utils.hpp"
 #include "VideoRenderer.h"
 
@@ -16,31 +22,72 @@ extern "C" {
 
 #define MAX_BUFFER 1024 * 1024
 
-typedef struct MLFrameData {
-	int64_t decodeEndQpc;     // when we finished decoding
-	int64_t presentTargetQpc; // timestamp when frame should be presented (slightly earlier than vsync)
-	int64_t presentVsyncQpc;  // hard vsync deadline
-} MLFrameData;
+// Bytes moonlight-common-c guarantees to be readable and zeroed after each bufferList entry. Single-entry
+// decode units are passed to FFmpeg without a copy when this covers AV_INPUT_BUFFER_PADDING_SIZE, the
+// depacketizer doesn't reserve any padding today.
+#define DECODE_UNIT_PADDING 0
 
 namespace moonlight_xbox_dx {
 
+enum class DecoderBackend {
+	D3D11VA,  // decodes into D3D11 surfaces the renderer samples directly
+	Software, // SoftwareDecoder on the CPU, the renderer uploads each frame
+};
+
 class FFMpegDecoder {
   public:
 	// Singleton accessor
 	static FFMpegDecoder &instance();
 
-	void CompleteInitialization(const std::shared_ptr<DX::DeviceResources> &res, STREAM_CONFIGURATION *config, bool framePacingImmediate);
+	void CompleteInitialization(const std::shared_ptr<DX::DeviceResources> &res, STREAM_CONFIGURATION *config, PacingMode pacingMode, double latencyBudgetMs);
 	int Init(int videoFormat, int width, int height, int redrawRate, void *context, int drFlags);
 	void Cleanup();
 	int SubmitDecodeUnit(PDECODE_UNIT decodeUnit);
 	static FFMpegDecoder *getInstance();
 	static DECODER_RENDERER_CALLBACKS getDecoder();
 
+	// Backend the next Init() starts with, set before getDecoder() so the host is asked for slices when
+	// decoding in software. D3D11VA falls back to software if the device or the stream's profile is refused.
+	void SetPreferredBackend(DecoderBackend backend) {
+		m_PreferredBackend = backend;
+	}
+	DecoderBackend GetBackend() const {
+		return m_Backend;
+	}
+
+	// Also ask for slices while D3D11VA is preferred, for streams that may end up in software (4:4:4)
+	void SetSlicesForSoftwareFallback(bool slices) {
+		m_SlicesForFallback = slices;
+	}
+
+	// Decode on moonlight-common-c's decoder thread instead of the receive thread, before getDecoder()
+	void SetPipelined(bool pipelined) {
+		m_Pipelined = pipelined;
+	}
+	bool IsPipelined() const {
+		return m_Pipelined;
+	}
+
+	// True if the GPU has a D3D11 video decoder for AV1 in 8-bit (NV12) or 10-bit (P010)
+	static bool IsAV1DecodeSupported(ID3D11Device *device, bool tenBit);
+
 	// Called from the get_format callback to set up a frame pool with
 	// D3D11_BIND_SHADER_RESOURCE so the renderer can sample decoder surfaces
-	// directly. Returns false on failure, which aborts decoding.
+	// directly, sized by RequiredSurfaces(). Returns false on failure, which aborts decoding.
 	bool setupDirectSampleFramesContext(AVCodecContext *avctx);
 
+	// Called from the get_format callback when the decoder can't get D3D11 surfaces at all
+	void rejectHwaccel() {
+		m_HwaccelRejected = true;
+	}
+
+	// get_buffer2 of the D3D11VA decoder. When every surface of the fixed pool is referenced it waits for
+	// the renderer to release one instead of failing the frame.
+	int getSurface(AVCodecContext *avctx, AVFrame *frame, int flags);
+
+	// Counts data buffers allocated by m_PacketPool
+	static std::atomic<uint32_t> s_PacketBufferAllocs;
+
 	int videoFormat, width, height, fps;
 	std::recursive_mutex m_mutex;
 
@@ -70,14 +117,68 @@ class FFMpegDecoder {
 	FFMpegDecoder(const FFMpegDecoder &) = delete;
 	FFMpegDecoder &operator=(const FFMpegDecoder &) = delete;
 
+	// Points m_Packet at the decode unit's data, returns false if no buffer could be allocated
+	bool PreparePacket(PDECODE_UNIT decodeUnit, uint32_t &bytesCopied, bool &zeroCopy);
+
+	// Opens the D3D11VA decoder, returns an AVERROR code if the device or codec refuses it
+	int InitHardware();
+	int InitSoftware();
+
+	// Replaces a D3D11VA decoder whose hwaccel rejected the stream in get_format, true if decoding can go on
+	bool FallBackToSoftware();
+
+	// Closes and opens the active backend again, a D3D11VA decoder that can't be reopened falls back to
+	// software. Returns false if no decoder could be opened.
+	bool ReopenDecoder();
+
+	// D3D11VA pool size for the decoder's own surfaces plus a FrameQueue at its current high water mark
+	int RequiredSurfaces() const;
+
+	// Reopens the D3D11VA decoder at an IDR when the queue depth no longer matches the pool, requesting
+	// one if the pool became too small. Returns false if no decoder could be opened.
+	bool ResizeSurfacePool(PDECODE_UNIT decodeUnit);
+
+	int SendPacket(const AVPacket *packet);
+	int ReceiveFrame(AVFrame *frame);
+	AVCodecContext *ActiveContext() const;
+
+	// Receives every frame the decoder has ready and hands it to the Pacer. Returns DR_OK, or DR_NEED_IDR
+	// if the error policy wants a keyframe.
+	int DrainFrames(PDECODE_UNIT decodeUnit, const NalFrameInfo &nal, uint32_t traceId, int64_t decodeStartQpc,
+	                int64_t &decodeEndQpc);
+
+	// Marks the decode unit as undecodable and asks moonlight-common-c for a keyframe
+	int RequestIdr(PDECODE_UNIT decodeUnit);
+
+	// Lets m_ErrorPolicy decide about a decode error and carries out its decision, returns DR_OK while
+	// decoding goes on without a keyframe. Only a returned DR_NEED_IDR marks the unit in m_Recovery.
+	int HandleDecodeError(DecodeErrorPolicy::Error error, bool referenceFrame, PDECODE_UNIT decodeUnit);
+	int ApplyErrorAction(DecodeErrorPolicy::Action action, PDECODE_UNIT decodeUnit);
+
 	const AVCodec *decoder;
 	AVCodecContext *decoder_ctx;
+	SoftwareDecoder m_Software;
+	DecoderBackend m_PreferredBackend;
+	DecoderBackend m_Backend;
+	bool m_Pipelined;
+	bool m_SlicesForFallback;
+	bool m_HwaccelRejected;     // set by get_format when it can't give the decoder D3D11 surfaces
+	int m_SurfacePoolSize;      // surfaces in the D3D11VA pool, 0 until get_format made one
+	int m_DecoderSurfaces;      // of those, what the decoder keeps for references and the picture in progress
+	bool m_SurfacePoolFixed;    // the driver refused our size, FFmpeg's default is used as is
+	bool m_SurfaceResizePending; // an IDR was requested to grow the pool
 	AVHWDeviceContext *device_ctx;
 	AVD3D11VADeviceContext *d3d11va_device_ctx;
-	unsigned char *ffmpeg_buffer;
-	int ffmpeg_buffer_size;
+	AVPacket *m_Packet;         // reused for every decode unit
+	AVBufferPool *m_PacketPool; // refcounted buffers for decode units that have to be gathered
+	int m_PacketPoolSize;
+	bool m_ZeroCopyPackets;     // cleared if FFmpeg ever holds on to a decode unit buffer
+	bool m_ZeroCopyReleased;
 	std::shared_ptr<DX::DeviceResources> m_deviceResources;
 	int m_LastFrameNumber;
+	RecoveryTracker m_Recovery;
+	DecodeErrorPolicy m_ErrorPolicy;
+	NalScanner m_NalScanner;
 	int64_t m_StreamEpochQpc;
 };
 } // namespace moonlight_xbox_dx
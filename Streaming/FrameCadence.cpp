@@ -1,7 +1,9 @@
-#include "pch.h"
+// Built without the precompiled header, see PacerCore.h
 #include "FrameCadence.h"
 
 #include <algorithm> // std::clamp
+#include <cmath>
+#include "PacingLog.h"
 
 FrameCadence::FrameCadence()
     : m_displayPeriodMs(1000.0 / 59.94),
@@ -20,6 +22,7 @@ void FrameCadence::init(double hz, double fps) {
 	periodMs = std::clamp(periodMs, m_minStreamPeriodMs, m_maxStreamPeriodMs);
 
 	m_streamPeriodEwmaMs = periodMs;
+	m_hostClockScale = 1.0;
 	m_lastPts90k = 0;
 	m_haveLastPts = false;
 
@@ -28,6 +31,14 @@ void FrameCadence::init(double hz, double fps) {
 
 	// Start cadence phase at zero.
 	m_phase = 0.0;
+
+	// Forget any locked pattern.
+	unlockPattern();
+	m_candidateFrames = 0;
+	m_candidateVblanks = 0;
+	m_candidateStreak = 0;
+	m_patternBreaks.store(0, std::memory_order_release);
+	m_driftCorrections.store(0, std::memory_order_release);
 }
 
 // Called by Pacer getNextVBlankQpc (main thread)
@@ -57,8 +68,7 @@ void FrameCadence::observeFramePts(int64_t pts90k) {
 			    deltaMs * m_streamEwmaAlpha +
 			    m_streamPeriodEwmaMs * (1.0 - m_streamEwmaAlpha);
 
-			// Publish the updated stream period.
-			m_streamPeriodMs.store(m_streamPeriodEwmaMs, std::memory_order_release);
+			publishStreamPeriod();
 		}
 	}
 
@@ -66,6 +76,20 @@ void FrameCadence::observeFramePts(int64_t pts90k) {
 	m_haveLastPts = true;
 }
 
+// Decoder thread only
+void FrameCadence::setHostClockScale(double scale) {
+	if (scale <= 0.0) {
+		scale = 1.0;
+	}
+	m_hostClockScale = scale;
+	publishStreamPeriod();
+}
+
+// Decoder thread only, publishes the stream period in local time
+void FrameCadence::publishStreamPeriod() {
+	m_streamPeriodMs.store(m_streamPeriodEwmaMs * m_hostClockScale, std::memory_order_release);
+}
+
 int FrameCadence::decideAdvanceCount() {
 	// Main thread only.
 	// Uses a fractional phase accumulator to decide how many frames to advance.
@@ -84,6 +108,28 @@ int FrameCadence::decideAdvanceCount() {
 	// Stream frames per present interval.
 	const double framesPerPresent = displayMs / streamMs;
 
+	// Follow the exact repeat pattern when the ratio is locked.
+	updatePatternLock(framesPerPresent);
+	if (m_locked) {
+		const int frames = m_lockedFrames.load(std::memory_order_relaxed);
+		const int vblanks = m_lockedVblanks.load(std::memory_order_relaxed);
+		int advanceCount = m_pattern[m_patternIdx];
+		m_patternIdx = (m_patternIdx + 1) % vblanks;
+
+		// Pay back the difference between the true ratio and the pattern one frame at a time
+		m_driftFrames += framesPerPresent - static_cast<double>(frames) / vblanks;
+		if (m_driftFrames >= 1.0 && advanceCount < m_maxAdvancePerPresent) {
+			advanceCount++;
+			m_driftFrames -= 1.0;
+			m_driftCorrections.fetch_add(1, std::memory_order_acq_rel);
+		} else if (m_driftFrames <= -1.0 && advanceCount > 0) {
+			advanceCount--;
+			m_driftFrames += 1.0;
+			m_driftCorrections.fetch_add(1, std::memory_order_acq_rel);
+		}
+		return advanceCount;
+	}
+
 	// Accumulate fractional frames owed.
 	m_phase += framesPerPresent;
 
@@ -107,8 +153,156 @@ int FrameCadence::decideAdvanceCount() {
 	return advanceCount;
 }
 
+// Cadence pattern lock (main thread)
+
+// Smallest frames/vblanks fraction within PATTERN_TOLERANCE of framesPerPresent
+bool FrameCadence::findPattern(double framesPerPresent, int &frames, int &vblanks) const {
+	for (int q = 1; q <= MAX_PATTERN_VBLANKS; ++q) {
+		const int p = static_cast<int>(std::lround(framesPerPresent * q));
+		if (p < 1 || p > q * m_maxAdvancePerPresent) {
+			continue;
+		}
+		const double err = std::fabs(framesPerPresent - static_cast<double>(p) / q) / framesPerPresent;
+		if (err < PATTERN_TOLERANCE) {
+			frames = p;
+			vblanks = q;
+			return true;
+		}
+	}
+	return false;
+}
+
+void FrameCadence::updatePatternLock(double framesPerPresent) {
+	int frames = 0;
+	int vblanks = 0;
+	const bool found = findPattern(framesPerPresent, frames, vblanks);
+
+	if (m_locked) {
+		const int lockedFrames = m_lockedFrames.load(std::memory_order_relaxed);
+		const int lockedVblanks = m_lockedVblanks.load(std::memory_order_relaxed);
+		if (found && frames == lockedFrames && vblanks == lockedVblanks) {
+			m_mismatchStreak = 0;
+			return;
+		}
+
+		// The EWMA wanders off the pattern with timestamp jitter, only a lasting change unlocks
+		if (++m_mismatchStreak < PATTERN_UNLOCK) {
+			return;
+		}
+
+		// Ratio changed, go back to the accumulator until a new pattern holds. The accumulator carries on
+		// from the pattern's phase, so relocking to the same pattern picks up where it left off.
+		PacingLogf("FrameCadence: pattern %s broken by ratio %.4f\n", patternName().c_str(), framesPerPresent);
+		m_patternBreaks.fetch_add(1, std::memory_order_acq_rel);
+		m_phase = static_cast<double>((m_patternIdx * lockedFrames) % lockedVblanks) / lockedVblanks;
+		unlockPattern();
+	}
+
+	if (found && frames == m_candidateFrames && vblanks == m_candidateVblanks) {
+		if (++m_candidateStreak >= PATTERN_CONFIRM) {
+			lockPattern(frames, vblanks);
+		}
+	} else {
+		m_candidateFrames = found ? frames : 0;
+		m_candidateVblanks = found ? vblanks : 0;
+		m_candidateStreak = found ? 1 : 0;
+	}
+}
+
+void FrameCadence::lockPattern(int frames, int vblanks) {
+	// Evenly spread advances, e.g. 2 frames per 5 vblanks -> 0,0,1,0,1 (3:2 pulldown)
+	for (int k = 0; k < vblanks; ++k) {
+		m_pattern[k] = ((k + 1) * frames) / vblanks - (k * frames) / vblanks;
+	}
+
+	// Start where the accumulator left off so locking doesn't cause a hiccup
+	int bestIdx = 0;
+	double bestErr = 2.0;
+	for (int k = 0; k < vblanks; ++k) {
+		const double phaseAtK = static_cast<double>((k * frames) % vblanks) / vblanks;
+		const double err = std::fabs(phaseAtK - m_phase);
+		if (err < bestErr) {
+			bestErr = err;
+			bestIdx = k;
+		}
+	}
+	m_patternIdx = bestIdx;
+	m_mismatchStreak = 0;
+	m_driftFrames = 0.0;
+
+	m_locked = true;
+	m_lockedFrames.store(frames, std::memory_order_release);
+	m_lockedVblanks.store(vblanks, std::memory_order_release);
+
+	PacingLogf("FrameCadence: locked to %d frame(s) per %d vblank(s), pattern %s\n", frames, vblanks, patternName().c_str());
+}
+
+void FrameCadence::unlockPattern() {
+	m_locked = false;
+	m_patternIdx = 0;
+	m_mismatchStreak = 0;
+	m_lockedFrames.store(0, std::memory_order_release);
+	m_lockedVblanks.store(0, std::memory_order_release);
+}
+
+void FrameCadence::notePatternBreak() {
+	if (m_locked) {
+		m_patternBreaks.fetch_add(1, std::memory_order_acq_rel);
+
+		// The queue just absorbed the difference itself
+		m_driftFrames = 0.0;
+	}
+}
+
 // Accessors
 
+bool FrameCadence::lockedPattern(int &frames, int &vblanks) const {
+	frames = m_lockedFrames.load(std::memory_order_acquire);
+	vblanks = m_lockedVblanks.load(std::memory_order_acquire);
+	return frames > 0 && vblanks > 0;
+}
+
+// Pattern as the number of vblanks each frame is shown for, e.g. "3:2" for 24 on 60,
+// or frames consumed per vblank when frames are being skipped, e.g. "2/1" for 120 on 60
+std::string FrameCadence::patternName() const {
+	int frames = 0;
+	int vblanks = 0;
+	if (!lockedPattern(frames, vblanks)) {
+		return "unlocked";
+	}
+
+	if (frames > vblanks) {
+		return std::to_string(frames) + "/" + std::to_string(vblanks);
+	}
+
+	// Count vblanks between advances, the pattern always ends on an advance
+	std::string name;
+	int runs[MAX_PATTERN_VBLANKS] = {};
+	int runCount = 0;
+	for (int k = 0; k < vblanks; ++k) {
+		runs[runCount]++;
+		if ((((k + 1) * frames) / vblanks - (k * frames) / vblanks) > 0) {
+			runCount++;
+		}
+	}
+	for (int i = 0; i < runCount; ++i) {
+		if (i > 0) {
+			name += ":";
+		}
+		name += std::to_string(runs[i]);
+	}
+	return name;
+}
+
+uint32_t FrameCadence::patternBreaks() const {
+	return m_patternBreaks.load(std::memory_order_acquire);
+}
+
+uint32_t FrameCadence::driftCorrections() const {
+	return m_driftCorrections.load(std::memory_order_acquire);
+}
+
+
 double FrameCadence::displayHz() const {
 	const double periodMs = m_displayPeriodMs.load(std::memory_order_acquire);
 	return (periodMs > 0.0) ? (1000.0 / periodMs) : 0.0;
@@ -1,11 +1,24 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <cstdint>
+#include <string>
 
 // This class tracks the current display refresh rate and the incoming stream framerate
 // and instructs the render thread whether it should display a new frame or the previous frame.
 //
+// When the stream/display ratio settles on a small fraction (24 on 60, 30 on 60, 50 on 60, 120 on 60...)
+// the exact repeat pattern for that ratio is locked in, e.g. 3:2 pulldown for 24 on 60, instead of
+// following the accumulator, which drifts with the EWMA stream period. The accumulator takes over
+// again once the ratio has stayed off the pattern for PATTERN_UNLOCK presents, so jitter in the host
+// timestamps doesn't break the lock, and a relock to the same pattern resumes at the same phase.
+//
+// Stream frame intervals come from host timestamps and are converted to local time with the host
+// clock skew from HostClockEstimator. While locked, the small difference between the true ratio and
+// the pattern (e.g. 60 fps on 59.94 Hz, or host clock drift) is accumulated and paid back with a single
+// extra or skipped advance once it reaches a whole frame, instead of letting the queue fill or drain.
+//
 // This class is thread-safe when used as documented, atomics are used for performance.
 
 class FrameCadence {
@@ -23,6 +36,9 @@ class FrameCadence {
 	// Updates EWMA of stream period and publishes it. No locks.
 	void observeFramePts(int64_t pts90k);
 
+	// Called by decoder thread with HostClockEstimator::hostToLocalScale(). No locks.
+	void setHostClockScale(double scale);
+
 	// Decide how many stream frames should be consumed for this present interval (main thread).
 	//
 	// Return value:
@@ -31,6 +47,16 @@ class FrameCadence {
 	//   2+ -> drop some incoming frames (e.g. 120 fps stream on 60 Hz display)
 	int decideAdvanceCount();
 
+	// Called by Pacer (main thread) when it had to deviate from the locked pattern,
+	// e.g. the queue ran dry or had to be drained
+	void notePatternBreak();
+
+	// Locked pattern as frames per vblanks, 0/0 when not locked. Lock-free.
+	bool lockedPattern(int &frames, int &vblanks) const;
+	std::string patternName() const;
+	uint32_t patternBreaks() const;
+	uint32_t driftCorrections() const;
+
 	// Lock-free accessors.
 	double displayHz() const;
 	double displayPeriodMs() const;
@@ -44,15 +70,41 @@ class FrameCadence {
 
 	double m_streamPeriodEwmaMs = 0.0;
 	double m_streamEwmaAlpha = 0.10;
+	double m_hostClockScale = 1.0; // local ms per host ms
+
+	void publishStreamPeriod();
 
 	double m_minStreamPeriodMs = 1000.0 / 240.0;
 	double m_maxStreamPeriodMs = 1000.0 / 1.0;
 
+	static constexpr int MAX_PATTERN_VBLANKS = 6;   // longest repeat pattern we try to lock to
+	static constexpr double PATTERN_TOLERANCE = 0.005; // relative ratio error accepted for a pattern
+	static constexpr int PATTERN_CONFIRM = 30;         // presents the same ratio must hold before locking
+	static constexpr int PATTERN_UNLOCK = 60;          // presents in a row off the pattern before unlocking
+
+	void updatePatternLock(double framesPerPresent);
+	bool findPattern(double framesPerPresent, int &frames, int &vblanks) const;
+	void lockPattern(int frames, int vblanks);
+	void unlockPattern();
+
 	// Main-thread owned state.
 	double m_phase = 0.0;
 	int m_maxAdvancePerPresent = 2;
 
+	int m_candidateFrames = 0;
+	int m_candidateVblanks = 0;
+	int m_candidateStreak = 0;
+	bool m_locked = false;
+	std::array<int, MAX_PATTERN_VBLANKS> m_pattern{};
+	int m_patternIdx = 0;
+	int m_mismatchStreak = 0;
+	double m_driftFrames = 0.0; // frames owed (+) or overdrawn (-) by the locked pattern
+
 	// Published values (written by pacer or decoder, read by main).
 	std::atomic<double> m_displayPeriodMs;
 	std::atomic<double> m_streamPeriodMs;
+	std::atomic<int> m_lockedFrames{0};
+	std::atomic<int> m_lockedVblanks{0};
+	std::atomic<uint32_t> m_patternBreaks{0};
+	std::atomic<uint32_t> m_driftCorrections{0};
 };
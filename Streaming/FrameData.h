@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// Per-frame data the decoder attaches to each AVFrame as opaque_ref, kept apart from FFmpegDecoder.h so
+// the pacing code built without the precompiled header can read it (see PacerCore.h)
+typedef struct MLFrameData {
+	int64_t decodeEndQpc;     // when we finished decoding
+	int64_t presentTargetQpc; // timestamp when frame should be presented (slightly earlier than vsync)
+	int64_t presentVsyncQpc;  // hard vsync deadline
+	uint32_t traceId;         // FrameTrace record of this frame, 0 if untraced
+	uint8_t frameClass;       // NalFrameClass of the decode unit, from the NAL headers
+	uint8_t changedParamSets; // NAL_CHANGED_* if the unit carried new parameter sets
+} MLFrameData;
@@ -0,0 +1,94 @@
+// Built without the precompiled header, see PacerCore.h
+#include "FramePool.h"
+#include <cstring>
+#include "AtomicWait.h"
+#include "FrameData.h"
+
+FramePool &FramePool::instance() {
+	static FramePool inst;
+	return inst;
+}
+
+FramePool::~FramePool() {
+	clear();
+}
+
+template <typename T>
+T *FramePool::take(std::array<std::atomic<T *>, kCapacity> &slots) {
+	for (auto &slot : slots) {
+		if (slot.load(std::memory_order_relaxed)) {
+			if (T *item = slot.exchange(nullptr, std::memory_order_acq_rel)) {
+				return item;
+			}
+		}
+	}
+	return nullptr;
+}
+
+template <typename T>
+bool FramePool::put(std::array<std::atomic<T *>, kCapacity> &slots, T *item) {
+	for (auto &slot : slots) {
+		T *expected = nullptr;
+		if (slot.compare_exchange_strong(expected, item, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+AVFrame *FramePool::acquireFrame() {
+	if (AVFrame *frame = take(m_frames)) {
+		return frame;
+	}
+	m_allocations.fetch_add(1, std::memory_order_acq_rel);
+	return av_frame_alloc();
+}
+
+AVBufferRef *FramePool::acquireFrameData() {
+	if (AVBufferRef *buf = take(m_frameData)) {
+		memset(buf->data, 0, sizeof(MLFrameData));
+		return buf;
+	}
+	m_allocations.fetch_add(1, std::memory_order_acq_rel);
+	return av_buffer_allocz(sizeof(MLFrameData));
+}
+
+void FramePool::release(AVFrame **frame) {
+	if (!frame || !*frame) {
+		return;
+	}
+	AVFrame *f = *frame;
+	*frame = nullptr;
+
+	const bool surface = f->format == AV_PIX_FMT_D3D11 && f->buf[0];
+
+	// Keep MLFrameData out of av_frame_unref(), only buffers nobody else references can be reused
+	AVBufferRef *data = f->opaque_ref;
+	f->opaque_ref = nullptr;
+	if (data && (static_cast<size_t>(data->size) < sizeof(MLFrameData) || !av_buffer_is_writable(data) || !put(m_frameData, data))) {
+		av_buffer_unref(&data);
+	}
+
+	av_frame_unref(f);
+	if (!put(m_frames, f)) {
+		av_frame_free(&f);
+	}
+
+	if (surface) {
+		m_surfacesHeld.fetch_sub(1, std::memory_order_acq_rel);
+		atomicWakeAll(m_surfacesHeld);
+	}
+}
+
+void FramePool::waitForSurface(int held, unsigned long timeoutMs) {
+	atomicWait(m_surfacesHeld, held, timeoutMs);
+}
+
+void FramePool::clear() {
+	while (AVFrame *frame = take(m_frames)) {
+		av_frame_free(&frame);
+	}
+	while (AVBufferRef *data = take(m_frameData)) {
+		av_buffer_unref(&data);
+	}
+}
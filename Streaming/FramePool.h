@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+}
+
+// Recycles the AVFrame shells and MLFrameData buffers that carry decoded frames from FFMpegDecoder
+// through FrameQueue to Pacer.
+//
+// Frames are acquired on the decoder thread and released on either the decoder thread (FrameQueue drops)
+// or the render thread, so both free lists are fixed arrays of atomic slots: release() puts an item in
+// the first empty slot, acquire takes one out with an exchange. Nothing takes a lock. A released frame
+// is unreferenced (returning its decoder surface) before its shell is kept, its MLFrameData buffer is
+// detached first and kept as is.
+//
+// Every av_frame_alloc/av_buffer_alloc made here is counted, once the pool is warm a stream runs with
+// allocations() standing still. FFmpeg's own references to decoder surfaces are not part of this.
+//
+// D3D11 frames are also counted between surfaceReceived() and release(), that is the part of the
+// decoder's fixed surface pool held by FrameQueue and Pacer.
+
+class FramePool {
+  public:
+	// Singleton
+	static FramePool &instance();
+
+	// Empty frame for avcodec_receive_frame(), decoder thread
+	AVFrame *acquireFrame();
+
+	// Zeroed MLFrameData for AVFrame::opaque_ref, decoder thread
+	AVBufferRef *acquireFrameData();
+
+	// Unreferences the frame and keeps its shell and MLFrameData for reuse, any thread. Sets *frame to null.
+	void release(AVFrame **frame);
+
+	// Frees everything pooled, frames released later are pooled again
+	void clear();
+
+	// Heap allocations made by the pool since startup
+	uint32_t allocations() const {
+		return m_allocations.load(std::memory_order_acquire);
+	}
+
+	// Decoder thread, for each D3D11 frame avcodec_receive_frame() returned. Returns the surfaces now held.
+	int surfaceReceived() {
+		return m_surfacesHeld.fetch_add(1, std::memory_order_acq_rel) + 1;
+	}
+
+	int surfacesHeld() const {
+		return m_surfacesHeld.load(std::memory_order_acquire);
+	}
+
+	// Decoder thread, waits up to timeoutMs for release() to return a surface while held are held
+	void waitForSurface(int held, unsigned long timeoutMs);
+
+  private:
+	FramePool() = default;
+	~FramePool();
+	FramePool(const FramePool &) = delete;
+	FramePool &operator=(const FramePool &) = delete;
+
+	// Frames in flight: FrameQueue capacity, the current and held frames in Pacer, and the decoder's
+	static constexpr int kCapacity = 16;
+
+	template <typename T>
+	static T *take(std::array<std::atomic<T *>, kCapacity> &slots);
+	template <typename T>
+	static bool put(std::array<std::atomic<T *>, kCapacity> &slots, T *item);
+
+	std::array<std::atomic<AVFrame *>, kCapacity> m_frames{};
+	std::array<std::atomic<AVBufferRef *>, kCapacity> m_frameData{};
+	std::atomic<uint32_t> m_allocations{0};
+	std::atomic<int> m_surfacesHeld{0};
+};
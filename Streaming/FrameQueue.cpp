@@ -1,17 +1,24 @@
-// clang-format off
-#include "pch.h"
-// clang-format on
+// Built without the precompiled header, see PacerCore.h
 #include "FrameQueue.h"
-#include "Utils.hpp"
+#include "AtomicWait.h"
+#include "FrameData.h"
+#include "FramePool.h"
+#include "NalScanner.h"
+#include "PacingLog.h"
 #include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <thread>
 
-using namespace moonlight_xbox_dx;
+// NalScanner's classification of the decode unit, unknown for AV1 and frames without MLFrameData
+static inline NalFrameClass frameClass(AVFrame *frame) {
+	return frame->opaque_ref ? static_cast<NalFrameClass>(reinterpret_cast<MLFrameData *>(frame->opaque_ref->data)->frameClass)
+	                         : NAL_FRAME_UNKNOWN;
+}
 
 static inline bool isFrameIDR(AVFrame *frame) {
-	return frame->pict_type == AV_PICTURE_TYPE_I;
+	const NalFrameClass cls = frameClass(frame);
+	return cls != NAL_FRAME_UNKNOWN ? cls == NAL_FRAME_IDR : frame->pict_type == AV_PICTURE_TYPE_I;
 }
 
 FrameQueue &FrameQueue::instance() {
@@ -20,42 +27,42 @@ FrameQueue &FrameQueue::instance() {
 }
 
 FrameQueue::FrameQueue()
-    : _capacity(0),
-      _head(0),
-      _tail(0),
-      _count(0),
-      _droppedLast(false),
-      _maxCapacity(5), // should not exceed swapchain BufferCount
+    : _droppedLast(false),
       _highWaterMark(3),
-      _paused(true) {    // caller will call start()
-
-	_capacity = _maxCapacity;
-	_buffer.assign(_capacity, nullptr);
-	_head = _tail = _count = 0;
+      _paused(true) {    // caller will call setClock() and start()
 }
 
 void FrameQueue::setPaused(bool p) {
 	_paused.store(p, std::memory_order_release);
 	if (p) {
 		// Wake any waiters so they can exit
-		_cv.notify_all();
+		wakeWaiters();
 	}
 }
 
+void FrameQueue::wakeWaiters() {
+	// Waiters sample _enqueueSeq before checking their condition, so bumping it here can't be missed
+	_enqueueSeq.fetch_add(1, std::memory_order_acq_rel);
+	atomicWakeAll(_enqueueSeq);
+}
+
 void FrameQueue::start() {
+	assert(std::atomic_load(&_clock));
 	setPaused(false);
-	Utils::Logf("FrameQueue started\n");
+	PacingLogf("FrameQueue started\n");
 }
 
 void FrameQueue::stop() {
 	setPaused(true);
 	clear();
-	Utils::Logf("FrameQueue stopped\n");
+	PacingLogf("FrameQueue stopped\n");
 }
 
 std::size_t FrameQueue::count() const {
-	std::lock_guard<std::mutex> lock(_mutex);
-	return static_cast<std::size_t>(_count);
+	// load head first, tail can only have moved forward since
+	const uint64_t head = _head.load(std::memory_order_acquire);
+	const uint64_t tail = _tail.load(std::memory_order_acquire);
+	return static_cast<std::size_t>(std::min<uint64_t>(tail - head, kMaxCapacity));
 }
 
 bool FrameQueue::isEmpty() const {
@@ -63,97 +70,95 @@ bool FrameQueue::isEmpty() const {
 }
 
 void FrameQueue::clear() {
-	std::lock_guard<std::mutex> lock(_mutex);
 	// free all AVFrame in the queue
-	while (_count > 0) {
-		AVFrame *frame = popFrame();
+	while (AVFrame *frame = popFrame()) {
 		dropFrame(frame);
 	}
-	_head = _tail = _count = 0;
-	std::fill(_buffer.begin(), _buffer.end(), nullptr);
 }
 
 void FrameQueue::setHighWaterMark(int hwm) {
-	std::lock_guard<std::mutex> lock(_mutex);
-	_highWaterMark = hwm;
+	_highWaterMark.store(std::clamp(hwm, 1, kMaxCapacity), std::memory_order_release);
+}
+
+void FrameQueue::setClock(const std::shared_ptr<PacerClock> &clock) {
+	std::atomic_store(&_clock, clock);
 }
 
 int FrameQueue::highWaterMark() const {
-	std::lock_guard<std::mutex> lock(_mutex);
-	return _highWaterMark;
+	return _highWaterMark.load(std::memory_order_acquire);
 }
 
-// Push into buffer at _tail (requires _mutex held)
+// Push into the slot at _tail (producer only, caller makes sure there is room)
 void FrameQueue::pushFrame(AVFrame *frame) {
-	_buffer[_tail] = frame;
-	_tail = (_tail + 1) % _capacity;
-	_count++;
+	const uint64_t tail = _tail.load(std::memory_order_relaxed);
+	_slots[tail % kMaxCapacity].store(frame, std::memory_order_relaxed);
+	_tail.store(tail + 1, std::memory_order_release);
 
 	// Wake waiting consumer
-	_cv.notify_one();
+	wakeWaiters();
 
 	FQLog("[-> %s pts: %.3fms] enqueue frame, queue size %d/%d\n",
 		isFrameIDR(frame) ? "IDR" : "P",
-		frame->pts / 90.0, _count, _highWaterMark);
+		frame->pts / 90.0, (int)count(), highWaterMark());
 }
 
-// Pop oldest frame from _head (requires _mutex held)
+// Pop oldest frame from _head. Both sides may call this, the CAS decides who owns the frame.
 AVFrame* FrameQueue::popFrame() {
-	if (_count == 0) {
-		return nullptr;
-	}
-
-	AVFrame *frame = _buffer[_head];
-	_buffer[_head] = nullptr;
-	_head = (_head + 1) % _capacity;
-	_count--;
-	return frame;
-}
+	uint64_t head = _head.load(std::memory_order_acquire);
+	for (;;) {
+		if (head == _tail.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
 
-// Peek next frame (requires _mutex held)
-AVFrame* FrameQueue::peekFrame() {
-	if (_count == 0) {
-		return nullptr;
+		// A failed CAS means the other side took this slot first, the value we read is discarded
+		AVFrame *frame = _slots[head % kMaxCapacity].load(std::memory_order_relaxed);
+		if (_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+			return frame;
+		}
 	}
-	return _buffer[_head];
 }
 
-void FrameQueue::enumerateFrames(const std::function<void(AVFrame *frame, std::size_t idx, bool &stop)> &func) const {
-	std::lock_guard<std::mutex> lock(_mutex);
-	bool stop = false;
-	for (int i = 0; i < _count; ++i) {
-		int idx = (_head + i) % _capacity;
-		AVFrame *f = _buffer[idx];
-		func(f, static_cast<std::size_t>(i), stop);
-		if (stop) {
-			break;
+// Pop the oldest frame only while the ring is full (producer only). Returns nullptr if the consumer
+// made room first, so we never drop more than needed.
+AVFrame* FrameQueue::popFrameIfFull() {
+	uint64_t head = _head.load(std::memory_order_acquire);
+	const uint64_t tail = _tail.load(std::memory_order_relaxed);
+	while (tail - head >= static_cast<uint64_t>(kMaxCapacity)) {
+		AVFrame *frame = _slots[head % kMaxCapacity].load(std::memory_order_relaxed);
+		if (_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+			return frame;
 		}
 	}
+	return nullptr;
 }
 
 void FrameQueue::dropFrame(AVFrame *frame) {
 	if (frame) {
 		FQLog("! dropped frame [pts: %.3fms]\n", frame->pts / 90.0);
-		av_frame_free(&frame);
+		FramePool::instance().release(&frame);
 	}
 }
 
+// Producer only. The queue may shrink underneath us as the consumer dequeues, which at worst
+// means we drop a frame the consumer would have made room for, same as losing the race for the old mutex.
 int FrameQueue::unsafeEnqueue(AVFrame *frame, int frameDropTarget) {
 	int dropCount = 0;
 
 	// Always accept IDR frames, allow exceeding HWM
-	if (isFrameIDR(frame) || _count < frameDropTarget) {
+	if (isFrameIDR(frame) || static_cast<int>(count()) < frameDropTarget) {
 		// in the unlikely event of a full queue, blindly drop the oldest
 		// we don't care if it's an IDR because we just got a new one
-		if (_count == _capacity) {
-			AVFrame *oldest = popFrame();
-			if (oldest) {
-				dropFrame(oldest);
-				dropCount = 1;
-			}
+		AVFrame *oldest = popFrameIfFull();
+		if (oldest) {
+			dropFrame(oldest);
+			dropCount = 1;
 		}
 		pushFrame(frame);
 		_droppedLast = false;
+	} else if (frameClass(frame) == NAL_FRAME_NON_REFERENCE) {
+		// Drop non-reference frames first, the alternation is kept for the reference frames
+		dropFrame(frame);
+		dropCount = 1;
 	} else {
 		if (!_droppedLast) {
 			// alternate between: dropping newest...
@@ -176,48 +181,59 @@ int FrameQueue::unsafeEnqueue(AVFrame *frame, int frameDropTarget) {
 
 // Enqueue with simple alternate-drop logic
 int FrameQueue::enqueue(AVFrame *frame) {
-	std::lock_guard<std::mutex> lock(_mutex);
-	return unsafeEnqueue(frame, _highWaterMark);
+	return unsafeEnqueue(frame, highWaterMark());
 }
 
 // Allows the render loop to wait if the queue is empty
 // Optional param: wait until the queue contains N items
 // Optional timeout in milliseconds
 void FrameQueue::waitForEnqueue(int num) {
-	std::unique_lock<std::mutex> lock(_mutex);
-	while (!_paused.load(std::memory_order_acquire) && _count < num) {
+	for (;;) {
+		uint32_t seq = _enqueueSeq.load(std::memory_order_acquire);
+		if (paused() || static_cast<int>(count()) >= num) {
+			break;
+		}
 		// This waits forever until a frame arrives
-		_cv.wait(lock);
+		atomicWait(_enqueueSeq, seq, ATOMIC_WAIT_INFINITE);
 	}
 }
 
 void FrameQueue::waitForEnqueue(int num, double timeoutMs) {
-	std::unique_lock<std::mutex> lock(_mutex);
-	auto deadline = std::chrono::steady_clock::now() +
-	                std::chrono::microseconds(static_cast<long long>(timeoutMs * 1000.0));
+	if (paused()) {
+		return;
+	}
+
+	std::shared_ptr<PacerClock> clock = std::atomic_load(&_clock);
+	const int64_t freq = clock->frequency();
+	const int64_t deadline = clock->now() + static_cast<int64_t>(timeoutMs * freq / 1000.0);
 
-	while (_count < num && !_paused.load(std::memory_order_acquire)) {
-		auto now = std::chrono::steady_clock::now();
-		if (now >= deadline) break;
+	for (;;) {
+		uint32_t seq = _enqueueSeq.load(std::memory_order_acquire);
+		if (paused() || static_cast<int>(count()) >= num) {
+			break;
+		}
 
-		// wait_for overshoots a lot, so wait in small chunks
-		auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now);
-		auto chunk = remaining / 4;
-		if (chunk > std::chrono::microseconds(1000)) chunk = std::chrono::microseconds(1000);
-		if (chunk < std::chrono::microseconds(250))  chunk = std::chrono::microseconds(250);
+		const int64_t remaining = deadline - clock->now();
+		if (remaining <= 0) {
+			break;
+		}
 
-		_cv.wait_for(lock, chunk);
+		// WaitOnAddress timeouts overshoot by up to a timer tick, so only sleep whole milliseconds
+		// while we have slack and spin for the remainder, like SleepUntilQpc
+		const unsigned long ms = static_cast<unsigned long>(remaining * 1000 / freq);
+		if (ms > 1) {
+			atomicWait(_enqueueSeq, seq, ms - 1);
+		} else {
+			std::this_thread::yield();
+		}
 	}
 }
 
 AVFrame* FrameQueue::dequeue() {
-	std::lock_guard<std::mutex> lock(_mutex);
-	AVFrame *frame = nullptr;
-
-	if (_count > 0) {
-		frame = popFrame();
+	AVFrame *frame = popFrame();
+	if (frame) {
 		FQLog("[<- pts: %.3fms] dequeue frame, queue size %d/%d\n",
-			frame->pts / 90.0, _count, _highWaterMark);
+			frame->pts / 90.0, (int)count(), highWaterMark());
 	}
 	return frame;
 }
@@ -227,23 +243,26 @@ AVFrame* FrameQueue::dequeueWithTimeout(double timeoutSeconds) {
 		return nullptr;
 	}
 
-	const int64_t startQpc = QpcNow();
-	const int64_t deadlineQpc = startQpc + MsToQpc(timeoutSeconds * 1000.0);
+	std::shared_ptr<PacerClock> clock = std::atomic_load(&_clock);
+	const int64_t freq = clock->frequency();
+
+	const int64_t startQpc = clock->now();
+	const int64_t deadlineQpc = startQpc + static_cast<int64_t>(timeoutSeconds * freq);
 
 	int round = 0;
 
 	// Always attempt to dequeue at least once
 	do {
         if (round > 0) {
-            std::this_thread::sleep_for(std::chrono::microseconds(100)); // 0.1 ms
+            clock->sleepUntil(clock->now() + freq / 10000); // 0.1 ms
         }
         AVFrame *frame = dequeue();
         if (frame) {
             return frame;
         }
         round++;
-    } while (QpcNow() < deadlineQpc);
+    } while (clock->now() < deadlineQpc);
 
-	FQLog("dequeueWithTimeout timed out after %.3fms\n", QpcToMs(QpcNow() - startQpc));
+	FQLog("dequeueWithTimeout timed out after %.3fms\n", (clock->now() - startQpc) * 1000.0 / freq);
 	return nullptr;
 }
@@ -1,22 +1,27 @@
 #pragma once
 
+#include <array>
 #include <atomic>
-#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <memory>
-#include <mutex>
 #include <string>
 #include <vector>
 
-#include "../Utils/FloatBuffer.h"
-#include "Utils.hpp"
+#include "PacerClock.h"
 
 extern "C" {
-#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
 }
 
+// Single-producer (decoder thread) / single-consumer (render thread) ring of decoded frames.
+//
+// head and tail are monotonic counters, the producer owns tail and the consumer owns head. The only
+// shared write is when the producer drops the oldest frame to make room, both sides then race to
+// advance head with a CAS and whoever wins owns the frame. Nothing takes a lock, waiters sleep on
+// _enqueueSeq with atomicWait().
+
 class FrameQueue {
   public:
 	// Singleton
@@ -28,9 +33,12 @@ class FrameQueue {
 	void setHighWaterMark(int hwm);
 	int highWaterMark() const;
 	int maxCapacity() const {
-		return _maxCapacity;
+		return kMaxCapacity;
 	}
 
+	// Time source for timed waits, set by PacerCore::init before start()
+	void setClock(const std::shared_ptr<PacerClock> &clock);
+
 	// Queue operations
 	int enqueue(AVFrame *frame);
 	AVFrame* dequeue();
@@ -46,35 +54,33 @@ class FrameQueue {
 	FrameQueue(const FrameQueue &) = delete;
 	FrameQueue &operator=(const FrameQueue &) = delete;
 
+	static constexpr int kMaxCapacity = 5; // should not exceed swapchain BufferCount
+
 	void setPaused(bool paused);
 	bool paused() const {
 		return _paused.load(std::memory_order_acquire);
 	}
+	void wakeWaiters();
 
-	// Internal helpers (must be called with _mutex held)
+	// Producer side
 	int unsafeEnqueue(AVFrame *frame, int frameDropTarget);
 	void pushFrame(AVFrame *frame);
+	AVFrame* popFrameIfFull();
+
+	// Either side
 	AVFrame* popFrame();
-	AVFrame* peekFrame();
 	void dropFrame(AVFrame *frame);
 
-	void enumerateFrames(
-	    const std::function<void(AVFrame *frame, std::size_t idx, bool &stop)> &func) const;
-
 	// Members
 
-	mutable std::mutex _mutex;
-	std::condition_variable _cv;
-
-	std::vector<AVFrame*> _buffer;
-	int _capacity;
-	int _head;
-	int _tail;
-	int _count;
-	bool _droppedLast;
-
-	const int _maxCapacity;
-	int _highWaterMark;
+	std::array<std::atomic<AVFrame *>, kMaxCapacity> _slots{};
+	alignas(64) std::atomic<uint64_t> _head{0};
+	alignas(64) std::atomic<uint64_t> _tail{0};
+	alignas(64) std::atomic<uint32_t> _enqueueSeq{0};
+	bool _droppedLast; // producer only
 
+	std::atomic<int> _highWaterMark;
 	std::atomic<bool> _paused;
+
+	std::shared_ptr<PacerClock> _clock; // accessed with std::atomic_load/atomic_store
 };
@@ -0,0 +1,204 @@
+// clang-format off
+#include "pch.h"
+// clang-format on
+#include "FrameTrace.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <Limelight.h>
+#include "Utils.hpp"
+
+// How far back from the newest present markLanded() looks for the present it was given
+constexpr uint32_t LANDED_SEARCH_DEPTH = 16;
+
+FrameTrace &FrameTrace::instance() {
+	static FrameTrace inst;
+	return inst;
+}
+
+FrameTrace::FrameTrace() {
+}
+
+void FrameTrace::reset() {
+	for (Slot &slot : m_Slots) {
+		slot.id.store(0, std::memory_order_relaxed);
+	}
+	m_LastPresentedId.store(0, std::memory_order_relaxed);
+	m_NextId.store(1, std::memory_order_release);
+}
+
+// Decoder thread
+uint32_t FrameTrace::beginFrame(uint32_t frameNumber, uint32_t rtpTimestamp, uint16_t frameType,
+                                int64_t receiveQpc, int64_t reassembledQpc, int64_t decodeStartQpc) {
+	uint32_t id = m_NextId.fetch_add(1, std::memory_order_relaxed);
+	if (id == 0) {
+		// wrapped, 0 is reserved for untraced frames
+		id = m_NextId.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Invalidate the slot while it is rewritten so late writers for the frame kCapacity ids ago
+	// don't land in the new record
+	Slot &slot = m_Slots[id & (kCapacity - 1)];
+	slot.id.store(0, std::memory_order_relaxed);
+
+	slot.frameNumber.store(frameNumber, std::memory_order_relaxed);
+	slot.rtpTimestamp.store(rtpTimestamp, std::memory_order_relaxed);
+	uint16_t flags = (frameType == FRAME_TYPE_IDR) ? TRACE_FLAG_IDR : 0;
+	slot.typeAndFlags.store(frameType | (uint32_t(flags) << 16), std::memory_order_relaxed);
+	for (auto &t : slot.t) {
+		t.store(0, std::memory_order_relaxed);
+	}
+	slot.t[TRACE_RECEIVE].store(receiveQpc, std::memory_order_relaxed);
+	slot.t[TRACE_REASSEMBLED].store(reassembledQpc, std::memory_order_relaxed);
+	slot.t[TRACE_DECODE_START].store(decodeStartQpc, std::memory_order_relaxed);
+	slot.presentId.store(0, std::memory_order_relaxed);
+	slot.landedRefreshCount.store(0, std::memory_order_relaxed);
+	slot.repeatCount.store(0, std::memory_order_relaxed);
+
+	slot.id.store(id, std::memory_order_release);
+	return id;
+}
+
+FrameTrace::Slot *FrameTrace::slotFor(uint32_t id) {
+	if (!id) {
+		return nullptr;
+	}
+	Slot &slot = m_Slots[id & (kCapacity - 1)];
+	if (slot.id.load(std::memory_order_acquire) != id) {
+		return nullptr;
+	}
+	return &slot;
+}
+
+void FrameTrace::mark(uint32_t id, FrameTraceTime which, int64_t qpc) {
+	Slot *slot = slotFor(id);
+	if (!slot) {
+		return;
+	}
+	int64_t expected = 0;
+	slot->t[which].compare_exchange_strong(expected, qpc, std::memory_order_relaxed);
+}
+
+// Render thread
+void FrameTrace::markPresented(uint32_t id, int64_t renderEndQpc, int64_t targetQpc, int64_t presentQpc, uint32_t presentId) {
+	Slot *slot = slotFor(id);
+	if (!slot) {
+		return;
+	}
+	slot->t[TRACE_RENDER_END].store(renderEndQpc, std::memory_order_relaxed);
+	slot->t[TRACE_PRESENT_TARGET].store(targetQpc, std::memory_order_relaxed);
+	slot->t[TRACE_PRESENT].store(presentQpc, std::memory_order_relaxed);
+	slot->presentId.store(presentId, std::memory_order_relaxed);
+	m_LastPresentedId.store(id, std::memory_order_release);
+}
+
+void FrameTrace::markRepeated(uint32_t id) {
+	Slot *slot = slotFor(id);
+	if (slot) {
+		slot->repeatCount.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+// Vsync thread. Frame statistics only describe the most recent present, which is the one we just
+// made for nearly every vblank since this is polled once per vblank.
+void FrameTrace::markLanded(uint32_t presentId, uint32_t refreshCount, int64_t vsyncQpc) {
+	if (!presentId) {
+		return;
+	}
+
+	uint32_t id = m_LastPresentedId.load(std::memory_order_acquire);
+	for (uint32_t i = 0; i < LANDED_SEARCH_DEPTH && id; ++i, --id) {
+		Slot *slot = slotFor(id);
+		if (!slot) {
+			continue;
+		}
+		uint32_t slotPresentId = slot->presentId.load(std::memory_order_relaxed);
+		if (slotPresentId == presentId) {
+			int64_t expected = 0;
+			if (slot->t[TRACE_LANDED_VSYNC].compare_exchange_strong(expected, vsyncQpc, std::memory_order_relaxed)) {
+				slot->landedRefreshCount.store(refreshCount, std::memory_order_relaxed);
+			}
+			return;
+		}
+		if (slotPresentId && static_cast<int32_t>(presentId - slotPresentId) > 0) {
+			return; // presentId was a repeat present, older frames can't match
+		}
+	}
+}
+
+uint32_t FrameTrace::snapshot(FrameTraceRecord *out, uint32_t maxRecords) const {
+	const uint32_t next = m_NextId.load(std::memory_order_acquire);
+	const uint32_t available = std::min(next - 1, kCapacity);
+	const uint32_t count = std::min(available, maxRecords);
+
+	uint32_t written = 0;
+	for (uint32_t id = next - count; id != next; ++id) {
+		const Slot &slot = m_Slots[id & (kCapacity - 1)];
+		if (slot.id.load(std::memory_order_acquire) != id) {
+			continue; // being rewritten by the decoder thread
+		}
+
+		FrameTraceRecord &r = out[written];
+		memset(&r, 0, sizeof(r));
+		r.id = id;
+		r.frameNumber = slot.frameNumber.load(std::memory_order_relaxed);
+		r.rtpTimestamp = slot.rtpTimestamp.load(std::memory_order_relaxed);
+		uint32_t typeAndFlags = slot.typeAndFlags.load(std::memory_order_relaxed);
+		r.frameType = static_cast<uint16_t>(typeAndFlags & 0xFFFF);
+		r.flags = static_cast<uint16_t>(typeAndFlags >> 16);
+		for (int i = 0; i < TRACE_TIME_COUNT; ++i) {
+			r.t[i] = slot.t[i].load(std::memory_order_relaxed);
+		}
+		r.presentId = slot.presentId.load(std::memory_order_relaxed);
+		r.landedRefreshCount = slot.landedRefreshCount.load(std::memory_order_relaxed);
+		r.repeatCount = slot.repeatCount.load(std::memory_order_relaxed);
+		if (slot.id.load(std::memory_order_acquire) != id) {
+			continue; // overwritten while we were copying it
+		}
+		written++;
+	}
+	return written;
+}
+
+std::wstring FrameTrace::dump() {
+	auto records = std::make_shared<std::vector<FrameTraceRecord>>(kCapacity);
+	uint32_t count = snapshot(records->data(), kCapacity);
+	if (count == 0) {
+		Utils::Log("FrameTrace: nothing to dump\n");
+		return std::wstring();
+	}
+	records->resize(count);
+
+	wchar_t name[64];
+	time_t now = time(nullptr);
+	struct tm local;
+	localtime_s(&local, &now);
+	wcsftime(name, _countof(name), L"\\frametrace-%Y%m%d-%H%M%S.bin", &local);
+	Platform::String ^ folder = Windows::Storage::ApplicationData::Current->LocalFolder->Path;
+	std::wstring path = std::wstring(folder->Data()) + name;
+
+	// Don't block the caller (usually the UI thread) on file I/O
+	Concurrency::create_task([records, path]() {
+		FrameTraceFileHeader header = {};
+		memcpy(header.magic, FRAME_TRACE_MAGIC, sizeof(header.magic));
+		header.version = FRAME_TRACE_VERSION;
+		header.recordSize = sizeof(FrameTraceRecord);
+		header.qpcFreq = QpcFreq();
+		header.recordCount = static_cast<uint32_t>(records->size());
+
+		FILE *f = nullptr;
+		if (_wfopen_s(&f, path.c_str(), L"wb") != 0 || !f) {
+			Utils::Logf("FrameTrace: couldn't open %ls\n", path.c_str());
+			return;
+		}
+		bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+		          fwrite(records->data(), sizeof(FrameTraceRecord), records->size(), f) == records->size();
+		fclose(f);
+
+		Utils::Logf("FrameTrace: %s %u frames to %ls\n", ok ? "wrote" : "failed writing",
+		            header.recordCount, path.c_str());
+	});
+
+	return path;
+}
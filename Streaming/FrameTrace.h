@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "FrameTraceFormat.h"
+
+// Per-frame lifecycle trace.
+//
+// Stats only keeps one second sums, this keeps the timeline of each of the last kCapacity frames
+// so a specific stutter can be explained after the fact. Every stage writes its timestamp into the
+// frame's record: the decoder thread (receive, decode, enqueue), the render thread (dequeue,
+// render, present) and the vsync thread (the vblank the present landed on).
+//
+// The ring is preallocated and the hot path only does relaxed atomic stores, tracing is always on.
+// A frame is identified by the id returned from beginFrame(), which travels with the frame in
+// MLFrameData::traceId. Id 0 means untraced and is ignored by every call.
+
+class FrameTrace {
+  public:
+	static constexpr uint32_t kCapacity = 4096; // power of two, ~68s at 60fps
+
+	// Singleton accessor
+	static FrameTrace &instance();
+
+	// Forget all records, called when a stream starts
+	void reset();
+
+	// Called by the decoder thread once per decode unit, returns the frame's trace id
+	uint32_t beginFrame(uint32_t frameNumber, uint32_t rtpTimestamp, uint16_t frameType,
+	                    int64_t receiveQpc, int64_t reassembledQpc, int64_t decodeStartQpc);
+
+	// Record when a frame reached a stage. The first time wins, so repeated presents of the
+	// same frame don't overwrite its first one.
+	void mark(uint32_t id, FrameTraceTime which, int64_t qpc);
+
+	// Render thread, after Present() of a new frame
+	void markPresented(uint32_t id, int64_t renderEndQpc, int64_t targetQpc, int64_t presentQpc, uint32_t presentId);
+
+	// Render thread, after Present() of a frame that was already presented
+	void markRepeated(uint32_t id);
+
+	// Vsync thread, from DXGI frame statistics: present presentId was displayed at vsyncQpc
+	void markLanded(uint32_t presentId, uint32_t refreshCount, int64_t vsyncQpc);
+
+	// Write the ring to a binary file (see FrameTraceFormat.h) in the app's local folder.
+	// The file is written in the background, returns the path or an empty string if there is nothing to dump.
+	std::wstring dump();
+
+	// Copy the records out, oldest first
+	uint32_t snapshot(FrameTraceRecord *out, uint32_t maxRecords) const;
+
+  private:
+	FrameTrace();
+	FrameTrace(const FrameTrace &) = delete;
+	FrameTrace &operator=(const FrameTrace &) = delete;
+
+	struct Slot {
+		std::atomic<uint32_t> id{0};
+		std::atomic<uint32_t> frameNumber{0};
+		std::atomic<uint32_t> rtpTimestamp{0};
+		std::atomic<uint32_t> typeAndFlags{0};
+		std::array<std::atomic<int64_t>, TRACE_TIME_COUNT> t{};
+		std::atomic<uint32_t> presentId{0};
+		std::atomic<uint32_t> landedRefreshCount{0};
+		std::atomic<uint32_t> repeatCount{0};
+	};
+
+	// Returns the slot for id, or nullptr if the ring has wrapped past it
+	Slot *slotFor(uint32_t id);
+
+	std::array<Slot, kCapacity> m_Slots;
+	std::atomic<uint32_t> m_NextId{1};
+
+	// Newest presented id, markLanded() searches back from here
+	std::atomic<uint32_t> m_LastPresentedId{0};
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+// On-disk layout of a frame trace dump written by FrameTrace::dump().
+//
+// A dump is a FrameTraceFileHeader followed by recordCount FrameTraceRecords, oldest first. Times
+// are raw QPC ticks, divide by qpcFreq for seconds. A time of 0 means the frame never reached
+// that stage (dropped, still in flight when the dump was taken, or unknown).
+//
+// This header has no Windows dependencies, it is shared with the offline converter in
+// Tools/FrameTraceConvert. Bump FRAME_TRACE_VERSION when the layout changes.
+
+#define FRAME_TRACE_MAGIC "MLFTRACE"
+#define FRAME_TRACE_VERSION 1
+
+enum FrameTraceTime {
+	TRACE_RECEIVE = 0,    // first packet of the frame received
+	TRACE_REASSEMBLED,    // frame reassembled and queued for the decoder by moonlight-common-c
+	TRACE_DECODE_START,   // SubmitDecodeUnit entered
+	TRACE_DECODE_END,     // avcodec_receive_frame returned the frame
+	TRACE_QUEUE_ENQUEUE,  // submitted to FrameQueue
+	TRACE_QUEUE_DEQUEUE,  // taken from FrameQueue by Pacer for its first present
+	TRACE_RENDER_START,   // VideoRenderer::Render started
+	TRACE_RENDER_END,     // render loop finished drawing, including overlays
+	TRACE_PRESENT_TARGET, // vblank deadline the render loop aimed for
+	TRACE_PRESENT,        // Present() called
+	TRACE_LANDED_VSYNC,   // vblank the present was actually displayed at, from DXGI frame statistics
+	TRACE_TIME_COUNT
+};
+
+enum FrameTraceFlags : uint16_t {
+	TRACE_FLAG_IDR = 1 << 0,
+};
+
+struct FrameTraceFileHeader {
+	char magic[8];         // FRAME_TRACE_MAGIC, not null terminated
+	uint32_t version;      // FRAME_TRACE_VERSION
+	uint32_t recordSize;   // sizeof(FrameTraceRecord)
+	int64_t qpcFreq;       // QPC ticks per second
+	uint32_t recordCount;
+	uint32_t reserved;
+};
+
+struct FrameTraceRecord {
+	uint32_t id;                 // trace sequence number, increases by one per decode unit
+	uint32_t frameNumber;        // moonlight-common-c frame number, gaps are network losses
+	uint32_t rtpTimestamp;       // host timestamp, 90kHz
+	uint16_t frameType;          // moonlight-common-c FRAME_TYPE_*
+	uint16_t flags;              // FrameTraceFlags
+	int64_t t[TRACE_TIME_COUNT]; // QPC, indexed by FrameTraceTime
+	uint32_t presentId;          // DXGI present count of the first present of this frame
+	uint32_t landedRefreshCount; // DXGI refresh count of TRACE_LANDED_VSYNC
+	uint32_t repeatCount;        // extra presents of this frame (display-locked mode repeats)
+	uint32_t reserved;
+};
+
+static_assert(sizeof(FrameTraceFileHeader) == 32, "frame trace header layout changed");
+static_assert(sizeof(FrameTraceRecord) == 120, "frame trace record layout changed");
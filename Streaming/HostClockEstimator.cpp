@@ -0,0 +1,161 @@
+// Built without the precompiled header, see PacerCore.h
+#include "HostClockEstimator.h"
+#include <algorithm>
+#include <cmath>
+#include "PacingLog.h"
+
+HostClockEstimator::HostClockEstimator()
+    : m_valid(false),
+      m_scale(1.0),
+      m_baseTransitMs(0.0) {
+}
+
+void HostClockEstimator::reset(int64_t qpcFreq) {
+	m_qpcFreq = qpcFreq > 0 ? qpcFreq : 10000000;
+	m_anchorQpc = 0;
+	m_haveLastPts = false;
+	m_ptsUnwrapped = 0;
+	m_bucketCount = 0;
+	m_bucketIdx = 0;
+	m_bucketStartMs = 0.0;
+	m_haveCurrent = false;
+
+	m_valid.store(false, std::memory_order_release);
+	m_scale.store(1.0, std::memory_order_release);
+	m_baseTransitMs.store(0.0, std::memory_order_release);
+}
+
+// Decoder thread only
+bool HostClockEstimator::observe(int64_t pts90k, int64_t arrivalQpc) {
+	if (pts90k == INT64_MIN || !arrivalQpc) {
+		return false;
+	}
+
+	// pts comes from the 32-bit RTP timestamp, unwrap it so host time stays continuous
+	const uint32_t pts32 = static_cast<uint32_t>(pts90k);
+	if (m_haveLastPts) {
+		const int32_t delta = static_cast<int32_t>(pts32 - m_lastPts32);
+		if (delta <= 0 || delta > 10 * 90000) {
+			// reordered, repeated or the host restarted the stream, host time can't be compared across that
+			if (m_bucketCount) {
+				PacingLogf("HostClockEstimator: pts discontinuity (%d ticks), restarting\n", delta);
+			}
+			reset(m_qpcFreq);
+		} else {
+			m_ptsUnwrapped += delta;
+		}
+	}
+	m_lastPts32 = pts32;
+	m_haveLastPts = true;
+	if (!m_anchorQpc) {
+		m_anchorQpc = arrivalQpc;
+	}
+
+	const double hostMs = m_ptsUnwrapped / 90.0;
+	const double localMs = static_cast<double>(arrivalQpc - m_anchorQpc) * 1000.0 / static_cast<double>(m_qpcFreq);
+	const double transitMs = localMs - hostMs;
+
+	// Keep the best case of each bucket, that's the sample with the least network and decode delay
+	if (!m_haveCurrent) {
+		m_bucketStartMs = hostMs;
+		m_current = {hostMs, transitMs};
+		m_haveCurrent = true;
+	} else if (transitMs < m_current.transitMs) {
+		m_current = {hostMs, transitMs};
+	}
+
+	if (hostMs - m_bucketStartMs < BUCKET_MS) {
+		return false;
+	}
+
+	m_buckets[m_bucketIdx] = m_current;
+	m_bucketIdx = (m_bucketIdx + 1) % BUCKETS;
+	m_bucketCount = std::min(m_bucketCount + 1, BUCKETS);
+	m_haveCurrent = false;
+
+	if (m_bucketCount < MIN_BUCKETS) {
+		return false;
+	}
+	fit();
+	return true;
+}
+
+// Least squares line through the bucket minimums, refitted without buckets that sit well above the
+// first line (a whole bucket of congestion)
+void HostClockEstimator::fit() {
+	std::array<bool, BUCKETS> use;
+	use.fill(true);
+
+	double slope = 0.0, intercept = 0.0;
+	for (int pass = 0; pass < 2; ++pass) {
+		// Centered on the mean host time so the sums keep their precision in long sessions
+		int n = 0;
+		double meanX = 0.0, meanY = 0.0;
+		for (int i = 0; i < m_bucketCount; ++i) {
+			if (use[i]) {
+				meanX += m_buckets[i].hostMs;
+				meanY += m_buckets[i].transitMs;
+				n++;
+			}
+		}
+		if (n < MIN_BUCKETS / 2) {
+			return;
+		}
+		meanX /= n;
+		meanY /= n;
+
+		double sxx = 0.0, sxy = 0.0;
+		for (int i = 0; i < m_bucketCount; ++i) {
+			if (use[i]) {
+				const double dx = m_buckets[i].hostMs - meanX;
+				sxx += dx * dx;
+				sxy += dx * (m_buckets[i].transitMs - meanY);
+			}
+		}
+		if (sxx <= 0.0) {
+			return;
+		}
+		slope = sxy / sxx;
+		intercept = meanY - slope * meanX;
+
+		for (int i = 0; i < m_bucketCount; ++i) {
+			use[i] = m_buckets[i].transitMs - (intercept + slope * m_buckets[i].hostMs) < OUTLIER_MS;
+		}
+	}
+
+	if (std::fabs(slope) * 1e6 > MAX_SKEW_PPM) {
+		PacingLogf("HostClockEstimator: implausible skew %.0f ppm, restarting\n", slope * 1e6);
+		reset(m_qpcFreq);
+		return;
+	}
+
+	const bool wasValid = m_valid.load(std::memory_order_relaxed);
+	publish(1.0 + slope, intercept + slope * (m_ptsUnwrapped / 90.0));
+
+	if (!wasValid) {
+		PacingLogf("HostClockEstimator: host clock %+.1f ppm over %d buckets\n", skewPpm(), m_bucketCount);
+	}
+}
+
+void HostClockEstimator::publish(double scale, double baseTransitMs) {
+	m_scale.store(scale, std::memory_order_release);
+	m_baseTransitMs.store(baseTransitMs, std::memory_order_release);
+	m_valid.store(true, std::memory_order_release);
+}
+
+bool HostClockEstimator::valid() const {
+	return m_valid.load(std::memory_order_acquire);
+}
+
+double HostClockEstimator::hostToLocalScale() const {
+	return m_scale.load(std::memory_order_acquire);
+}
+
+double HostClockEstimator::skewPpm() const {
+	const double scale = hostToLocalScale();
+	return scale > 0.0 ? (1.0 / scale - 1.0) * 1e6 : 0.0;
+}
+
+double HostClockEstimator::baseTransitMs() const {
+	return m_baseTransitMs.load(std::memory_order_acquire);
+}
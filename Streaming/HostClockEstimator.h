@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Estimates the host's 90 kHz RTP clock against the local QPC clock.
+//
+// The host and the console run off different crystals, so host time drifts against local time by
+// tens of ppm. Each frame gives a transit sample, local arrival minus host timestamp. Network and
+// decode delays only ever add to transit, so the lowest transit of each BUCKET_MS of host time is
+// kept and a line is fitted through the last BUCKETS minimums. The slope is the skew, the intercept
+// the offset. Memory is fixed at BUCKETS entries.
+//
+// This class has no Windows dependencies so PacerSimulator can drive it.
+// observe() is called by the decoder thread, the accessors are lock-free for other threads.
+
+class HostClockEstimator {
+  public:
+	explicit HostClockEstimator();
+
+	// Call once before use, qpcFreq is the tick rate of the arrival timestamps
+	void reset(int64_t qpcFreq);
+
+	// Called by decoder thread for every decoded frame. Returns true when the estimate was refitted.
+	bool observe(int64_t pts90k, int64_t arrivalQpc);
+
+	// Lock-free accessors
+	bool valid() const;
+
+	// Local ms per host ms, 1.0 until valid(). Above 1.0 the host clock runs slow.
+	double hostToLocalScale() const;
+
+	// Host clock error in ppm, positive means the host runs fast, same sign as PacerSimConfig::hostClockPpm
+	double skewPpm() const;
+
+	// Best-case transit the fit predicts for the latest frame, relative to the first frame's transit
+	double baseTransitMs() const;
+
+  private:
+	static constexpr double BUCKET_MS = 1000.0; // host time covered by each minimum
+	static constexpr int BUCKETS = 64;
+	static constexpr int MIN_BUCKETS = 8;         // buckets needed before the estimate is used
+	static constexpr double OUTLIER_MS = 1.0;     // bucket minimums this far above the first fit are left out
+	static constexpr double MAX_SKEW_PPM = 1000.0; // anything larger is a discontinuity, not drift
+
+	struct Bucket {
+		double hostMs;    // host time of the minimum, relative to the first frame
+		double transitMs; // minimum transit in the bucket
+	};
+
+	void fit();
+	void publish(double scale, double baseTransitMs);
+
+	// Decoder-thread owned state
+	int64_t m_qpcFreq = 10000000;
+	int64_t m_anchorQpc = 0; // arrival of the first frame, times are kept in ms relative to it
+	uint32_t m_lastPts32 = 0;
+	int64_t m_ptsUnwrapped = 0;
+	bool m_haveLastPts = false;
+
+	std::array<Bucket, BUCKETS> m_buckets{};
+	int m_bucketCount = 0;
+	int m_bucketIdx = 0;
+	double m_bucketStartMs = 0.0;
+	Bucket m_current{};
+	bool m_haveCurrent = false;
+
+	// Published values
+	std::atomic<bool> m_valid;
+	std::atomic<double> m_scale;
+	std::atomic<double> m_baseTransitMs;
+};
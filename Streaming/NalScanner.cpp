@@ -0,0 +1,156 @@
+// Built without the precompiled header, see NalScanner.h
+#include "NalScanner.h"
+#include <algorithm>
+#include <iterator>
+#include "third_party/h264bitstream/bs.h"
+
+// Enough RBSP for every header field read here, the HEVC level sits at byte 12 of the SPS
+#define HEADER_RBSP_BYTES 32
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+enum ParamSetKind { PARAM_VPS, PARAM_SPS, PARAM_PPS, PARAM_NONE };
+
+// First byte after the next 00 00 01, or end
+static const uint8_t *findStartCode(const uint8_t *p, const uint8_t *end) {
+	while (end - p >= 3) {
+		if (p[2] > 1) {
+			p += 3;
+		} else if (p[2] == 0) {
+			p++;
+		} else if (p[0] == 0 && p[1] == 0) {
+			return p + 3;
+		} else {
+			p += 3;
+		}
+	}
+	return end;
+}
+
+// Strips emulation prevention bytes from the start of a NAL unit, returns the RBSP length
+static size_t unescapeHeader(const uint8_t *nal, size_t size, uint8_t *rbsp, size_t capacity) {
+	size_t out = 0;
+	int zeroes = 0;
+	for (size_t i = 0; i < size && out < capacity; i++) {
+		if (zeroes >= 2 && nal[i] == 3) {
+			zeroes = 0;
+			continue;
+		}
+		zeroes = nal[i] == 0 ? zeroes + 1 : 0;
+		rbsp[out++] = nal[i];
+	}
+	return out;
+}
+
+static uint64_t fnv1a(uint64_t hash, const uint8_t *p, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ p[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+void NalScanner::reset(Codec codec) {
+	m_codec = codec;
+	std::fill(std::begin(m_paramSetHash), std::end(m_paramSetHash), 0);
+	m_maxSubLayers = 1;
+}
+
+void NalScanner::parseSps(const uint8_t *nal, size_t size, NalFrameInfo &info) {
+	const size_t headerSize = m_codec == Codec::HEVC ? 2 : 1;
+	if (size <= headerSize) {
+		return;
+	}
+
+	uint8_t rbsp[HEADER_RBSP_BYTES];
+	bs_t b;
+	bs_init(&b, rbsp, unescapeHeader(nal + headerSize, size - headerSize, rbsp, sizeof(rbsp)));
+
+	if (m_codec == Codec::H264) {
+		info.profile = static_cast<uint8_t>(bs_read_u8(&b));
+		bs_skip_u(&b, 8); // constraint_set flags
+		info.level = static_cast<uint8_t>(bs_read_u8(&b));
+		return;
+	}
+
+	bs_skip_u(&b, 4); // sps_video_parameter_set_id
+	m_maxSubLayers = static_cast<int>(bs_read_u(&b, 3)) + 1;
+	bs_skip_u(&b, 1 + 2 + 1); // temporal_id_nesting, general_profile_space, general_tier_flag
+	info.profile = static_cast<uint8_t>(bs_read_u(&b, 5));
+	bs_skip_u(&b, 32 + 48); // compatibility and constraint flags
+	info.level = static_cast<uint8_t>(bs_read_u8(&b));
+}
+
+NalFrameInfo NalScanner::scan(const uint8_t *data, size_t size) {
+	NalFrameInfo info;
+	if (m_codec == Codec::None || !data) {
+		return info;
+	}
+
+	const uint8_t *end = data + size;
+	const uint8_t *nal = findStartCode(data, end);
+	const uint8_t *sps = nullptr;
+	size_t spsSize = 0;
+	uint64_t hash[3] = {};
+
+	while (nal < end) {
+		info.nalCount++;
+
+		int kind = PARAM_NONE;
+		if (m_codec == Codec::H264) {
+			const int type = nal[0] & 0x1f;
+			const int refIdc = (nal[0] >> 5) & 0x03;
+			if (type >= 1 && type <= 5) {
+				info.firstSliceType = static_cast<uint8_t>(type);
+				info.frameClass = type == 5 ? NAL_FRAME_IDR : refIdc ? NAL_FRAME_REFERENCE : NAL_FRAME_NON_REFERENCE;
+				break;
+			}
+			kind = type == 7 ? PARAM_SPS : type == 8 ? PARAM_PPS : PARAM_NONE;
+		} else if (end - nal >= 2) {
+			const int type = (nal[0] >> 1) & 0x3f;
+			const int temporalId = (nal[1] & 0x07) - 1;
+			if (type < 32) {
+				info.firstSliceType = static_cast<uint8_t>(type);
+				if (type >= 16 && type <= 23) {
+					info.frameClass = NAL_FRAME_IDR;
+				} else if (type <= 14 && (type & 1) == 0 && temporalId == m_maxSubLayers - 1) {
+					// Sub-layer non-reference, and there is no higher sub-layer that could still use it
+					info.frameClass = NAL_FRAME_NON_REFERENCE;
+				} else {
+					info.frameClass = NAL_FRAME_REFERENCE;
+				}
+				break;
+			}
+			kind = type == 32 ? PARAM_VPS : type == 33 ? PARAM_SPS : type == 34 ? PARAM_PPS : PARAM_NONE;
+		}
+
+		const uint8_t *next = findStartCode(nal, end);
+		if (kind != PARAM_NONE) {
+			// Ends at the next start code, without its leading zero and any trailing_zero_8bits
+			const uint8_t *nalEnd = next < end ? next - 3 : end;
+			while (nalEnd > nal && nalEnd[-1] == 0) {
+				nalEnd--;
+			}
+			const size_t nalSize = static_cast<size_t>(nalEnd - nal);
+
+			// Several sets of one kind (e.g. PPS ids) are hashed together
+			hash[kind] = fnv1a(hash[kind] ? hash[kind] : FNV_OFFSET, nal, nalSize);
+			if (kind == PARAM_SPS && !sps) {
+				sps = nal;
+				spsSize = nalSize;
+			}
+		}
+		nal = next;
+	}
+
+	for (int kind = PARAM_VPS; kind < PARAM_NONE; kind++) {
+		if (hash[kind] && hash[kind] != m_paramSetHash[kind]) {
+			m_paramSetHash[kind] = hash[kind];
+			info.changedParamSets |= static_cast<uint8_t>(1 << kind);
+		}
+	}
+	if ((info.changedParamSets & NAL_CHANGED_SPS) && sps) {
+		parseSps(sps, spsSize, info);
+	}
+	return info;
+}
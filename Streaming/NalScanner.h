@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// What a decode unit is, as far as the NAL unit headers can tell. Stored in MLFrameData, 0 means AV1 or a
+// unit without slices.
+enum NalFrameClass : uint8_t {
+	NAL_FRAME_UNKNOWN = 0,
+	NAL_FRAME_IDR,           // H.264 IDR, HEVC IRAP (IDR/CRA/BLA)
+	NAL_FRAME_REFERENCE,     // later frames may predict from it
+	NAL_FRAME_NON_REFERENCE, // nothing predicts from it, H.264 nal_ref_idc 0 or an HEVC *_N picture
+};
+
+// Parameter sets in the unit that differ from the last ones of the same type, or are the first ones seen
+enum NalParamSetFlags : uint8_t {
+	NAL_CHANGED_VPS = 1 << 0,
+	NAL_CHANGED_SPS = 1 << 1,
+	NAL_CHANGED_PPS = 1 << 2,
+};
+
+struct NalFrameInfo {
+	NalFrameClass frameClass = NAL_FRAME_UNKNOWN;
+	uint8_t changedParamSets = 0; // NAL_CHANGED_*
+	uint8_t firstSliceType = 0;   // nal_unit_type of the first slice
+	uint16_t nalCount = 0;        // NAL units seen up to and including the first slice
+	uint8_t profile = 0;          // profile_idc and level_idc of the SPS, only set with NAL_CHANGED_SPS
+	uint8_t level = 0;
+};
+
+// Classifies H.264 and HEVC access units from their NAL unit headers without decoding them.
+//
+// Only the Annex-B start codes up to the first slice are looked at, which is where the host puts its
+// parameter sets, so the cost does not grow with the frame size. Parameter sets are remembered as a hash of
+// their payload; a change means the host reconfigured the encoder (resolution, profile, HDR). The few
+// header fields needed are read with h264bitstream's bs_t.
+//
+// No Windows dependencies, the file builds without the precompiled header and Tools/DecodeBench classifies
+// units with it. Decoder thread only.
+
+class NalScanner {
+  public:
+	enum class Codec {
+		None, // AV1, units are not scanned
+		H264,
+		HEVC,
+	};
+
+	void reset(Codec codec);
+
+	// data/size is one complete access unit in Annex-B format
+	NalFrameInfo scan(const uint8_t *data, size_t size);
+
+	Codec codec() const {
+		return m_codec;
+	}
+
+  private:
+	// Reads profile and level, and for HEVC the number of temporal sub-layers
+	void parseSps(const uint8_t *nal, size_t size, NalFrameInfo &info);
+
+	Codec m_codec = Codec::None;
+	uint64_t m_paramSetHash[3] = {}; // VPS, SPS, PPS, 0 until seen
+	int m_maxSubLayers = 1;          // HEVC, only pictures in the highest sub-layer can be non-reference
+};
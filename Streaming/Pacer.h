@@ -5,7 +5,7 @@
 #include <set>
 #include <thread>
 #include <utility>
-#include "FrameCadence.h"
+#include "PacerCore.h"
 #include "Utils.hpp"
 #include "VideoRenderer.h"
 #include "..\Common\DirectXHelper.h"
@@ -18,19 +18,24 @@ namespace DX {
     class GpuPerformanceTimer;
 }
 
-class Pacer {
+class Pacer : private PacerCoreObserver {
   public:
 	// Singleton accessor
 	static Pacer &instance();
 
 	void deinit();
-	void init(const std::shared_ptr<DX::DeviceResources> &res, int maxVideoFps, double refreshRate, bool framePacingImmediate);
-	bool getPacingImmediate();
-	void setPacingImmediate(bool framePacingImmediate);
+	void init(const std::shared_ptr<DX::DeviceResources> &res, int maxVideoFps, double refreshRate, PacingMode pacingMode, double latencyBudgetMs);
+	PacingMode getPacingMode();
+	void setPacingMode(PacingMode pacingMode);
+	double getLatencyBudgetMs();
+	static const char *pacingModeName(PacingMode pacingMode);
+	const FrameCadence &getFrameCadence() const { return m_Core.getFrameCadence(); }
+	const HostClockEstimator &getHostClock() const { return m_Core.getHostClock(); }
 	void waitForFrame(double timeoutMs);
 	bool renderOnMainThread(std::shared_ptr<moonlight_xbox_dx::VideoRenderer> &sceneRenderer);
 	bool waitBeforePresent(int64_t deadline);
 	int64_t getCurrentFramePts();
+	uint32_t getCurrentFrameTraceId();
 	int64_t getNextVBlankQpc(int64_t *now);
 	void submitFrame(AVFrame *frame);
 
@@ -51,32 +56,16 @@ class Pacer {
 		return m_Running.load(std::memory_order_acquire);
 	}
 
-	bool renderModeImmediate(std::shared_ptr<moonlight_xbox_dx::VideoRenderer> &sceneRenderer);
-	bool renderModeDisplayLocked(std::shared_ptr<moonlight_xbox_dx::VideoRenderer> &sceneRenderer);
 	void vsyncHardware();
-	void updateFrameStats();
 
-	std::shared_ptr<DX::DeviceResources> m_DeviceResources;
+	// PacerCoreObserver
+	void pacerDroppedFrame() override;
+	void latencyBudgetFrame(bool met, double latencyMs) override;
+	void presentLanded(uint32_t presentCount, uint32_t presentRefreshCount, int64_t vblankQpc) override;
+
+	PacerCore m_Core;
 	std::thread m_VsyncThread;
 	std::atomic<bool> m_Running{false};
 	std::atomic<bool> m_Stopping{false};
-	int m_StreamFps;
-	double m_RefreshRate;
-	std::atomic<bool> m_FramePacingImmediate;
 	std::unique_ptr<DX::GpuPerformanceTimer> m_GpuPerformanceTimer;
-
-	FrameCadence m_FrameCadence;
-	AVFrame* m_CurrentFrame = nullptr;
-
-	static constexpr int VSYNC_HISTORY_SIZE = 512;
-	std::mutex m_FrameStatsLock;
-	UINT m_LastSyncRefreshCount;
-	int64_t m_LastSyncQpc;
-	int64_t m_VsyncIntervalQpc;
-	std::array<int64_t, VSYNC_HISTORY_SIZE> m_vhistory{};
-	int m_vhcount = 0;
-	int m_vhidx = 0;
-	int64_t m_vhsum = 0;
-	std::atomic<int64_t> m_LastSyncTarget{0};
-	double m_ewmaVsyncDriftQpc = 1;
 };
@@ -0,0 +1,64 @@
+// clang-format off
+#include "pch.h"
+// clang-format on
+#include "PacerClock.h"
+#include <cstdarg>
+#include <cstdio>
+#include "..\Common\DeviceResources.h"
+#include "PacingLog.h"
+#include "Utils.hpp"
+
+// The app's end of PacingLog.h
+void PacingLogf(const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+
+	char buf[1024];
+	std::vsnprintf(buf, sizeof(buf) - 1, fmt, args);
+	va_end(args);
+
+	moonlight_xbox_dx::Utils::Log(std::string_view(buf));
+}
+
+DxgiPacerClock::DxgiPacerClock(const std::shared_ptr<DX::DeviceResources> &res)
+    : m_DeviceResources(res) {
+}
+
+int64_t DxgiPacerClock::frequency() {
+	return QpcFreq();
+}
+
+int64_t DxgiPacerClock::now() {
+	return QpcNow();
+}
+
+void DxgiPacerClock::sleepUntil(int64_t targetQpc) {
+	SleepUntilQpc(targetQpc);
+}
+
+bool DxgiPacerClock::waitForVBlank() {
+	if (!m_DeviceResources || !m_DeviceResources->GetDXGIOutput()) {
+		return false;
+	}
+	return SUCCEEDED(m_DeviceResources->GetDXGIOutput()->WaitForVBlank());
+}
+
+// based on mpv's d3d11_get_vsync()
+bool DxgiPacerClock::getFrameStatistics(PacerFrameStatistics &stats) {
+	if (!m_DeviceResources || !m_DeviceResources->GetSwapChain()) {
+		return false;
+	}
+
+	// After we've presented a couple of frames, we can obtain the true vsync interval
+	DXGI_FRAME_STATISTICS dxgiStats;
+	if (m_DeviceResources->GetSwapChain()->GetFrameStatistics(&dxgiStats) != S_OK ||
+	    (dxgiStats.SyncRefreshCount == 0 && dxgiStats.SyncQPCTime.QuadPart == 0ULL)) {
+		return false;
+	}
+
+	stats.syncRefreshCount = dxgiStats.SyncRefreshCount;
+	stats.syncQpc = dxgiStats.SyncQPCTime.QuadPart;
+	stats.presentCount = dxgiStats.PresentCount;
+	stats.presentRefreshCount = dxgiStats.PresentRefreshCount;
+	return true;
+}
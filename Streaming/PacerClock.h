@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+namespace DX {
+	class DeviceResources;
+}
+
+// Time and vsync source used by PacerCore and FrameQueue.
+//
+// The live implementation (DxgiPacerClock) reads QPC and the swapchain's frame statistics.
+// PacerSimulator substitutes a virtual clock so pacing behavior can be measured deterministically
+// without a display attached.
+//
+// All times are in ticks of frequency(), QPC ticks in the app.
+
+// Equivalent to the DXGI_FRAME_STATISTICS fields Pacer uses
+struct PacerFrameStatistics {
+	uint32_t syncRefreshCount = 0;    // most recent vblank known to the display
+	int64_t syncQpc = 0;              // time of that vblank
+	uint32_t presentCount = 0;        // Present() the statistics describe, 0 if unknown
+	uint32_t presentRefreshCount = 0; // vblank that present was displayed at
+};
+
+class PacerClock {
+  public:
+	virtual ~PacerClock() = default;
+
+	// Ticks per second
+	virtual int64_t frequency() = 0;
+
+	// Current time
+	virtual int64_t now() = 0;
+
+	// Block the calling thread until targetQpc
+	virtual void sleepUntil(int64_t targetQpc) = 0;
+
+	// Block until the next vblank. Returns false if no vblank source is available.
+	virtual bool waitForVBlank() = 0;
+
+	// Most recent vblank known to the display and the last displayed present.
+	// Returns false when no statistics are available yet.
+	virtual bool getFrameStatistics(PacerFrameStatistics &stats) = 0;
+};
+
+class DxgiPacerClock : public PacerClock {
+  public:
+	explicit DxgiPacerClock(const std::shared_ptr<DX::DeviceResources> &res);
+
+	int64_t frequency() override;
+	int64_t now() override;
+	void sleepUntil(int64_t targetQpc) override;
+	bool waitForVBlank() override;
+	bool getFrameStatistics(PacerFrameStatistics &stats) override;
+
+  private:
+	std::shared_ptr<DX::DeviceResources> m_DeviceResources;
+};
@@ -0,0 +1,459 @@
+// Built without the precompiled header, see PacerCore.h
+#include "PacerCore.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "FrameData.h"
+#include "FramePool.h"
+#include "FrameQueue.h"
+#include "PacingLog.h"
+
+// Default depths, the high water mark adapts at runtime and the catch-up depth follows it
+constexpr int FRAME_QUEUE_LOW = 1;
+constexpr int FRAME_QUEUE_HIGH = 3;
+
+PacerCore::PacerCore(const std::shared_ptr<PacerClock> &clock)
+    : m_Clock(clock),
+      m_QpcFreq(clock->frequency()) {
+}
+
+void PacerCore::init(const std::shared_ptr<PacerClock> &clock, PacerCoreObserver *observer, int streamFps, double refreshRate,
+                     PacingMode pacingMode, double latencyBudgetMs, bool xbox) {
+	assert(clock->frequency() == m_QpcFreq);
+	std::atomic_store(&m_Clock, clock);
+	m_Observer = observer;
+	m_StreamFps = streamFps;
+	m_RefreshRate = refreshRate;
+	m_Xbox = xbox;
+	m_PacingMode.store(pacingMode, std::memory_order_release);
+	m_LatencyBudgetMs.store(latencyBudgetMs > 0.0 ? latencyBudgetMs : 8.0, std::memory_order_release);
+	m_RepeatCount = 0;
+	m_PresentTargetQpc = 0;
+	m_PresentIntervalQpc = 0;
+
+	m_FrameCadence.init(m_RefreshRate > 0.0 ? m_RefreshRate : 60.0, static_cast<double>(streamFps));
+	m_QueueDepth.init(m_QpcFreq, static_cast<double>(streamFps), 1, FrameQueue::instance().maxCapacity(), FRAME_QUEUE_HIGH);
+	m_HostClock.reset(m_QpcFreq);
+
+	PacingLogf("Frame Pacer init: mode %s, latency budget %.1fms, streamFps %d, refreshRate %.2f\n",
+	           pacingModeName(pacingMode), m_LatencyBudgetMs.load(), m_StreamFps, m_RefreshRate);
+
+	{
+		std::scoped_lock<std::mutex> lock(m_FrameStatsLock);
+		m_VsyncTracker.reset(m_QpcFreq, nominalVsyncHz());
+		m_PresentSlots.configure(m_RefreshRate, static_cast<double>(streamFps));
+		m_PresentSlotCount = 1;
+		m_LoggedStartup = false;
+		m_LastSyncRefreshCount = 0;
+		m_LastSyncQpc = 0;
+		m_VsyncIntervalQpc = 0;
+	}
+
+	// Start FrameQueue so it's ready to receive new frames
+	FrameQueue::instance().setClock(clock);
+	FrameQueue::instance().setHighWaterMark(m_QueueDepth.depth());
+	FrameQueue::instance().start();
+}
+
+void PacerCore::deinit(const std::shared_ptr<PacerClock> &idleClock) {
+	// Stop and clear out FrameQueue
+	FrameQueue::instance().stop();
+
+	FramePool::instance().release(&m_CurrentFrame);
+	FramePool::instance().release(&m_HeldFrame);
+
+	assert(idleClock->frequency() == m_QpcFreq);
+	std::atomic_store(&m_Clock, idleClock);
+
+	std::scoped_lock<std::mutex> lock(m_FrameStatsLock);
+	m_LastSyncQpc = 0;
+	m_VsyncIntervalQpc = 0;
+}
+
+PacingMode PacerCore::getPacingMode() const {
+	return m_PacingMode.load(std::memory_order_acquire);
+}
+
+void PacerCore::setPacingMode(PacingMode pacingMode) {
+	m_PacingMode.store(pacingMode, std::memory_order_release);
+}
+
+double PacerCore::getLatencyBudgetMs() const {
+	return m_LatencyBudgetMs.load(std::memory_order_acquire);
+}
+
+double PacerCore::getVsyncPeriodMs() {
+	std::scoped_lock<std::mutex> lock(m_FrameStatsLock);
+	return qpcToMs(m_VsyncIntervalQpc);
+}
+
+const char *PacerCore::pacingModeName(PacingMode pacingMode) {
+	switch (pacingMode) {
+	case PacingMode::Immediate:
+		return "immediate";
+	case PacingMode::DisplayLocked:
+		return "display-locked";
+	case PacingMode::LatencyBudget:
+		return "latency budget";
+	}
+	return "unknown";
+}
+
+int64_t PacerCore::msToQpc(double ms) const {
+	const double qpc = ms * static_cast<double>(m_QpcFreq) / 1000.0;
+	return static_cast<int64_t>(qpc >= 0.0 ? qpc + 0.5 : qpc - 0.5);
+}
+
+double PacerCore::qpcToMs(int64_t qpc) const {
+	return static_cast<double>(qpc) * 1000.0 / static_cast<double>(m_QpcFreq);
+}
+
+// Best guess at the real vblank rate before any frame statistics are available
+double PacerCore::nominalVsyncHz() const {
+	double vsyncRR = m_RefreshRate > 0.0 ? m_RefreshRate : 60.0;
+
+	if (m_Xbox) {
+		if (vsyncRR >= 120.0) {
+			vsyncRR = 60.0;
+		} else if (vsyncRR >= 119.0) {
+			vsyncRR = 59.94;
+		} else if (vsyncRR >= 60.0) {
+			vsyncRR = 60.0;
+		} else if (vsyncRR >= 59.0) {
+			vsyncRR = 59.94;
+		}
+	}
+
+	return vsyncRR;
+}
+
+// based on mpv's d3d11_get_vsync()
+void PacerCore::updateFrameStats() {
+	std::scoped_lock<std::mutex> lock(m_FrameStatsLock);
+
+	const std::shared_ptr<PacerClock> clock = this->clock();
+	PacerFrameStatistics frameStats;
+	if (clock->getFrameStatistics(frameStats)) {
+		const uint32_t syncRefreshCount = frameStats.syncRefreshCount;
+		const int64_t syncQpc = frameStats.syncQpc;
+		if (syncRefreshCount == m_LastSyncRefreshCount && m_VsyncTracker.hasEstimate()) {
+			return; // no new vblank since last time
+		}
+		m_LastSyncRefreshCount = syncRefreshCount;
+
+		VsyncTracker::Result result = m_VsyncTracker.observe(syncRefreshCount, syncQpc);
+		if (result == VsyncTracker::Result::Reset) {
+			PacingLogf("updateFrameStats(): vsync timing changed, relocking at %.3fms\n", qpcToMs(m_VsyncTracker.periodQpc()));
+		}
+
+		// Publish the filtered estimate, phase is the predicted time of the vblank we just sampled
+		m_LastSyncQpc = m_VsyncTracker.lastVBlankQpc();
+		m_VsyncIntervalQpc = m_VsyncTracker.periodQpc();
+
+		// The last displayed present, usually the one made for the previous vblank
+		if (frameStats.presentCount && m_Observer) {
+			const int32_t refreshDelta = static_cast<int32_t>(frameStats.presentRefreshCount - syncRefreshCount);
+			m_Observer->presentLanded(frameStats.presentCount, frameStats.presentRefreshCount,
+			                          syncQpc + refreshDelta * m_VsyncIntervalQpc);
+		}
+
+		FQLog("updateFrameStats(): %s SyncQpc %lld, filtered %lld (%+.3fms), interval %.4fms (%.3f Hz) +/- %.4fms, phase +/- %.4fms\n",
+		      result == VsyncTracker::Result::Rejected ? "rejected" : "accepted",
+		      syncQpc, m_LastSyncQpc, qpcToMs(m_LastSyncQpc - syncQpc),
+		      qpcToMs(m_VsyncIntervalQpc), 1000.0 / qpcToMs(m_VsyncIntervalQpc),
+		      m_VsyncTracker.periodStdDevMs(), m_VsyncTracker.phaseStdDevMs());
+	} else if (!m_VsyncTracker.hasEstimate()) {
+		// We have a chicken and the egg problem here in that no frame stats are available before presenting real frames,
+		// so we need to fake some numbers early on so Pacer can at least limp through a few frames.
+		double vsyncRR = nominalVsyncHz();
+
+		m_LastSyncQpc = clock->now();
+		m_VsyncIntervalQpc = msToQpc(1000.0 / vsyncRR);
+
+		if (!m_LoggedStartup) {
+			PacingLogf("vsyncHardware(): starting up with interval %.2f based on system rate %.2f\n", vsyncRR, m_RefreshRate);
+			m_LoggedStartup = true;
+		}
+	}
+}
+
+// Updates m_CurrentFrame according to the pacing mode, returns true if it should be rendered
+bool PacerCore::selectFrameForPresent() {
+	const PacingMode mode = m_PacingMode.load(std::memory_order_acquire);
+
+	if (m_HeldFrame && mode != PacingMode::LatencyBudget) {
+		// Mode was switched while latency budget mode was holding a frame, newer frames are queued behind it
+		FramePool::instance().release(&m_HeldFrame);
+	}
+
+	switch (mode) {
+	case PacingMode::DisplayLocked:
+		return selectFrameDisplayLocked();
+	case PacingMode::LatencyBudget:
+		return selectFrameLatencyBudget();
+	case PacingMode::Immediate:
+	default:
+		return selectFrameImmediate();
+	}
+}
+
+// Dequeue a new frame if available and immediately render it. When no new frame is available
+// skips Present and relies on the system to continue showing the previous frame.
+// Pros: lowest latency, output framerate matches input framerate
+// Cons: only works well on Xbox Series for some reason
+bool PacerCore::selectFrameImmediate() {
+	AVFrame *newFrame = FrameQueue::instance().dequeue();
+	if (!newFrame) {
+		return false;
+	}
+
+	// if we're a frame behind, catch up
+	int queueDepth = FrameQueue::instance().count();
+	if (queueDepth > catchUpDepth()) {
+		AVFrame *newFrame2 = FrameQueue::instance().dequeue();
+		if (newFrame2) {
+			FramePool::instance().release(&newFrame);
+			newFrame = newFrame2;
+			if (m_Observer) {
+				m_Observer->pacerDroppedFrame();
+			}
+		}
+	}
+
+	if (m_CurrentFrame) {
+		FramePool::instance().release(&m_CurrentFrame);
+	}
+	m_CurrentFrame = newFrame;
+
+	FQLog("> Frame rendered [pts: %.3f] [%.2ffps] [%.2fhz] [queued %d]\n",
+	      m_CurrentFrame->pts / 90.0, m_FrameCadence.streamFps(), m_FrameCadence.displayHz(), (int)FrameQueue::instance().count());
+
+	return true;
+}
+
+// Attempt to pace rendering based on observed framerate from host pts data
+// Pros: always presents at max refresh rate, using either a new frame or a cached previous frame
+//       Prevents most artifacts/tearing on Xbox One.
+//       May do a better job with e.g. 24fps needing 3:2 pulldown
+// Cons: higher latency
+//       more difficult to control queue size, requires additional frame drop logic
+bool PacerCore::selectFrameDisplayLocked() {
+	// Consume frame(s) according to cadence
+	const int cadenceCount = m_FrameCadence.decideAdvanceCount();
+	int advanceCount = cadenceCount;
+
+	// if the queue has too many frames in it, break the cadence and render or drop one extra
+	int queueDepth = FrameQueue::instance().count();
+	if (queueDepth > catchUpDepth()) {
+		advanceCount++;
+		m_FrameCadence.notePatternBreak();
+	}
+
+	for (int i = 0; i < advanceCount; ++i) {
+		AVFrame *newFrame = FrameQueue::instance().dequeue();
+		if (!newFrame) {
+			if (i < cadenceCount && m_CurrentFrame) {
+				// the cadence wanted a new frame but the queue ran dry
+				m_FrameCadence.notePatternBreak();
+			}
+			break;
+		}
+
+		if (m_CurrentFrame) {
+			if (i > 0 && m_Observer) {
+				// advanceCount was > 1, so this is a dropped frame
+				m_Observer->pacerDroppedFrame();
+			}
+			FramePool::instance().release(&m_CurrentFrame);
+		}
+		m_CurrentFrame = newFrame;
+	}
+
+	if (!m_CurrentFrame) {
+		// No frame available yet
+		return false;
+	}
+
+	FQLog("> Frame rendered [pts: %.3f] [%.2ffps] [%.2fhz] [advanceCount %d] [cadence %s] [queued %d]\n",
+	      m_CurrentFrame->pts / 90.0, m_FrameCadence.streamFps(), m_FrameCadence.displayHz(),
+	      advanceCount, m_FrameCadence.patternName().c_str(), queueDepth);
+
+	return true;
+}
+
+// Estimated decode-to-photon latency if frame is presented for the vblank at targetQpc. The present is
+// issued at the vblank and scanned out one interval later.
+static int64_t photonLatencyQpc(AVFrame *frame, int64_t targetQpc, int64_t intervalQpc) {
+	if (!frame->opaque_ref) {
+		return 0;
+	}
+	auto *data = reinterpret_cast<MLFrameData *>(frame->opaque_ref->data);
+	return targetQpc + intervalQpc - data->decodeEndQpc;
+}
+
+// Choose the frame and vblank that meet the user's decode-to-photon latency budget with the fewest repeats.
+//  * frames that can no longer make the budget are skipped when a newer frame is queued
+//  * when the stream is slower than the display, a new frame may be held back one vblank so each frame
+//    gets its fair share of vblanks, but only if it still meets the budget one vblank later. The current
+//    frame is presented again meanwhile.
+// Pros: latency is bounded by a number the user picked, smoother than immediate when the budget allows
+// Cons: depends on accurate vsync timing, a budget below one refresh interval can't be met
+bool PacerCore::selectFrameLatencyBudget() {
+	const int64_t targetQpc = m_PresentTargetQpc;
+	const int64_t intervalQpc = m_PresentIntervalQpc;
+	if (!targetQpc || !intervalQpc) {
+		// No vsync timing yet
+		return selectFrameImmediate();
+	}
+
+	const int64_t budgetQpc = msToQpc(m_LatencyBudgetMs.load(std::memory_order_acquire));
+	FrameQueue &queue = FrameQueue::instance();
+
+	AVFrame *frame = m_HeldFrame;
+	m_HeldFrame = nullptr;
+	if (!frame) {
+		frame = queue.dequeue();
+	}
+	if (!frame) {
+		// Nothing new, present the current frame again like display-locked mode
+		m_RepeatCount++;
+		return m_CurrentFrame != nullptr;
+	}
+
+	// Skip frames that would miss the budget if something newer is available
+	while (queue.count() > 0 && photonLatencyQpc(frame, targetQpc, intervalQpc) > budgetQpc) {
+		AVFrame *newer = queue.dequeue();
+		if (!newer) {
+			break;
+		}
+		FramePool::instance().release(&frame);
+		frame = newer;
+		if (m_Observer) {
+			m_Observer->pacerDroppedFrame();
+		}
+	}
+
+	// Hold the frame for the next-but-one vblank if the current frame hasn't had its share of vblanks yet
+	const double vblanksPerFrame = m_FrameCadence.streamPeriodMs() / m_FrameCadence.displayPeriodMs();
+	const int fairShare = std::max(1, static_cast<int>(std::lround(vblanksPerFrame)));
+	if (m_CurrentFrame && queue.count() == 0 && m_RepeatCount + 1 < fairShare &&
+	    photonLatencyQpc(frame, targetQpc + intervalQpc, intervalQpc) <= budgetQpc) {
+		m_HeldFrame = frame;
+		m_RepeatCount++;
+		FQLog("> Frame held [pts: %.3f] [repeat %d of %d]\n", frame->pts / 90.0, m_RepeatCount, fairShare);
+		return true; // present the current frame again, skipping Present() corrupts the picture on Xbox One
+	}
+
+	const int64_t latencyQpc = photonLatencyQpc(frame, targetQpc, intervalQpc);
+	if (frame->opaque_ref) {
+		auto *data = reinterpret_cast<MLFrameData *>(frame->opaque_ref->data);
+		data->presentTargetQpc = targetQpc;
+		data->presentVsyncQpc = targetQpc + intervalQpc;
+		if (m_Observer) {
+			m_Observer->latencyBudgetFrame(latencyQpc <= budgetQpc, qpcToMs(latencyQpc));
+		}
+	}
+
+	if (m_CurrentFrame) {
+		FramePool::instance().release(&m_CurrentFrame);
+	}
+	m_CurrentFrame = frame;
+	m_RepeatCount = 0;
+
+	FQLog("> Frame rendered [pts: %.3f] [latency %.2fms of %.2fms] [queued %d]\n",
+	      m_CurrentFrame->pts / 90.0, qpcToMs(latencyQpc), qpcToMs(budgetQpc), (int)queue.count());
+
+	return true;
+}
+
+// Frames we let sit in the queue before catching up, keeps the default spacing between the
+// catch-up depth and the high water mark as the high water mark adapts
+int PacerCore::catchUpDepth() const {
+	return std::max(FRAME_QUEUE_LOW, m_QueueDepth.depth() - (FRAME_QUEUE_HIGH - FRAME_QUEUE_LOW));
+}
+
+// called by render thread, returns true if we waited, false if we missed the target
+bool PacerCore::waitBeforePresent(int64_t target) {
+	const std::shared_ptr<PacerClock> clock = this->clock();
+	int64_t now = clock->now();
+	if (target <= 0) {
+		target = getNextVBlankQpc(&now);
+	}
+
+	if (target > now) {
+		FQLog("waitBeforePresent(): waiting %.3fms\n", qpcToMs(target - now));
+		clock->sleepUntil(target);
+		return true;
+	}
+
+	return false;
+}
+
+// called by decoder thread
+int PacerCore::submitFrame(AVFrame *frame) {
+	// Update cadence from pts if available
+	if (frame->pts) {
+		m_FrameCadence.observeFramePts(frame->pts);
+
+		// Adapt queue depth to arrival jitter
+		if (frame->opaque_ref) {
+			auto *data = reinterpret_cast<MLFrameData *>(frame->opaque_ref->data);
+			if (m_QueueDepth.observeFrame(frame->pts, data->decodeEndQpc)) {
+				FrameQueue::instance().setHighWaterMark(m_QueueDepth.depth());
+			}
+
+			// Convert the stream period to local time as the host clock drifts
+			if (m_HostClock.observe(frame->pts, data->decodeEndQpc)) {
+				m_FrameCadence.setHostClockScale(m_HostClock.hostToLocalScale());
+			}
+		}
+	}
+
+	return FrameQueue::instance().enqueue(frame);
+}
+
+// Caller often needs now and the vsync interval, since this needs locking
+// the logic is confined to this function.
+int64_t PacerCore::getNextVBlankQpc(int64_t *now) {
+	std::scoped_lock<std::mutex> lock(m_FrameStatsLock);
+	int64_t target = 0, interval = 0;
+	*now = clock()->now();
+
+	if (m_LastSyncQpc == 0 || m_VsyncIntervalQpc == 0) {
+		// Fallback until vsyncHardware spins up
+		double rr = m_RefreshRate > 0.0 ? m_RefreshRate : 60.0;
+		interval = msToQpc(1000.0 / rr);
+		target = *now + interval;
+	} else {
+		interval = m_VsyncIntervalQpc;
+		if (m_VsyncTracker.hasEstimate()) {
+			target = m_VsyncTracker.nextVBlankAfter(*now);
+		} else {
+			int64_t next = m_LastSyncQpc;
+			while (next <= *now) {
+				next += interval;
+			}
+			target = next;
+		}
+	}
+
+	// Present in sub-vblank slots if the display runs faster than the vblanks we measure, e.g. 120hz on Xbox
+	const int slots = m_PresentSlots.slotsFor(interval, m_QpcFreq);
+	if (slots != m_PresentSlotCount) {
+		PacingLogf("Pacer: %d present slot(s) per %.3fms vblank\n", slots, qpcToMs(interval));
+		m_PresentSlotCount = slots;
+	}
+	target = PresentSlotScheduler::nextSlotAfter(*now, target, interval, slots);
+	interval /= slots;
+
+	// Keep true refresh rate synced with cadence
+	m_FrameCadence.setDisplayHz(1000.0 / qpcToMs(interval));
+
+	// Used by latency budget mode to predict when the selected frame reaches the screen
+	m_PresentTargetQpc = target;
+	m_PresentIntervalQpc = interval;
+
+	assert(target > *now);
+
+	return target;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include "FrameCadence.h"
+#include "HostClockEstimator.h"
+#include "PacerClock.h"
+#include "PresentSlotScheduler.h"
+#include "QueueDepthController.h"
+#include "VsyncTracker.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+enum class PacingMode {
+	Immediate,     // present each new frame as soon as it is available
+	DisplayLocked, // present every vblank, advancing frames according to FrameCadence
+	LatencyBudget  // pick the frame and vblank that keep decode-to-photon latency within a budget
+};
+
+// What the pacing decisions report besides the frame they pick, Pacer forwards it to Stats, ImGuiPlots
+// and FrameTrace. Called on the thread that made the decision.
+class PacerCoreObserver {
+  public:
+	virtual ~PacerCoreObserver() = default;
+
+	// A queued frame was skipped to catch up (render thread)
+	virtual void pacerDroppedFrame() = 0;
+
+	// Latency budget mode presents a new frame with this decode-to-photon estimate (render thread)
+	virtual void latencyBudgetFrame(bool met, double latencyMs) = 0;
+
+	// Frame statistics show present presentCount reached the screen at vblankQpc (vsync thread)
+	virtual void presentLanded(uint32_t presentCount, uint32_t presentRefreshCount, int64_t vblankQpc) = 0;
+};
+
+// The frame pacing decisions of Pacer: which frame to present and for which vblank, fed by the decoder
+// through FrameQueue and by the vblank timing of a PacerClock. Pacer wraps it with the vsync thread, the
+// renderer and the stats. See Pacer.cpp for how the threads use it.
+//
+// This file, the components it owns, FrameQueue, FramePool and PacerSimulator don't depend on Windows or
+// D3D11. They build without the precompiled header, log through PacingLog.h and keep time in ticks of
+// PacerClock::frequency(), so Tools/PacerSim can run the real pacing code on a virtual clock.
+
+class PacerCore {
+  public:
+	// clock serves getNextVBlankQpc() until init(), every clock given later must tick at its frequency
+	explicit PacerCore(const std::shared_ptr<PacerClock> &clock);
+	PacerCore(const PacerCore &) = delete;
+	PacerCore &operator=(const PacerCore &) = delete;
+
+	// Starts FrameQueue. xbox applies the console's vblank rates until frame statistics arrive.
+	// observer may be null.
+	void init(const std::shared_ptr<PacerClock> &clock, PacerCoreObserver *observer, int streamFps, double refreshRate,
+	          PacingMode pacingMode, double latencyBudgetMs, bool xbox);
+
+	// Stops FrameQueue and releases the frames held here, then keeps idleClock for getNextVBlankQpc()
+	void deinit(const std::shared_ptr<PacerClock> &idleClock);
+
+	// init() and deinit() swap the clock while the other threads use it, so callers keep their own reference
+	std::shared_ptr<PacerClock> clock() const { return std::atomic_load(&m_Clock); }
+	PacingMode getPacingMode() const;
+	void setPacingMode(PacingMode pacingMode);
+	double getLatencyBudgetMs() const;
+	static const char *pacingModeName(PacingMode pacingMode);
+	const FrameCadence &getFrameCadence() const { return m_FrameCadence; }
+	const HostClockEstimator &getHostClock() const { return m_HostClock; }
+	const QueueDepthController &getQueueDepth() const { return m_QueueDepth; }
+	double getVsyncPeriodMs(); // period of the vblanks frame statistics report, 0 before the first estimate
+
+	// Decoder thread, returns the number of frames FrameQueue dropped
+	int submitFrame(AVFrame *frame);
+
+	// Vsync thread, once per vblank
+	void updateFrameStats();
+
+	// Render thread
+	int64_t getNextVBlankQpc(int64_t *now);
+	bool selectFrameForPresent(); // updates currentFrame(), returns true if it should be rendered
+	bool waitBeforePresent(int64_t deadline);
+	AVFrame *currentFrame() const { return m_CurrentFrame; }
+
+  private:
+	bool selectFrameImmediate();
+	bool selectFrameDisplayLocked();
+	bool selectFrameLatencyBudget();
+	int catchUpDepth() const;
+	double nominalVsyncHz() const;
+	int64_t msToQpc(double ms) const;
+	double qpcToMs(int64_t qpc) const;
+
+	std::shared_ptr<PacerClock> m_Clock; // accessed with std::atomic_load/atomic_store
+	const int64_t m_QpcFreq;
+	PacerCoreObserver *m_Observer = nullptr;
+	int m_StreamFps = 0;
+	double m_RefreshRate = 0.0;
+	bool m_Xbox = false;
+	std::atomic<PacingMode> m_PacingMode{PacingMode::Immediate};
+	std::atomic<double> m_LatencyBudgetMs{8.0};
+
+	FrameCadence m_FrameCadence;
+	QueueDepthController m_QueueDepth;
+	HostClockEstimator m_HostClock;
+	AVFrame *m_CurrentFrame = nullptr;
+
+	// Latency budget mode (main thread)
+	AVFrame *m_HeldFrame = nullptr;   // frame being held for a later vblank, older than anything queued
+	int m_RepeatCount = 0;            // selects since the last new frame was presented
+	int64_t m_PresentTargetQpc = 0;   // last vblank returned by getNextVBlankQpc
+	int64_t m_PresentIntervalQpc = 0;
+
+	std::mutex m_FrameStatsLock;
+	VsyncTracker m_VsyncTracker;
+	PresentSlotScheduler m_PresentSlots;
+	int m_PresentSlotCount = 1;
+	bool m_LoggedStartup = false;
+	uint32_t m_LastSyncRefreshCount = 0;
+	int64_t m_LastSyncQpc = 0;
+	int64_t m_VsyncIntervalQpc = 0;
+};
@@ -0,0 +1,327 @@
+// Built without the precompiled header, see PacerCore.h
+#include "PacerSimulator.h"
+#include <algorithm>
+#include <cmath>
+#include "FrameData.h"
+#include "FramePool.h"
+#include "FrameQueue.h"
+#include "PacingLog.h"
+#include "RenderCostPredictor.h"
+
+// Start the virtual clock well past zero, PacerCore treats a zero QPC as "no vsync stats yet"
+constexpr double SIM_START_MS = 1000.0;
+
+// pch.h's QPC helpers, on the simulated clock
+static int64_t MsToQpc(double ms) {
+	return std::llround(ms * SimulatedPacerClock::FREQUENCY / 1000.0);
+}
+
+static double QpcToMs(int64_t qpc) {
+	return static_cast<double>(qpc) * 1000.0 / SimulatedPacerClock::FREQUENCY;
+}
+
+void PacerSimReport::log(const char *label) const {
+	PacingLogf("PacerSim [%s]: submitted %d, displayed %d, dropped %d, repeated vblanks %d, missed presents %d, skipped presents %d\n",
+	            label, framesSubmitted, framesDisplayed, framesDropped, repeatedVblanks, missedPresents, skippedPresents);
+	PacingLogf("PacerSim [%s]: judder %.3fms, latency p50 %.2fms p95 %.2fms p99 %.2fms max %.2fms, host clock %+.1f ppm, pattern breaks %d, queue depth %d, vsync period %.4fms\n",
+	            label, judderMs, latencyP50Ms, latencyP95Ms, latencyP99Ms, latencyMaxMs, hostClockPpm, patternBreaks,
+	            queueDepth, vsyncPeriodMs);
+}
+
+SimulatedPacerClock::SimulatedPacerClock(double displayHz, int statsLagVblanks, int statsEveryVblanks)
+    : m_Now(MsToQpc(SIM_START_MS)),
+      m_PeriodQpc(static_cast<double>(FREQUENCY) / displayHz),
+      m_StatsLag(std::max(0, statsLagVblanks)),
+      m_StatsEvery(std::max(1, statsEveryVblanks)) {
+}
+
+int64_t SimulatedPacerClock::frequency() {
+	return FREQUENCY;
+}
+
+int64_t SimulatedPacerClock::now() {
+	return m_Now;
+}
+
+void SimulatedPacerClock::sleepUntil(int64_t targetQpc) {
+	if (targetQpc > m_Now) {
+		m_Now = targetQpc;
+	}
+}
+
+bool SimulatedPacerClock::waitForVBlank() {
+	const int64_t reported = vblankIndexAtOrBefore(m_Now) / m_StatsEvery + 1;
+	m_Now = vblankQpc(reported * m_StatsEvery);
+	return true;
+}
+
+// Refresh counts are in reported vblanks, i.e. every m_StatsEvery-th real vblank
+bool SimulatedPacerClock::getFrameStatistics(PacerFrameStatistics &stats) {
+	int64_t reported = vblankIndexAtOrBefore(m_Now) / m_StatsEvery - m_StatsLag;
+	if (reported <= 0) {
+		return false;
+	}
+
+	// Presents aren't modelled, presentCount stays 0
+	stats.syncRefreshCount = static_cast<uint32_t>(reported);
+	stats.syncQpc = vblankQpc(reported * m_StatsEvery);
+	return true;
+}
+
+int64_t SimulatedPacerClock::vblankQpc(int64_t index) const {
+	return std::llround(static_cast<double>(index) * m_PeriodQpc);
+}
+
+int64_t SimulatedPacerClock::vblankIndexAtOrBefore(int64_t qpc) const {
+	int64_t index = static_cast<int64_t>(std::floor(static_cast<double>(qpc) / m_PeriodQpc));
+	// correct for rounding in vblankQpc()
+	while (vblankQpc(index + 1) <= qpc) {
+		++index;
+	}
+	while (index > 0 && vblankQpc(index) > qpc) {
+		--index;
+	}
+	return index;
+}
+
+std::vector<PacerSimulator::Arrival> PacerSimulator::generateArrivals(const PacerSimConfig &config, std::mt19937 &rng) const {
+	std::vector<Arrival> arrivals;
+	arrivals.reserve(config.frameCount);
+
+	std::normal_distribution<double> jitter(0.0, 1.0);
+	std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+	// A host clock running fast produces frames slightly more often in local time, pts stays in host time
+	const double hostPeriodMs = 1000.0 / config.streamFps;
+	const double localPeriodMs = hostPeriodMs / (1.0 + config.hostClockPpm * 1e-6);
+
+	for (int i = 0; i < config.frameCount; ++i) {
+		double arrivalMs = SIM_START_MS + i * localPeriodMs + config.decodeMs;
+		if (config.arrivalJitterMs > 0.0) {
+			arrivalMs += std::abs(jitter(rng)) * config.arrivalJitterMs;
+		}
+
+		Arrival a;
+		a.arrivalQpc = MsToQpc(arrivalMs);
+		double ptsMs = i * hostPeriodMs;
+		if (config.ptsJitterMs > 0.0) {
+			// The frame still arrives on time, only the host's capture timestamp is off
+			ptsMs += jitter(rng) * config.ptsJitterMs;
+		}
+		a.pts90k = std::llround(ptsMs * 90.0);
+		if (!arrivals.empty()) {
+			a.pts90k = std::max(a.pts90k, arrivals.back().pts90k + 1);
+		}
+		a.idr = (i == 0);
+		arrivals.push_back(a);
+	}
+
+	// Bursts: hold a run of frames back and release them all with the last one
+	if (config.burstProbability > 0.0 && config.burstLength > 1) {
+		for (size_t i = 0; i < arrivals.size(); ++i) {
+			if (chance(rng) >= config.burstProbability) {
+				continue;
+			}
+			size_t last = std::min(arrivals.size() - 1, i + config.burstLength - 1);
+			for (size_t j = i; j < last; ++j) {
+				arrivals[j].arrivalQpc = arrivals[last].arrivalQpc;
+			}
+			i = last;
+		}
+	}
+
+	// Frames are decoded in order, so arrivals can never go backwards
+	for (size_t i = 1; i < arrivals.size(); ++i) {
+		arrivals[i].arrivalQpc = std::max(arrivals[i].arrivalQpc, arrivals[i - 1].arrivalQpc);
+	}
+
+	return arrivals;
+}
+
+PacerSimReport PacerSimulator::run(const PacerSimConfig &config) {
+	PacerSimReport report;
+	std::mt19937 rng(config.seed);
+	std::normal_distribution<double> renderJitter(0.0, 1.0);
+
+	std::vector<Arrival> arrivals = generateArrivals(config, rng);
+
+	auto clock = std::make_shared<SimulatedPacerClock>(config.displayHz, config.statsLagVblanks, config.statsEveryVblanks);
+	PacerCore pacer(clock);
+	pacer.init(clock, nullptr, static_cast<int>(std::lround(config.streamFps)),
+	           config.reportedHz > 0.0 ? config.reportedHz : config.displayHz,
+	           config.pacingMode, config.latencyBudgetMs, false);
+
+	size_t nextArrival = 0;
+	int64_t lastStatsVblank = -1;
+
+	// Stand-in for the vsync thread, which wakes up once per vblank
+	auto pollVsync = [&]() {
+		int64_t index = clock->vblankIndexAtOrBefore(clock->now());
+		if (index != lastStatsVblank) {
+			lastStatsVblank = index;
+			pacer.updateFrameStats();
+		}
+	};
+
+	// Stand-in for the decoder thread, submits every frame that has arrived by upToQpc
+	auto deliver = [&](int64_t upToQpc) {
+		while (nextArrival < arrivals.size() && arrivals[nextArrival].arrivalQpc <= upToQpc) {
+			const Arrival &a = arrivals[nextArrival++];
+
+			AVFrame *frame = FramePool::instance().acquireFrame();
+			frame->pts = a.pts90k;
+			frame->pict_type = a.idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_P;
+			frame->opaque_ref = FramePool::instance().acquireFrameData();
+			if (frame->opaque_ref) {
+				reinterpret_cast<MLFrameData *>(frame->opaque_ref->data)->decodeEndQpc = a.arrivalQpc;
+			}
+
+			pacer.submitFrame(frame);
+			report.framesSubmitted++;
+		}
+	};
+
+	// Each present lands on the first vblank strictly after the present call, the last present before
+	// a vblank wins
+	struct Shown {
+		int64_t vblank;
+		int64_t pts;
+		int64_t decodeEndQpc;
+	};
+	std::vector<Shown> shown;
+	shown.reserve(arrivals.size());
+
+	// Prewait budget as in moonlight_xbox_dxMain::StartRenderLoop
+	RenderCostPredictor renderCost(config.renderMissProbability);
+	const int64_t renderQpc = MsToQpc(config.renderMs);
+	const size_t maxIterations = arrivals.size() * (static_cast<size_t>(config.displayHz / config.streamFps) + 2) * 4 + 100;
+
+	for (size_t iter = 0; iter < maxIterations; ++iter) {
+		if (nextArrival == arrivals.size() && FrameQueue::instance().count() == 0) {
+			break;
+		}
+
+		int64_t t0 = 0;
+		int64_t deadline = pacer.getNextVBlankQpc(&t0);
+
+		// waitForFrame(): return as soon as a frame is queued, or give up in time to render
+		const int64_t waitEnd = t0 + std::max<int64_t>(0, deadline - t0 - MsToQpc(renderCost.budgetMs()));
+		deliver(t0);
+		if (FrameQueue::instance().count() == 0) {
+			if (nextArrival < arrivals.size() && arrivals[nextArrival].arrivalQpc <= waitEnd) {
+				clock->sleepUntil(arrivals[nextArrival].arrivalQpc);
+			} else {
+				clock->sleepUntil(waitEnd);
+			}
+			deliver(clock->now());
+		}
+		pollVsync();
+
+		const bool hadFrame = pacer.currentFrame() != nullptr;
+		bool rendered = pacer.selectFrameForPresent();
+		const int64_t t1 = clock->now();
+
+		int64_t thisRenderQpc = renderQpc;
+		if (config.renderJitterMs > 0.0) {
+			thisRenderQpc += MsToQpc(std::abs(renderJitter(rng)) * config.renderJitterMs);
+		}
+		clock->sleepUntil(clock->now() + thisRenderQpc);
+		deliver(clock->now());
+
+		if (rendered) {
+			// The virtual clock wakes up exactly on time
+			RenderCostSample costSample;
+			costSample.windowMs = static_cast<float>(QpcToMs(deadline - t0));
+			costSample.renderMs = static_cast<float>(QpcToMs(thisRenderQpc));
+			costSample.wakeMs = t1 >= waitEnd ? static_cast<float>(QpcToMs(t1 - waitEnd)) : -1.0f;
+			renderCost.observe(costSample);
+		}
+
+		if (!pacer.waitBeforePresent(deadline)) {
+			report.missedPresents++;
+		}
+		deliver(clock->now());
+		pollVsync();
+
+		AVFrame *current = pacer.currentFrame();
+		if (!rendered || !current) {
+			// No Present(), the previous frame stays on screen
+			if (hadFrame) {
+				report.skippedPresents++;
+			}
+			continue;
+		}
+
+		int64_t decodeEndQpc = 0;
+		if (current->opaque_ref) {
+			decodeEndQpc = reinterpret_cast<MLFrameData *>(current->opaque_ref->data)->decodeEndQpc;
+		}
+
+		Shown s{clock->vblankIndexAtOrBefore(clock->now()) + 1, current->pts, decodeEndQpc};
+		if (!shown.empty() && shown.back().vblank == s.vblank) {
+			shown.back() = s;
+		} else {
+			shown.push_back(s);
+		}
+	}
+
+	// Collapse to the vblank each unique frame first appeared on
+	std::vector<Shown> firstShown;
+	firstShown.reserve(shown.size());
+	for (const Shown &s : shown) {
+		if (firstShown.empty() || firstShown.back().pts != s.pts) {
+			firstShown.push_back(s);
+		}
+	}
+
+	report.framesDisplayed = static_cast<int>(firstShown.size());
+	report.framesDropped = std::max(0, report.framesSubmitted - report.framesDisplayed -
+	                                       static_cast<int>(FrameQueue::instance().count()));
+
+	std::vector<double> latencies;
+	latencies.reserve(firstShown.size());
+	double sumSq = 0.0;
+	for (size_t i = 0; i < firstShown.size(); ++i) {
+		const Shown &s = firstShown[i];
+		if (s.decodeEndQpc) {
+			latencies.push_back(QpcToMs(clock->vblankQpc(s.vblank) - s.decodeEndQpc));
+		}
+
+		if (i + 1 < firstShown.size()) {
+			const Shown &next = firstShown[i + 1];
+			int64_t vblanks = next.vblank - s.vblank;
+			report.repeatedVblanks += static_cast<int>(std::max<int64_t>(0, vblanks - 1));
+
+			// Compare time on screen to the host interval between the two frames, so dropped frames
+			// don't count as judder twice
+			double onScreenMs = QpcToMs(clock->vblankQpc(next.vblank) - clock->vblankQpc(s.vblank));
+			double expectedMs = (next.pts - s.pts) / 90.0;
+			sumSq += (onScreenMs - expectedMs) * (onScreenMs - expectedMs);
+		}
+	}
+	if (firstShown.size() > 1) {
+		report.judderMs = std::sqrt(sumSq / (firstShown.size() - 1));
+	}
+
+	if (!latencies.empty()) {
+		std::sort(latencies.begin(), latencies.end());
+		auto percentile = [&](double p) {
+			size_t idx = static_cast<size_t>(std::ceil(p * latencies.size())) - 1;
+			return latencies[std::min(idx, latencies.size() - 1)];
+		};
+		report.latencyP50Ms = percentile(0.50);
+		report.latencyP95Ms = percentile(0.95);
+		report.latencyP99Ms = percentile(0.99);
+		report.latencyMaxMs = latencies.back();
+	}
+
+	report.hostClockPpm = pacer.getHostClock().skewPpm();
+	report.patternBreaks = static_cast<int>(pacer.getFrameCadence().patternBreaks());
+	report.queueDepth = pacer.getQueueDepth().depth();
+	report.vsyncPeriodMs = pacer.getVsyncPeriodMs();
+
+	// Frees queued frames and the current frame
+	pacer.deinit(clock);
+
+	return report;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+#include "PacerClock.h"
+#include "PacerCore.h"
+
+// Headless frame pacing simulator.
+//
+// Drives PacerCore::submitFrame / selectFrameForPresent / waitBeforePresent with a synthetic decode-unit
+// arrival trace on a virtual clock, mirroring the render loop in moonlight_xbox_dxMain::StartRenderLoop.
+// Nothing is rendered or presented, each present is assumed to land on the first vblank after the
+// present call. Results are fully deterministic for a given PacerSimConfig.
+//
+// Usage:
+//   PacerSimConfig cfg;
+//   cfg.streamFps = 60.0;
+//   cfg.displayHz = 59.94;
+//   cfg.arrivalJitterMs = 2.0;
+//   PacerSimReport report = PacerSimulator().run(cfg);
+//   report.log("60fps on 59.94Hz, 2ms jitter");
+//
+// Present slot scheduling, e.g. the Xbox 120 Hz mode where frame statistics only tick at 60 Hz:
+//   cfg.streamFps = 120.0;
+//   cfg.displayHz = 120.0;
+//   cfg.statsEveryVblanks = 2;
+//   PacerSimulator().run(cfg).log("120fps, 120Hz output with 60Hz stats"); // expect no repeated vblanks
+//
+// Tools/PacerSim runs both of these and more scenarios as checked cases.
+//
+// The simulator takes over the FrameQueue singleton, it must not be run during a stream.
+
+struct PacerSimConfig {
+	double streamFps = 60.0;       // host framerate
+	double hostClockPpm = 0.0;     // host clock error, positive means the host runs fast
+	double displayHz = 60.0;       // true display refresh rate
+	double reportedHz = 0.0;       // refresh rate given to PacerCore::init, 0 means same as displayHz
+	int frameCount = 3600;         // number of host frames to generate
+
+	double decodeMs = 3.0;         // fixed network + decode delay before a frame reaches submitFrame()
+	double arrivalJitterMs = 0.0;  // standard deviation of additional half-normal arrival delay
+	double ptsJitterMs = 0.0;      // standard deviation of the error in the host's frame timestamps
+	double burstProbability = 0.0; // chance a frame is held back and released together with the next ones
+	int burstLength = 3;           // frames released together in a burst
+
+	double renderMs = 1.5;         // time spent inside Render()
+	double renderJitterMs = 0.0;   // standard deviation of additional half-normal render time
+	double renderMissProbability = 0.01; // RenderCostPredictor target, as the render loop's setting
+	int statsLagVblanks = 2;       // how stale DXGI frame statistics are, in reported vblanks
+	int statsEveryVblanks = 1;     // frame statistics and waitForVBlank() only see every Nth vblank
+
+	PacingMode pacingMode = PacingMode::Immediate;
+	double latencyBudgetMs = 8.0;  // used by PacingMode::LatencyBudget
+	uint32_t seed = 1;
+};
+
+struct PacerSimReport {
+	int framesSubmitted = 0;
+	int framesDisplayed = 0;     // unique frames that reached the screen
+	int framesDropped = 0;       // frames discarded by FrameQueue or PacerCore
+	int repeatedVblanks = 0;     // vblanks that showed the same frame as the previous vblank
+	int missedPresents = 0;      // waitBeforePresent() was already past its target
+	int skippedPresents = 0;     // iterations without Present() while a frame was on screen, only immediate mode may skip
+	double judderMs = 0.0;       // standard deviation of on-screen duration minus the host frame interval
+	double latencyP50Ms = 0.0;   // decode end -> first vblank showing the frame
+	double latencyP95Ms = 0.0;
+	double latencyP99Ms = 0.0;
+	double latencyMaxMs = 0.0;
+	double hostClockPpm = 0.0;   // HostClockEstimator's estimate at the end of the run, compare to the config
+	int patternBreaks = 0;       // FrameCadence left a locked pattern, display-locked mode only
+	int queueDepth = 0;          // QueueDepthController's depth at the end of the run
+	double vsyncPeriodMs = 0.0;  // VsyncTracker's period at the end of the run, in reported vblanks
+
+	void log(const char *label) const;
+};
+
+// Virtual time and vsync source, time only moves when the simulator or PacerCore sleeps.
+// Ticks at 10 MHz like QPC on the console.
+class SimulatedPacerClock : public PacerClock {
+  public:
+	static constexpr int64_t FREQUENCY = 10000000;
+
+	SimulatedPacerClock(double displayHz, int statsLagVblanks, int statsEveryVblanks = 1);
+
+	int64_t frequency() override;
+	int64_t now() override;
+	void sleepUntil(int64_t targetQpc) override;
+	bool waitForVBlank() override;
+	bool getFrameStatistics(PacerFrameStatistics &stats) override;
+
+	// Vblank helpers used by the simulator, vblank N happens at N * period
+	int64_t vblankQpc(int64_t index) const;
+	int64_t vblankIndexAtOrBefore(int64_t qpc) const;
+
+  private:
+	int64_t m_Now;
+	double m_PeriodQpc;
+	int m_StatsLag;
+	int m_StatsEvery;
+};
+
+class PacerSimulator {
+  public:
+	PacerSimReport run(const PacerSimConfig &config);
+
+  private:
+	struct Arrival {
+		int64_t arrivalQpc;
+		int64_t pts90k;
+		bool idr;
+	};
+
+	std::vector<Arrival> generateArrivals(const PacerSimConfig &config, std::mt19937 &rng) const;
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+// Log output of the pacing code that is built without the precompiled header (see PacerCore.h).
+// The app defines PacingLogf() next to DxgiPacerClock and sends it to Utils::Log, Tools/PacerSim
+// prints it.
+void PacingLogf(const char *fmt, ...);
+
+// FQLog() for those files, a no-op unless FRAME_QUEUE_VERBOSE is defined here as well as in pch.h
+#ifndef FQLog
+#ifdef FRAME_QUEUE_VERBOSE
+#define FQLog(fmt, ...) PacingLogf(fmt, ##__VA_ARGS__)
+#else
+#define FQLog(...) \
+	do {           \
+	} while (0)
+#endif
+#endif
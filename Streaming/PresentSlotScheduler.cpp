@@ -0,0 +1,35 @@
+// Built without the precompiled header, see PacerCore.h
+#include "PresentSlotScheduler.h"
+#include <algorithm>
+#include <cmath>
+
+void PresentSlotScheduler::configure(double reportedHz, double streamFps) {
+	m_reportedHz = reportedHz > 0.0 ? reportedHz : 60.0;
+	m_streamFps = streamFps > 0.0 ? streamFps : 60.0;
+}
+
+int PresentSlotScheduler::slotsFor(int64_t vblankIntervalQpc, int64_t qpcFreq) const {
+	if (vblankIntervalQpc <= 0 || qpcFreq <= 0) {
+		return 1;
+	}
+	const double measuredHz = static_cast<double>(qpcFreq) / static_cast<double>(vblankIntervalQpc);
+
+	// Refreshes the output really does per measured vblank
+	const int displaySlots = static_cast<int>(std::lround(m_reportedHz / measuredHz));
+
+	// Slots the stream can fill, more would only repeat frames at a finer granularity
+	const int streamSlots = static_cast<int>(std::ceil(m_streamFps / measuredHz - STREAM_RATE_SLACK));
+
+	return std::clamp(std::min(displaySlots, streamSlots), 1, MAX_SLOTS);
+}
+
+int64_t PresentSlotScheduler::nextSlotAfter(int64_t now, int64_t nextVBlankQpc, int64_t vblankIntervalQpc, int slots) {
+	if (slots <= 1 || vblankIntervalQpc <= 0 || nextVBlankQpc <= now) {
+		return nextVBlankQpc;
+	}
+
+	// Slot boundaries sit at nextVBlankQpc - k * slot for k = 0..slots-1, pick the earliest one still ahead
+	const int64_t slotQpc = vblankIntervalQpc / slots;
+	const int64_t k = std::min<int64_t>((nextVBlankQpc - now - 1) / slotQpc, slots - 1);
+	return nextVBlankQpc - k * slotQpc;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+// Divides each measured vblank interval into evenly spaced present slots.
+//
+// Some outputs scan out faster than the vblanks DXGI frame statistics report, e.g. the Xbox in 120 Hz
+// mode reports 60 Hz statistics. The slot count is the number of reported refreshes that fit in one
+// measured vblank, capped to what the stream framerate needs: a 120 fps stream on the Xbox gets 2 slots
+// per measured vblank, 240 fps on 240 Hz reported as 60 Hz gets 4, and a 60 fps stream stays at 1.
+// When the reported and measured rates agree there is always a single slot.
+//
+// This class has no Windows dependencies. Tools/PacerSim checks the slot counts above and runs it
+// through PacerCore with PacerSimConfig::statsEveryVblanks. It is not thread-safe, PacerCore guards it
+// with m_FrameStatsLock.
+
+class PresentSlotScheduler {
+  public:
+	static constexpr int MAX_SLOTS = 4;
+
+	// reportedHz is the refresh rate the system reports, streamFps the negotiated stream framerate
+	void configure(double reportedHz, double streamFps);
+
+	// Slots per vblank for a measured vblank interval, 1 to MAX_SLOTS
+	int slotsFor(int64_t vblankIntervalQpc, int64_t qpcFreq) const;
+
+	// First slot boundary strictly after now. nextVBlankQpc is the first vblank after now.
+	static int64_t nextSlotAfter(int64_t now, int64_t nextVBlankQpc, int64_t vblankIntervalQpc, int slots);
+
+  private:
+	// Tolerance for framerates that are a hair above a multiple of the vblank rate, e.g. 60 fps on 59.94 Hz
+	static constexpr double STREAM_RATE_SLACK = 0.1;
+
+	double m_reportedHz = 60.0;
+	double m_streamFps = 60.0;
+};
@@ -0,0 +1,120 @@
+// Built without the precompiled header, see PacerCore.h
+#include "QueueDepthController.h"
+#include <algorithm>
+#include <cmath>
+#include "PacingLog.h"
+
+QueueDepthController::QueueDepthController()
+    : m_depth(1),
+      m_jitterMs(0.0) {
+}
+
+void QueueDepthController::init(int64_t qpcFreq, double streamFps, int minDepth, int maxDepth, int initialDepth) {
+	m_qpcFreq = qpcFreq > 0 ? qpcFreq : 10000000;
+	m_streamPeriodMs = 1000.0 / (streamFps > 0.0 ? streamFps : 60.0);
+	m_minDepth = std::max(1, minDepth);
+	m_maxDepth = std::max(m_minDepth, maxDepth);
+
+	m_count = 0;
+	m_idx = 0;
+	m_sinceEval = 0;
+	m_haveLastPts = false;
+	m_ptsUnwrapped = 0;
+	m_lowerSinceQpc = 0;
+
+	m_depth.store(std::clamp(initialDepth, m_minDepth, m_maxDepth), std::memory_order_release);
+	m_jitterMs.store(0.0, std::memory_order_release);
+}
+
+// Decoder thread only
+bool QueueDepthController::observeFrame(int64_t pts90k, int64_t arrivalQpc) {
+	if (pts90k == INT64_MIN || !arrivalQpc) {
+		return false;
+	}
+
+	// pts comes from the 32-bit RTP timestamp, unwrap it so transit stays continuous
+	const uint32_t pts32 = static_cast<uint32_t>(pts90k);
+	if (m_haveLastPts) {
+		const int32_t delta = static_cast<int32_t>(pts32 - m_lastPts32);
+		if (delta <= 0 || delta > 90000) {
+			// reordered, repeated or a discontinuity (e.g. host restarted the stream), start over
+			m_count = 0;
+			m_idx = 0;
+		}
+		m_ptsUnwrapped += delta;
+	}
+	m_lastPts32 = pts32;
+	m_haveLastPts = true;
+
+	// Only differences between transits matter, so the unknown clock offset cancels out
+	m_transitMs[m_idx] = toMs(arrivalQpc) - m_ptsUnwrapped / 90.0;
+	m_idx = (m_idx + 1) % WINDOW_SIZE;
+	m_count = std::min(m_count + 1, WINDOW_SIZE);
+
+	if (++m_sinceEval < EVAL_INTERVAL || m_count < WINDOW_SIZE / 4) {
+		return false;
+	}
+	m_sinceEval = 0;
+
+	// 95th percentile of transit above the best case in the window
+	std::array<double, WINDOW_SIZE> sorted;
+	std::copy_n(m_transitMs.begin(), m_count, sorted.begin());
+	const int p95 = (m_count * 95) / 100;
+	std::nth_element(sorted.begin(), sorted.begin() + p95, sorted.begin() + m_count);
+	const double highMs = sorted[p95];
+	const double lowMs = *std::min_element(sorted.begin(), sorted.begin() + m_count);
+	const double jitterMs = highMs - lowMs;
+	m_jitterMs.store(jitterMs, std::memory_order_release);
+
+	const int current = m_depth.load(std::memory_order_relaxed);
+	int next = current;
+
+	const int wanted = depthForJitter(jitterMs);
+	if (wanted > current) {
+		// Raise right away, a dropped frame costs more than a little latency
+		next = wanted;
+		m_lowerSinceQpc = 0;
+	} else if (depthForJitter(jitterMs * LOWER_MARGIN) < current) {
+		// Lower one step at a time, only after the jitter has stayed low for LOWER_HOLD_MS
+		if (!m_lowerSinceQpc) {
+			m_lowerSinceQpc = arrivalQpc;
+		} else if (toMs(arrivalQpc - m_lowerSinceQpc) >= LOWER_HOLD_MS) {
+			next = current - 1;
+			m_lowerSinceQpc = 0;
+		}
+	} else {
+		m_lowerSinceQpc = 0;
+	}
+
+	if (next == current) {
+		return false;
+	}
+
+	m_depth.store(next, std::memory_order_release);
+	PacingLogf("QueueDepthController: depth %d -> %d (jitter p95 %.2fms, frame %.2fms)\n",
+	            current, next, jitterMs, m_streamPeriodMs);
+	return true;
+}
+
+double QueueDepthController::toMs(int64_t qpc) const {
+	return static_cast<double>(qpc) * 1000.0 / static_cast<double>(m_qpcFreq);
+}
+
+// One frame for the frame being rendered, plus enough frames to cover the jitter. Timestamp rounding
+// and scheduler noise never measure exactly zero, the render loop's wait for a frame absorbs that much.
+int QueueDepthController::depthForJitter(double jitterMs) const {
+	const int extra = std::max(0, static_cast<int>(std::ceil(jitterMs / m_streamPeriodMs - JITTER_SLACK)));
+	return std::clamp(1 + extra, m_minDepth, m_maxDepth);
+}
+
+int QueueDepthController::depth() const {
+	return m_depth.load(std::memory_order_acquire);
+}
+
+double QueueDepthController::jitterMs() const {
+	return m_jitterMs.load(std::memory_order_acquire);
+}
+
+double QueueDepthController::latencyCostMs() const {
+	return (depth() - m_minDepth) * m_streamPeriodMs;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Picks the FrameQueue depth from measured frame arrival jitter.
+//
+// Each frame's transit time is its arrival (decodeEndQpc) minus its host timestamp (pts). The
+// lowest transit in the window is the best case, anything above it is jitter the queue has to absorb.
+// The depth follows the 95th percentile of that jitter: it goes up as soon as the jitter needs it
+// and only comes back down after the jitter has stayed low for a while.
+//
+// observeFrame() is called by the decoder thread, the accessors are lock-free for other threads.
+
+class QueueDepthController {
+  public:
+	explicit QueueDepthController();
+
+	// Call once before use, qpcFreq is the tick rate of the arrival timestamps
+	void init(int64_t qpcFreq, double streamFps, int minDepth, int maxDepth, int initialDepth);
+
+	// Called by decoder thread for every decoded frame. Returns true if depth() changed.
+	bool observeFrame(int64_t pts90k, int64_t arrivalQpc);
+
+	// Lock-free accessors
+	int depth() const;
+	double jitterMs() const;
+
+	// Extra latency the current depth adds compared to the minimum depth
+	double latencyCostMs() const;
+
+  private:
+	static constexpr int WINDOW_SIZE = 256;  // transit samples used for the jitter estimate
+	static constexpr int EVAL_INTERVAL = 16; // frames between evaluations
+	static constexpr double LOWER_HOLD_MS = 10000.0;
+	static constexpr double LOWER_MARGIN = 1.25; // jitter must drop this far below a depth before we use it
+	static constexpr double JITTER_SLACK = 0.1;  // fraction of a frame of jitter that needs no extra queued frame
+
+	int depthForJitter(double jitterMs) const;
+	double toMs(int64_t qpc) const;
+
+	// Decoder-thread owned state
+	std::array<double, WINDOW_SIZE> m_transitMs{};
+	int m_count = 0;
+	int m_idx = 0;
+	int m_sinceEval = 0;
+
+	uint32_t m_lastPts32 = 0;
+	int64_t m_ptsUnwrapped = 0;
+	bool m_haveLastPts = false;
+
+	int64_t m_qpcFreq = 10000000;
+	int m_minDepth = 1;
+	int m_maxDepth = 1;
+	double m_streamPeriodMs = 1000.0 / 60.0;
+	int64_t m_lowerSinceQpc = 0;
+
+	// Published values
+	std::atomic<int> m_depth;
+	std::atomic<double> m_jitterMs;
+};
@@ -0,0 +1,40 @@
+// Built without the precompiled header, see RecoveryTracker.h
+#include "RecoveryTracker.h"
+#include <algorithm>
+
+void RecoveryTracker::reset(int64_t qpcFreq) {
+	m_qpcFreq = qpcFreq > 0 ? qpcFreq : 10000000;
+	m_lastGoodQpc = 0;
+	m_broken = false;
+	m_invalidFirst = 0;
+	m_invalidLast = 0;
+}
+
+void RecoveryTracker::invalidate(uint32_t first, uint32_t last) {
+	if (!m_broken) {
+		m_broken = true;
+		m_invalidFirst = first;
+		m_invalidLast = last;
+		return;
+	}
+
+	// A second loss before the chain was repaired, e.g. the frame after a gap failed to decode
+	m_invalidFirst = std::min(m_invalidFirst, first);
+	m_invalidLast = std::max(m_invalidLast, last);
+}
+
+RecoveryTracker::Recovery RecoveryTracker::frameDecoded(uint32_t frameNumber, bool idr, int64_t nowQpc, double &recoveryMs) {
+	recoveryMs = 0.0;
+	const int64_t lastGoodQpc = m_lastGoodQpc;
+	m_lastGoodQpc = nowQpc;
+
+	if (!m_broken || frameNumber <= m_invalidLast) {
+		return Recovery::None;
+	}
+
+	m_broken = false;
+	if (lastGoodQpc) {
+		recoveryMs = static_cast<double>(nowQpc - lastGoodQpc) * 1000.0 / static_cast<double>(m_qpcFreq);
+	}
+	return idr ? Recovery::IDR : Recovery::RFI;
+}
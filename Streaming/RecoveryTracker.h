@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+// Follows whether the decoder's reference chain is intact.
+//
+// The chain breaks when frames never reach the decoder (moonlight-common-c drops everything after a lost
+// packet until the host has recovered) or when decoding a frame fails. It is repaired by the next frame that
+// decodes cleanly: an IDR, or a P-frame the host encoded against references the client still has after a
+// reference frame invalidation (RFI) request. The tracker reports which of the two it was and how long the
+// picture was frozen, measured from the last good frame.
+//
+// This class has no Windows dependencies and is built without the precompiled header, times are plain QPC
+// ticks. Decoder thread only.
+
+class RecoveryTracker {
+  public:
+	enum class Recovery {
+		None, // the chain was intact
+		RFI,  // repaired by a P-frame
+		IDR,  // repaired by a keyframe
+	};
+
+	void reset(int64_t qpcFreq);
+
+	// Frames first..last will never be decoded. Ranges that touch are merged.
+	void invalidate(uint32_t first, uint32_t last);
+
+	// frameNumber decoded without errors, returns how the chain was repaired and the freeze in recoveryMs
+	Recovery frameDecoded(uint32_t frameNumber, bool idr, int64_t nowQpc, double &recoveryMs);
+
+	bool broken() const {
+		return m_broken;
+	}
+
+	// Invalid range of the current break, only meaningful while broken()
+	uint32_t invalidFirst() const {
+		return m_invalidFirst;
+	}
+	uint32_t invalidLast() const {
+		return m_invalidLast;
+	}
+
+  private:
+	int64_t m_qpcFreq = 10000000;
+	int64_t m_lastGoodQpc = 0;
+	bool m_broken = false;
+	uint32_t m_invalidFirst = 0;
+	uint32_t m_invalidLast = 0;
+};
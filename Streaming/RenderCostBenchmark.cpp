@@ -0,0 +1,99 @@
+// clang-format off
+#include "pch.h"
+// clang-format on
+#include "RenderCostBenchmark.h"
+#include <algorithm>
+#include "Utils.hpp"
+
+void RenderCostBenchResult::log() const {
+	Utils::Logf("RenderCostBench [%s miss %.1f%%]: %d iterations, hit %.2f%%, budget %.2fms, slack %.2fms\n",
+	            predictor, missProbability * 100.0, iterations, hitRate * 100.0, meanBudgetMs, meanSlackMs);
+}
+
+// The render loop's previous render cost estimate, kept as the baseline
+class EwmaRenderCost {
+  public:
+	double budgetMs() const {
+		return m_ewmaRenderMs + BUFFER_MS;
+	}
+
+	void observe(const RenderCostSample &s, bool hit) {
+		double clampedRenderMs = std::clamp(static_cast<double>(s.renderMs), 0.0, static_cast<double>(s.windowMs));
+		double alpha = (clampedRenderMs > m_ewmaRenderMs) ? ALPHA_UP : ALPHA_DOWN;
+		if (!hit) alpha *= 2.0;
+		m_ewmaRenderMs = (clampedRenderMs * alpha) + (m_ewmaRenderMs * (1.0 - alpha));
+	}
+
+  private:
+	static constexpr double BUFFER_MS = 1.5;
+	static constexpr double ALPHA_UP = 0.25;
+	static constexpr double ALPHA_DOWN = 0.05;
+	double m_ewmaRenderMs = 3.0;
+};
+
+class QuantileRenderCost {
+  public:
+	explicit QuantileRenderCost(double missProbability)
+	    : m_predictor(missProbability) {
+	}
+
+	double budgetMs() const {
+		return m_predictor.budgetMs();
+	}
+
+	void observe(const RenderCostSample &s, bool) {
+		m_predictor.observe(s);
+	}
+
+  private:
+	RenderCostPredictor m_predictor;
+};
+
+template <typename Predictor>
+RenderCostBenchResult RenderCostBenchmark::replay(Predictor &predictor, const std::vector<RenderCostSample> &samples) {
+	RenderCostBenchResult result;
+	int hits = 0;
+	double totalBudgetMs = 0.0, totalSlackMs = 0.0;
+
+	for (const RenderCostSample &s : samples) {
+		// The prewait can't be negative, a budget longer than the window leaves the whole window to render
+		const double reservedMs = std::min(predictor.budgetMs(), static_cast<double>(s.windowMs));
+		const double costMs = s.renderMs + std::max(0.0f, s.wakeMs);
+		const bool hit = costMs <= reservedMs;
+
+		if (hit) {
+			hits++;
+			totalSlackMs += reservedMs - costMs;
+		}
+		totalBudgetMs += reservedMs;
+		predictor.observe(s, hit);
+	}
+
+	result.iterations = static_cast<int>(samples.size());
+	if (!samples.empty()) {
+		result.hitRate = static_cast<double>(hits) / samples.size();
+		result.meanBudgetMs = totalBudgetMs / samples.size();
+	}
+	if (hits) {
+		result.meanSlackMs = totalSlackMs / hits;
+	}
+	return result;
+}
+
+std::vector<RenderCostBenchResult> RenderCostBenchmark::run(const std::vector<RenderCostSample> &samples,
+                                                            const std::vector<double> &missProbabilities) {
+	std::vector<RenderCostBenchResult> results;
+
+	EwmaRenderCost ewma;
+	results.push_back(replay(ewma, samples));
+	results.back().predictor = "ewma";
+
+	for (double missProbability : missProbabilities) {
+		QuantileRenderCost quantile(missProbability);
+		results.push_back(replay(quantile, samples));
+		results.back().predictor = "p2";
+		results.back().missProbability = missProbability;
+	}
+
+	return results;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include "RenderCostPredictor.h"
+
+// Replays recorded render loop timings through the prewait budget predictors.
+//
+// For each recorded iteration the predictor is asked for its budget before it sees the sample, as in the
+// render loop. The iteration hits its deadline if render time plus wake-up overshoot fits in the budget,
+// assuming the frame arrives at the end of the prewait (the case the budget exists for). A smaller mean
+// budget means frames may arrive later and still be shown at the next vblank, i.e. lower latency.
+//
+// The baseline is the asymmetric EWMA plus 1.5ms margin the render loop used before RenderCostPredictor.
+//
+// Usage, with samples recorded by the render loop's RenderCostPredictor:
+//   std::vector<RenderCostSample> samples;
+//   predictor.copyHistory(samples);
+//   for (auto &r : RenderCostBenchmark().run(samples)) r.log();
+
+struct RenderCostBenchResult {
+	const char *predictor = "";
+	double missProbability = 0.0; // target miss rate, 0 for the EWMA baseline
+	int iterations = 0;
+	double hitRate = 0.0;
+	double meanBudgetMs = 0.0; // time reserved before the deadline, lower is better
+	double meanSlackMs = 0.0;  // budget left unused on iterations that hit
+
+	void log() const;
+};
+
+class RenderCostBenchmark {
+  public:
+	std::vector<RenderCostBenchResult> run(const std::vector<RenderCostSample> &samples,
+	                                       const std::vector<double> &missProbabilities = {0.1, 0.05, 0.01, 0.001});
+
+  private:
+	template <typename Predictor>
+	RenderCostBenchResult replay(Predictor &predictor, const std::vector<RenderCostSample> &samples);
+};
@@ -0,0 +1,175 @@
+// Built without the precompiled header, see PacerCore.h
+#include "RenderCostPredictor.h"
+#include <algorithm>
+#include <cmath>
+
+P2Quantile::P2Quantile(double p)
+    : m_p(std::clamp(p, 0.0, 1.0)) {
+	reset();
+}
+
+void P2Quantile::reset() {
+	m_count = 0;
+	m_dn = {0.0, m_p / 2.0, m_p, (1.0 + m_p) / 2.0, 1.0};
+}
+
+void P2Quantile::add(double x) {
+	// The first five samples seed the markers
+	if (m_count < 5) {
+		m_q[m_count++] = x;
+		if (m_count == 5) {
+			std::sort(m_q.begin(), m_q.end());
+			for (int i = 0; i < 5; ++i) {
+				m_n[i] = i;
+			}
+			m_np = {0.0, 2.0 * m_p, 4.0 * m_p, 2.0 + 2.0 * m_p, 4.0};
+		}
+		return;
+	}
+	m_count++;
+
+	// Cell the sample falls in, extending the extremes if needed
+	int k;
+	if (x < m_q[0]) {
+		m_q[0] = x;
+		k = 0;
+	} else if (x >= m_q[4]) {
+		m_q[4] = x;
+		k = 3;
+	} else {
+		k = 0;
+		while (k < 3 && x >= m_q[k + 1]) {
+			++k;
+		}
+	}
+
+	for (int i = k + 1; i < 5; ++i) {
+		m_n[i] += 1.0;
+	}
+	for (int i = 0; i < 5; ++i) {
+		m_np[i] += m_dn[i];
+	}
+
+	// Move the middle markers toward their desired positions
+	for (int i = 1; i <= 3; ++i) {
+		const double d = m_np[i] - m_n[i];
+		if ((d >= 1.0 && m_n[i + 1] - m_n[i] > 1.0) || (d <= -1.0 && m_n[i - 1] - m_n[i] < -1.0)) {
+			const int step = d > 0.0 ? 1 : -1;
+			double q = parabolic(i, step);
+			if (!(m_q[i - 1] < q && q < m_q[i + 1])) {
+				q = linear(i, step);
+			}
+			m_q[i] = q;
+			m_n[i] += step;
+		}
+	}
+}
+
+double P2Quantile::parabolic(int i, double d) const {
+	return m_q[i] + d / (m_n[i + 1] - m_n[i - 1]) *
+	                    ((m_n[i] - m_n[i - 1] + d) * (m_q[i + 1] - m_q[i]) / (m_n[i + 1] - m_n[i]) +
+	                     (m_n[i + 1] - m_n[i] - d) * (m_q[i] - m_q[i - 1]) / (m_n[i] - m_n[i - 1]));
+}
+
+double P2Quantile::linear(int i, int d) const {
+	return m_q[i] + d * (m_q[i + d] - m_q[i]) / (m_n[i + d] - m_n[i]);
+}
+
+double P2Quantile::value() const {
+	if (m_count == 0) {
+		return 0.0;
+	}
+	if (m_count < 5) {
+		// Not enough samples for the markers yet, use the exact quantile
+		std::array<double, 5> sorted = m_q;
+		std::sort(sorted.begin(), sorted.begin() + m_count);
+		size_t idx = static_cast<size_t>(std::lround(m_p * (m_count - 1)));
+		return sorted[idx];
+	}
+	return m_q[2];
+}
+
+void RenderCostPredictor::WindowedQuantile::reset(double p) {
+	m_est = {P2Quantile(p), P2Quantile(p)};
+	m_sinceRestart = 0;
+}
+
+void RenderCostPredictor::WindowedQuantile::add(double x) {
+	m_est[0].add(x);
+	m_est[1].add(x);
+
+	// Every half window the older estimator starts over, the other one then covers the last half to full window
+	if (++m_sinceRestart >= WINDOW / 2) {
+		m_sinceRestart = 0;
+		m_est[olderIndex()].reset();
+	}
+}
+
+int RenderCostPredictor::WindowedQuantile::olderIndex() const {
+	return m_est[0].count() >= m_est[1].count() ? 0 : 1;
+}
+
+double RenderCostPredictor::WindowedQuantile::value() const {
+	return m_est[olderIndex()].value();
+}
+
+uint32_t RenderCostPredictor::WindowedQuantile::count() const {
+	return m_est[olderIndex()].count();
+}
+
+RenderCostPredictor::RenderCostPredictor(double missProbability)
+    : m_history(kHistory) {
+	setMissProbability(missProbability);
+}
+
+void RenderCostPredictor::setMissProbability(double missProbability) {
+	m_missProbability = std::clamp(missProbability, 0.0001, 0.5);
+	m_render.reset(1.0 - m_missProbability);
+	m_wake.reset(1.0 - m_missProbability);
+	m_wakeTypical.reset(0.5);
+	m_cost.reset(1.0 - m_missProbability);
+}
+
+void RenderCostPredictor::observe(const RenderCostSample &sample) {
+	m_render.add(sample.renderMs);
+
+	// Wake-up overshoot only matters when the prewait ran to its timeout, a frame arriving
+	// early leaves slack anyway
+	if (sample.wakeMs >= 0.0f) {
+		m_wake.add(sample.wakeMs);
+		m_wakeTypical.add(sample.wakeMs);
+	}
+
+	// Iterations without a timeout still stand in for one with a typical wake-up, so the cost
+	// quantile sees every render time
+	const double wakeMs = sample.wakeMs >= 0.0f ? sample.wakeMs : m_wakeTypical.value();
+	m_cost.add(sample.renderMs + wakeMs);
+
+	m_history[m_historyNext] = sample;
+	m_historyNext = (m_historyNext + 1) % kHistory;
+	m_historyCount = std::min(m_historyCount + 1, kHistory);
+}
+
+double RenderCostPredictor::renderQuantileMs() const {
+	return m_render.value();
+}
+
+double RenderCostPredictor::wakeQuantileMs() const {
+	return m_wake.value();
+}
+
+double RenderCostPredictor::budgetMs() const {
+	if (m_cost.count() < WARMUP_SAMPLES) {
+		return INITIAL_BUDGET_MS;
+	}
+	return std::max(MIN_BUDGET_MS, m_cost.value() + PRESENT_MARGIN_MS);
+}
+
+void RenderCostPredictor::copyHistory(std::vector<RenderCostSample> &out) const {
+	out.clear();
+	out.reserve(m_historyCount);
+	uint32_t start = (m_historyNext + kHistory - m_historyCount) % kHistory;
+	for (uint32_t i = 0; i < m_historyCount; ++i) {
+		out.push_back(m_history[(start + i) % kHistory]);
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Streaming quantile estimate using the P-square algorithm (Jain & Chlamtac, 1985).
+// Five markers track the min, max, the target quantile and two points halfway between,
+// so memory and time per sample are constant.
+class P2Quantile {
+  public:
+	explicit P2Quantile(double p = 0.99);
+
+	void reset();
+	void add(double x);
+
+	// Current estimate, 0 before the first sample
+	double value() const;
+	uint32_t count() const { return m_count; }
+
+  private:
+	double parabolic(int i, double d) const;
+	double linear(int i, int d) const;
+
+	double m_p;
+	uint32_t m_count = 0;
+	std::array<double, 5> m_q{};  // marker heights
+	std::array<double, 5> m_n{};  // marker positions
+	std::array<double, 5> m_np{}; // desired marker positions
+	std::array<double, 5> m_dn{}; // desired position increments
+};
+
+// One render loop iteration, as seen by RenderCostPredictor
+struct RenderCostSample {
+	float windowMs; // time from the start of the iteration to the present deadline
+	float renderMs; // Update() + Render()
+	float wakeMs;   // how late waitForFrame() returned after its timeout, -1 if a frame arrived first
+};
+
+// Predicts how much of each vblank interval the render loop must keep free after waiting for a frame.
+//
+// The old estimate was an asymmetric EWMA of render time plus a fixed 1.5ms margin, which reserves
+// too much on average and still misses on spikes. This tracks the (1 - missProbability) quantile
+// of render time plus prewait wake-up overshoot instead, so the prewait is as long as possible
+// for the chosen deadline miss rate. A small margin on top keeps an iteration that costs exactly the
+// quantile from finishing on the vblank itself, which misses it.
+//
+// Quantiles cover roughly the last WINDOW samples: two estimators restart in turn, half a window apart.
+// Not thread-safe, owned by the render loop.
+class RenderCostPredictor {
+  public:
+	static constexpr uint32_t kHistory = 8192; // samples kept for RenderCostBenchmark
+
+	explicit RenderCostPredictor(double missProbability = 0.01);
+
+	// Restarts the estimates
+	void setMissProbability(double missProbability);
+	double missProbability() const { return m_missProbability; }
+
+	void observe(const RenderCostSample &sample);
+
+	// Time to reserve before the present deadline for rendering, in ms
+	double budgetMs() const;
+
+	// Render time and wake-up overshoot at the same quantile, for stats
+	double renderQuantileMs() const;
+	double wakeQuantileMs() const;
+
+	// Most recent samples, oldest first
+	void copyHistory(std::vector<RenderCostSample> &out) const;
+
+  private:
+	static constexpr uint32_t WINDOW = 1200;      // samples, ~10-20s of frames
+	static constexpr double MIN_BUDGET_MS = 0.5;  // never plan to finish right at the deadline
+	static constexpr double PRESENT_MARGIN_MS = 0.25; // on top of the quantile, so Present() comes before the vblank
+	static constexpr double INITIAL_BUDGET_MS = 4.5;
+	static constexpr uint32_t WARMUP_SAMPLES = 30;
+
+	// Pair of P2Quantile covering a sliding window
+	class WindowedQuantile {
+	  public:
+		void reset(double p);
+		void add(double x);
+		double value() const;
+		uint32_t count() const;
+
+	  private:
+		int olderIndex() const;
+		std::array<P2Quantile, 2> m_est;
+		uint32_t m_sinceRestart = 0;
+	};
+
+	double m_missProbability;
+	WindowedQuantile m_render;      // for display
+	WindowedQuantile m_wake;        // for display
+	WindowedQuantile m_wakeTypical; // median wake-up overshoot
+	WindowedQuantile m_cost;        // render + wake-up, drives the budget
+
+	std::vector<RenderCostSample> m_history; // ring, preallocated
+	uint32_t m_historyNext = 0;
+	uint32_t m_historyCount = 0;
+};
@@ -0,0 +1,174 @@
+// Built without the precompiled header, see SoftwareDecoder.h
+#include "SoftwareDecoder.h"
+#include <algorithm>
+#include <thread>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+}
+
+// Row alignment of the output planes, enough for SIMD in swscale and for the renderer's row copies
+#define OUTPUT_LINESIZE_ALIGN 64
+
+SoftwareDecoder::~SoftwareDecoder() {
+	close();
+}
+
+enum AVPixelFormat SoftwareDecoder::outputFormatFor(enum AVPixelFormat decoded) {
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(decoded);
+	const bool tenBit = desc && desc->comp[0].depth > 8;
+	if (desc && desc->log2_chroma_w == 0 && desc->log2_chroma_h == 0) {
+		return tenBit ? AV_PIX_FMT_P410 : AV_PIX_FMT_NV24;
+	}
+	return tenBit ? AV_PIX_FMT_P010 : AV_PIX_FMT_NV12;
+}
+
+int SoftwareDecoder::defaultThreadCount() {
+	const int cores = static_cast<int>(std::thread::hardware_concurrency());
+	return std::clamp(cores, 1, MAX_SLICES);
+}
+
+int SoftwareDecoder::open(enum AVCodecID codecId, int width, int height, bool tenBit, int threads) {
+	close();
+
+	const AVCodec *codec = avcodec_find_decoder(codecId);
+	if (!codec) {
+		av_log(NULL, AV_LOG_ERROR, "SoftwareDecoder: no decoder for %s\n", avcodec_get_name(codecId));
+		return AVERROR_DECODER_NOT_FOUND;
+	}
+	if (codec->capabilities & AV_CODEC_CAP_HARDWARE) {
+		// e.g. FFmpeg's native AV1 decoder, which only works through a hwaccel
+		av_log(NULL, AV_LOG_ERROR, "SoftwareDecoder: %s has no software implementation in this build\n", codec->name);
+		return AVERROR_DECODER_NOT_FOUND;
+	}
+
+	m_ctx = avcodec_alloc_context3(codec);
+	m_decoded = av_frame_alloc();
+	if (!m_ctx || !m_decoded) {
+		close();
+		return AVERROR(ENOMEM);
+	}
+
+	m_threads = threads > 0 ? threads : defaultThreadCount();
+	m_ctx->thread_count = m_threads;
+	m_ctx->thread_type = FF_THREAD_SLICE; // frame threading adds a frame of latency per thread
+	m_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+	m_ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+	m_ctx->pkt_timebase.num = 1;
+	m_ctx->pkt_timebase.den = 90000;
+	m_ctx->width = width;
+	m_ctx->height = height;
+	m_outFormat = tenBit ? AV_PIX_FMT_P010 : AV_PIX_FMT_NV12;
+
+	int err = avcodec_open2(m_ctx, codec, NULL);
+	if (err < 0) {
+		char e[AV_ERROR_MAX_STRING_SIZE];
+		av_log(NULL, AV_LOG_ERROR, "SoftwareDecoder: avcodec_open2 failed: %s\n", av_make_error_string(e, sizeof(e), err));
+		close();
+		return err;
+	}
+
+	av_log(NULL, AV_LOG_INFO, "SoftwareDecoder: %s %dx%d, %d slice threads, %s output\n", codec->name, width, height,
+	       m_threads, av_get_pix_fmt_name(m_outFormat));
+	return 0;
+}
+
+void SoftwareDecoder::close() {
+	avcodec_free_context(&m_ctx);
+	av_frame_free(&m_decoded);
+	sws_freeContext(m_sws);
+	m_sws = nullptr;
+
+	// Frames still holding output buffers keep the pool alive until they are released
+	av_buffer_pool_uninit(&m_outPool);
+	m_outPoolSize = 0;
+	m_threads = 0;
+}
+
+int SoftwareDecoder::send(const AVPacket *packet) {
+	if (!m_ctx) {
+		return AVERROR(EINVAL);
+	}
+	return avcodec_send_packet(m_ctx, packet);
+}
+
+int SoftwareDecoder::allocOutput(AVFrame *out, enum AVPixelFormat format, int width, int height) {
+	const bool fullChroma = format == AV_PIX_FMT_NV24 || format == AV_PIX_FMT_P410;
+	const int bytesPerSample = format == AV_PIX_FMT_P010 || format == AV_PIX_FMT_P410 ? 2 : 1;
+	const int evenWidth = FFALIGN(width, 2);
+	const int chromaHeight = fullChroma ? height : (height + 1) / 2;
+	const int linesize = FFALIGN(evenWidth * bytesPerSample, OUTPUT_LINESIZE_ALIGN);
+	const int chromaLinesize = fullChroma ? FFALIGN(width * 2 * bytesPerSample, OUTPUT_LINESIZE_ALIGN) : linesize;
+	const int lumaSize = linesize * height;
+	const int size = lumaSize + chromaLinesize * chromaHeight;
+
+	if (size != m_outPoolSize) {
+		// Resolution change, buffers in flight keep the old pool alive until they are released
+		av_buffer_pool_uninit(&m_outPool);
+		m_outPool = av_buffer_pool_init(size, NULL);
+		m_outPoolSize = m_outPool ? size : 0;
+	}
+
+	out->buf[0] = m_outPool ? av_buffer_pool_get(m_outPool) : NULL;
+	if (!out->buf[0]) {
+		return AVERROR(ENOMEM);
+	}
+
+	// Both planes in one buffer, the same layout as an NV12/P010 texture
+	out->format = format;
+	out->width = width;
+	out->height = height;
+	out->data[0] = out->buf[0]->data;
+	out->data[1] = out->data[0] + lumaSize;
+	out->linesize[0] = linesize;
+	out->linesize[1] = chromaLinesize;
+	return 0;
+}
+
+int SoftwareDecoder::receive(AVFrame *out) {
+	if (!m_ctx) {
+		return AVERROR(EINVAL);
+	}
+
+	int err = avcodec_receive_frame(m_ctx, m_decoded);
+	if (err < 0) {
+		return err;
+	}
+
+	const int64_t convertStart = av_gettime_relative();
+	const enum AVPixelFormat srcFormat = static_cast<enum AVPixelFormat>(m_decoded->format);
+	m_outFormat = outputFormatFor(srcFormat);
+	if (srcFormat == m_outFormat) {
+		// Already in the surface layout, hand over the decoder's own buffers
+		av_frame_move_ref(out, m_decoded);
+		m_lastConvertMs = 0.0;
+		return 0;
+	}
+
+	m_sws = sws_getCachedContext(m_sws, m_decoded->width, m_decoded->height, srcFormat,
+	                             m_decoded->width, m_decoded->height, m_outFormat, SWS_POINT, NULL, NULL, NULL);
+	if (!m_sws) {
+		av_log(NULL, AV_LOG_ERROR, "SoftwareDecoder: can't convert %s to %s\n", av_get_pix_fmt_name(srcFormat),
+		       av_get_pix_fmt_name(m_outFormat));
+		av_frame_unref(m_decoded);
+		return AVERROR(ENOSYS);
+	}
+
+	err = allocOutput(out, m_outFormat, m_decoded->width, m_decoded->height);
+	if (err >= 0) {
+		// Copy the colour properties first, so swscale sees matching ranges and only repacks
+		err = av_frame_copy_props(out, m_decoded);
+	}
+	if (err >= 0) {
+		err = sws_scale_frame(m_sws, out, m_decoded);
+	}
+	av_frame_unref(m_decoded);
+	if (err < 0) {
+		av_frame_unref(out);
+		return err;
+	}
+
+	m_lastConvertMs = (av_gettime_relative() - convertStart) / 1000.0;
+	return 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+// CPU decoder that produces the same NV12/P010 layout the D3D11VA decoder writes, so its frames can go
+// through FrameQueue and Pacer unchanged and VideoRenderer only has to upload them. 4:4:4 streams come
+// out as NV24/P410, the same two-plane layout with chroma at full resolution.
+//
+// Latency matters more than throughput here: FFmpeg frame threading holds back one frame per thread, so
+// only slice threading is used and the host is asked to encode that many slices per frame
+// (CAPABILITY_SLICES_PER_FRAME). The decoder's planar output is repacked with swscale's unscaled
+// yuv420p -> nv12 / yuv420p10 -> p010 (yuv444p -> nv24 / yuv444p10 -> p410) paths into buffers from an
+// AVBufferPool.
+//
+// Nothing here depends on Windows or D3D11, the file builds without the precompiled header and is used
+// headless by Tools/DecodeBench to measure decode throughput and latency. Not thread-safe, every call
+// has to come from the decoding thread.
+
+class SoftwareDecoder {
+  public:
+	// Slices the host is asked for, and the most threads that can work on one frame
+	static constexpr int MAX_SLICES = 4;
+
+	SoftwareDecoder() = default;
+	~SoftwareDecoder();
+	SoftwareDecoder(const SoftwareDecoder &) = delete;
+	SoftwareDecoder &operator=(const SoftwareDecoder &) = delete;
+
+	// Thread count used for threads <= 0, min(MAX_SLICES, hardware threads)
+	static int defaultThreadCount();
+
+	// Opens a decoder for codecId, output frames are expected to be P010 when tenBit is set and NV12
+	// otherwise, the stream decides in the end. Returns 0 or an AVERROR code, failures are logged through
+	// av_log.
+	int open(enum AVCodecID codecId, int width, int height, bool tenBit, int threads = 0);
+	void close();
+	bool isOpen() const {
+		return m_ctx != nullptr;
+	}
+
+	// Same contract as avcodec_send_packet()
+	int send(const AVPacket *packet);
+
+	// Next decoded picture converted into out, which must be empty. Same return codes as
+	// avcodec_receive_frame(), out keeps the decoded frame's pts and colour properties.
+	int receive(AVFrame *out);
+
+	AVCodecContext *context() const {
+		return m_ctx;
+	}
+	int threadCount() const {
+		return m_threads;
+	}
+	// Format of the last frame returned by receive()
+	enum AVPixelFormat outputFormat() const {
+		return m_outFormat;
+	}
+
+	// NV12/P010 for 4:2:0 sources, NV24/P410 for 4:4:4
+	static enum AVPixelFormat outputFormatFor(enum AVPixelFormat decoded);
+
+	// Time spent in swscale for the last frame returned by receive()
+	double lastConvertMs() const {
+		return m_lastConvertMs;
+	}
+
+  private:
+	// Points out at a pooled buffer laid out like an NV12/P010 (NV24/P410) surface of the given size
+	int allocOutput(AVFrame *out, enum AVPixelFormat format, int width, int height);
+
+	AVCodecContext *m_ctx = nullptr;
+	AVFrame *m_decoded = nullptr;     // reused for every avcodec_receive_frame()
+	SwsContext *m_sws = nullptr;
+	AVBufferPool *m_outPool = nullptr;
+	int m_outPoolSize = 0;
+	enum AVPixelFormat m_outFormat = AV_PIX_FMT_NONE;
+	int m_threads = 0;
+	double m_lastConvertMs = 0.0;
+};
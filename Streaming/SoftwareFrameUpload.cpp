@@ -0,0 +1,36 @@
+// Built without the precompiled header, see SoftwareFrameUpload.h
+#include "SoftwareFrameUpload.h"
+#include <algorithm>
+#include <cstring>
+
+bool SoftwareUploadLayout::init(AVPixelFormat format, int frameWidth, int frameHeight) {
+	if (format != AV_PIX_FMT_NV12 && format != AV_PIX_FMT_P010 && format != AV_PIX_FMT_NV24 && format != AV_PIX_FMT_P410) {
+		return false;
+	}
+
+	tenBit = format == AV_PIX_FMT_P010 || format == AV_PIX_FMT_P410;
+	fullChroma = format == AV_PIX_FMT_NV24 || format == AV_PIX_FMT_P410;
+	width = (frameWidth + 1) & ~1;
+	height = (frameHeight + 1) & ~1;
+
+	// Chroma holds interleaved U/V, at half resolution it has the same row size in bytes as luma
+	const size_t sampleBytes = tenBit ? 2 : 1;
+	planes[0].width = width;
+	planes[0].height = height;
+	planes[0].rowBytes = width * sampleBytes;
+	planes[0].rows = frameHeight;
+	planes[1].width = fullChroma ? width : width / 2;
+	planes[1].height = fullChroma ? height : height / 2;
+	planes[1].rowBytes = planes[1].width * sampleBytes * 2;
+	planes[1].rows = fullChroma ? frameHeight : (frameHeight + 1) / 2;
+	return true;
+}
+
+void SoftwareUploadLayout::copyPlane(int plane, const uint8_t *src, int srcLinesize, uint8_t *dst, size_t dstRowPitch) const {
+	const size_t copyBytes = std::min({planes[plane].rowBytes, dstRowPitch, (size_t)srcLinesize});
+	for (int row = 0; row < planes[plane].rows; row++) {
+		memcpy(dst, src, copyBytes);
+		src += srcLinesize;
+		dst += dstRowPitch;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+
+// Where the planes of a software decoded frame go in VideoRenderer's upload textures.
+//
+// Luma goes into an R8/R16 texture, the interleaved U/V plane into an R8G8/R16G16 texture that is half the
+// size for NV12/P010 and full size for 4:4:4 (NV24/P410). 10-bit formats keep FFmpeg's MSB aligned samples,
+// the shader reads them as 16-bit UNORM. Sizes are rounded up to even like decoder surfaces.
+//
+// No Windows dependencies, the file builds without the precompiled header and Tools/RenderCheck checks
+// the repack of every format against the CSC table.
+
+struct SoftwareUploadPlane {
+	uint32_t width = 0;  // texture size in texels
+	uint32_t height = 0;
+	size_t rowBytes = 0; // bytes of a texture row that hold samples
+	int rows = 0;        // rows of the frame's plane that are copied
+};
+
+struct SoftwareUploadLayout {
+	bool tenBit = false;
+	bool fullChroma = false;
+	uint32_t width = 0; // both planes described as one NV12/P010 surface
+	uint32_t height = 0;
+	std::array<SoftwareUploadPlane, 2> planes;
+
+	// False if the renderer can't upload the format
+	bool init(AVPixelFormat format, int frameWidth, int frameHeight);
+
+	// Copies one plane from the frame into a mapped texture, rows that don't fit either pitch are cut short
+	void copyPlane(int plane, const uint8_t *src, int srcLinesize, uint8_t *dst, size_t dstRowPitch) const;
+};
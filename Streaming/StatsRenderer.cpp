@@ -27,11 +27,11 @@ void StatsRenderer::Update(DX::StepTimer const &timer) {
 	// We let the Stats class always process even if not visible. Most of the time
 	// it will simply accumulate stats during its 1-second window period. Each second,
 	// when it determines the user-visible text should be updated, it will update outputStr and return true.
-	char outputStr[1024]; // char is used so we can share more of the formatting code with moonlight-qt
+	char outputStr[2048]; // char is used so we can share more of the formatting code with moonlight-qt
 	wchar_t wideStr[2048];
 
 	if (Stats::instance().ShouldUpdateDisplay(timer, m_visible, outputStr, sizeof(outputStr))) {
-		size_t numChars = mbstowcs(wideStr, outputStr, 1024);
+		size_t numChars = mbstowcs(wideStr, outputStr, _countof(wideStr));
 		if (numChars != -1) {
 			m_console->Clear();
 			m_console->Write(wideStr);
@@ -61,17 +61,8 @@ static inline float clampGetter(void *data, int idx) {
 }
 
 void StatsRenderer::RenderGraphs() {
-	// we malloc a buffer for each stat only once and reuse it each frame
-	assert(PlotCount == 8);
-	static float *buffers[8] = {
-	    (float *)malloc(sizeof(float) * 512),
-	    (float *)malloc(sizeof(float) * 512),
-	    (float *)malloc(sizeof(float) * 512),
-	    (float *)malloc(sizeof(float) * 512),
-	    (float *)malloc(sizeof(float) * 512),
-	    (float *)malloc(sizeof(float) * 512),
-	    (float *)malloc(sizeof(float) * 512),
-	    (float *)malloc(sizeof(float) * 512)};
+	// we allocate a buffer for each stat only once and reuse it each frame
+	static float buffers[PlotCount][512];
 
 	float graphW = 850.0f * (m_displayWidth / 3840.0f);
 	float graphH = 120.0f * (m_displayHeight / 2160.0f);
@@ -81,7 +72,8 @@ void StatsRenderer::RenderGraphs() {
 	        graphW, graphH, m_displayWidth, m_displayHeight, opacity);
 
 	// Row 1: 3 graphs
-	// Row 2: 2 graphs left-aligned
+	// Row 2: 3 graphs
+	// Row 3: 2 graphs left-aligned
 	float itemSpacingX = ImGui::GetStyle().ItemSpacing.x;
 	float itemSpacingY = ImGui::GetStyle().ItemSpacing.y;
 	float row1Width = (3 * graphW) + (2 * itemSpacingX);
@@ -161,9 +153,14 @@ void StatsRenderer::RenderGraphs() {
 		draw_plot(row2[c], graphW, graphH);
 	}
 
-	// 3rd row for quickly graphing something if needed
-	// ImGui::Dummy(ImVec2(1.0f, itemSpacingY));
-	// draw_plot(PLOT_ETC, graphW, graphH);
+	ImGui::Dummy(ImVec2(1.0f, itemSpacingY));
+	const int row3[2] = {PLOT_QUEUE_DEPTH, PLOT_QUEUE_LATENCY};
+	for (int c = 0; c < 2; ++c) {
+		if (c > 0) ImGui::SameLine(0.0f, itemSpacingX);
+		draw_plot(row3[c], graphW, graphH);
+	}
+
+	// PLOT_ETC is available for quickly graphing something if needed
 
 	ImGui::End();
 }
@@ -187,22 +184,22 @@ void StatsRenderer::CreateWindowSizeDependentResources() {
 	int right = m_displayWidth / 3;
 	int bottom = 0;
 
-	// 12 lines of text
+	// 15 lines of text
 	if (m_displayHeight >= 2160) { // 24pt font
 		left = 20;
 		right = m_displayWidth / 2;
-		bottom = 446;
+		bottom = 555;
 	} else if (m_displayHeight >= 1440) { // 12pt font
 		left = 14;
-		bottom = 224;
+		bottom = 280;
 	} else {
 		left = 10;
-		bottom = 224;
+		bottom = 280;
 	}
 
 #if defined(_DEBUG)
-	// make room for 4 extra lines of stats
-	bottom += (m_displayHeight >= 2160) ? 140 : 70;
+	// make room for 9 extra lines of stats
+	bottom += (m_displayHeight >= 2160) ? 315 : 158;
 #endif
 
 	// The size of our text area (left, top, right, bottom)
@@ -0,0 +1,194 @@
+// clang-format off
+#include "pch.h"
+// clang-format on
+#include "StreamCapture.h"
+#include <cstring>
+#include <ctime>
+#include <Limelight.h>
+#include "Utils.hpp"
+
+// Buffers kept for reuse, enough for the units in flight at a steady bitrate
+#define MAX_SPARE_BUFFERS 16
+
+StreamCapture &StreamCapture::instance() {
+	static StreamCapture inst;
+	return inst;
+}
+
+StreamCapture::~StreamCapture() {
+	stop();
+	if (m_Writer.joinable()) {
+		m_Writer.join();
+	}
+}
+
+void StreamCapture::setStream(int videoFormat, int width, int height, int fps) {
+	std::lock_guard<std::mutex> lock(m_Lock);
+	memcpy(m_Header.magic, STREAM_CAPTURE_MAGIC, sizeof(m_Header.magic));
+	m_Header.version = STREAM_CAPTURE_VERSION;
+	m_Header.recordSize = sizeof(StreamCaptureRecord);
+	m_Header.codec = (videoFormat & VIDEO_FORMAT_MASK_H264)   ? STREAM_CAPTURE_H264
+	                 : (videoFormat & VIDEO_FORMAT_MASK_H265) ? STREAM_CAPTURE_HEVC
+	                                                          : STREAM_CAPTURE_AV1;
+	m_Header.bitDepth = (videoFormat & VIDEO_FORMAT_MASK_10BIT) ? 10 : 8;
+	m_Header.width = width;
+	m_Header.height = height;
+	m_Header.fps = fps;
+}
+
+std::wstring StreamCapture::start() {
+	if (active()) {
+		return std::wstring();
+	}
+	// A previous capture may still be flushing
+	if (m_Writer.joinable()) {
+		m_Writer.join();
+	}
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (m_Header.codec == 0) {
+		Utils::Log("StreamCapture: no stream to capture\n");
+		return std::wstring();
+	}
+
+	wchar_t name[64];
+	time_t now = time(nullptr);
+	struct tm local;
+	localtime_s(&local, &now);
+	wcsftime(name, _countof(name), L"\\capture-%Y%m%d-%H%M%S", &local);
+	Platform::String ^ folder = Windows::Storage::ApplicationData::Current->LocalFolder->Path;
+	const std::wstring base = std::wstring(folder->Data()) + name;
+	const wchar_t *ext = m_Header.codec == STREAM_CAPTURE_H264 ? L".h264" : m_Header.codec == STREAM_CAPTURE_HEVC ? L".hevc" : L".obu";
+	const std::wstring streamPath = base + ext;
+	const std::wstring indexPath = base + L".idx";
+
+	FILE *stream = nullptr, *index = nullptr;
+	if (_wfopen_s(&stream, streamPath.c_str(), L"wb") != 0 || !stream || _wfopen_s(&index, indexPath.c_str(), L"wb") != 0 || !index ||
+	    fwrite(&m_Header, sizeof(m_Header), 1, index) != 1) {
+		Utils::Logf("StreamCapture: couldn't create %ls\n", base.c_str());
+		if (stream) fclose(stream);
+		if (index) fclose(index);
+		return std::wstring();
+	}
+
+	m_Queue.clear();
+	m_QueuedBytes = 0;
+	m_Offset = 0;
+	m_WaitingForIdr = true;
+	m_Gap = false;
+	m_Dropped = 0;
+	m_Active.store(true, std::memory_order_release);
+	m_Writer = std::thread(&StreamCapture::writerLoop, this, stream, index);
+
+	Utils::Logf("StreamCapture: capturing to %ls from the next IDR\n", streamPath.c_str());
+	return streamPath;
+}
+
+void StreamCapture::stop() {
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (!m_Active.load(std::memory_order_relaxed)) {
+			return;
+		}
+		m_Active.store(false, std::memory_order_release);
+	}
+	m_Wake.notify_one();
+}
+
+// Decoder thread
+void StreamCapture::submit(uint32_t frameNumber, uint32_t rtpTimestamp, int frameType, uint64_t receiveTimeUs,
+                           uint64_t enqueueTimeUs, const uint8_t *data, size_t size) {
+	if (!active()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (!m_Active.load(std::memory_order_relaxed)) {
+			return;
+		}
+		if (m_WaitingForIdr) {
+			if (frameType != FRAME_TYPE_IDR) {
+				return;
+			}
+			m_WaitingForIdr = false;
+		}
+		if (m_QueuedBytes + size > kMaxQueuedBytes) {
+			m_Dropped++;
+			m_Gap = true;
+			return;
+		}
+
+		Unit unit;
+		if (!m_Spare.empty()) {
+			unit.data = std::move(m_Spare.back());
+			m_Spare.pop_back();
+		}
+		unit.data.assign(data, data + size);
+
+		StreamCaptureRecord &r = unit.record;
+		r.offset = m_Offset;
+		r.size = static_cast<uint32_t>(size);
+		r.frameNumber = frameNumber;
+		r.rtpTimestamp = rtpTimestamp;
+		r.frameType = static_cast<uint16_t>(frameType);
+		r.flags = m_Gap ? STREAM_CAPTURE_FLAG_GAP : 0;
+		r.receiveTimeUs = receiveTimeUs;
+		r.enqueueTimeUs = enqueueTimeUs;
+
+		m_Offset += size;
+		m_QueuedBytes += size;
+		m_Gap = false;
+		m_Queue.push_back(std::move(unit));
+	}
+	m_Wake.notify_one();
+}
+
+void StreamCapture::writerLoop(FILE *stream, FILE *index) {
+	uint32_t written = 0;
+	uint64_t bytes = 0;
+	bool failed = false;
+
+	for (;;) {
+		std::deque<Unit> batch;
+		{
+			std::unique_lock<std::mutex> lock(m_Lock);
+			m_Wake.wait(lock, [this] { return !m_Queue.empty() || !m_Active.load(std::memory_order_relaxed); });
+			if (m_Queue.empty()) {
+				break;
+			}
+			batch.swap(m_Queue);
+		}
+
+		size_t batchBytes = 0;
+		for (Unit &unit : batch) {
+			batchBytes += unit.data.size();
+			if (failed) {
+				continue;
+			}
+			if (fwrite(unit.data.data(), 1, unit.data.size(), stream) != unit.data.size() ||
+			    fwrite(&unit.record, sizeof(unit.record), 1, index) != 1) {
+				Utils::Log("StreamCapture: write failed, discarding the rest of the capture\n");
+				failed = true;
+				continue;
+			}
+			written++;
+			bytes += unit.data.size();
+		}
+
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_QueuedBytes -= batchBytes;
+		for (Unit &unit : batch) {
+			if (m_Spare.size() >= MAX_SPARE_BUFFERS) {
+				break;
+			}
+			m_Spare.push_back(std::move(unit.data));
+		}
+	}
+
+	fclose(stream);
+	fclose(index);
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	Utils::Logf("StreamCapture: wrote %u units (%llu bytes), %u dropped\n", written, static_cast<unsigned long long>(bytes), m_Dropped);
+}
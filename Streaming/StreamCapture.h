@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "StreamCaptureFormat.h"
+
+// Tees decode units to disk so a decode stall can be reproduced offline (see StreamCaptureFormat.h and
+// Tools/DecodeBench).
+//
+// The decoder thread only copies each unit into a queue, a writer thread does the file I/O. The lock is
+// held for queue operations only, never across I/O. When more than kMaxQueuedBytes are waiting the unit is
+// dropped and the next written one carries STREAM_CAPTURE_FLAG_GAP, so a slow disk can't stall decoding.
+// Capturing starts with the next IDR so the file is decodable from its first unit.
+
+class StreamCapture {
+  public:
+	static constexpr size_t kMaxQueuedBytes = 32 * 1024 * 1024;
+
+	// Singleton accessor
+	static StreamCapture &instance();
+
+	// Decoder thread, from Init: the stream the following units belong to
+	void setStream(int videoFormat, int width, int height, int fps);
+
+	// Opens the capture files in the app's local folder, returns the elementary stream path or an empty
+	// string on failure. The caller should request an IDR, nothing is written until one arrives.
+	std::wstring start();
+
+	// Stops capturing, the writer flushes what is queued in the background
+	void stop();
+
+	bool active() const {
+		return m_Active.load(std::memory_order_acquire);
+	}
+
+	// Decoder thread, once per decode unit. data is one complete access unit.
+	void submit(uint32_t frameNumber, uint32_t rtpTimestamp, int frameType, uint64_t receiveTimeUs, uint64_t enqueueTimeUs,
+	            const uint8_t *data, size_t size);
+
+  private:
+	StreamCapture() = default;
+	~StreamCapture();
+	StreamCapture(const StreamCapture &) = delete;
+	StreamCapture &operator=(const StreamCapture &) = delete;
+
+	struct Unit {
+		StreamCaptureRecord record;
+		std::vector<uint8_t> data;
+	};
+
+	void writerLoop(FILE *stream, FILE *index);
+
+	StreamCaptureFileHeader m_Header = {};
+	std::atomic<bool> m_Active{false};
+	std::thread m_Writer;
+
+	// Guarded by m_Lock
+	std::mutex m_Lock;
+	std::condition_variable m_Wake;
+	std::deque<Unit> m_Queue;
+	std::vector<std::vector<uint8_t>> m_Spare; // buffers the writer is done with
+	size_t m_QueuedBytes = 0;
+	uint64_t m_Offset = 0;
+	bool m_WaitingForIdr = false;
+	bool m_Gap = false;
+	uint32_t m_Dropped = 0;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+// On-disk layout of a stream capture written by StreamCapture.
+//
+// A capture is two files with the same name: the elementary stream exactly as the host sent it (.h264/.hevc
+// Annex-B, .obu for AV1) and an index (.idx). The index is a StreamCaptureFileHeader followed by one
+// StreamCaptureRecord per decode unit, as many as fit in the file. Every unit is a complete access unit and
+// the first one is an IDR.
+//
+// This header has no Windows dependencies, it is shared with Tools/DecodeBench which replays captures.
+// Bump STREAM_CAPTURE_VERSION when the layout changes.
+
+#define STREAM_CAPTURE_MAGIC "MLESCAPT"
+#define STREAM_CAPTURE_VERSION 1
+
+enum StreamCaptureCodec : uint32_t {
+	STREAM_CAPTURE_H264 = 1,
+	STREAM_CAPTURE_HEVC,
+	STREAM_CAPTURE_AV1,
+};
+
+enum StreamCaptureFlags : uint16_t {
+	STREAM_CAPTURE_FLAG_GAP = 1 << 0, // units before this one were dropped because the writer fell behind
+};
+
+struct StreamCaptureFileHeader {
+	char magic[8];       // STREAM_CAPTURE_MAGIC, not null terminated
+	uint32_t version;    // STREAM_CAPTURE_VERSION
+	uint32_t recordSize; // sizeof(StreamCaptureRecord)
+	uint32_t codec;      // StreamCaptureCodec
+	uint32_t bitDepth;   // 8 or 10
+	uint32_t width;
+	uint32_t height;
+	uint32_t fps;
+	uint32_t reserved;
+};
+
+struct StreamCaptureRecord {
+	uint64_t offset;        // of the unit in the elementary stream file
+	uint32_t size;          // bytes
+	uint32_t frameNumber;   // moonlight-common-c frame number, gaps are network losses
+	uint32_t rtpTimestamp;  // host timestamp, 90kHz
+	uint16_t frameType;     // moonlight-common-c FRAME_TYPE_*
+	uint16_t flags;         // StreamCaptureFlags
+	uint64_t receiveTimeUs; // first packet of the frame received
+	uint64_t enqueueTimeUs; // frame reassembled and queued for the decoder
+};
+
+static_assert(sizeof(StreamCaptureFileHeader) == 40, "stream capture header layout changed");
+static_assert(sizeof(StreamCaptureRecord) == 40, "stream capture record layout changed");
@@ -0,0 +1,572 @@
+// clang-format off
+#include "pch.h"
+// clang-format on
+#include "StreamRecorder.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include "State/Stats.h"
+#include "Utils.hpp"
+
+extern "C" {
+#include <Limelight.h>
+#include <libavcodec/avcodec.h>
+#include <libavcodec/bsf.h>
+#include <libavformat/avformat.h>
+}
+
+using namespace moonlight_xbox_dx;
+
+static const AVRational kMicroseconds = {1, 1000000};
+
+// Parameter sets of the first keyframe, in the Annex-B/OBU form the host sends. The muxers convert them to
+// avcC/hvcC/av1C, and the units themselves to length-prefixed NAL units.
+static bool extractExtradata(AVCodecParameters *par, const uint8_t *data, size_t size) {
+	const AVBitStreamFilter *filter = av_bsf_get_by_name("extract_extradata");
+	AVBSFContext *bsf = nullptr;
+	AVPacket *packet = av_packet_alloc();
+	bool found = false;
+	if (filter && packet && av_bsf_alloc(filter, &bsf) >= 0 && avcodec_parameters_copy(bsf->par_in, par) >= 0 && av_bsf_init(bsf) >= 0 &&
+	    av_new_packet(packet, static_cast<int>(size)) >= 0) {
+		memcpy(packet->data, data, size);
+		if (av_bsf_send_packet(bsf, packet) >= 0 && av_bsf_receive_packet(bsf, packet) >= 0) {
+			size_t extradataSize = 0;
+			const uint8_t *extradata = av_packet_get_side_data(packet, AV_PKT_DATA_NEW_EXTRADATA, &extradataSize);
+			if (extradata && extradataSize > 0) {
+				par->extradata = static_cast<uint8_t *>(av_mallocz(extradataSize + AV_INPUT_BUFFER_PADDING_SIZE));
+				if (par->extradata) {
+					memcpy(par->extradata, extradata, extradataSize);
+					par->extradata_size = static_cast<int>(extradataSize);
+					found = true;
+				}
+			}
+		}
+	}
+	av_packet_free(&packet);
+	av_bsf_free(&bsf);
+	return found;
+}
+
+// One output file. It starts at the first video keyframe written to it, audio before that is dropped.
+class StreamRecorder::Muxer {
+  public:
+	Muxer(std::string path, RecordingContainer container, const VideoParams &video, const AudioParams &audio)
+	    : m_Path(std::move(path)), m_Container(container), m_Video(video), m_Audio(audio) {
+	}
+	~Muxer() {
+		close();
+	}
+	Muxer(const Muxer &) = delete;
+	Muxer &operator=(const Muxer &) = delete;
+
+	// False once writing failed, the file is closed then
+	bool write(const Unit &unit) {
+		if (m_Failed) {
+			return false;
+		}
+		if (!m_Fmt) {
+			if (!unit.video || !unit.keyframe) {
+				return true;
+			}
+			if (!open(unit)) {
+				Utils::Logf("StreamRecorder: couldn't create %s\n", m_Path.c_str());
+				m_Failed = true;
+				close();
+				return false;
+			}
+		}
+		AVStream *stream = unit.video ? m_VideoStream : m_AudioStream;
+		if (!stream || unit.ptsUs < m_StartUs) {
+			return true;
+		}
+
+		int64_t &lastPts = m_LastPts[unit.video ? 0 : 1];
+		int64_t pts = av_rescale_q(unit.ptsUs - m_StartUs, kMicroseconds, stream->time_base);
+		if (pts <= lastPts) {
+			// Timestamps only go backwards by rounding or when a late audio anchor overlaps the video
+			pts = lastPts + 1;
+		}
+		lastPts = pts;
+
+		// Not refcounted, the muxer copies the data when it has to keep it for interleaving
+		m_Packet->data = const_cast<uint8_t *>(unit.data.data());
+		m_Packet->size = static_cast<int>(unit.data.size());
+		m_Packet->stream_index = stream->index;
+		m_Packet->pts = pts;
+		m_Packet->dts = pts;
+		m_Packet->duration = av_rescale_q(unit.durationUs, kMicroseconds, stream->time_base);
+		m_Packet->flags = (unit.keyframe || !unit.video) ? AV_PKT_FLAG_KEY : 0;
+		int err = av_interleaved_write_frame(m_Fmt, m_Packet);
+		if (err < 0) {
+			char msg[AV_ERROR_MAX_STRING_SIZE];
+			av_strerror(err, msg, sizeof(msg));
+			Utils::Logf("StreamRecorder: writing %s failed: %s\n", m_Path.c_str(), msg);
+			m_Failed = true;
+			close();
+			return false;
+		}
+		m_Bytes += unit.data.size();
+		m_EndUs = std::max(m_EndUs, unit.ptsUs);
+		return true;
+	}
+
+	void close() {
+		if (m_Fmt) {
+			if (m_HeaderWritten) {
+				av_write_trailer(m_Fmt);
+			}
+			if (!(m_Fmt->oformat->flags & AVFMT_NOFILE)) {
+				avio_closep(&m_Fmt->pb);
+			}
+			avformat_free_context(m_Fmt);
+			m_Fmt = nullptr;
+			if (!m_Failed) {
+				Utils::Logf("StreamRecorder: wrote %s, %.1f MB, %.1f s\n", m_Path.c_str(), m_Bytes / (1024.0 * 1024.0),
+				            (m_EndUs - m_StartUs) / 1000000.0);
+			}
+		}
+		av_packet_free(&m_Packet);
+	}
+
+  private:
+	bool open(const Unit &keyframe) {
+		m_Packet = av_packet_alloc();
+		if (!m_Packet || avformat_alloc_output_context2(&m_Fmt, nullptr, m_Container == RecordingContainer::MP4 ? "mp4" : "matroska",
+		                                                m_Path.c_str()) < 0) {
+			return false;
+		}
+
+		m_VideoStream = avformat_new_stream(m_Fmt, nullptr);
+		if (!m_VideoStream) {
+			return false;
+		}
+		AVCodecParameters *par = m_VideoStream->codecpar;
+		par->codec_type = AVMEDIA_TYPE_VIDEO;
+		par->codec_id = static_cast<AVCodecID>(m_Video.codecId);
+		par->width = m_Video.width;
+		par->height = m_Video.height;
+		m_VideoStream->time_base = {1, 90000};
+		m_VideoStream->avg_frame_rate = {m_Video.fps, 1};
+		if (!extractExtradata(par, keyframe.data.data(), keyframe.data.size())) {
+			Utils::Log("StreamRecorder: no parameter sets in the keyframe\n");
+			return false;
+		}
+
+		if (m_Audio.sampleRate > 0) {
+			m_AudioStream = avformat_new_stream(m_Fmt, nullptr);
+			if (!m_AudioStream) {
+				return false;
+			}
+			par = m_AudioStream->codecpar;
+			par->codec_type = AVMEDIA_TYPE_AUDIO;
+			par->codec_id = AV_CODEC_ID_OPUS;
+			par->sample_rate = m_Audio.sampleRate;
+			av_channel_layout_default(&par->ch_layout, m_Audio.channelCount);
+			par->extradata = static_cast<uint8_t *>(av_mallocz(m_Audio.opusHead.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+			if (!par->extradata) {
+				return false;
+			}
+			memcpy(par->extradata, m_Audio.opusHead.data(), m_Audio.opusHead.size());
+			par->extradata_size = static_cast<int>(m_Audio.opusHead.size());
+			m_AudioStream->time_base = {1, m_Audio.sampleRate};
+		}
+
+		if (!(m_Fmt->oformat->flags & AVFMT_NOFILE) && avio_open(&m_Fmt->pb, m_Path.c_str(), AVIO_FLAG_WRITE) < 0) {
+			return false;
+		}
+		AVDictionary *options = nullptr;
+		if (m_Container == RecordingContainer::MP4) {
+			av_dict_set(&options, "movflags", "+frag_keyframe+empty_moov+default_base_moof", 0);
+		}
+		int err = avformat_write_header(m_Fmt, &options);
+		av_dict_free(&options);
+		if (err < 0) {
+			return false;
+		}
+		m_HeaderWritten = true;
+		m_StartUs = keyframe.ptsUs;
+		m_EndUs = keyframe.ptsUs;
+		return true;
+	}
+
+	std::string m_Path;
+	RecordingContainer m_Container;
+	VideoParams m_Video;
+	AudioParams m_Audio;
+	AVFormatContext *m_Fmt = nullptr;
+	AVStream *m_VideoStream = nullptr;
+	AVStream *m_AudioStream = nullptr;
+	AVPacket *m_Packet = nullptr;
+	bool m_HeaderWritten = false;
+	bool m_Failed = false;
+	int64_t m_StartUs = 0;
+	int64_t m_EndUs = 0;
+	int64_t m_LastPts[2] = {-1, -1};
+	uint64_t m_Bytes = 0;
+};
+
+StreamRecorder &StreamRecorder::instance() {
+	static StreamRecorder inst;
+	return inst;
+}
+
+StreamRecorder::~StreamRecorder() {
+	shutdown();
+}
+
+void StreamRecorder::configure(RecordingContainer container, int replaySeconds) {
+	m_Container = container;
+	m_ReplaySeconds = std::max(replaySeconds, 0);
+	if (m_ReplaySeconds > 0) {
+		ensureWriter();
+	}
+}
+
+void StreamRecorder::setVideo(int videoFormat, int width, int height, int fps) {
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Video.codecId = (videoFormat & VIDEO_FORMAT_MASK_H264)   ? AV_CODEC_ID_H264
+		                  : (videoFormat & VIDEO_FORMAT_MASK_H265) ? AV_CODEC_ID_HEVC
+		                                                           : AV_CODEC_ID_AV1;
+		m_Video.width = width;
+		m_Video.height = height;
+		m_Video.fps = fps;
+	}
+	m_VideoWaitForKeyframe = true;
+	m_VideoAnchored = false;
+}
+
+void StreamRecorder::setAudio(int sampleRate, int channelCount, int streams, int coupledStreams, const uint8_t *mapping) {
+	// OpusHead, RFC 7845 section 5.1. Mapping family 0 covers mono and stereo in a single stream.
+	const bool family0 = channelCount <= 2 && streams == 1;
+	std::vector<uint8_t> head = {'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, static_cast<uint8_t>(channelCount), 0, 0};
+	for (int shift = 0; shift < 32; shift += 8) {
+		head.push_back(static_cast<uint8_t>(sampleRate >> shift));
+	}
+	head.insert(head.end(), {0, 0, static_cast<uint8_t>(family0 ? 0 : 1)});
+	if (!family0) {
+		head.push_back(static_cast<uint8_t>(streams));
+		head.push_back(static_cast<uint8_t>(coupledStreams));
+		head.insert(head.end(), mapping, mapping + channelCount);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Audio.sampleRate = sampleRate;
+		m_Audio.channelCount = channelCount;
+		m_Audio.opusHead = std::move(head);
+	}
+	m_AudioSampleRate = sampleRate;
+	m_AudioAnchored = false;
+}
+
+std::string StreamRecorder::outputPath(const char *prefix) const {
+	char name[64];
+	time_t now = time(nullptr);
+	struct tm local;
+	localtime_s(&local, &now);
+	strftime(name, sizeof(name), "-%Y%m%d-%H%M%S", &local);
+	Platform::String ^ folder = Windows::Storage::ApplicationData::Current->LocalFolder->Path;
+	return Utils::PlatformStringToStdString(folder) + "\\" + prefix + name + (m_Container == RecordingContainer::MP4 ? ".mp4" : ".mkv");
+}
+
+void StreamRecorder::ensureWriter() {
+	m_Active.store(true, std::memory_order_release);
+	if (m_Writer.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Stop = false;
+	}
+	m_Writer = std::thread(&StreamRecorder::writerLoop, this);
+}
+
+bool StreamRecorder::startRecording() {
+	if (recording()) {
+		return false;
+	}
+	const std::string path = outputPath("recording");
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (m_Video.codecId == 0) {
+			Utils::Log("StreamRecorder: no stream to record\n");
+			return false;
+		}
+		m_RecordingRequested = true;
+		m_RecordingPath = path;
+	}
+	m_Recording.store(true, std::memory_order_release);
+	ensureWriter();
+	m_Wake.notify_one();
+	Utils::Logf("StreamRecorder: recording to %s from the next IDR\n", path.c_str());
+	return true;
+}
+
+void StreamRecorder::stopRecording() {
+	if (!m_Recording.exchange(false, std::memory_order_acq_rel)) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_RecordingRequested = false;
+	}
+	if (m_ReplaySeconds == 0) {
+		m_Active.store(false, std::memory_order_release);
+	}
+	m_Wake.notify_one();
+}
+
+bool StreamRecorder::saveReplay() {
+	if (m_ReplaySeconds == 0 || !m_Writer.joinable()) {
+		Utils::Log("StreamRecorder: the replay buffer is off, enable it in the host settings\n");
+		return false;
+	}
+	bool expected = false;
+	if (!m_Saving.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+		Utils::Log("StreamRecorder: still saving the last replay\n");
+		return false;
+	}
+	const std::string path = outputPath("replay");
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_SaveRequested = true;
+		m_SavePath = path;
+	}
+	m_Wake.notify_one();
+	return true;
+}
+
+void StreamRecorder::shutdown() {
+	m_Recording.store(false, std::memory_order_release);
+	m_Active.store(false, std::memory_order_release);
+	if (m_Writer.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_Lock);
+			m_Stop = true;
+		}
+		m_Wake.notify_one();
+		m_Writer.join();
+	}
+	if (m_Saver.joinable()) {
+		m_Saver.join();
+	}
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Queue.clear();
+	m_QueuedBytes = 0;
+	m_RecordingRequested = false;
+	m_SaveRequested = false;
+	m_Video = VideoParams();
+	m_Audio = AudioParams();
+}
+
+bool StreamRecorder::enqueue(UnitPtr unit) {
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (m_QueuedBytes + unit->data.size() > kMaxQueuedBytes) {
+			m_Dropped++;
+			return false;
+		}
+		m_QueuedBytes += unit->data.size();
+		m_Queue.push_back(std::move(unit));
+	}
+	m_Wake.notify_one();
+	return true;
+}
+
+// Decoder thread
+void StreamRecorder::submitVideo(const uint8_t *data, size_t size, bool keyframe, uint32_t rtpTimestamp) {
+	// 90 kHz RTP time, unwrapped. Followed even while nothing is recorded so the clock stays on the audio's.
+	if (!m_VideoAnchored) {
+		m_VideoAnchored = true;
+		m_VideoPts90k = 0;
+		m_VideoAnchorUs = QpcToUs(QpcNow());
+	} else {
+		m_VideoPts90k += static_cast<int32_t>(rtpTimestamp - m_LastRtp);
+	}
+	m_LastRtp = rtpTimestamp;
+
+	if (!m_Active.load(std::memory_order_acquire) || (m_VideoWaitForKeyframe && !keyframe)) {
+		return;
+	}
+	const int64_t start = QpcNow();
+
+	auto unit = std::make_shared<Unit>();
+	unit->data.assign(data, data + size);
+	unit->ptsUs = m_VideoAnchorUs + m_VideoPts90k * 1000 / 90;
+	unit->durationUs = 0;
+	unit->video = true;
+	unit->keyframe = keyframe;
+	const bool queued = enqueue(std::move(unit));
+	if (queued) {
+		m_VideoWaitForKeyframe = false;
+	} else if (!m_VideoWaitForKeyframe) {
+		// Everything up to the next keyframe would reference the dropped unit
+		m_VideoWaitForKeyframe = true;
+		LiRequestIdrFrame();
+	}
+	Stats::instance().SubmitRecorderInput(QpcToMs(QpcNow() - start), !queued);
+}
+
+// Audio thread
+void StreamRecorder::submitAudio(const uint8_t *data, size_t size, int samples) {
+	// Counted even while nothing is recorded, like the video clock
+	if (!m_AudioAnchored) {
+		m_AudioAnchored = true;
+		m_AudioSamples = 0;
+		m_AudioAnchorUs = QpcToUs(QpcNow());
+	}
+	const int64_t ptsUs = m_AudioAnchorUs + m_AudioSamples * 1000000 / m_AudioSampleRate;
+	m_AudioSamples += samples;
+
+	// A lost packet leaves a gap in the file
+	if (!m_Active.load(std::memory_order_acquire) || !data || size == 0) {
+		return;
+	}
+	const int64_t start = QpcNow();
+
+	auto unit = std::make_shared<Unit>();
+	unit->data.assign(data, data + size);
+	unit->ptsUs = ptsUs;
+	unit->durationUs = static_cast<int64_t>(samples) * 1000000 / m_AudioSampleRate;
+	unit->video = false;
+	unit->keyframe = false;
+	const bool queued = enqueue(std::move(unit));
+	Stats::instance().SubmitRecorderInput(QpcToMs(QpcNow() - start), !queued);
+}
+
+// Keeps the keyframe interval that overlaps the start of the m_ReplaySeconds window up to newestUs and
+// everything after it, older intervals are dropped whole. The buffer stays within kMaxReplayBytes.
+void StreamRecorder::trimReplay(int64_t newestUs) {
+	const int64_t windowUs = static_cast<int64_t>(m_ReplaySeconds) * 1000000;
+	while (m_ReplayKeyframes > 1) {
+		// The buffer starts with a keyframe, find the one after it
+		auto next = std::find_if(m_Replay.begin() + 1, m_Replay.end(), [](const UnitPtr &unit) { return unit->video && unit->keyframe; });
+		if ((*next)->ptsUs > newestUs - windowUs && m_ReplayBytes <= kMaxReplayBytes) {
+			break;
+		}
+		for (size_t n = next - m_Replay.begin(); n > 0; n--) {
+			const UnitPtr &front = m_Replay.front();
+			m_ReplayBytes -= front->data.size();
+			m_ReplayKeyframes -= (front->video && front->keyframe) ? 1 : 0;
+			m_Replay.pop_front();
+		}
+	}
+
+	// The host sends keyframes only on request, which is made when a replay is saved. A single interval that
+	// outgrows the limit can't be cut, the buffer starts over at the next keyframe.
+	if (m_ReplayKeyframes == 1 && m_ReplayBytes > kMaxReplayBytes) {
+		Utils::Logf("StreamRecorder: %.0f s without a keyframe exceed the replay buffer, dropping it\n",
+		            (newestUs - m_Replay.front()->ptsUs) / 1000000.0);
+		m_Replay.clear();
+		m_ReplayBytes = 0;
+		m_ReplayKeyframes = 0;
+	}
+}
+
+void StreamRecorder::writerLoop() {
+	const int64_t startQpc = QpcNow();
+	m_WriterBusyQpc = 0;
+
+	for (;;) {
+		std::deque<UnitPtr> batch;
+		std::string recordingPath, savePath;
+		VideoParams video;
+		AudioParams audio;
+		{
+			std::unique_lock<std::mutex> lock(m_Lock);
+			m_Wake.wait(lock, [this] {
+				return !m_Queue.empty() || m_Stop || m_RecordingRequested || m_SaveRequested ||
+				       (m_Recorder && !m_Recording.load(std::memory_order_relaxed));
+			});
+			if (m_Stop && m_Queue.empty()) {
+				break;
+			}
+			batch.swap(m_Queue);
+			if (m_RecordingRequested) {
+				m_RecordingRequested = false;
+				recordingPath = m_RecordingPath;
+			}
+			if (m_SaveRequested) {
+				m_SaveRequested = false;
+				savePath = m_SavePath;
+			}
+			video = m_Video;
+			audio = m_Audio;
+		}
+
+		const int64_t busyStart = QpcNow();
+		if (m_Recorder && (!m_Recording.load(std::memory_order_acquire) || !recordingPath.empty())) {
+			m_Recorder.reset();
+		}
+		if (!recordingPath.empty()) {
+			m_Recorder = std::make_unique<Muxer>(recordingPath, m_Container, video, audio);
+		}
+
+		size_t batchBytes = 0;
+		for (UnitPtr &unit : batch) {
+			batchBytes += unit->data.size();
+			if (m_Recorder && !m_Recorder->write(*unit)) {
+				m_Recorder.reset();
+				m_Recording.store(false, std::memory_order_release);
+			}
+			if (m_ReplaySeconds > 0) {
+				if (unit->video && unit->keyframe) {
+					m_ReplayKeyframes++;
+				}
+				if (!m_Replay.empty() || (unit->video && unit->keyframe)) {
+					m_ReplayBytes += unit->data.size();
+					const int64_t ptsUs = unit->ptsUs;
+					m_Replay.push_back(std::move(unit));
+					trimReplay(ptsUs);
+				}
+			}
+		}
+
+		if (!savePath.empty()) {
+			if (m_Replay.empty()) {
+				Utils::Log("StreamRecorder: the replay buffer is empty\n");
+				m_Saving.store(false, std::memory_order_release);
+			} else {
+				if (m_Saver.joinable()) {
+					m_Saver.join();
+				}
+				std::vector<UnitPtr> snapshot(m_Replay.begin(), m_Replay.end());
+				m_Saver = std::thread(&StreamRecorder::saveLoop, this, std::move(snapshot), savePath, video, audio);
+			}
+		}
+
+		const int64_t busyQpc = QpcNow() - busyStart;
+		m_WriterBusyQpc += busyQpc;
+		Stats::instance().SubmitRecorderOutput(batchBytes, QpcToMs(busyQpc));
+
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_QueuedBytes -= batchBytes;
+	}
+
+	m_Recorder.reset();
+	m_Replay.clear();
+	m_ReplayBytes = 0;
+	m_ReplayKeyframes = 0;
+
+	const double seconds = QpcToMs(QpcNow() - startQpc) / 1000.0;
+	std::lock_guard<std::mutex> lock(m_Lock);
+	Utils::Logf("StreamRecorder: writer busy %.1f%% of %.0f s, %u units dropped\n",
+	            seconds > 0.0 ? QpcToMs(m_WriterBusyQpc) / 10.0 / seconds : 0.0, seconds, m_Dropped);
+	m_Dropped = 0;
+}
+
+void StreamRecorder::saveLoop(std::vector<UnitPtr> units, std::string path, VideoParams video, AudioParams audio) {
+	const int64_t start = QpcNow();
+	{
+		Muxer muxer(path, m_Container, video, audio);
+		for (const UnitPtr &unit : units) {
+			if (!muxer.write(*unit)) {
+				break;
+			}
+		}
+	}
+	Utils::Logf("StreamRecorder: saved the replay buffer in %.0f ms\n", QpcToMs(QpcNow() - start));
+	m_Saving.store(false, std::memory_order_release);
+}
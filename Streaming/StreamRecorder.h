@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class RecordingContainer {
+	MKV,
+	MP4, // fragmented, so a recording cut short by a crash still plays
+};
+
+// Records the stream by remuxing what the host sent into MKV or MP4 with libavformat, nothing is decoded or
+// encoded again. Video comes from the decode units, audio from the Opus packets before they are decoded.
+//
+// Two ways to record, both can run at once:
+// - a recording, from startRecording() until stopRecording()
+// - a replay buffer that always holds at least the last replaySeconds, saveReplay() writes it to a file
+//
+// The decoder and audio threads only copy each unit into a queue, the writer thread muxes and does the file
+// I/O. When more than kMaxQueuedBytes are waiting, units are dropped instead of stalling the decode path;
+// video then resumes at the next keyframe. Every file starts with a keyframe, and the host only sends those
+// on request. A recording starts at the one requested with it. The replay buffer keeps the last keyframe
+// before its window and everything after it, so a saved replay can start earlier than replaySeconds ago;
+// the keyframe requested when a replay is saved lets the buffer trim closer to the window afterwards. Saving
+// a replay runs on its own thread from a snapshot of the buffer.
+//
+// Video timestamps come from the host's RTP clock, audio ones from the sample count. Both are anchored to
+// their first packet's arrival time, which keeps them in sync within the network jitter.
+
+class StreamRecorder {
+  public:
+	static constexpr size_t kMaxQueuedBytes = 64 * 1024 * 1024;
+	static constexpr size_t kMaxReplayBytes = 384 * 1024 * 1024; // about 60 s at 50 Mbps
+
+	// Singleton accessor
+	static StreamRecorder &instance();
+
+	// Before streaming, from the host settings. replaySeconds 0 disables the replay buffer.
+	void configure(RecordingContainer container, int replaySeconds);
+
+	// Decoder thread, from Init
+	void setVideo(int videoFormat, int width, int height, int fps);
+
+	// Audio thread, from the audio init callback. mapping has channelCount entries.
+	void setAudio(int sampleRate, int channelCount, int streams, int coupledStreams, const uint8_t *mapping);
+
+	// Starts a recording in the app's local folder, returns false if one is running or no stream is set up.
+	// The caller should request an IDR, the file starts with the next one.
+	bool startRecording();
+
+	// Stops the recording, the writer finishes the file in the background
+	void stopRecording();
+
+	bool recording() const {
+		return m_Recording.load(std::memory_order_acquire);
+	}
+	bool replayEnabled() const {
+		return m_ReplaySeconds > 0;
+	}
+
+	// Writes the replay buffer to a file in the app's local folder in the background. Returns false if the
+	// buffer is disabled or a save is still running. The caller should request an IDR, later replays start
+	// from it.
+	bool saveReplay();
+
+	// End of the session: stops the recording, drops the replay buffer and joins the threads
+	void shutdown();
+
+	// Decoder thread, once per decode unit. data is one complete access unit.
+	void submitVideo(const uint8_t *data, size_t size, bool keyframe, uint32_t rtpTimestamp);
+
+	// Audio thread, once per Opus packet of samples per channel. data is null for a lost packet.
+	void submitAudio(const uint8_t *data, size_t size, int samples);
+
+  private:
+	StreamRecorder() = default;
+	~StreamRecorder();
+	StreamRecorder(const StreamRecorder &) = delete;
+	StreamRecorder &operator=(const StreamRecorder &) = delete;
+
+	struct Unit {
+		std::vector<uint8_t> data;
+		int64_t ptsUs;
+		int64_t durationUs;
+		bool video;
+		bool keyframe;
+	};
+	using UnitPtr = std::shared_ptr<const Unit>;
+
+	struct VideoParams {
+		int codecId = 0; // AVCodecID, 0 until setVideo()
+		int width = 0;
+		int height = 0;
+		int fps = 0;
+	};
+	struct AudioParams {
+		int sampleRate = 0; // 0 until setAudio()
+		int channelCount = 0;
+		std::vector<uint8_t> opusHead; // extradata, the OpusHead of RFC 7845
+	};
+
+	class Muxer;
+
+	// Starts the writer if recording or the replay buffer needs it
+	void ensureWriter();
+	bool enqueue(UnitPtr unit);
+	void writerLoop();
+	void trimReplay(int64_t newestUs);
+	void saveLoop(std::vector<UnitPtr> units, std::string path, VideoParams video, AudioParams audio);
+	std::string outputPath(const char *prefix) const;
+
+	RecordingContainer m_Container = RecordingContainer::MKV;
+	int m_ReplaySeconds = 0;
+	std::atomic<bool> m_Active{false}; // units are wanted, recording or replay buffer
+	std::atomic<bool> m_Recording{false};
+	std::atomic<bool> m_Saving{false};
+	std::thread m_Writer;
+	std::thread m_Saver;
+
+	// Decoder thread
+	bool m_VideoWaitForKeyframe = true; // after a drop, video resumes with a keyframe
+	bool m_VideoAnchored = false;
+	uint32_t m_LastRtp = 0;
+	int64_t m_VideoPts90k = 0;          // unwrapped RTP time since the first unit
+	int64_t m_VideoAnchorUs = 0;
+
+	// Audio thread
+	int m_AudioSampleRate = 48000;
+	bool m_AudioAnchored = false;
+	int64_t m_AudioSamples = 0;
+	int64_t m_AudioAnchorUs = 0;
+
+	// Guarded by m_Lock
+	std::mutex m_Lock;
+	std::condition_variable m_Wake;
+	std::deque<UnitPtr> m_Queue;
+	size_t m_QueuedBytes = 0;
+	bool m_Stop = false;
+	bool m_RecordingRequested = false; // the writer opens the file, which starts at the next keyframe
+	std::string m_RecordingPath;
+	bool m_SaveRequested = false;
+	std::string m_SavePath;
+	VideoParams m_Video;
+	AudioParams m_Audio;
+	uint32_t m_Dropped = 0;
+
+	// Writer thread
+	std::unique_ptr<Muxer> m_Recorder;
+	std::deque<UnitPtr> m_Replay;
+	size_t m_ReplayBytes = 0;
+	int m_ReplayKeyframes = 0;
+	int64_t m_WriterBusyQpc = 0;
+};
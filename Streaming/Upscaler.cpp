@@ -0,0 +1,298 @@
+// Built without the precompiled header, see Upscaler.h
+#include "Upscaler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+double Upscaler::budget(UpscaleDevice device) {
+	switch (device) {
+	case UpscaleDevice::XboxOne:
+		return 150.0;
+	case UpscaleDevice::XboxOneX:
+		return 600.0;
+	case UpscaleDevice::XboxSeriesS:
+		return 500.0;
+	case UpscaleDevice::XboxSeriesX:
+		return 1200.0;
+	case UpscaleDevice::Other:
+		break;
+	}
+	return 1e9;
+}
+
+UpscaleFilter Upscaler::choose(UpscaleFilter requested, UpscaleDevice device, int srcWidth, int srcHeight,
+                               int dstWidth, int dstHeight, int fps) {
+	if (dstWidth <= srcWidth && dstHeight <= srcHeight) {
+		return UpscaleFilter::Bilinear;
+	}
+	const double outputMpix = (double)dstWidth * dstHeight * std::max(fps, 1) / 1e6;
+	const double limit = budget(device);
+	if (requested == UpscaleFilter::FSR && outputMpix * kCostFsr > limit) {
+		requested = UpscaleFilter::Lanczos;
+	}
+	if (requested == UpscaleFilter::Lanczos && outputMpix * kCostLanczos > limit) {
+		requested = UpscaleFilter::Bilinear;
+	}
+	return requested;
+}
+
+UpscaleFilter Upscaler::parse(const char *name) {
+	if (strcmp(name, "Lanczos") == 0) {
+		return UpscaleFilter::Lanczos;
+	}
+	if (strcmp(name, "FSR 1") == 0) {
+		return UpscaleFilter::FSR;
+	}
+	return UpscaleFilter::Bilinear;
+}
+
+const char *Upscaler::name(UpscaleFilter filter) {
+	switch (filter) {
+	case UpscaleFilter::Bilinear:
+		return "Bilinear";
+	case UpscaleFilter::Lanczos:
+		return "Lanczos";
+	case UpscaleFilter::FSR:
+		return "FSR 1";
+	}
+	return "?";
+}
+
+float Upscaler::rcasScale(float sharpness) {
+	return std::exp2(-sharpness);
+}
+
+static float lanczos2(float x) {
+	x = std::fabs(x);
+	if (x < 1e-5f) {
+		return 1.0f;
+	}
+	if (x >= 2.0f) {
+		return 0.0f;
+	}
+	const float px = 3.14159265f * x;
+	return 2.0f * std::sin(px) * std::sin(px * 0.5f) / (px * px);
+}
+
+static float saturate(float x) {
+	return std::min(std::max(x, 0.0f), 1.0f);
+}
+
+void Upscaler::lanczos(const UpscaleImage &src, UpscaleImage &dst) {
+	const float scaleX = (float)src.width / dst.width;
+	const float scaleY = (float)src.height / dst.height;
+	for (int j = 0; j < dst.height; j++) {
+		for (int i = 0; i < dst.width; i++) {
+			const float px = (i + 0.5f) * scaleX - 0.5f;
+			const float py = (j + 0.5f) * scaleY - 0.5f;
+			const int bx = (int)std::floor(px);
+			const int by = (int)std::floor(py);
+			const float fx = px - bx;
+			const float fy = py - by;
+
+			float sum[3] = {};
+			float weights = 0.0f;
+			float mn[3] = {1e5f, 1e5f, 1e5f};
+			float mx[3] = {-1e5f, -1e5f, -1e5f};
+			for (int y = -1; y <= 2; y++) {
+				const float wy = lanczos2(y - fy);
+				for (int x = -1; x <= 2; x++) {
+					const float w = lanczos2(x - fx) * wy;
+					const float *c = src.at(bx + x, by + y);
+					for (int k = 0; k < 3; k++) {
+						sum[k] += c[k] * w;
+					}
+					weights += w;
+					// Anti-ringing, the result stays within the four nearest texels
+					if (x >= 0 && x <= 1 && y >= 0 && y <= 1) {
+						for (int k = 0; k < 3; k++) {
+							mn[k] = std::min(mn[k], c[k]);
+							mx[k] = std::max(mx[k], c[k]);
+						}
+					}
+				}
+			}
+			float *out = dst.at(i, j);
+			for (int k = 0; k < 3; k++) {
+				out[k] = std::min(std::max(sum[k] / weights, mn[k]), mx[k]);
+			}
+		}
+	}
+}
+
+// Luma approximation EASU analyses, B + R halved plus G
+static float easuLuma(const float *c) {
+	return c[2] * 0.5f + (c[0] * 0.5f + c[1]);
+}
+
+// Gradient direction and edge length around texel c, weighted by its bilinear weight w
+//     a
+//   b c d
+//     e
+static void easuSet(float dir[2], float &len, float w, float la, float lb, float lc, float ld, float le) {
+	const float dirX = ld - lb;
+	const float lenX = saturate(std::fabs(dirX) / std::max(std::max(std::fabs(ld - lc), std::fabs(lc - lb)), 1.0f / 65536.0f));
+	dir[0] += dirX * w;
+	len += lenX * lenX * w;
+
+	const float dirY = le - la;
+	const float lenY = saturate(std::fabs(dirY) / std::max(std::max(std::fabs(le - lc), std::fabs(lc - la)), 1.0f / 65536.0f));
+	dir[1] += dirY * w;
+	len += lenY * lenY * w;
+}
+
+void Upscaler::easu(const UpscaleImage &src, UpscaleImage &dst) {
+	// Taps around the sample point p, f is the texel at floor(p - 0.5)
+	//     b c
+	//   e f g h
+	//   i j k l
+	//     n o
+	static const int kTaps[12][2] = {
+	    {0, -1}, {1, -1}, {-1, 0}, {0, 0}, {1, 0}, {2, 0}, {-1, 1}, {0, 1}, {1, 1}, {2, 1}, {0, 2}, {1, 2},
+	};
+	enum { B, C, E, F, G, H, I, J, K, L, N, O };
+
+	const float scaleX = (float)src.width / dst.width;
+	const float scaleY = (float)src.height / dst.height;
+	for (int j = 0; j < dst.height; j++) {
+		for (int i = 0; i < dst.width; i++) {
+			const float px = (i + 0.5f) * scaleX - 0.5f;
+			const float py = (j + 0.5f) * scaleY - 0.5f;
+			const int bx = (int)std::floor(px);
+			const int by = (int)std::floor(py);
+			const float fx = px - bx;
+			const float fy = py - by;
+
+			const float *c[12];
+			float l[12];
+			for (int t = 0; t < 12; t++) {
+				c[t] = src.at(bx + kTaps[t][0], by + kTaps[t][1]);
+				l[t] = easuLuma(c[t]);
+			}
+
+			float dir[2] = {};
+			float len = 0.0f;
+			easuSet(dir, len, (1.0f - fx) * (1.0f - fy), l[B], l[E], l[F], l[G], l[J]);
+			easuSet(dir, len, fx * (1.0f - fy), l[C], l[F], l[G], l[H], l[K]);
+			easuSet(dir, len, (1.0f - fx) * fy, l[F], l[I], l[J], l[K], l[N]);
+			easuSet(dir, len, fx * fy, l[G], l[J], l[K], l[L], l[O]);
+
+			// Normalize the direction, no gradient at all samples along x
+			const float dirR = dir[0] * dir[0] + dir[1] * dir[1];
+			if (dirR < 1.0f / 32768.0f) {
+				dir[0] = 1.0f;
+				dir[1] = 0.0f;
+			} else {
+				const float rsq = 1.0f / std::sqrt(dirR);
+				dir[0] *= rsq;
+				dir[1] *= rsq;
+			}
+
+			// Along an edge the kernel stretches along it and narrows across it, and its negative lobe
+			// sharpens. Flat areas get a round, soft kernel.
+			len *= 0.5f;
+			len *= len;
+			const float stretch = (dir[0] * dir[0] + dir[1] * dir[1]) / std::max(std::fabs(dir[0]), std::fabs(dir[1]));
+			const float len2x = 1.0f + (stretch - 1.0f) * len;
+			const float len2y = 1.0f - 0.5f * len;
+			const float lob = 0.5f + ((1.0f / 4.0f - 0.04f) - 0.5f) * len;
+			const float clp = 1.0f / lob;
+
+			float sum[3] = {};
+			float weights = 0.0f;
+			for (int t = 0; t < 12; t++) {
+				const float ox = kTaps[t][0] - fx;
+				const float oy = kTaps[t][1] - fy;
+				const float vx = (ox * dir[0] + oy * dir[1]) * len2x;
+				const float vy = (ox * -dir[1] + oy * dir[0]) * len2y;
+				const float d2 = std::min(vx * vx + vy * vy, clp);
+				// Lanczos2 approximation, (25/16 (2/5 x^2 - 1)^2 - (25/16 - 1)) (lob x^2 - 1)^2
+				float wB = 2.0f / 5.0f * d2 - 1.0f;
+				float wA = lob * d2 - 1.0f;
+				wB *= wB;
+				wA *= wA;
+				wB = 25.0f / 16.0f * wB - (25.0f / 16.0f - 1.0f);
+				const float w = wB * wA;
+				for (int k = 0; k < 3; k++) {
+					sum[k] += c[t][k] * w;
+				}
+				weights += w;
+			}
+
+			float *out = dst.at(i, j);
+			for (int k = 0; k < 3; k++) {
+				const float mn = std::min(std::min(c[F][k], c[G][k]), std::min(c[J][k], c[K][k]));
+				const float mx = std::max(std::max(c[F][k], c[G][k]), std::max(c[J][k], c[K][k]));
+				out[k] = std::min(mx, std::max(mn, sum[k] / weights));
+			}
+		}
+	}
+}
+
+void Upscaler::rcas(const UpscaleImage &src, UpscaleImage &dst, float scale) {
+	//   b
+	// d e f
+	//   h
+	for (int y = 0; y < dst.height; y++) {
+		for (int x = 0; x < dst.width; x++) {
+			const float *b = src.at(x, y - 1);
+			const float *d = src.at(x - 1, y);
+			const float *e = src.at(x, y);
+			const float *f = src.at(x + 1, y);
+			const float *h = src.at(x, y + 1);
+
+			// The largest negative lobe that keeps every channel in range, limited so it can't go unstable
+			float lobe = -1e5f;
+			for (int k = 0; k < 3; k++) {
+				const float mn4 = std::min(std::min(b[k], d[k]), std::min(f[k], h[k]));
+				const float mx4 = std::max(std::max(b[k], d[k]), std::max(f[k], h[k]));
+				const float hitMin = mn4 / std::max(4.0f * mx4, 1.0f / 65536.0f);
+				const float hitMax = (1.0f - mx4) / std::min(4.0f * mn4 - 4.0f, -1.0f / 65536.0f);
+				lobe = std::max(lobe, std::max(-hitMin, hitMax));
+			}
+			lobe = std::max(-kRcasLimit, std::min(lobe, 0.0f)) * scale;
+
+			const float rcpL = 1.0f / (4.0f * lobe + 1.0f);
+			float *out = dst.at(x, y);
+			for (int k = 0; k < 3; k++) {
+				out[k] = saturate((lobe * (b[k] + d[k] + f[k] + h[k]) + e[k]) * rcpL);
+			}
+		}
+	}
+}
+
+UpscaleImage Upscaler::testPattern(int width, int height) {
+	UpscaleImage image(width, height);
+	uint32_t seed = 0x12345678;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			float *out = image.at(x, y);
+			const float u = (float)x / width;
+			const float v = (float)y / height;
+			seed = seed * 1664525u + 1013904223u;
+			const float noise = (float)(seed >> 8) / (float)(1u << 24);
+			if (u < 0.5f && v < 0.5f) {
+				// Hard edges at a few angles
+				out[0] = (x + 2 * y) % 11 < 5 ? 0.9f : 0.1f;
+				out[1] = (3 * x - y + 64) % 13 < 6 ? 0.8f : 0.2f;
+				out[2] = x % 7 < 3 ? 1.0f : 0.0f;
+			} else if (u >= 0.5f && v < 0.5f) {
+				// Zone plate, frequencies up to Nyquist
+				const float r2 = (u - 0.75f) * (u - 0.75f) + (v - 0.25f) * (v - 0.25f);
+				const float s = 0.5f + 0.5f * std::cos(r2 * 1600.0f);
+				out[0] = s;
+				out[1] = 1.0f - s;
+				out[2] = 0.5f;
+			} else if (u < 0.5f) {
+				out[0] = out[1] = out[2] = noise;
+			} else {
+				// Smooth gradient with a little noise
+				out[0] = u;
+				out[1] = v;
+				out[2] = 0.5f + 0.1f * (noise - 0.5f);
+			}
+		}
+	}
+	return image;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+enum class UpscaleFilter {
+	Bilinear, // the sampler stretches the frame, no extra pass
+	Lanczos,  // Lanczos2, 4x4 taps with anti-ringing
+	FSR,      // FSR 1 style EASU edge-adaptive scaling followed by RCAS sharpening
+};
+
+enum class UpscaleDevice {
+	XboxOne, // One and One S
+	XboxOneX,
+	XboxSeriesS,
+	XboxSeriesX,
+	Other, // no limit
+};
+
+// RGB image for the CPU reference, 3 floats per pixel, rows top to bottom
+struct UpscaleImage {
+	int width = 0;
+	int height = 0;
+	std::vector<float> pixels;
+
+	UpscaleImage() = default;
+	UpscaleImage(int w, int h) : width(w), height(h), pixels((size_t)w * h * 3) {}
+
+	// Clamped to the edge, like the shaders' Load()
+	const float *at(int x, int y) const {
+		x = x < 0 ? 0 : (x >= width ? width - 1 : x);
+		y = y < 0 ? 0 : (y >= height ? height - 1 : y);
+		return &pixels[((size_t)y * width + x) * 3];
+	}
+	float *at(int x, int y) {
+		return &pixels[((size_t)y * width + x) * 3];
+	}
+};
+
+// Upscaling of sub-native streams, so e.g. 1440p on a 4K TV doesn't have to look as soft as the bilinear
+// stretch makes it. VideoRenderer converts the frame to RGB at stream resolution, then one of the
+// d3d11_upscale_*.hlsl shaders scales it into the destination rect.
+//
+// The shaders are costly per output pixel, choose() falls back to a cheaper filter when the console's budget
+// for the output rate is exceeded. Source positions follow the same convention everywhere: output pixel i
+// samples the source at (i + 0.5) * scale, texel centers at +0.5, edges clamped.
+//
+// The static functions below are a CPU reference of the shaders' math, in the same order of operations.
+// No Windows dependencies, the file builds without the precompiled header and Tools/RenderCheck checks the
+// reference and choose() headless. Nothing compares the shaders with it, a change goes into both.
+
+class Upscaler {
+  public:
+	static constexpr float kRcasSharpness = 0.2f; // stops, 0 is the sharpest
+	static constexpr float kRcasLimit = 0.25f - 1.0f / 16.0f;
+
+	// Relative GPU cost per output pixel, and what each console can spend in millions of those per second.
+	// Conservative estimates that leave room for decoding and the overlays.
+	static constexpr double kCostLanczos = 1.0;
+	static constexpr double kCostFsr = 1.8; // EASU, RCAS and the extra intermediate
+	static double budget(UpscaleDevice device);
+
+	// The filter to use for the requested one, Bilinear when the stream isn't upscaled
+	static UpscaleFilter choose(UpscaleFilter requested, UpscaleDevice device, int srcWidth, int srcHeight,
+	                            int dstWidth, int dstHeight, int fps);
+
+	// From the host setting, Bilinear for anything unknown
+	static UpscaleFilter parse(const char *name);
+	static const char *name(UpscaleFilter filter);
+
+	// RCAS' lobe scale for a sharpness in stops
+	static float rcasScale(float sharpness);
+
+	// Reference implementations, dst has to be sized by the caller
+	static void lanczos(const UpscaleImage &src, UpscaleImage &dst);
+	static void easu(const UpscaleImage &src, UpscaleImage &dst);
+	static void rcas(const UpscaleImage &src, UpscaleImage &dst, float scale);
+
+	// Edges in every direction, a zone plate and noise, for checking the shaders
+	static UpscaleImage testPattern(int width, int height);
+};
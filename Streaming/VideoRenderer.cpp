@@ -1,6 +1,8 @@
 ﻿#include "pch.h"
 #include "VideoRenderer.h"
 #include "Pacer.h"
+#include "ColorConversion.h"
+#include "SoftwareFrameUpload.h"
 #include <State\MoonlightClient.h>
 #include "..\Common\DirectXHelper.h"
 #include <Utils.hpp>
@@ -52,6 +54,36 @@ typedef struct _CSC_CONST_BUF
 } CSC_CONST_BUF, * PCSC_CONST_BUF;
 static_assert(sizeof(CSC_CONST_BUF) % 16 == 0, "Constant buffer sizes must be a multiple of 16");
 
+// All variants of CSC_CONST_BUF share one buffer, a frame binds its slot with PSSetConstantBuffers1.
+// Offsets count 16-byte constants and have to be a multiple of 16 of them.
+#define CSC_SLOT_CONSTANTS 16
+
+typedef struct _CSC_CONST_BUF_SLOT
+{
+	CSC_CONST_BUF constants;
+	float padding[(CSC_SLOT_CONSTANTS * 16 - sizeof(CSC_CONST_BUF)) / sizeof(float)];
+} CSC_CONST_BUF_SLOT;
+static_assert(sizeof(CSC_CONST_BUF_SLOT) == CSC_SLOT_CONSTANTS * 16, "CSC slots must be 256 bytes apart");
+
+typedef struct _UPSCALE_CONST_BUF
+{
+	// Size of the texture being scaled, in pixels
+	float srcSize[2];
+
+	// Source pixels per output pixel
+	float scale[2];
+
+	// Top left of the output rect in render target pixels
+	float dstOffset[2];
+
+	// RCAS lobe scale
+	float sharpness;
+
+	// Padding float to end 16-byte boundary
+	float padding;
+} UPSCALE_CONST_BUF, * PUPSCALE_CONST_BUF;
+static_assert(sizeof(UPSCALE_CONST_BUF) % 16 == 0, "Constant buffer sizes must be a multiple of 16");
+
 // Loads vertex and pixel shaders from files and instantiates the cube geometry.
 VideoRenderer::VideoRenderer(const std::shared_ptr<DX::DeviceResources>& deviceResources, MoonlightClient* mclient, StreamConfiguration^ sConfig) :
 	m_LastColorTrc(AVCOL_TRC_UNSPECIFIED),
@@ -106,34 +138,37 @@ bool VideoRenderer::Render(AVFrame *frame) {
 	Pacer::instance().StartGpuTimerForFrame();
 #endif
 
-	// Clear the back buffer
 	ID3D11RenderTargetView* renderTarget[] = { m_deviceResources->GetBackBufferRenderTargetView() };
-	ctx->ClearRenderTargetView(renderTarget[0], Colors::Black);
 
 	// Bind the back buffer. This needs to be done each time,
 	// because the render target view will be unbound by Present().
 	ctx->OMSetRenderTargets(1, renderTarget, nullptr);
 
-	ID3D11Texture2D *ffmpegTexture = (ID3D11Texture2D *)(frame->data[0]);
-	if (!ffmpegTexture) {
-		// This sometimes happens when reconnecting
-		return false;
-	}
 	D3D11_TEXTURE2D_DESC ffmpegDesc;
-	ffmpegTexture->GetDesc(&ffmpegDesc);
-
-	bool hasChanged = hasFrameFormatChanged(frame);
+	const std::array<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>, 2>* frameSrvPair;
+	if (frame->format == AV_PIX_FMT_D3D11) {
+		ID3D11Texture2D *ffmpegTexture = (ID3D11Texture2D *)(frame->data[0]);
+		if (!ffmpegTexture) {
+			// This sometimes happens when reconnecting
+			return false;
+		}
+		ffmpegTexture->GetDesc(&ffmpegDesc);
 
-	// Sample the decoder's array texture straight into the YUV->RGB shader.
-	// frame->data[1] is the slice of the decoder's array texture holding this frame.
-	UINT slice = (UINT)(intptr_t)frame->data[1];
-	const std::array<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>, 2>* frameSrvPair =
-	    getDirectSampleSrvs(ffmpegTexture, slice, ffmpegDesc);
+		// Sample the decoder's array texture straight into the YUV->RGB shader.
+		// frame->data[1] is the slice of the decoder's array texture holding this frame.
+		UINT slice = (UINT)(intptr_t)frame->data[1];
+		frameSrvPair = getDirectSampleSrvs(ffmpegTexture, slice, ffmpegDesc);
+	}
+	else {
+		frameSrvPair = uploadSoftwareFrame(frame, ffmpegDesc);
+	}
 	if (!frameSrvPair) {
 		// SRV creation failed; nothing we can render this frame
 		return false;
 	}
 
+	bool hasChanged = hasFrameFormatChanged(frame);
+
 	// Setup shader
 	ctx->PSSetSamplers(0, 1, m_samplerState.GetAddressOf());
 	ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -146,27 +181,63 @@ bool VideoRenderer::Render(AVFrame *frame) {
 		bindColorConversion(frame, ffmpegDesc);
 	}
 
+	// Clear what the video won't cover
+	clearBackground(renderTarget[0]);
+
+	// Nothing is drawn outside the video rect, or outside the upscaler's textures.
+	// With an upscaler the frame is converted at stream resolution first.
+	const bool upscale = m_UpscaleFilter != UpscaleFilter::Bilinear;
+	const D3D11_RECT sourceRect = { 0, 0, (LONG)m_SourceViewport.Width, (LONG)m_SourceViewport.Height };
+	ctx->RSSetState(m_scissorState.Get());
+	ctx->RSSetScissorRects(1, upscale ? &sourceRect : &m_VideoRect);
+	if (upscale) {
+		ctx->OMSetRenderTargets(1, m_SourceRgbRtv.GetAddressOf(), nullptr);
+		ctx->RSSetViewports(1, &m_SourceViewport);
+	}
+
 	UINT stride = sizeof(VERTEX);
 	UINT offset = 0;
-	ctx->IASetVertexBuffers(0, 1, m_VideoVertexBuffer.GetAddressOf(), &stride, &offset);
+	ctx->IASetVertexBuffers(0, 1, upscale ? m_FullscreenVertexBuffer.GetAddressOf() : m_VideoVertexBuffer.GetAddressOf(), &stride, &offset);
 	ctx->IASetIndexBuffer(m_indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
 
 	// Bind SRVs for this frame
 	ID3D11ShaderResourceView* frameSrvs[] = { (*frameSrvPair)[0].Get(), (*frameSrvPair)[1].Get() };
 	ctx->PSSetShaderResources(0, 2, frameSrvs);
-	ctx->PSSetConstantBuffers(0, 1, m_cscConstantBuffer.GetAddressOf());
+	if (m_CanOffsetConstants) {
+		const UINT firstConstant = m_CscSlot * CSC_SLOT_CONSTANTS;
+		const UINT numConstants = CSC_SLOT_CONSTANTS;
+		ctx->PSSetConstantBuffers1(0, 1, m_cscConstantBuffer.GetAddressOf(), &firstConstant, &numConstants);
+	} else {
+		ctx->PSSetConstantBuffers(0, 1, m_cscConstantBuffer.GetAddressOf());
+	}
 
 	// Draw the video
 	ctx->DrawIndexed(6, 0, 0);
 
-#if defined(_DEBUG)
-	Pacer::instance().EndGpuTimerForFrame();
-#endif
-
 	// Unbind SRVs for this frame
 	ID3D11ShaderResourceView* nullSrvs[2] = {};
 	ctx->PSSetShaderResources(0, 2, nullSrvs);
 
+	// Scale into the back buffer, the last pass leaves it bound with the screen viewport
+	if (upscale) {
+		const D3D11_VIEWPORT screenViewport = m_deviceResources->GetScreenViewport();
+		if (m_UpscaleFilter == UpscaleFilter::FSR) {
+			const D3D11_RECT scaledRect = { 0, 0, (LONG)m_ScaledViewport.Width, (LONG)m_ScaledViewport.Height };
+			drawUpscalePass(m_pixelShaderEasu.Get(), m_SourceRgbSrv.Get(), m_scaleConstantBuffer.Get(), m_ScaledRtv.Get(),
+			                m_ScaledViewport, scaledRect, m_FullscreenVertexBuffer.Get());
+			drawUpscalePass(m_pixelShaderRcas.Get(), m_ScaledSrv.Get(), m_sharpenConstantBuffer.Get(), renderTarget[0],
+			                screenViewport, m_VideoRect, m_VideoVertexBuffer.Get());
+		} else {
+			drawUpscalePass(m_pixelShaderLanczos.Get(), m_SourceRgbSrv.Get(), m_scaleConstantBuffer.Get(), renderTarget[0],
+			                screenViewport, m_VideoRect, m_VideoVertexBuffer.Get());
+		}
+	}
+	ctx->RSSetState(nullptr);
+
+#if defined(_DEBUG)
+	Pacer::instance().EndGpuTimerForFrame();
+#endif
+
 	if (frame->color_trc != m_LastColorTrc) {
 		DXGI_COLOR_SPACE_TYPE colorspace = {};
 
@@ -198,7 +269,8 @@ bool VideoRenderer::Render(AVFrame *frame) {
 	Stats::instance().SubmitGpuTime(
 		gpuTimer->GetMinFrameTime(),
 		gpuTimer->GetMaxFrameTime(),
-		gpuTimer->GetAvgFrameTime());
+		gpuTimer->GetAvgFrameTime(),
+		m_ClearedFraction);
 #endif
 
 	return true;
@@ -279,6 +351,28 @@ void VideoRenderer::CreateDeviceDependentResources()
 		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateSamplerState(&samplerDesc,  &m_samplerState));
 	}
 
+	// Default rasterizer state with the scissor test, the video draws are clipped to their rect
+	{
+		CD3D11_RASTERIZER_DESC rasterizerDesc(D3D11_DEFAULT);
+		rasterizerDesc.ScissorEnable = TRUE;
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateRasterizerState(&rasterizerDesc, &m_scissorState), "Rasterizer State Creation");
+	}
+
+	// Clearing only the letterbox bars needs ClearView on render targets, binding a slot of the CSC table
+	// needs constant buffer offsets
+	{
+		D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+		const bool queried = SUCCEEDED(m_deviceResources->GetD3DDevice()->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options)));
+		m_CanClearRects = queried && options.ClearView;
+		if (!m_CanClearRects) {
+			Utils::Log("ClearView isn't supported, the whole back buffer is cleared every frame\n");
+		}
+		m_CanOffsetConstants = queried && options.ConstantBufferOffsetting;
+		if (!m_CanOffsetConstants) {
+			Utils::Log("Constant buffer offsets aren't supported, the CSC constants are recreated on format changes\n");
+		}
+	}
+
 	// We use a common index buffer for all geometry
 	{
 		const int indexes[] = { 0, 1, 2, 3, 2, 1 };
@@ -324,10 +418,30 @@ void VideoRenderer::ReleaseDeviceDependentResources()
 	m_cscConstantBuffer.Reset();
 	m_VideoVertexBuffer.Reset();
 	m_samplerState.Reset();
+	m_scissorState.Reset();
 	m_indexBuffer.Reset();
+	m_VideoRectValid = false;
 
 	// Drop SRVs over decoder surfaces; the pool is owned by ffmpeg and is going away.
 	m_DirectSampleSrvs.clear();
+	m_UploadTextures = {};
+	m_UploadSrvs = {};
+	m_UploadDesc = {};
+	m_UploadFormat = AV_PIX_FMT_NONE;
+
+	m_UpscaleFilter = UpscaleFilter::Bilinear;
+	m_pixelShaderLanczos.Reset();
+	m_pixelShaderEasu.Reset();
+	m_pixelShaderRcas.Reset();
+	m_FullscreenVertexBuffer.Reset();
+	m_scaleConstantBuffer.Reset();
+	m_sharpenConstantBuffer.Reset();
+	m_SourceRgbTexture.Reset();
+	m_SourceRgbRtv.Reset();
+	m_SourceRgbSrv.Reset();
+	m_ScaledTexture.Reset();
+	m_ScaledRtv.Reset();
+	m_ScaledSrv.Reset();
 }
 
 void VideoRenderer::scaleSourceToDestinationSurface(IRECT* src, IRECT* dst)
@@ -358,6 +472,10 @@ VideoRenderer::getDirectSampleSrvs(ID3D11Texture2D* texture, UINT slice, const D
 {
 	auto it = m_DirectSampleSrvs.find(texture);
 	if (it == m_DirectSampleSrvs.end()) {
+		// A new texture means the decoder rebuilt its pool (resolution change or resize), views over the
+		// old one would keep it alive. A late frame from it just gets its views built again.
+		m_DirectSampleSrvs.clear();
+
 		// Build the (luma, chroma) SRV pair for every slice of this array texture once.
 		std::vector<std::array<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>, 2>> slices(desc.ArraySize);
 		auto formats = getPlaneSRVFormats(desc.Format);
@@ -391,6 +509,85 @@ VideoRenderer::getDirectSampleSrvs(ID3D11Texture2D* texture, UINT slice, const D
 	return &it->second[slice];
 }
 
+// Copies a software decoded NV12/P010 (or 4:4:4 NV24/P410) frame into m_UploadTextures. desc receives the
+// combined surface description setupVertexBuffer() and bindColorConversion() expect from a decoder texture.
+const std::array<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>, 2>*
+VideoRenderer::uploadSoftwareFrame(const AVFrame* frame, D3D11_TEXTURE2D_DESC& desc)
+{
+	const AVPixelFormat format = (AVPixelFormat)frame->format;
+	SoftwareUploadLayout layout;
+	if (!layout.init(format, frame->width, frame->height)) {
+		Utils::Logf("Can't render software frames in %s\n", av_get_pix_fmt_name(format));
+		return nullptr;
+	}
+
+	const DXGI_FORMAT surfaceFormat = layout.tenBit ? DXGI_FORMAT_P010 : DXGI_FORMAT_NV12;
+	const UINT width = layout.width;
+	const UINT height = layout.height;
+	if (!m_UploadTextures[0] || m_UploadDesc.Width != width || m_UploadDesc.Height != height || m_UploadFormat != format) {
+		m_UploadTextures = {};
+		m_UploadSrvs = {};
+		m_UploadDesc = {};
+		m_UploadFormat = AV_PIX_FMT_NONE;
+
+		auto* dev = m_deviceResources->GetD3DDevice();
+		auto formats = getPlaneSRVFormats(surfaceFormat);
+		for (int plane = 0; plane < 2; plane++) {
+			D3D11_TEXTURE2D_DESC planeDesc = {};
+			planeDesc.Width = layout.planes[plane].width;
+			planeDesc.Height = layout.planes[plane].height;
+			planeDesc.MipLevels = 1;
+			planeDesc.ArraySize = 1;
+			planeDesc.Format = formats[plane];
+			planeDesc.SampleDesc.Count = 1;
+			planeDesc.Usage = D3D11_USAGE_DYNAMIC;
+			planeDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+			planeDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+			D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+			srvDesc.Format = formats[plane];
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+			srvDesc.Texture2DArray.MipLevels = 1;
+			srvDesc.Texture2DArray.ArraySize = 1;
+
+			HRESULT hr = dev->CreateTexture2D(&planeDesc, nullptr, &m_UploadTextures[plane]);
+			if (SUCCEEDED(hr)) {
+				hr = dev->CreateShaderResourceView(m_UploadTextures[plane].Get(), &srvDesc, &m_UploadSrvs[plane]);
+			}
+			if (FAILED(hr)) {
+				Utils::Logf("Software frame upload texture creation failed (plane %d, 0x%08X)\n", plane, hr);
+				m_UploadTextures = {};
+				m_UploadSrvs = {};
+				return nullptr;
+			}
+		}
+
+		m_UploadDesc.Width = width;
+		m_UploadDesc.Height = height;
+		m_UploadDesc.MipLevels = 1;
+		m_UploadDesc.ArraySize = 1;
+		m_UploadDesc.Format = surfaceFormat;
+		m_UploadDesc.SampleDesc.Count = 1;
+		m_UploadFormat = format;
+		Utils::Logf("Software frame upload textures: %ux%u %s\n", width, height, av_get_pix_fmt_name(format));
+	}
+
+	auto* ctx = m_deviceResources->GetD3DDeviceContext();
+	for (int plane = 0; plane < 2; plane++) {
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		HRESULT hr = ctx->Map(m_UploadTextures[plane].Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+		if (FAILED(hr)) {
+			Utils::Logf("Software frame upload: Map failed (plane %d, 0x%08X)\n", plane, hr);
+			return nullptr;
+		}
+		layout.copyPlane(plane, frame->data[plane], frame->linesize[plane], (uint8_t*)mapped.pData, mapped.RowPitch);
+		ctx->Unmap(m_UploadTextures[plane].Get(), 0);
+	}
+
+	desc = m_UploadDesc;
+	return &m_UploadSrvs;
+}
+
 // Create our fixed vertex buffer for video rendering
 void VideoRenderer::setupVertexBuffer(D3D11_TEXTURE2D_DESC frameDesc)
 {
@@ -442,8 +639,254 @@ void VideoRenderer::setupVertexBuffer(D3D11_TEXTURE2D_DESC frameDesc)
 			&m_VideoVertexBuffer
 		)
 		, "Vertex Buffer Creation");
+
+	// Same texture coordinates over the whole render target, for the passes into the upscaler's textures
+	VERTEX fullscreenVerts[] =
+	{
+		{-1.0f, -1.0f, 0, vMax},
+		{-1.0f, 1.0f, 0, 0},
+		{1.0f, -1.0f, uMax, vMax},
+		{1.0f, 1.0f, uMax, 0},
+	};
+	vbData.pSysMem = fullscreenVerts;
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateBuffer(
+			&vbDesc,
+			&vbData,
+			&m_FullscreenVertexBuffer
+		)
+		, "Fullscreen Vertex Buffer Creation");
+
+	setupBackground(dst);
+	setupUpscaler(src, dst);
 }
 
+// Computes the video rect and the bars around it
+void VideoRenderer::setupBackground(const IRECT& dst)
+{
+	// dst.y counts from the bottom like the device coordinates
+	const LONG left = dst.x;
+	const LONG top = m_DisplayHeight - dst.y - dst.h;
+	const LONG right = left + dst.w;
+	const LONG bottom = top + dst.h;
+	m_VideoRect = { left, top, right, bottom };
+
+	m_BarRectCount = 0;
+	auto addBar = [this](LONG l, LONG t, LONG r, LONG b) {
+		if (r > l && b > t) {
+			m_BarRects[m_BarRectCount++] = { l, t, r, b };
+		}
+	};
+	addBar(0, 0, m_DisplayWidth, top);
+	addBar(0, bottom, m_DisplayWidth, m_DisplayHeight);
+	addBar(0, top, left, bottom);
+	addBar(right, top, m_DisplayWidth, bottom);
+	m_VideoRectValid = true;
+
+	Utils::Logf("Video rect %ld,%ld %ldx%ld, %u letterbox bars\n", left, top, right - left, bottom - top, m_BarRectCount);
+}
+
+void VideoRenderer::clearBackground(ID3D11RenderTargetView* target)
+{
+	auto* ctx = m_deviceResources->GetD3DDeviceContext();
+	if (!m_VideoRectValid || !m_CanClearRects || m_FullClear.load(std::memory_order_relaxed)) {
+		ctx->ClearRenderTargetView(target, Colors::Black);
+		m_ClearedFraction = 1.0f;
+		return;
+	}
+
+	m_ClearedFraction = 0.0f;
+	if (m_BarRectCount == 0) {
+		return;
+	}
+	ctx->ClearView(target, Colors::Black, m_BarRects.data(), m_BarRectCount);
+
+	LONGLONG barPixels = 0;
+	for (UINT i = 0; i < m_BarRectCount; i++) {
+		barPixels += (LONGLONG)(m_BarRects[i].right - m_BarRects[i].left) * (m_BarRects[i].bottom - m_BarRects[i].top);
+	}
+	m_ClearedFraction = (float)((double)barPixels / ((double)m_DisplayWidth * m_DisplayHeight));
+}
+
+bool VideoRenderer::ToggleFullClear()
+{
+	const bool fullClear = !m_FullClear.load(std::memory_order_relaxed);
+	m_FullClear.store(fullClear, std::memory_order_relaxed);
+	Utils::Logf("Back buffer clear: %s\n", fullClear ? "whole back buffer" : "letterbox bars only");
+	return fullClear;
+}
+
+// Picks the upscaler for this stream and display, and creates the textures and constants it renders with
+void VideoRenderer::setupUpscaler(const IRECT& src, const IRECT& dst)
+{
+	UpscaleDevice device = UpscaleDevice::Other;
+	GAMING_DEVICE_MODEL_INFORMATION info = {};
+	if (SUCCEEDED(GetGamingDeviceModelInformation(&info)) && info.vendorId == GAMING_DEVICE_VENDOR_ID_MICROSOFT) {
+		switch (info.deviceId) {
+		case GAMING_DEVICE_DEVICE_ID_XBOX_ONE:
+		case GAMING_DEVICE_DEVICE_ID_XBOX_ONE_S:
+			device = UpscaleDevice::XboxOne;
+			break;
+		case GAMING_DEVICE_DEVICE_ID_XBOX_ONE_X:
+		case GAMING_DEVICE_DEVICE_ID_XBOX_ONE_X_DEVKIT:
+			device = UpscaleDevice::XboxOneX;
+			break;
+		case GAMING_DEVICE_DEVICE_ID_XBOX_SERIES_S:
+			device = UpscaleDevice::XboxSeriesS;
+			break;
+		default:
+			device = UpscaleDevice::XboxSeriesX;
+			break;
+		}
+	}
+
+	const UpscaleFilter requested = configuration->upscaler != nullptr
+		? Upscaler::parse(Utils::PlatformStringToStdString(configuration->upscaler).c_str())
+		: UpscaleFilter::Bilinear;
+	UpscaleFilter filter = Upscaler::choose(requested, device, src.w, src.h, dst.w, dst.h, m_DecoderParams.frameRate);
+	if (filter != requested && (dst.w > src.w || dst.h > src.h)) {
+		Utils::Logf("Upscaler: %s is too costly for %dx%d at %d FPS on this console\n",
+		            Upscaler::name(requested), dst.w, dst.h, m_DecoderParams.frameRate);
+	}
+	if (filter != UpscaleFilter::Bilinear && !loadUpscalerShaders(filter)) {
+		filter = UpscaleFilter::Bilinear;
+	}
+
+	m_SourceRgbTexture.Reset();
+	m_SourceRgbRtv.Reset();
+	m_SourceRgbSrv.Reset();
+	m_ScaledTexture.Reset();
+	m_ScaledRtv.Reset();
+	m_ScaledSrv.Reset();
+	if (filter != UpscaleFilter::Bilinear) {
+		// Same format as the back buffer, it holds PQ encoded values as well
+		const DXGI_FORMAT format = m_deviceResources->GetBackBufferFormat();
+		bool created = createRenderTexture(src.w, src.h, format, m_SourceRgbTexture, m_SourceRgbRtv, m_SourceRgbSrv);
+		if (created && filter == UpscaleFilter::FSR) {
+			created = createRenderTexture(dst.w, dst.h, format, m_ScaledTexture, m_ScaledRtv, m_ScaledSrv);
+		}
+		if (!created) {
+			filter = UpscaleFilter::Bilinear;
+		}
+	}
+
+	if (filter != UpscaleFilter::Bilinear) {
+		// The shaders see pixels from the top
+		const int dstTop = (int)m_VideoRect.top;
+		m_SourceViewport = CD3D11_VIEWPORT(0.0f, 0.0f, (float)src.w, (float)src.h);
+		m_ScaledViewport = CD3D11_VIEWPORT(0.0f, 0.0f, (float)dst.w, (float)dst.h);
+		if (filter == UpscaleFilter::FSR) {
+			createUpscaleConstants(src.w, src.h, dst.w, dst.h, 0, 0, 0.0f, m_scaleConstantBuffer);
+			createUpscaleConstants(dst.w, dst.h, dst.w, dst.h, dst.x, dstTop,
+			                       Upscaler::rcasScale(Upscaler::kRcasSharpness), m_sharpenConstantBuffer);
+		} else {
+			createUpscaleConstants(src.w, src.h, dst.w, dst.h, dst.x, dstTop, 0.0f, m_scaleConstantBuffer);
+		}
+	}
+
+	m_UpscaleFilter = filter;
+	Utils::Logf("Upscaler: %s, %dx%d to %dx%d\n", Upscaler::name(filter), src.w, src.h, dst.w, dst.h);
+}
+
+// The upscaler shaders are only loaded once one is used. Returns false, logged, if they can't be.
+bool VideoRenderer::loadUpscalerShaders(UpscaleFilter filter)
+{
+	auto load = [this](const wchar_t* path, ComPtr<ID3D11PixelShader>& shader) {
+		if (shader) {
+			return true;
+		}
+		try {
+			auto bytecode = DX::ReadData(path);
+			return SUCCEEDED(m_deviceResources->GetD3DDevice()->CreatePixelShader(bytecode.data(), bytecode.size(), nullptr, &shader));
+		}
+		catch (Platform::Exception^) {
+			return false;
+		}
+	};
+
+	const bool loaded = filter == UpscaleFilter::FSR
+		? load(L"Assets\\Shader\\d3d11_upscale_easu.fxc", m_pixelShaderEasu) && load(L"Assets\\Shader\\d3d11_upscale_rcas.fxc", m_pixelShaderRcas)
+		: load(L"Assets\\Shader\\d3d11_upscale_lanczos.fxc", m_pixelShaderLanczos);
+	if (!loaded) {
+		Utils::Logf("Upscaler: can't load the %s shaders\n", Upscaler::name(filter));
+	}
+	return loaded;
+}
+
+bool VideoRenderer::createRenderTexture(UINT width, UINT height, DXGI_FORMAT format, ComPtr<ID3D11Texture2D>& texture,
+                                        ComPtr<ID3D11RenderTargetView>& rtv, ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = format;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	auto* dev = m_deviceResources->GetD3DDevice();
+	HRESULT hr = dev->CreateTexture2D(&desc, nullptr, &texture);
+	if (SUCCEEDED(hr)) {
+		hr = dev->CreateRenderTargetView(texture.Get(), nullptr, &rtv);
+	}
+	if (SUCCEEDED(hr)) {
+		hr = dev->CreateShaderResourceView(texture.Get(), nullptr, &srv);
+	}
+	if (FAILED(hr)) {
+		Utils::Logf("Upscaler texture creation failed (%ux%u, 0x%08X)\n", width, height, (unsigned)hr);
+		texture.Reset();
+		rtv.Reset();
+		srv.Reset();
+		return false;
+	}
+	return true;
+}
+
+void VideoRenderer::createUpscaleConstants(int srcWidth, int srcHeight, int dstWidth, int dstHeight, int dstX, int dstY, float sharpness,
+                                           ComPtr<ID3D11Buffer>& buffer)
+{
+	D3D11_BUFFER_DESC constDesc = {};
+	constDesc.ByteWidth = sizeof(UPSCALE_CONST_BUF);
+	constDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	constDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+	UPSCALE_CONST_BUF constBuf = {};
+	constBuf.srcSize[0] = (float)srcWidth;
+	constBuf.srcSize[1] = (float)srcHeight;
+	constBuf.scale[0] = (float)srcWidth / dstWidth;
+	constBuf.scale[1] = (float)srcHeight / dstHeight;
+	constBuf.dstOffset[0] = (float)dstX;
+	constBuf.dstOffset[1] = (float)dstY;
+	constBuf.sharpness = sharpness;
+
+	D3D11_SUBRESOURCE_DATA constData = {};
+	constData.pSysMem = &constBuf;
+	DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&constDesc, &constData, &buffer), "Upscale Constant Buffer Creation");
+}
+
+void VideoRenderer::drawUpscalePass(ID3D11PixelShader* shader, ID3D11ShaderResourceView* source, ID3D11Buffer* constants,
+                                    ID3D11RenderTargetView* target, const D3D11_VIEWPORT& viewport, const D3D11_RECT& scissor,
+                                    ID3D11Buffer* vertexBuffer)
+{
+	auto* ctx = m_deviceResources->GetD3DDeviceContext();
+	ctx->OMSetRenderTargets(1, &target, nullptr);
+	ctx->RSSetViewports(1, &viewport);
+	ctx->RSSetScissorRects(1, &scissor);
+
+	UINT stride = sizeof(VERTEX);
+	UINT offset = 0;
+	ctx->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+	ctx->PSSetShader(shader, nullptr, 0);
+	ctx->PSSetShaderResources(0, 1, &source);
+	ctx->PSSetConstantBuffers(0, 1, &constants);
+	ctx->DrawIndexed(6, 0, 0);
+
+	// The source is a render target again next frame
+	ID3D11ShaderResourceView* nullSrv = nullptr;
+	ctx->PSSetShaderResources(0, 1, &nullSrv);
+}
 
 static inline bool isFrameFullRange(const AVFrame* frame) {
 	// This handles the case where the color range is unknown,
@@ -492,61 +935,26 @@ static inline int getFrameBitsPerChannel(const AVFrame* frame) {
 	return formatDesc->comp[0].depth;
 }
 
-void VideoRenderer::getFramePremultipliedCscConstants(const AVFrame* frame, std::array<float, 9> &cscMatrix, std::array<float, 3> &offsets) {
-	static const std::array<float, 9> k_CscMatrix_Bt601 = {
-		1.0f, 1.0f, 1.0f,
-		0.0f, -0.3441f, 1.7720f,
-		1.4020f, -0.7141f, 0.0f,
-	};
-	static const std::array<float, 9> k_CscMatrix_Bt709 = {
-		1.0f, 1.0f, 1.0f,
-		0.0f, -0.1873f, 1.8556f,
-		1.5748f, -0.4681f, 0.0f,
-	};
-	static const std::array<float, 9> k_CscMatrix_Bt2020 = {
-		1.0f, 1.0f, 1.0f,
-		0.0f, -0.1646f, 1.8814f,
-		1.4746f, -0.5714f, 0.0f,
-	};
-
+// The frame's entry in kCscTable, the constants are generated at compile time (see ColorConversion.h)
+int VideoRenderer::getFrameCscVariant(const AVFrame* frame) {
 	bool fullRange = isFrameFullRange(frame);
 	int bitsPerChannel = getFrameBitsPerChannel(frame);
-	int channelRange = (1 << bitsPerChannel);
-	double yMin = (fullRange ? 0 : (16 << (bitsPerChannel - 8)));
-	double yMax = (fullRange ? (channelRange - 1) : (235 << (bitsPerChannel - 8)));
-	double yScale = (channelRange - 1) / (yMax - yMin);
-	double uvMin = (fullRange ? 0 : (16 << (bitsPerChannel - 8)));
-	double uvMax = (fullRange ? (channelRange - 1) : (240 << (bitsPerChannel - 8)));
-	double uvScale = (channelRange - 1) / (uvMax - uvMin);
-
-	// Calculate YUV offsets
-	offsets[0] = yMin / (double)(channelRange - 1);
-	offsets[1] = (channelRange / 2) / (double)(channelRange - 1);
-	offsets[2] = (channelRange / 2) / (double)(channelRange - 1);
-
-	// Start with the standard full range color matrix
+
 	int colorspace = getFrameColorspace(frame);
+	CscColorspace cscColorspace;
 	switch (colorspace) {
 	default:
 	case COLORSPACE_REC_601:
-		cscMatrix = k_CscMatrix_Bt601;
+		cscColorspace = CscColorspace::Rec601;
 		break;
 	case COLORSPACE_REC_709:
-		cscMatrix = k_CscMatrix_Bt709;
+		cscColorspace = CscColorspace::Rec709;
 		break;
 	case COLORSPACE_REC_2020:
-		cscMatrix = k_CscMatrix_Bt2020;
+		cscColorspace = CscColorspace::Rec2020;
 		break;
 	}
 
-	// Scale the color matrix according to the color range
-	for (int i = 0; i < 3; i++) {
-		cscMatrix[i] *= yScale;
-	}
-	for (int i = 3; i < 9; i++) {
-		cscMatrix[i] *= uvScale;
-	}
-
 	Utils::Logf("Shader config: %s %d-bit %s, (AVColorSpace %d, AVChromaLocation %d)\n",
 	            colorspace == COLORSPACE_REC_601   ? "Rec. 601"
 	            : colorspace == COLORSPACE_REC_709 ? "Rec. 709"
@@ -555,6 +963,7 @@ void VideoRenderer::getFramePremultipliedCscConstants(const AVFrame* frame, std:
 	            fullRange ? "full range" : "limited/standard range",
 				frame->colorspace,
 	            frame->chroma_location);
+	return ColorConversion::index(cscColorspace, fullRange, bitsPerChannel);
 }
 
 void VideoRenderer::getFrameChromaCositingOffsets(const AVFrame* frame, std::array<float, 2> &chromaOffsets) {
@@ -611,6 +1020,7 @@ bool VideoRenderer::hasFrameFormatChanged(const AVFrame* frame) {
 	if (frame->width == m_LastFrameWidth &&
 		frame->height == m_LastFrameHeight &&
 		format == m_LastFramePixelFormat &&
+		frame->format == m_LastFrameFormat &&
 		frame->color_range == m_LastColorRange &&
 		frame->color_primaries == m_LastColorPrimaries &&
 		frame->colorspace == m_LastColorSpace &&
@@ -623,6 +1033,7 @@ bool VideoRenderer::hasFrameFormatChanged(const AVFrame* frame) {
 	m_LastFrameWidth = frame->width;
 	m_LastFrameHeight = frame->height;
 	m_LastFramePixelFormat = format;
+	m_LastFrameFormat = (AVPixelFormat)frame->format;
 	m_LastColorRange = frame->color_range;
 	m_LastColorPrimaries = frame->color_primaries;
 	m_LastColorSpace = frame->colorspace;
@@ -632,27 +1043,12 @@ bool VideoRenderer::hasFrameFormatChanged(const AVFrame* frame) {
 
 void VideoRenderer::bindColorConversion(AVFrame* frame, D3D11_TEXTURE2D_DESC frameDesc)
 {
-	D3D11_BUFFER_DESC constDesc = {};
-	constDesc.ByteWidth = sizeof(CSC_CONST_BUF);
-	constDesc.Usage = D3D11_USAGE_IMMUTABLE;
-	constDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	constDesc.CPUAccessFlags = 0;
-	constDesc.MiscFlags = 0;
+	const int variant = getFrameCscVariant(frame);
 
+	// The table is already packed column-major with float3 vectors padded to float4, as HLSL expects
 	CSC_CONST_BUF constBuf = {};
-	std::array<float, 9> cscMatrix;
-	std::array<float, 3> yuvOffsets;
-	getFramePremultipliedCscConstants(frame, cscMatrix, yuvOffsets);
-
-	std::copy(yuvOffsets.cbegin(), yuvOffsets.cend(), constBuf.offsets);
-
-	// We need to adjust our CSC matrix to be column-major and with float3 vectors
-	// padded with a float in between each of them to adhere to HLSL requirements.
-	for (int i = 0; i < 3; i++) {
-		for (int j = 0; j < 3; j++) {
-			constBuf.cscMatrix[i * 4 + j] = cscMatrix[j * 3 + i];
-		}
-	}
+	std::copy(std::begin(kCscTable[variant].matrix), std::end(kCscTable[variant].matrix), constBuf.cscMatrix);
+	std::copy(std::begin(kCscTable[variant].offsets), std::end(kCscTable[variant].offsets), constBuf.offsets);
 
 	m_TextureWidth = frameDesc.Width;
 	m_TextureHeight = frameDesc.Height;
@@ -676,6 +1072,43 @@ void VideoRenderer::bindColorConversion(AVFrame* frame, D3D11_TEXTURE2D_DESC fra
 				constBuf.chromaOffset[0], constBuf.chromaOffset[1],
 				constBuf.chromaUVMax[0], constBuf.chromaUVMax[1]);
 
+	D3D11_BUFFER_DESC constDesc = {};
+	constDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	constDesc.CPUAccessFlags = 0;
+	constDesc.MiscFlags = 0;
+
+	if (!m_CanOffsetConstants) {
+		constDesc.ByteWidth = sizeof(CSC_CONST_BUF);
+		constDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&constDesc, &constData, &m_cscConstantBuffer));
+		return;
+	}
+
+	// A colorspace, range or bit depth change only moves the slot. The chroma fields depend on the
+	// texture and the siting, they are written into every slot when they change.
+	m_CscSlot = variant;
+	const std::array<float, 4> chroma = { constBuf.chromaOffset[0], constBuf.chromaOffset[1], constBuf.chromaUVMax[0], constBuf.chromaUVMax[1] };
+	if (m_cscConstantBuffer && chroma == m_CscChroma) {
+		return;
+	}
+	m_CscChroma = chroma;
+
+	std::array<CSC_CONST_BUF_SLOT, ColorConversion::kVariantCount> slots = {};
+	for (int i = 0; i < ColorConversion::kVariantCount; i++) {
+		CSC_CONST_BUF& slot = slots[i].constants;
+		std::copy(std::begin(kCscTable[i].matrix), std::end(kCscTable[i].matrix), slot.cscMatrix);
+		std::copy(std::begin(kCscTable[i].offsets), std::end(kCscTable[i].offsets), slot.offsets);
+		std::copy(std::begin(constBuf.chromaOffset), std::end(constBuf.chromaOffset), slot.chromaOffset);
+		std::copy(std::begin(constBuf.chromaUVMax), std::end(constBuf.chromaUVMax), slot.chromaUVMax);
+	}
+
+	if (m_cscConstantBuffer) {
+		m_deviceResources->GetD3DDeviceContext()->UpdateSubresource(m_cscConstantBuffer.Get(), 0, nullptr, slots.data(), 0, 0);
+		return;
+	}
+	constDesc.ByteWidth = sizeof(slots);
+	constDesc.Usage = D3D11_USAGE_DEFAULT;
+	constData.pSysMem = slots.data();
 	DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&constDesc, &constData, &m_cscConstantBuffer));
 }
 
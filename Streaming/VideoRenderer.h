@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "ShaderStructures.h"
+#include "Upscaler.h"
 #include "Common\StepTimer.h"
 #include "State\MoonlightClient.h"
 #include "State\StreamConfiguration.h"
@@ -49,14 +50,29 @@ namespace moonlight_xbox_dx
 		void bindColorConversion(AVFrame* frame, D3D11_TEXTURE2D_DESC frameDesc);
 		void SetHDR(bool enabled);
 		void Stop();
+		// Switches between clearing the whole back buffer and only the bars, returns true for the whole
+		bool ToggleFullClear();
 
 	private:
 		const std::array<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>, 2>*
 			getDirectSampleSrvs(ID3D11Texture2D* texture, UINT slice, const D3D11_TEXTURE2D_DESC& desc);
+		const std::array<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>, 2>*
+			uploadSoftwareFrame(const AVFrame* frame, D3D11_TEXTURE2D_DESC& desc);
 		void setupVertexBuffer(D3D11_TEXTURE2D_DESC frameDesc);
-		void getFramePremultipliedCscConstants(const AVFrame* frame, std::array<float, 9> &cscMatrix, std::array<float, 3> &offsets);
+		int getFrameCscVariant(const AVFrame* frame);
 		void getFrameChromaCositingOffsets(const AVFrame* frame, std::array<float, 2> &chromaOffsets);
 		bool hasFrameFormatChanged(const AVFrame* frame);
+		void setupUpscaler(const IRECT& src, const IRECT& dst);
+		bool loadUpscalerShaders(UpscaleFilter filter);
+		bool createRenderTexture(UINT width, UINT height, DXGI_FORMAT format, Microsoft::WRL::ComPtr<ID3D11Texture2D>& texture,
+		                         Microsoft::WRL::ComPtr<ID3D11RenderTargetView>& rtv, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+		void createUpscaleConstants(int srcWidth, int srcHeight, int dstWidth, int dstHeight, int dstX, int dstY, float sharpness,
+		                            Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer);
+		void drawUpscalePass(ID3D11PixelShader* shader, ID3D11ShaderResourceView* source, ID3D11Buffer* constants,
+		                     ID3D11RenderTargetView* target, const D3D11_VIEWPORT& viewport, const D3D11_RECT& scissor,
+		                     ID3D11Buffer* vertexBuffer);
+		void setupBackground(const IRECT& dst);
+		void clearBackground(ID3D11RenderTargetView* target);
 
 		// Cached pointer to device resources.
 		std::shared_ptr<DX::DeviceResources> m_deviceResources;
@@ -68,8 +84,13 @@ namespace moonlight_xbox_dx
 		Microsoft::WRL::ComPtr<ID3D11VertexShader>	m_vertexShader;
 		// Texture2DArray YUV->RGB shader, samples the decoder surfaces directly
 		Microsoft::WRL::ComPtr<ID3D11PixelShader>	m_pixelShaderYUV420Array;
+		// Every CSC variant in 256-byte slots, or only the current one without constant buffer offsets
 		Microsoft::WRL::ComPtr<ID3D11Buffer>		m_cscConstantBuffer;
+		UINT m_CscSlot = 0;
+		std::array<float, 4> m_CscChroma{}; // chroma offset and UV max written into the slots
+		bool m_CanOffsetConstants = false;
 		Microsoft::WRL::ComPtr<ID3D11SamplerState>  m_samplerState;
+		Microsoft::WRL::ComPtr<ID3D11RasterizerState> m_scissorState;
 		Windows::Graphics::Display::Core::HdmiDisplayMode^ m_lastDisplayMode;
 		Windows::Graphics::Display::Core::HdmiDisplayMode^ m_currentDisplayMode;
 
@@ -90,6 +111,7 @@ namespace moonlight_xbox_dx
 		int m_LastFrameWidth = 0;
 		int m_LastFrameHeight = 0;
 		AVPixelFormat m_LastFramePixelFormat = AV_PIX_FMT_NONE;
+		AVPixelFormat m_LastFrameFormat = AV_PIX_FMT_NONE; // AV_PIX_FMT_D3D11 for decoder surfaces
 		AVColorRange m_LastColorRange = AVCOL_RANGE_UNSPECIFIED;
 		AVColorPrimaries m_LastColorPrimaries = AVCOL_PRI_UNSPECIFIED;
 		AVColorTransferCharacteristic m_LastColorTrc = AVCOL_TRC_UNSPECIFIED;
@@ -101,6 +123,44 @@ namespace moonlight_xbox_dx
 		// each holding the (luma, chroma) pair.
 		std::unordered_map<ID3D11Texture2D*,
 			std::vector<std::array<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>, 2>>> m_DirectSampleSrvs;
+
+		// Software decoded frames are copied into one dynamic texture per plane (luma, chroma) and
+		// sampled through the same Texture2DArray shader as decoder surfaces. For 4:4:4 (NV24/P410) the
+		// chroma texture is full size, so the shader samples it 1:1 with no cositing offset.
+		std::array<Microsoft::WRL::ComPtr<ID3D11Texture2D>, 2> m_UploadTextures;
+		std::array<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>, 2> m_UploadSrvs;
+		D3D11_TEXTURE2D_DESC m_UploadDesc{}; // describes both planes as one NV12/P010 surface
+		AVPixelFormat m_UploadFormat = AV_PIX_FMT_NONE; // frame format m_UploadTextures were created for
+
+		// Upscaling, see Upscaler.h. Unless the filter is Bilinear, the YUV->RGB pass renders at stream
+		// resolution into m_SourceRgb, which is scaled into the destination rect. FSR runs EASU into
+		// m_Scaled and RCAS from there into the back buffer.
+		UpscaleFilter m_UpscaleFilter = UpscaleFilter::Bilinear;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>	m_pixelShaderLanczos;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>	m_pixelShaderEasu;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>	m_pixelShaderRcas;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		m_FullscreenVertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		m_scaleConstantBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		m_sharpenConstantBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>	m_SourceRgbTexture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> m_SourceRgbRtv;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_SourceRgbSrv;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>	m_ScaledTexture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> m_ScaledRtv;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_ScaledSrv;
+		D3D11_VIEWPORT m_SourceViewport{};
+		D3D11_VIEWPORT m_ScaledViewport{};
+
+		// The video covers its rect in the back buffer every frame, so only the letterbox/pillarbox bars around
+		// it are cleared. That still happens every frame, FLIP_DISCARD leaves the back buffer undefined after
+		// each Present. Until the rect is known, or without ClearView, the whole back buffer is cleared.
+		D3D11_RECT m_VideoRect{}; // back buffer pixels, top left origin
+		bool m_VideoRectValid = false;
+		std::array<D3D11_RECT, 4> m_BarRects{};
+		UINT m_BarRectCount = 0;
+		bool m_CanClearRects = false;
+		std::atomic<bool> m_FullClear{false}; // clear everything, to compare the fill cost
+		float m_ClearedFraction = 1.0f; // of the back buffer, last frame
 	};
 }
 
@@ -0,0 +1,125 @@
+// Built without the precompiled header, see PacerCore.h
+#include "VsyncTracker.h"
+#include <cmath>
+
+void VsyncTracker::reset(int64_t qpcFreq, double nominalHz) {
+	m_qpcFreq = qpcFreq > 0 ? qpcFreq : 10000000;
+	m_nominalPeriodMs = 1000.0 / (nominalHz > 0.0 ? nominalHz : 60.0);
+	m_haveState = false;
+	m_accepted = 0;
+	m_rejects = 0;
+}
+
+double VsyncTracker::toMs(int64_t qpc) const {
+	return static_cast<double>(qpc - m_anchorQpc) * 1000.0 / static_cast<double>(m_qpcFreq);
+}
+
+int64_t VsyncTracker::toQpc(double ms) const {
+	return static_cast<int64_t>(std::llround(ms * static_cast<double>(m_qpcFreq) / 1000.0));
+}
+
+void VsyncTracker::restart(uint32_t syncRefreshCount, int64_t syncQpc, double periodMs) {
+	m_anchorQpc = syncQpc;
+	m_refCount = syncRefreshCount;
+	m_phaseMs = 0.0;
+	m_periodMs = periodMs;
+
+	m_P[0][0] = MEASUREMENT_SIGMA_MS * MEASUREMENT_SIGMA_MS;
+	m_P[0][1] = m_P[1][0] = 0.0;
+	m_P[1][1] = INITIAL_PERIOD_SIGMA_MS * INITIAL_PERIOD_SIGMA_MS;
+
+	m_haveState = true;
+	m_accepted = 1;
+	m_rejects = 0;
+}
+
+VsyncTracker::Result VsyncTracker::observe(uint32_t syncRefreshCount, int64_t syncQpc) {
+	if (!m_haveState) {
+		restart(syncRefreshCount, syncQpc, m_nominalPeriodMs);
+		return Result::Accepted;
+	}
+
+	// Refresh count is 32-bit and may wrap, a negative step means the count was reset
+	const int32_t n = static_cast<int32_t>(syncRefreshCount - m_refCount);
+	if (n == 0) {
+		return Result::Accepted;
+	}
+	if (n < 0 || n * m_periodMs > 10000.0) {
+		restart(syncRefreshCount, syncQpc, m_periodMs);
+		return Result::Reset;
+	}
+
+	// Predict n vblanks ahead
+	const double phasePred = m_phaseMs + n * m_periodMs;
+	const double p00 = m_P[0][0] + 2.0 * n * m_P[0][1] + double(n) * n * m_P[1][1] + n * PHASE_NOISE_MS * PHASE_NOISE_MS;
+	const double p01 = m_P[0][1] + n * m_P[1][1];
+	const double p11 = m_P[1][1] + n * PERIOD_NOISE_MS * PERIOD_NOISE_MS;
+
+	const double innovation = toMs(syncQpc) - phasePred;
+	const double s = p00 + MEASUREMENT_SIGMA_MS * MEASUREMENT_SIGMA_MS;
+	const double gate = std::fmax(GATE_SIGMA * std::sqrt(s), GATE_FLOOR_MS);
+
+	if (std::fabs(innovation) > gate) {
+		if (m_rejects == 0) {
+			m_firstRejectCount = syncRefreshCount;
+			m_firstRejectQpc = syncQpc;
+		}
+		if (++m_rejects <= MAX_REJECTS) {
+			return Result::Rejected;
+		}
+
+		// Consistently off, assume the display timing changed and restart from the rejected samples
+		double periodMs = m_nominalPeriodMs;
+		const int32_t spanCount = static_cast<int32_t>(syncRefreshCount - m_firstRejectCount);
+		if (spanCount > 0) {
+			const double spanMs = static_cast<double>(syncQpc - m_firstRejectQpc) * 1000.0 / static_cast<double>(m_qpcFreq);
+			const double measured = spanMs / spanCount;
+			if (measured > 1.0 && measured < 100.0) {
+				periodMs = measured;
+			}
+		}
+		restart(syncRefreshCount, syncQpc, periodMs);
+		return Result::Reset;
+	}
+	m_rejects = 0;
+
+	// Update
+	const double k0 = p00 / s;
+	const double k1 = p01 / s;
+	m_phaseMs = phasePred + k0 * innovation;
+	m_periodMs += k1 * innovation;
+
+	m_P[0][0] = (1.0 - k0) * p00;
+	m_P[0][1] = m_P[1][0] = (1.0 - k0) * p01;
+	m_P[1][1] = p11 - k1 * p01;
+
+	m_refCount = syncRefreshCount;
+	m_accepted++;
+	return Result::Accepted;
+}
+
+int64_t VsyncTracker::periodQpc() const {
+	return toQpc(m_periodMs);
+}
+
+int64_t VsyncTracker::lastVBlankQpc() const {
+	return m_anchorQpc + toQpc(m_phaseMs);
+}
+
+int64_t VsyncTracker::nextVBlankAfter(int64_t qpc) const {
+	double k = std::floor((toMs(qpc) - m_phaseMs) / m_periodMs) + 1.0;
+	int64_t next = m_anchorQpc + toQpc(m_phaseMs + k * m_periodMs);
+	while (next <= qpc) {
+		k += 1.0;
+		next = m_anchorQpc + toQpc(m_phaseMs + k * m_periodMs);
+	}
+	return next;
+}
+
+double VsyncTracker::phaseStdDevMs() const {
+	return std::sqrt(m_P[0][0]);
+}
+
+double VsyncTracker::periodStdDevMs() const {
+	return std::sqrt(m_P[1][1]);
+}
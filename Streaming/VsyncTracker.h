@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+// Kalman filter over DXGI frame statistics that estimates the vblank phase and period together.
+//
+// State is (time of the reference vblank, period). Each (SyncRefreshCount, SyncQPCTime) sample is
+// checked against the prediction, samples outside the gate are rejected as outliers. A run of
+// rejections means the display mode changed, the filter then restarts from the rejected samples so
+// it relocks within a few vblanks.
+//
+// This class has no Windows or DXGI dependencies so it can be driven from recorded
+// DXGI_FRAME_STATISTICS traces. It is not thread-safe, PacerCore guards it with m_FrameStatsLock.
+
+class VsyncTracker {
+  public:
+	enum class Result {
+		Accepted,
+		Rejected, // outlier, state unchanged
+		Reset     // filter restarted, e.g. after a refresh rate change
+	};
+
+	// qpcFreq is the tick rate of the sample timestamps, nominalHz seeds the period before any samples
+	void reset(int64_t qpcFreq, double nominalHz);
+
+	// Feed one frame statistics sample, repeated samples (same refresh count) are ignored
+	Result observe(uint32_t syncRefreshCount, int64_t syncQpc);
+
+	bool hasEstimate() const { return m_haveState; }
+	bool locked() const { return m_haveState && m_accepted >= LOCK_SAMPLES; }
+
+	// Estimated period and the vblank at the most recent sample, in ticks
+	int64_t periodQpc() const;
+	int64_t lastVBlankQpc() const;
+
+	// First predicted vblank strictly after qpc
+	int64_t nextVBlankAfter(int64_t qpc) const;
+
+	// One standard deviation of the estimates, in ms
+	double phaseStdDevMs() const;
+	double periodStdDevMs() const;
+
+  private:
+	static constexpr int LOCK_SAMPLES = 8;
+	static constexpr int MAX_REJECTS = 3;     // consecutive outliers before restarting the filter
+	static constexpr double GATE_SIGMA = 4.0; // reject innovations beyond this many standard deviations
+	static constexpr double GATE_FLOOR_MS = 0.25;
+
+	static constexpr double MEASUREMENT_SIGMA_MS = 0.05;
+	static constexpr double PHASE_NOISE_MS = 0.01;     // per vblank
+	static constexpr double PERIOD_NOISE_MS = 0.0001;  // per vblank
+	static constexpr double INITIAL_PERIOD_SIGMA_MS = 0.5;
+
+	void restart(uint32_t syncRefreshCount, int64_t syncQpc, double periodMs);
+	double toMs(int64_t qpc) const;
+	int64_t toQpc(double ms) const;
+
+	int64_t m_qpcFreq = 10000000;
+	double m_nominalPeriodMs = 1000.0 / 60.0;
+
+	bool m_haveState = false;
+	int64_t m_anchorQpc = 0;  // times are kept in ms relative to this to preserve precision
+	uint32_t m_refCount = 0;  // refresh count of the reference vblank
+	double m_phaseMs = 0.0;   // time of the reference vblank
+	double m_periodMs = 0.0;
+	double m_P[2][2] = {};    // covariance of (phase, period)
+	int m_accepted = 0;
+
+	// Consecutive rejected samples, used to restart after a mode change
+	int m_rejects = 0;
+	uint32_t m_firstRejectCount = 0;
+	int64_t m_firstRejectQpc = 0;
+};
@@ -4,6 +4,8 @@
 #include <Pages/HostSelectorPage.xaml.h>
 #include <Pages/StreamPage.xaml.h>
 #include <Streaming\FFMpegDecoder.h>
+#include <Streaming\FrameTrace.h>
+#include <Streaming\RenderCostBenchmark.h>
 #include "../Plot/ImGuiPlots.h"
 #include "Common\DirectXHelper.h"
 #include "State\GamepadState.h"
@@ -145,8 +147,19 @@ moonlight_xbox_dxMain::moonlight_xbox_dxMain(const std::shared_ptr<DX::DeviceRes
 	m_statsTextRenderer = std::make_unique<StatsRenderer>(m_deviceResources);
 	m_statsTextRenderer->SetVisible(configuration->enableStats);
 
+	// "1%" -> 0.01
+	if (configuration->renderMissTarget != nullptr && !configuration->renderMissTarget->IsEmpty()) {
+		try {
+			m_renderCost.setMissProbability(std::stod(configuration->renderMissTarget->Data()) / 100.0);
+		}
+		catch (const std::exception &) {
+			Utils::Log("Invalid render deadline miss setting, keeping the default\n");
+		}
+	}
+
 	// Reset Stats since it may have data from a prior stream
 	Stats::instance().Reset();
+	FrameTrace::instance().reset();
 
 	// We're now connected and can register for gamepad events
 	for (int i = 0; i < MAX_GAMEPADS; i++) {
@@ -231,18 +244,15 @@ void moonlight_xbox_dxMain::StartRenderLoop() {
 		int64_t t0 = 0, t1 = 0, t2 = 0, t3 = 0;
 		int64_t lastFramePts = 0, lastPresentTime = 0;
 		double frametimeMs = 0.0, hostFrametimeMs = 0.0;
-		const double bufferMs = 1.5;   // safety wait time to avoid missing deadline
-		const double alphaUp = 0.25;   // react faster when renderMs spikes upward
-		const double alphaDown = 0.05; // decay slowly when renderMs drops
-		double ewmaRenderMs = 3.0;     // Initial guess for render cost
 
 		// Calculate the updated frame and render once per vertical blanking interval.
 		while (action->Status == AsyncStatus::Started && !moonlightClient->IsConnectionTerminated()) {
 			// Get overall deadline we must hit by the Present for this frame
 			int64_t deadline = Pacer::instance().getNextVBlankQpc(&t0);
 
-			// wait for a frame + avg render time + safety buffer
-			double maxWaitMs = std::max(0.0, QpcToMs(deadline - t0) - ewmaRenderMs - bufferMs);
+			// wait for a frame, leaving enough time to render it with the configured miss probability
+			double budgetMs = m_renderCost.budgetMs();
+			double maxWaitMs = std::max(0.0, QpcToMs(deadline - t0) - budgetMs);
 			Pacer::instance().waitForFrame(maxWaitMs);
 			t1 = QpcNow();
 
@@ -271,10 +281,12 @@ void moonlight_xbox_dxMain::StartRenderLoop() {
 					continue;
 				}
 
+				UINT presentId = 0;
 				{
 					// lock is required around Present
 					auto guard = FFMpegDecoder::Lock();
 					m_deviceResources->Present();
+					m_deviceResources->GetSwapChain()->GetLastPresentCount(&presentId);
 				}
 
 				// Graph frametime only for new frames
@@ -291,25 +303,32 @@ void moonlight_xbox_dxMain::StartRenderLoop() {
 					isRepeatFrame = false;
 				}
 
-				// Weighted avg of time spent in Render(), more weight given to a slower render time
-				// If we missed our present deadline this frame, aggressively weight this higher so maxWaitMs is smaller.
-				// This is clamped to the deadline to prevent outliers
+				uint32_t traceId = Pacer::instance().getCurrentFrameTraceId();
+				if (isRepeatFrame) {
+					FrameTrace::instance().markRepeated(traceId);
+				} else {
+					FrameTrace::instance().markPresented(traceId, t2, deadline, t3, presentId);
+				}
+
+				// Feed the render cost quantiles. Wake-up overshoot is only known when the prewait timed out.
 				double renderMs = QpcToMs(t2 - t1);
-				double clampedRenderMs = std::clamp(renderMs, 0.0, QpcToMs(deadline - t0));
-				double alpha = (clampedRenderMs > ewmaRenderMs) ? alphaUp : alphaDown;
-				if (!hitDeadline) alpha *= 2.0;
-				ewmaRenderMs = (clampedRenderMs * alpha) + (ewmaRenderMs * (1.0 - alpha));
+				double preWaitMs = QpcToMs(t1 - t0);
+				RenderCostSample costSample;
+				costSample.windowMs = static_cast<float>(QpcToMs(deadline - t0));
+				costSample.renderMs = static_cast<float>(renderMs);
+				costSample.wakeMs = preWaitMs >= maxWaitMs ? static_cast<float>(preWaitMs - maxWaitMs) : -1.0f;
+				m_renderCost.observe(costSample);
 
 				// Track high-level render loop stats
-				double preWaitMs = QpcToMs(t1 - t0);
 				double beforePresentMs = QpcToMs(t3 - t2);
 				Stats::instance().SubmitRenderStats(preWaitMs, renderMs, beforePresentMs, hitDeadline);
+				Stats::instance().SubmitRenderBudget(budgetMs, m_renderCost.renderQuantileMs(), m_renderCost.wakeQuantileMs());
 
-				FQLog("render loop %.3fms %s%s%s pts:%.3fs frametime(c:%02.3fms h:%02.3fms) (Deadline %.3fms PreWait %.3fms (max %.3fms) + Render %.3fms (avg %.3f) + Present %.3fms)\n",
+				FQLog("render loop %.3fms %s%s%s pts:%.3fs frametime(c:%02.3fms h:%02.3fms) (Deadline %.3fms PreWait %.3fms (max %.3fms) + Render %.3fms (budget %.3f) + Present %.3fms)\n",
 				      QpcToMs(t3 - t0),                             // loop time
 				      hitDeadline ? " " : "M",                      // missed deadline?
 				      isRepeatFrame ? "R" : " ",                    // repeated frame?
-				      preWaitMs > maxWaitMs + bufferMs ? "W" : " ", // we waited too long for a frame (including buffer)
+				      costSample.wakeMs > m_renderCost.wakeQuantileMs() ? "W" : " ", // woke up later than predicted
 				      (double)currentFramePts / 90000.0,            // host's timestamp (in seconds)
 				      frametimeMs,                                  // effective client frametime not counting repeated frames
 				      hostFrametimeMs,                              // host frametime
@@ -317,11 +336,20 @@ void moonlight_xbox_dxMain::StartRenderLoop() {
 				      preWaitMs,                                    // prewait (time spent waiting for new frame to arrive)
 				      maxWaitMs,                                    // max wait allowed this frame
 				      renderMs,                                     // render time this frame
-				      ewmaRenderMs,                                 // average of render time used to control prewait
+				      budgetMs,                                     // predicted render cost used to control prewait
 				      beforePresentMs);                             // wait time to align present to vblank
 			}
 		}
 
+#if defined(_DEBUG)
+		// Compare prewait predictors on this session's render loop timings
+		std::vector<RenderCostSample> costSamples;
+		m_renderCost.copyHistory(costSamples);
+		for (const RenderCostBenchResult &r : RenderCostBenchmark().run(costSamples)) {
+			r.log();
+		}
+#endif
+
 		// we've lost the connection, clean up
 		StopRenderLoop(); // also stops input
 		Disconnect();
@@ -950,6 +978,10 @@ bool moonlight_xbox_dxMain::ToggleLogs() {
 	return visible ? false : true;
 }
 
+bool moonlight_xbox_dxMain::ToggleFullClear() {
+	return m_sceneRenderer->ToggleFullClear();
+}
+
 bool moonlight_xbox_dxMain::ToggleStats() {
 	bool visible = m_statsTextRenderer->GetVisible();
 
@@ -5,6 +5,7 @@
 #include "Streaming\VideoRenderer.h"
 #include "Streaming\LogRenderer.h"
 #include "Streaming\StatsRenderer.h"
+#include "Streaming\RenderCostPredictor.h"
 #include "Pages\StreamPage.xaml.h"
 
 // Xbox supports 8 controllers, this ought to be enough for anyone.
@@ -38,6 +39,7 @@ namespace moonlight_xbox_dx
 		void SendWinAltB();
 		bool ToggleLogs();
 		bool ToggleStats();
+		bool ToggleFullClear();
 
 		bool mouseMode = false;
 
@@ -62,6 +64,9 @@ namespace moonlight_xbox_dx
 		// Rendering loop timer.
 		DX::StepTimer m_timer;
 
+		// Time the render loop keeps free before each present deadline
+		RenderCostPredictor m_renderCost;
+
 		// Track current input pointer position.
 		float m_pointerLocationX;
 		bool insideFlyout = false;
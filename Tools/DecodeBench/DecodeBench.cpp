@@ -0,0 +1,742 @@
+// Measures SoftwareDecoder throughput and per-frame latency on an Annex-B elementary stream or on a stream
+// capture taken in the app (see Streaming/StreamCaptureFormat.h), headless.
+//
+// Builds anywhere FFmpeg (libavcodec, libswscale, libavutil) is installed, as one command wrapped here:
+//   g++ -std=c++17 -O2 -Wall -o DecodeBench DecodeBench.cpp ../../Streaming/SoftwareDecoder.cpp
+//       ../../Streaming/DecodeErrorPolicy.cpp ../../Streaming/NalScanner.cpp -I../..
+//       $(pkg-config --cflags --libs libavcodec libswscale libavutil)
+//
+// Usage:
+//   DecodeBench stream.h264              decode with 1 thread and with SoftwareDecoder's default count
+//   DecodeBench stream.hevc 1 2 4        decode once per listed thread count
+//   DecodeBench capture-*.idx            replay captures, one report per capture and thread count
+//   DecodeBench --realtime capture.idx   replay at the speed the units originally reached the decoder
+//   DecodeBench --pipelined ...          decode on a second thread behind a bounded queue
+//   DecodeBench --corrupt 2 stream.hevc  damage 2% of the units and recover like the app does
+//   DecodeBench --corrupt 2 --always-idr ...  same damage, but every error waits for a keyframe
+//   DecodeBench --check-policy           only the scripted fault patterns, no stream needed
+//
+// Access units are decoded back to back as fast as possible, or with --realtime spaced like the capture's
+// enqueue times. Latency is the time from sending an access unit to receiving its NV12/P010 frame (NV24/P410
+// for 4:4:4), including the swscale repack. The app decodes captures with D3D11VA, which this can't reproduce off the
+// console; the replay shows whether the stream itself is expensive to decode around a stall. To see slice threading help, the
+// stream has to be encoded with several slices per frame, like the host does for the software backend,
+// e.g. ffmpeg -i in.mkv -c:v libx264 -tune zerolatency -x264-params slices=4 -an stream.h264
+//
+// --corrupt is the fault injection test of Streaming/DecodeErrorPolicy. Each unit is damaged with the given
+// probability and decoding reacts to the errors the way FFMpegDecoder does, on a simulated clock (the capture's
+// enqueue times, 60 fps for raw streams). A keyframe request is answered by the next keyframe in the file,
+// everything before it is dropped like moonlight-common-c does. The report counts frames lost (never
+// decoded) and shown damaged per injected error. Raw H.264/HEVC streams need periodic keyframes for this,
+// e.g. -g 60, AV1 isn't supported. Units are classified with Streaming/NalScanner like the app does. A run
+// fails if the policy requests a keyframe sooner than its rate limit allows.
+//
+// --corrupt and --check-policy first replay scripted fault patterns against the policy (kFaultPatterns) and
+// fail unless every pattern gets the expected tolerated, deferred, IDR, flush and reopen counts.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../../Streaming/DecodeErrorPolicy.h"
+#include "../../Streaming/NalScanner.h"
+#include "../../Streaming/SoftwareDecoder.h"
+#include "../../Streaming/StreamCaptureFormat.h"
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+struct Stream {
+	enum AVCodecID codecId = AV_CODEC_ID_NONE;
+	int width = 0;
+	int height = 0;
+	bool tenBit = false;
+	std::vector<std::vector<uint8_t>> accessUnits; // each padded with AV_INPUT_BUFFER_PADDING_SIZE zeroes
+	std::vector<uint64_t> enqueueTimeUs;           // captures only, when each unit reached the decoder
+	int gaps = 0;                                  // captures only, units the app's writer dropped
+};
+
+static bool endsWith(const std::string &s, const char *suffix) {
+	const size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &data) {
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f) {
+		fprintf(stderr, "can't open %s\n", path.c_str());
+		return false;
+	}
+	uint8_t chunk[1 << 16];
+	size_t n;
+	while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+		data.insert(data.end(), chunk, chunk + n);
+	}
+	fclose(f);
+	return true;
+}
+
+// Cuts the elementary stream next to the index into the units the app received, with their timing
+static bool loadCapture(const std::string &indexPath, Stream &stream) {
+	std::vector<uint8_t> index;
+	if (!readFile(indexPath, index)) {
+		return false;
+	}
+	StreamCaptureFileHeader header;
+	if (index.size() < sizeof(header)) {
+		fprintf(stderr, "%s: not a stream capture index\n", indexPath.c_str());
+		return false;
+	}
+	memcpy(&header, index.data(), sizeof(header));
+	if (memcmp(header.magic, STREAM_CAPTURE_MAGIC, sizeof(header.magic)) != 0 || header.version != STREAM_CAPTURE_VERSION ||
+	    header.recordSize != sizeof(StreamCaptureRecord)) {
+		fprintf(stderr, "%s: not a version %d stream capture index\n", indexPath.c_str(), STREAM_CAPTURE_VERSION);
+		return false;
+	}
+
+	const char *ext = header.codec == STREAM_CAPTURE_H264 ? ".h264" : header.codec == STREAM_CAPTURE_HEVC ? ".hevc" : ".obu";
+	stream.codecId = header.codec == STREAM_CAPTURE_H264 ? AV_CODEC_ID_H264
+	                 : header.codec == STREAM_CAPTURE_HEVC ? AV_CODEC_ID_HEVC
+	                                                       : AV_CODEC_ID_AV1;
+	stream.width = static_cast<int>(header.width);
+	stream.height = static_cast<int>(header.height);
+	stream.tenBit = header.bitDepth > 8;
+
+	std::vector<uint8_t> data;
+	if (!readFile(indexPath.substr(0, indexPath.size() - 4) + ext, data)) {
+		return false;
+	}
+
+	// A capture cut short by the app closing has a partial last record, or a last unit without data
+	const size_t records = (index.size() - sizeof(header)) / sizeof(StreamCaptureRecord);
+	for (size_t i = 0; i < records; i++) {
+		StreamCaptureRecord r;
+		memcpy(&r, index.data() + sizeof(header) + i * sizeof(r), sizeof(r));
+		if (r.offset + r.size > data.size()) {
+			break;
+		}
+		std::vector<uint8_t> au(data.begin() + r.offset, data.begin() + r.offset + r.size);
+		au.resize(r.size + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+		stream.accessUnits.push_back(std::move(au));
+		stream.enqueueTimeUs.push_back(r.enqueueTimeUs);
+		stream.gaps += (r.flags & STREAM_CAPTURE_FLAG_GAP) ? 1 : 0;
+	}
+
+	if (stream.accessUnits.empty()) {
+		fprintf(stderr, "%s: no access units captured\n", indexPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+static enum AVCodecID codecFromPath(const std::string &path) {
+	std::string ext = path.substr(path.find_last_of('.') + 1);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+	if (ext == "h264" || ext == "264") {
+		return AV_CODEC_ID_H264;
+	}
+	if (ext == "hevc" || ext == "h265" || ext == "265") {
+		return AV_CODEC_ID_HEVC;
+	}
+	return AV_CODEC_ID_NONE;
+}
+
+// Splits the file into access units with FFmpeg's parser, the same units the host sends as decode units
+static bool load(const std::string &path, Stream &stream) {
+	if (endsWith(path, ".idx")) {
+		return loadCapture(path, stream);
+	}
+
+	stream.codecId = codecFromPath(path);
+	if (stream.codecId == AV_CODEC_ID_NONE) {
+		fprintf(stderr, "%s: unknown extension, use .h264/.264, .hevc/.h265/.265 or a capture's .idx\n", path.c_str());
+		return false;
+	}
+
+	std::vector<uint8_t> data;
+	if (!readFile(path, data)) {
+		return false;
+	}
+	data.resize(data.size() + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+
+	AVCodecParserContext *parser = av_parser_init(stream.codecId);
+	AVCodecContext *parseCtx = avcodec_alloc_context3(avcodec_find_decoder(stream.codecId));
+	if (!parser || !parseCtx) {
+		fprintf(stderr, "can't create a parser for %s\n", avcodec_get_name(stream.codecId));
+		av_parser_close(parser);
+		avcodec_free_context(&parseCtx);
+		return false;
+	}
+
+	const uint8_t *p = data.data();
+	int remaining = static_cast<int>(data.size() - AV_INPUT_BUFFER_PADDING_SIZE);
+	for (;;) {
+		uint8_t *out = nullptr;
+		int outSize = 0;
+		// An empty input flushes the last access unit
+		int used = av_parser_parse2(parser, parseCtx, &out, &outSize, p, remaining, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+		if (used < 0) {
+			break;
+		}
+		if (outSize > 0) {
+			std::vector<uint8_t> au(out, out + outSize);
+			au.resize(outSize + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+			stream.accessUnits.push_back(std::move(au));
+			if (!stream.width && parser->width > 0) {
+				stream.width = parser->width;
+				stream.height = parser->height;
+				const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<enum AVPixelFormat>(parser->format));
+				stream.tenBit = desc && desc->comp[0].depth > 8;
+			}
+		}
+		if (remaining == 0) {
+			break;
+		}
+		p += used;
+		remaining -= used;
+	}
+	av_parser_close(parser);
+	avcodec_free_context(&parseCtx);
+
+	if (stream.accessUnits.empty()) {
+		fprintf(stderr, "%s: no access units found\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+static double percentile(std::vector<double> sorted, double q) {
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	size_t i = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(i, sorted.size() - 1)];
+}
+
+// Decode units the pipelined mode lets pile up before the receive side has to wait
+#define PIPELINE_DEPTH 4
+
+using Clock = std::chrono::steady_clock;
+
+static double msBetween(Clock::time_point from, Clock::time_point to) {
+	return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// Replays the stream the way the app's receive thread hands it over. Direct decodes on the feeding thread,
+// like CAPABILITY_DIRECT_SUBMIT. Pipelined hands each unit through a bounded queue to a decoder thread, like
+// moonlight-common-c's VideoDec thread. Stall is how long the feeder was held up past the moment a unit was
+// ready, i.e. how much reassembly of the next frame would have been delayed.
+static bool run(const Stream &stream, int threads, bool realtime, bool pipelined) {
+	SoftwareDecoder decoder;
+	if (decoder.open(stream.codecId, stream.width, stream.height, stream.tenBit, threads) < 0) {
+		return false;
+	}
+
+	AVPacket *packet = av_packet_alloc();
+	AVFrame *frame = av_frame_alloc();
+	std::vector<double> latencyMs;
+	double convertMs = 0.0, handoffMs = 0.0, stallMs = 0.0;
+	int errors = 0;
+	latencyMs.reserve(stream.accessUnits.size());
+
+	// Decodes one unit, latency counts from when it was handed over
+	auto decode = [&](size_t i, Clock::time_point handedOver) {
+		const std::vector<uint8_t> &au = stream.accessUnits[i];
+		packet->data = const_cast<uint8_t *>(au.data());
+		packet->size = static_cast<int>(au.size() - AV_INPUT_BUFFER_PADDING_SIZE);
+		if (decoder.send(packet) < 0) {
+			errors++;
+			return;
+		}
+
+		int err;
+		while ((err = decoder.receive(frame)) >= 0) {
+			latencyMs.push_back(msBetween(handedOver, Clock::now()));
+			convertMs += decoder.lastConvertMs();
+			av_frame_unref(frame);
+		}
+		if (err != AVERROR(EAGAIN)) {
+			errors++;
+		}
+	};
+
+	realtime = realtime && !stream.enqueueTimeUs.empty();
+	const Clock::time_point start = Clock::now();
+	auto readyAt = [&](size_t i) {
+		return realtime ? start + std::chrono::microseconds(stream.enqueueTimeUs[i] - stream.enqueueTimeUs[0]) : Clock::now();
+	};
+
+	if (!pipelined) {
+		for (size_t i = 0; i < stream.accessUnits.size(); i++) {
+			const Clock::time_point ready = readyAt(i);
+			std::this_thread::sleep_until(ready);
+			const Clock::time_point handedOver = Clock::now();
+			stallMs += std::max(0.0, msBetween(ready, handedOver));
+			decode(i, handedOver);
+		}
+	} else {
+		std::mutex lock;
+		std::condition_variable changed;
+		std::deque<std::pair<size_t, Clock::time_point>> queue;
+		bool fed = false;
+
+		std::thread feeder([&] {
+			for (size_t i = 0; i < stream.accessUnits.size(); i++) {
+				const Clock::time_point ready = readyAt(i);
+				std::this_thread::sleep_until(ready);
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [&] { return queue.size() < PIPELINE_DEPTH; });
+				const Clock::time_point handedOver = Clock::now();
+				stallMs += std::max(0.0, msBetween(ready, handedOver));
+				queue.emplace_back(i, handedOver);
+				changed.notify_all();
+			}
+			std::lock_guard<std::mutex> guard(lock);
+			fed = true;
+			changed.notify_all();
+		});
+
+		for (;;) {
+			std::pair<size_t, Clock::time_point> unit;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [&] { return !queue.empty() || fed; });
+				if (queue.empty()) {
+					break;
+				}
+				unit = queue.front();
+				queue.pop_front();
+				changed.notify_all();
+			}
+			handoffMs += msBetween(unit.second, Clock::now());
+			decode(unit.first, unit.second);
+		}
+		feeder.join();
+	}
+
+	// Whatever the decoder still holds, with slice threading and low delay there should be nothing
+	int flushed = 0;
+	decoder.send(nullptr);
+	while (decoder.receive(frame) >= 0) {
+		flushed++;
+		av_frame_unref(frame);
+	}
+	const double totalMs = msBetween(start, Clock::now());
+
+	av_frame_free(&frame);
+	av_packet_free(&packet);
+
+	std::vector<double> sorted = latencyMs;
+	std::sort(sorted.begin(), sorted.end());
+	double sum = 0.0;
+	for (double ms : latencyMs) {
+		sum += ms;
+	}
+	const size_t frames = latencyMs.size();
+	const size_t units = stream.accessUnits.size();
+
+	printf("%s, %d thread%s, %s: %zu frames in %.0f ms, %.1f fps | latency avg %.2f p50 %.2f p99 %.2f max %.2f ms | "
+	       "handoff avg %.2f ms | receive stall avg %.2f ms | repack avg %.2f ms | %d flushed, %d errors\n",
+	       avcodec_get_name(stream.codecId), decoder.threadCount(), decoder.threadCount() == 1 ? "" : "s",
+	       pipelined ? "pipelined" : "direct", frames, totalMs, totalMs > 0.0 ? (frames + flushed) * 1000.0 / totalMs : 0.0,
+	       frames ? sum / frames : 0.0, percentile(sorted, 0.5), percentile(sorted, 0.99), sorted.empty() ? 0.0 : sorted.back(),
+	       units ? handoffMs / units : 0.0, units ? stallMs / units : 0.0, frames ? convertMs / frames : 0.0, flushed, errors);
+	return true;
+}
+
+// Requests are kMinIdrIntervalMs apart, only a fatal error's reopen and --always-idr may come sooner
+struct RequestSpacing {
+	int64_t lastUs = -1;
+	int violations = 0;
+
+	void request(int64_t nowUs, bool exempt) {
+		if (!exempt && lastUs >= 0 && nowUs - lastUs < static_cast<int64_t>(DecodeErrorPolicy::kMinIdrIntervalMs * 1000.0)) {
+			violations++;
+		}
+		lastUs = nowUs;
+	}
+};
+
+struct PolicyCounts {
+	int tolerated = 0;
+	int deferred = 0;
+	int idr = 0;
+	int flush = 0;
+	int reinit = 0;
+	int recoveries = 0; // keyframe waits
+
+	bool operator==(const PolicyCounts &o) const {
+		return tolerated == o.tolerated && deferred == o.deferred && idr == o.idr && flush == o.flush &&
+		       reinit == o.reinit && recoveries == o.recoveries;
+	}
+};
+
+// A scripted run of DecodeErrorPolicy without a decoder: units at 60 fps, the host answers a request with a
+// keyframe KEYFRAME_DELAY_UNITS later and the units in between are dropped like moonlight-common-c does
+struct FaultPattern {
+	const char *name;
+	int units;
+	bool (*errorAt)(int unit, DecodeErrorPolicy::Error &error, bool &reference); // false for a clean unit
+	PolicyCounts expected;
+};
+
+#define KEYFRAME_DELAY_UNITS 3
+
+static PolicyCounts runPattern(const FaultPattern &pattern, RequestSpacing &spacing) {
+	DecodeErrorPolicy policy;
+	policy.reset(1000000);
+	PolicyCounts counts;
+	int keyframeAt = 0;
+
+	for (int i = 0; i < pattern.units; i++) {
+		const int64_t now = static_cast<int64_t>(i) * 1000000 / 60;
+		if (i < keyframeAt) {
+			continue;
+		}
+		const bool keyframe = i == keyframeAt;
+
+		DecodeErrorPolicy::Error error = DecodeErrorPolicy::Error::Lost;
+		bool reference = true;
+		DecodeErrorPolicy::Action action;
+		if (!keyframe && pattern.errorAt(i, error, reference)) {
+			action = policy.onError(error, reference, now);
+			if (action == DecodeErrorPolicy::Action::Continue) {
+				counts.tolerated++;
+			}
+		} else {
+			action = policy.frameDecoded(keyframe, now);
+		}
+
+		switch (action) {
+		case DecodeErrorPolicy::Action::Continue:
+			continue;
+		case DecodeErrorPolicy::Action::Defer:
+			counts.deferred++;
+			continue;
+		case DecodeErrorPolicy::Action::RequestIdr:
+			counts.idr++;
+			break;
+		case DecodeErrorPolicy::Action::Flush:
+			counts.flush++;
+			break;
+		case DecodeErrorPolicy::Action::Reinit:
+			counts.reinit++;
+			break;
+		}
+		spacing.request(now, !keyframe && error == DecodeErrorPolicy::Error::Fatal);
+		counts.recoveries++;
+		keyframeAt = i + KEYFRAME_DELAY_UNITS;
+	}
+	return counts;
+}
+
+static bool lostReference(DecodeErrorPolicy::Error &error, bool &reference) {
+	error = DecodeErrorPolicy::Error::Lost;
+	reference = true;
+	return true;
+}
+
+// The expected counts follow from the constants in DecodeErrorPolicy.h, 30 units apart is kMinIdrIntervalMs
+static const FaultPattern kFaultPatterns[] = {
+    {"isolated non-reference losses", 600,
+     [](int unit, DecodeErrorPolicy::Error &error, bool &reference) {
+	     error = DecodeErrorPolicy::Error::Lost;
+	     reference = false;
+	     return unit % 10 == 0;
+     },
+     {59, 0, 0, 0, 0, 0}},
+    {"isolated concealed frames", 600,
+     [](int unit, DecodeErrorPolicy::Error &error, bool &) {
+	     error = DecodeErrorPolicy::Error::Concealed;
+	     return unit % 90 == 0;
+     },
+     {6, 0, 0, 0, 0, 0}},
+    {"three concealed frames within a second", 600,
+     [](int unit, DecodeErrorPolicy::Error &error, bool &) {
+	     error = DecodeErrorPolicy::Error::Concealed;
+	     return unit == 100 || unit == 110 || unit == 120;
+     },
+     {2, 0, 1, 0, 0, 1}},
+    {"lost reference frame", 600,
+     [](int unit, DecodeErrorPolicy::Error &error, bool &reference) { return unit == 100 && lostReference(error, reference); },
+     {0, 0, 1, 0, 0, 1}},
+    // Errors before the keyframe answers a request don't count against it, the ones after fail it once.
+    // The rate limit holds the next requests 500ms apart, so one burst ends at a flush, not a reopen.
+    {"one second of corrupt slices", 600,
+     [](int unit, DecodeErrorPolicy::Error &error, bool &reference) {
+	     return unit >= 100 && unit < 160 && lostReference(error, reference);
+     },
+     {0, 52, 2, 1, 0, 3}},
+    // Every request fails: two IDRs, two flushes and a reopen, then one IDR, two flushes and a reopen over and
+    // over, since the first error after a reopen already fails it
+    {"ten seconds of corrupt slices", 800,
+     [](int unit, DecodeErrorPolicy::Error &error, bool &reference) {
+	     return unit >= 100 && unit < 700 && lostReference(error, reference);
+     },
+     {0, 520, 6, 10, 5, 21}},
+    // A clean kRecoveryWindowMs after a flush starts over from a plain IDR request
+    {"burst, clean two seconds, one loss", 600,
+     [](int unit, DecodeErrorPolicy::Error &error, bool &reference) {
+	     return ((unit >= 100 && unit < 160) || unit == 400) && lostReference(error, reference);
+     },
+     {0, 52, 3, 1, 0, 4}},
+    // A fatal error reopens the decoder even right after a request
+    {"fatal error after a loss", 600,
+     [](int unit, DecodeErrorPolicy::Error &error, bool &reference) {
+	     if (unit == 110) {
+		     error = DecodeErrorPolicy::Error::Fatal;
+		     return true;
+	     }
+	     return unit == 100 && lostReference(error, reference);
+     },
+     {0, 0, 1, 0, 1, 2}},
+};
+
+// Runs kFaultPatterns, prints one line per pattern and returns false if any decision differs
+static bool checkPolicy() {
+	bool ok = true;
+	for (const FaultPattern &pattern : kFaultPatterns) {
+		RequestSpacing spacing;
+		const PolicyCounts c = runPattern(pattern, spacing);
+		const bool match = c == pattern.expected && spacing.violations == 0;
+		printf("%-40s %d tolerated, %d deferred, %d IDR, %d flush, %d reinit, %d recoveries%s\n", pattern.name, c.tolerated,
+		       c.deferred, c.idr, c.flush, c.reinit, c.recoveries, match ? "" : " FAIL");
+		if (spacing.violations) {
+			printf("%-40s %d requests sooner than %.0f ms after the last\n", "", spacing.violations,
+			       DecodeErrorPolicy::kMinIdrIntervalMs);
+		}
+		ok = ok && match;
+	}
+	return ok;
+}
+
+// Bytes overwritten in each damaged unit, after the first quarter so the parameter sets and slice headers
+// usually survive and the decoder conceals instead of giving up on the unit
+#define CORRUPT_BYTES 32
+#define CORRUPT_MIN_UNIT 64
+
+// Decodes the stream with units damaged at random and counts what the recovery decisions cost. Fails if the
+// policy requests sooner than its rate limit allows.
+static bool faultRun(const Stream &stream, int threads, double corruptPercent, bool alwaysIdr) {
+	if (stream.codecId != AV_CODEC_ID_H264 && stream.codecId != AV_CODEC_ID_HEVC) {
+		fprintf(stderr, "fault injection needs an H.264 or HEVC stream\n");
+		return false;
+	}
+	SoftwareDecoder decoder;
+	if (decoder.open(stream.codecId, stream.width, stream.height, stream.tenBit, threads) < 0) {
+		return false;
+	}
+
+	// Microsecond ticks
+	DecodeErrorPolicy policy;
+	policy.reset(1000000);
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<double> roll(0.0, 100.0);
+
+	// Classifies the units like FFMpegDecoder does
+	NalScanner scanner;
+	scanner.reset(stream.codecId == AV_CODEC_ID_H264 ? NalScanner::Codec::H264 : NalScanner::Codec::HEVC);
+
+	AVPacket *packet = av_packet_alloc();
+	AVFrame *frame = av_frame_alloc();
+	std::vector<uint8_t> damaged;
+	int injected = 0, frames = 0, damagedFrames = 0, dropped = 0, keyframesWaited = 0, tolerated = 0;
+	int errors[4] = {}, actions[5] = {};
+	bool waitForKeyframe = false;
+	bool reopenFailed = false;
+	RequestSpacing spacing;
+
+	// What FFMpegDecoder::ApplyErrorAction does, a keyframe request drops units until the next keyframe
+	auto apply = [&](DecodeErrorPolicy::Action action, int64_t now, bool fatal) {
+		actions[static_cast<int>(action)]++;
+		switch (action) {
+		case DecodeErrorPolicy::Action::Continue:
+		case DecodeErrorPolicy::Action::Defer:
+			return;
+		case DecodeErrorPolicy::Action::RequestIdr:
+			break;
+		case DecodeErrorPolicy::Action::Flush:
+			avcodec_flush_buffers(decoder.context());
+			break;
+		case DecodeErrorPolicy::Action::Reinit:
+			decoder.close();
+			reopenFailed = decoder.open(stream.codecId, stream.width, stream.height, stream.tenBit, threads) < 0;
+			break;
+		}
+		spacing.request(now, fatal);
+		waitForKeyframe = true;
+		keyframesWaited++;
+	};
+	auto onError = [&](DecodeErrorPolicy::Error error, bool reference, int64_t now) {
+		errors[static_cast<int>(error)]++;
+		const DecodeErrorPolicy::Action action = alwaysIdr && error != DecodeErrorPolicy::Error::Transient
+		                                             ? DecodeErrorPolicy::Action::RequestIdr
+		                                             : policy.onError(error, reference, now);
+		if (action == DecodeErrorPolicy::Action::Continue) {
+			tolerated++;
+		}
+		apply(action, now, alwaysIdr || error == DecodeErrorPolicy::Error::Fatal);
+	};
+
+	for (size_t i = 0; i < stream.accessUnits.size() && !reopenFailed; i++) {
+		const int64_t now = stream.enqueueTimeUs.empty() ? static_cast<int64_t>(i * 1000000 / 60)
+		                                                 : static_cast<int64_t>(stream.enqueueTimeUs[i] - stream.enqueueTimeUs[0]);
+		const std::vector<uint8_t> &au = stream.accessUnits[i];
+		const size_t size = au.size() - AV_INPUT_BUFFER_PADDING_SIZE;
+		const NalFrameInfo nal = scanner.scan(au.data(), size);
+		const bool keyframe = nal.frameClass == NAL_FRAME_IDR;
+		if (waitForKeyframe) {
+			if (!keyframe) {
+				dropped++;
+				continue;
+			}
+			waitForKeyframe = false;
+		}
+
+		packet->data = const_cast<uint8_t *>(au.data());
+		packet->size = static_cast<int>(size);
+		if (size >= CORRUPT_MIN_UNIT && roll(rng) < corruptPercent) {
+			damaged = au;
+			std::uniform_int_distribution<size_t> at(size / 4, size - 1);
+			for (int b = 0; b < CORRUPT_BYTES; b++) {
+				damaged[at(rng)] = static_cast<uint8_t>(rng());
+			}
+			packet->data = damaged.data();
+			injected++;
+		}
+
+		const bool reference = nal.frameClass != NAL_FRAME_NON_REFERENCE;
+		int err = decoder.send(packet);
+		if (err < 0) {
+			onError(DecodeErrorPolicy::classify(err), reference, now);
+			continue;
+		}
+		while ((err = decoder.receive(frame)) >= 0) {
+			frames++;
+			const bool concealed = (frame->flags & AV_FRAME_FLAG_CORRUPT) || frame->decode_error_flags;
+			av_frame_unref(frame);
+			if (concealed) {
+				damagedFrames++;
+				onError(DecodeErrorPolicy::Error::Concealed, reference, now);
+			} else if (!alwaysIdr) {
+				apply(policy.frameDecoded(keyframe, now), now, false);
+			}
+			if (waitForKeyframe) {
+				break;
+			}
+		}
+		if (err < 0 && err != AVERROR(EAGAIN)) {
+			onError(DecodeErrorPolicy::classify(err), reference, now);
+		}
+	}
+
+	decoder.send(nullptr);
+	while (decoder.receive(frame) >= 0) {
+		frames++;
+		av_frame_unref(frame);
+	}
+	av_frame_free(&frame);
+	av_packet_free(&packet);
+
+	const int lost = static_cast<int>(stream.accessUnits.size()) - frames;
+	printf("%s, %d thread%s, %s: %.1f%% damaged, %d errors injected | errors %d transient %d concealed %d lost %d fatal | "
+	       "%d tolerated, %d deferred, %d IDR, %d flush, %d reinit | %d keyframe waits, %d units dropped | "
+	       "%d frames lost, %d shown damaged, per injected error %.2f lost %.2f damaged\n",
+	       avcodec_get_name(stream.codecId), decoder.threadCount(), decoder.threadCount() == 1 ? "" : "s",
+	       alwaysIdr ? "always IDR" : "error policy", corruptPercent, injected, errors[0], errors[1], errors[2], errors[3],
+	       tolerated, actions[1], actions[2], actions[3], actions[4], keyframesWaited, dropped, lost, damagedFrames,
+	       injected ? static_cast<double>(lost) / injected : 0.0, injected ? static_cast<double>(damagedFrames) / injected : 0.0);
+	if (reopenFailed) {
+		fprintf(stderr, "couldn't reopen the decoder\n");
+	}
+	if (spacing.violations) {
+		fprintf(stderr, "FAIL: %d requests sooner than %.0f ms after the last\n", spacing.violations,
+		        DecodeErrorPolicy::kMinIdrIntervalMs);
+	}
+	return !reopenFailed && spacing.violations == 0;
+}
+
+int main(int argc, char **argv) {
+	bool realtime = false;
+	bool pipelined = false;
+	bool alwaysIdr = false;
+	bool checkOnly = false;
+	double corruptPercent = -1.0;
+	std::vector<std::string> paths;
+	std::vector<int> threadCounts;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (arg == "--realtime") {
+			realtime = true;
+		} else if (arg == "--pipelined") {
+			pipelined = true;
+		} else if (arg == "--corrupt" && i + 1 < argc) {
+			corruptPercent = atof(argv[++i]);
+		} else if (arg == "--always-idr") {
+			alwaysIdr = true;
+		} else if (arg == "--check-policy") {
+			checkOnly = true;
+		} else if (!arg.empty() && std::all_of(arg.begin(), arg.end(), [](unsigned char c) { return isdigit(c) != 0; })) {
+			threadCounts.push_back(atoi(arg.c_str()));
+		} else {
+			paths.push_back(arg);
+		}
+	}
+	if (checkOnly || corruptPercent >= 0.0) {
+		if (!checkPolicy()) {
+			return 1;
+		}
+		if (checkOnly) {
+			return 0;
+		}
+	}
+	if (paths.empty()) {
+		fprintf(stderr,
+		        "usage: %s [--realtime] [--pipelined] [--corrupt <percent> [--always-idr]] <stream.h264|stream.hevc|capture.idx>... "
+		        "[threads...]\n"
+		        "       %s --check-policy\n",
+		        argv[0], argv[0]);
+		return 1;
+	}
+	if (threadCounts.empty()) {
+		threadCounts = {1, SoftwareDecoder::defaultThreadCount()};
+		if (threadCounts[1] == 1) {
+			threadCounts.pop_back();
+		}
+	}
+
+	av_log_set_level(AV_LOG_WARNING);
+
+	for (const std::string &path : paths) {
+		Stream stream;
+		if (!load(path, stream)) {
+			return 1;
+		}
+		printf("%s: %s %dx%d%s, %zu access units", path.c_str(), avcodec_get_name(stream.codecId), stream.width, stream.height,
+		       stream.tenBit ? " 10-bit" : "", stream.accessUnits.size());
+		if (!stream.enqueueTimeUs.empty()) {
+			printf(", %d gaps, %s", stream.gaps, realtime ? "original speed" : "max speed");
+		}
+		printf("\n");
+
+		for (int threads : threadCounts) {
+			const bool ok = corruptPercent >= 0.0 ? faultRun(stream, threads, corruptPercent, alwaysIdr)
+			                                      : run(stream, threads, realtime, pipelined);
+			if (!ok) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
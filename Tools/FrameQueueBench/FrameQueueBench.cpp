@@ -0,0 +1,324 @@
+// Contention microbenchmark for Streaming/FrameQueue, headless.
+//
+// A producer thread enqueues frames at a fixed rate while a consumer thread follows the render loop
+// pattern at 60Hz: waitForEnqueue() up to a deadline, then count()/dequeue() as Pacer's immediate mode does.
+// Each scenario runs once against the lock-free FrameQueue and once against MutexFrameRing, a copy
+// of the previous std::mutex based implementation kept here as the baseline.
+//
+// Builds anywhere FFmpeg's libavutil is installed, as one command wrapped here:
+//   g++ -std=c++17 -O2 -Wall -pthread -o FrameQueueBench FrameQueueBench.cpp ../../Streaming/FrameQueue.cpp
+//       ../../Streaming/FramePool.cpp $(pkg-config --cflags --libs libavutil)
+//
+// Usage:
+//   FrameQueueBench        run 60/120/240 fps producers for 5 seconds each, against both implementations
+//   FrameQueueBench 1.5    same with 1.5 seconds per run
+//
+// Timing runs on std::chrono::steady_clock, the numbers are only comparable between the two implementations
+// on the same machine. Run it on an idle machine, the consumer's sleeps depend on the scheduler. FrameQueue
+// only sleeps on WaitOnAddress on Windows (cl FrameQueueBench.cpp ... Synchronization.lib), elsewhere
+// AtomicWait.h polls every millisecond and the lock-free wake times mean nothing.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../../Streaming/FrameData.h"
+#include "../../Streaming/FrameQueue.h"
+
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+}
+
+constexpr double CONSUMER_HZ = 60.0;
+constexpr double CONSUMER_RENDER_BUDGET_MS = 3.0;
+
+// PacingLog.h, FrameQueue only logs when built with FRAME_QUEUE_VERBOSE
+void PacingLogf(const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+}
+
+// FrameQueue's timed waits on steady_clock nanoseconds, there is no display to wait for
+class SteadyPacerClock : public PacerClock {
+  public:
+	int64_t frequency() override {
+		return 1000000000;
+	}
+	int64_t now() override {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	void sleepUntil(int64_t target) override {
+		std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(target)));
+	}
+	bool waitForVBlank() override {
+		return false;
+	}
+	bool getFrameStatistics(PacerFrameStatistics &) override {
+		return false;
+	}
+};
+
+static SteadyPacerClock g_clock;
+
+static int64_t msToTicks(double ms) {
+	return static_cast<int64_t>(ms * 1000000.0);
+}
+
+static double ticksToUs(int64_t ticks) {
+	return ticks / 1000.0;
+}
+
+// The previous FrameQueue: one std::mutex around a ring, same alternating drop logic
+class MutexFrameRing {
+  public:
+	explicit MutexFrameRing(int highWaterMark) : _highWaterMark(highWaterMark) {}
+	~MutexFrameRing() { clear(); }
+
+	std::size_t count() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return static_cast<std::size_t>(_count);
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		while (_count > 0) {
+			AVFrame *frame = popFrame();
+			av_frame_free(&frame);
+		}
+	}
+
+	int enqueue(AVFrame *frame) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		int dropCount = 0;
+		if (frame->pict_type == AV_PICTURE_TYPE_I || _count < _highWaterMark) {
+			if (_count == kCapacity) {
+				AVFrame *oldest = popFrame();
+				av_frame_free(&oldest);
+				dropCount = 1;
+			}
+			pushFrame(frame);
+			_droppedLast = false;
+		} else if (!_droppedLast) {
+			av_frame_free(&frame);
+			dropCount = 1;
+			_droppedLast = true;
+		} else {
+			AVFrame *oldest = popFrame();
+			if (oldest) {
+				av_frame_free(&oldest);
+				dropCount = 1;
+			}
+			pushFrame(frame);
+			_droppedLast = false;
+		}
+		return dropCount;
+	}
+
+	AVFrame *dequeue() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return popFrame();
+	}
+
+	void waitForEnqueue(int num, double timeoutMs) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		auto deadline = std::chrono::steady_clock::now() +
+		                std::chrono::microseconds(static_cast<long long>(timeoutMs * 1000.0));
+		while (_count < num) {
+			auto now = std::chrono::steady_clock::now();
+			if (now >= deadline) break;
+			auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now);
+			auto chunk = std::clamp(remaining / 4, std::chrono::microseconds(250), std::chrono::microseconds(1000));
+			_cv.wait_for(lock, chunk);
+		}
+	}
+
+  private:
+	static constexpr int kCapacity = 5;
+
+	void pushFrame(AVFrame *frame) {
+		_buffer[_tail] = frame;
+		_tail = (_tail + 1) % kCapacity;
+		_count++;
+		_cv.notify_one();
+	}
+
+	AVFrame *popFrame() {
+		if (_count == 0) {
+			return nullptr;
+		}
+		AVFrame *frame = _buffer[_head];
+		_buffer[_head] = nullptr;
+		_head = (_head + 1) % kCapacity;
+		_count--;
+		return frame;
+	}
+
+	mutable std::mutex _mutex;
+	std::condition_variable _cv;
+	AVFrame *_buffer[kCapacity] = {};
+	int _head = 0;
+	int _tail = 0;
+	int _count = 0;
+	bool _droppedLast = false;
+	int _highWaterMark;
+};
+
+struct FrameQueueBenchResult {
+	const char *impl = "";
+	double producerFps = 0.0;
+	int framesEnqueued = 0;
+	int framesDequeued = 0;
+	int framesDropped = 0;
+
+	// Time spent inside enqueue() on the producer thread
+	double enqueueP50Us = 0.0;
+	double enqueueP99Us = 0.0;
+	double enqueueMaxUs = 0.0;
+
+	// Time spent inside count()/dequeue() on the consumer thread
+	double consumerP50Us = 0.0;
+	double consumerP99Us = 0.0;
+	double consumerMaxUs = 0.0;
+
+	// enqueue() -> waitForEnqueue() returning, for waits that started on an empty queue
+	double wakeP50Us = 0.0;
+	double wakeP99Us = 0.0;
+
+	void print() const {
+		printf("%-9s @ %3.0ffps: enqueued %d, dequeued %d, dropped %d\n", impl, producerFps, framesEnqueued, framesDequeued,
+		       framesDropped);
+		printf("    enqueue p50 %.2fus p99 %.2fus max %.2fus, consumer p50 %.2fus p99 %.2fus max %.2fus, wake p50 %.1fus p99 %.1fus\n",
+		       enqueueP50Us, enqueueP99Us, enqueueMaxUs, consumerP50Us, consumerP99Us, consumerMaxUs, wakeP50Us, wakeP99Us);
+	}
+};
+
+static void percentiles(std::vector<double> &v, double &p50, double &p99, double *max) {
+	if (v.empty()) {
+		return;
+	}
+	std::sort(v.begin(), v.end());
+	p50 = v[v.size() / 2];
+	p99 = v[std::min(v.size() - 1, v.size() * 99 / 100)];
+	if (max) {
+		*max = v.back();
+	}
+}
+
+template <typename Queue>
+static FrameQueueBenchResult runOne(Queue &queue, const char *impl, double producerFps, double seconds) {
+	FrameQueueBenchResult result;
+	result.impl = impl;
+	result.producerFps = producerFps;
+
+	std::atomic<bool> done{false};
+	std::vector<double> enqueueUs, consumerUs, wakeUs;
+	const int64_t start = g_clock.now() + msToTicks(10.0);
+	const int64_t end = start + msToTicks(seconds * 1000.0);
+
+	std::thread producer([&]() {
+		const double periodMs = 1000.0 / producerFps;
+		for (int i = 0;; ++i) {
+			const int64_t due = start + msToTicks(i * periodMs);
+			if (due >= end) {
+				break;
+			}
+			g_clock.sleepUntil(due);
+
+			AVFrame *frame = av_frame_alloc();
+			frame->pts = static_cast<int64_t>(i * 90000.0 / producerFps);
+			frame->pict_type = i == 0 ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_P;
+			frame->opaque_ref = av_buffer_allocz(sizeof(MLFrameData));
+
+			const int64_t before = g_clock.now();
+			if (frame->opaque_ref) {
+				reinterpret_cast<MLFrameData *>(frame->opaque_ref->data)->decodeEndQpc = before;
+			}
+			result.framesDropped += queue.enqueue(frame);
+			enqueueUs.push_back(ticksToUs(g_clock.now() - before));
+			result.framesEnqueued++;
+		}
+		done.store(true, std::memory_order_release);
+	});
+
+	// Consumer follows the render loop: wait for a frame until the render budget runs out,
+	// then dequeue and catch up if more than one frame is queued
+	const int64_t vsync = msToTicks(1000.0 / CONSUMER_HZ);
+	int64_t nextVsync = start + vsync;
+	int consumerDrops = 0; // framesDropped belongs to the producer thread until join()
+	while (!done.load(std::memory_order_acquire)) {
+		const bool wasEmpty = queue.count() == 0;
+		const double waitMs = std::max(0.0, (nextVsync - g_clock.now()) / 1000000.0 - CONSUMER_RENDER_BUDGET_MS);
+		queue.waitForEnqueue(1, waitMs);
+		const int64_t woke = g_clock.now();
+
+		int64_t before = g_clock.now();
+		AVFrame *frame = queue.dequeue();
+		consumerUs.push_back(ticksToUs(g_clock.now() - before));
+
+		if (frame) {
+			if (wasEmpty && frame->opaque_ref) {
+				wakeUs.push_back(ticksToUs(woke - reinterpret_cast<MLFrameData *>(frame->opaque_ref->data)->decodeEndQpc));
+			}
+
+			before = g_clock.now();
+			const bool behind = queue.count() > 1;
+			consumerUs.push_back(ticksToUs(g_clock.now() - before));
+
+			if (behind) {
+				before = g_clock.now();
+				AVFrame *frame2 = queue.dequeue();
+				consumerUs.push_back(ticksToUs(g_clock.now() - before));
+				if (frame2) {
+					av_frame_free(&frame);
+					frame = frame2;
+					consumerDrops++;
+				}
+			}
+			av_frame_free(&frame);
+			result.framesDequeued++;
+		}
+
+		g_clock.sleepUntil(nextVsync);
+		nextVsync += vsync;
+	}
+
+	producer.join();
+	queue.clear();
+	result.framesDropped += consumerDrops;
+
+	percentiles(enqueueUs, result.enqueueP50Us, result.enqueueP99Us, &result.enqueueMaxUs);
+	percentiles(consumerUs, result.consumerP50Us, result.consumerP99Us, &result.consumerMaxUs);
+	percentiles(wakeUs, result.wakeP50Us, result.wakeP99Us, nullptr);
+	return result;
+}
+
+int main(int argc, char **argv) {
+	const double secondsPerRun = argc > 1 ? atof(argv[1]) : 5.0;
+	if (secondsPerRun <= 0.0) {
+		fprintf(stderr, "usage: FrameQueueBench [seconds per run]\n");
+		return 2;
+	}
+
+	FrameQueue &lockFree = FrameQueue::instance();
+	const int hwm = lockFree.highWaterMark();
+	lockFree.setClock(std::shared_ptr<PacerClock>(&g_clock, [](PacerClock *) {}));
+
+	for (double fps : {60.0, 120.0, 240.0}) {
+		lockFree.start();
+		runOne(lockFree, "lock-free", fps, secondsPerRun).print();
+		lockFree.stop();
+
+		MutexFrameRing mutexRing(hwm);
+		runOne(mutexRing, "mutex", fps, secondsPerRun).print();
+	}
+	return 0;
+}
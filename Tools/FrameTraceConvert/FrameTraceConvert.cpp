@@ -0,0 +1,212 @@
+// Converts a frame trace dump (Save frame trace in the stream menu) to CSV or Chrome trace JSON.
+//
+// Standalone, builds with any C++17 compiler:
+//   cl /std:c++17 /EHsc /O2 FrameTraceConvert.cpp
+//   g++ -std=c++17 -O2 -o FrameTraceConvert FrameTraceConvert.cpp
+//
+// Usage:
+//   FrameTraceConvert frametrace-20250101-120000.bin out.csv    one row per frame, times in ms
+//   FrameTraceConvert frametrace-20250101-120000.bin out.json   open in chrome://tracing or ui.perfetto.dev
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../../Streaming/FrameTraceFormat.h"
+
+static const char *kTimeNames[TRACE_TIME_COUNT] = {
+    "receive", "reassembled", "decode_start", "decode_end", "queue_enqueue", "queue_dequeue",
+    "render_start", "render_end", "present_target", "present", "landed_vsync",
+};
+
+struct Trace {
+	FrameTraceFileHeader header;
+	std::vector<FrameTraceRecord> records;
+	int64_t baseQpc = 0; // earliest timestamp in the trace, output times are relative to it
+
+	double toMs(int64_t qpc) const {
+		return static_cast<double>(qpc - baseQpc) * 1000.0 / static_cast<double>(header.qpcFreq);
+	}
+	double toUs(int64_t qpc) const {
+		return toMs(qpc) * 1000.0;
+	}
+};
+
+static bool load(const char *path, Trace &trace) {
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "can't open %s\n", path);
+		return false;
+	}
+
+	bool ok = fread(&trace.header, sizeof(trace.header), 1, f) == 1;
+	if (!ok || memcmp(trace.header.magic, FRAME_TRACE_MAGIC, sizeof(trace.header.magic)) != 0) {
+		fprintf(stderr, "%s is not a frame trace\n", path);
+		fclose(f);
+		return false;
+	}
+	if (trace.header.version != FRAME_TRACE_VERSION || trace.header.recordSize != sizeof(FrameTraceRecord) ||
+	    trace.header.qpcFreq <= 0) {
+		fprintf(stderr, "%s: unsupported trace version %u (record size %u), this tool reads version %d\n",
+		        path, trace.header.version, trace.header.recordSize, FRAME_TRACE_VERSION);
+		fclose(f);
+		return false;
+	}
+
+	trace.records.resize(trace.header.recordCount);
+	size_t read = fread(trace.records.data(), sizeof(FrameTraceRecord), trace.records.size(), f);
+	fclose(f);
+	if (read != trace.records.size()) {
+		fprintf(stderr, "%s: truncated, read %zu of %u records\n", path, read, trace.header.recordCount);
+		trace.records.resize(read);
+	}
+
+	trace.baseQpc = INT64_MAX;
+	for (const FrameTraceRecord &r : trace.records) {
+		for (int64_t t : r.t) {
+			if (t) {
+				trace.baseQpc = std::min(trace.baseQpc, t);
+			}
+		}
+	}
+	if (trace.baseQpc == INT64_MAX) {
+		trace.baseQpc = 0;
+	}
+	return true;
+}
+
+static bool writeCsv(const Trace &trace, FILE *out) {
+	fprintf(out, "id,frame_number,rtp_timestamp,frame_type,idr");
+	for (const char *name : kTimeNames) {
+		fprintf(out, ",%s_ms", name);
+	}
+	fprintf(out, ",present_id,landed_refresh_count,repeat_count\n");
+
+	for (const FrameTraceRecord &r : trace.records) {
+		fprintf(out, "%u,%u,%u,%u,%d", r.id, r.frameNumber, r.rtpTimestamp, r.frameType,
+		        (r.flags & TRACE_FLAG_IDR) ? 1 : 0);
+		for (int64_t t : r.t) {
+			if (t) {
+				fprintf(out, ",%.3f", trace.toMs(t));
+			} else {
+				fprintf(out, ",");
+			}
+		}
+		fprintf(out, ",%u,%u,%u\n", r.presentId, r.landedRefreshCount, r.repeatCount);
+	}
+	return true;
+}
+
+// One track per pipeline stage, each frame is a slice on every track it reached
+enum Track {
+	TRACK_NETWORK = 1,
+	TRACK_DECODE,
+	TRACK_QUEUE,
+	TRACK_RENDER,
+	TRACK_PRESENT_WAIT,
+	TRACK_DISPLAY,
+};
+
+static void writeSlice(const Trace &trace, FILE *out, bool &first, const FrameTraceRecord &r, Track track,
+                       const char *stage, int64_t startQpc, int64_t endQpc) {
+	if (!startQpc || !endQpc || endQpc < startQpc) {
+		return;
+	}
+	fprintf(out, "%s\n{\"name\":\"frame %u\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+	             "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"id\":%u,\"rtp\":%u,\"idr\":%d,\"repeats\":%u}}",
+	        first ? "" : ",", r.frameNumber, stage, track, trace.toUs(startQpc), trace.toUs(endQpc) - trace.toUs(startQpc),
+	        r.id, r.rtpTimestamp, (r.flags & TRACE_FLAG_IDR) ? 1 : 0, r.repeatCount);
+	first = false;
+}
+
+static bool writeChromeTrace(const Trace &trace, FILE *out) {
+	static const struct {
+		Track track;
+		const char *name;
+	} kTracks[] = {
+	    {TRACK_NETWORK, "1 network reassembly"},
+	    {TRACK_DECODE, "2 decode"},
+	    {TRACK_QUEUE, "3 frame queue"},
+	    {TRACK_RENDER, "4 render"},
+	    {TRACK_PRESENT_WAIT, "5 wait for present"},
+	    {TRACK_DISPLAY, "6 on screen"},
+	};
+
+	fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	bool first = true;
+	for (const auto &t : kTracks) {
+		fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+		        first ? "" : ",", t.track, t.name);
+		first = false;
+	}
+
+	for (size_t i = 0; i < trace.records.size(); ++i) {
+		const FrameTraceRecord &r = trace.records[i];
+		writeSlice(trace, out, first, r, TRACK_NETWORK, "network", r.t[TRACE_RECEIVE], r.t[TRACE_REASSEMBLED]);
+		writeSlice(trace, out, first, r, TRACK_DECODE, "decode", r.t[TRACE_DECODE_START], r.t[TRACE_DECODE_END]);
+		writeSlice(trace, out, first, r, TRACK_QUEUE, "queue", r.t[TRACE_QUEUE_ENQUEUE], r.t[TRACE_QUEUE_DEQUEUE]);
+		writeSlice(trace, out, first, r, TRACK_RENDER, "render", r.t[TRACE_RENDER_START], r.t[TRACE_RENDER_END]);
+		writeSlice(trace, out, first, r, TRACK_PRESENT_WAIT, "present", r.t[TRACE_RENDER_END], r.t[TRACE_PRESENT]);
+
+		// On screen from the vblank it landed on until the next frame that landed replaced it
+		if (r.t[TRACE_LANDED_VSYNC]) {
+			for (size_t j = i + 1; j < trace.records.size(); ++j) {
+				if (trace.records[j].t[TRACE_LANDED_VSYNC]) {
+					writeSlice(trace, out, first, r, TRACK_DISPLAY, "display", r.t[TRACE_LANDED_VSYNC],
+					           trace.records[j].t[TRACE_LANDED_VSYNC]);
+					break;
+				}
+			}
+		}
+
+		// Mark presents that missed the vblank they aimed for
+		if (r.t[TRACE_LANDED_VSYNC] && r.t[TRACE_PRESENT_TARGET] &&
+		    r.t[TRACE_LANDED_VSYNC] > r.t[TRACE_PRESENT_TARGET] + trace.header.qpcFreq / 2000) {
+			fprintf(out, ",\n{\"name\":\"late frame %u\",\"cat\":\"late\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,"
+			             "\"ts\":%.3f,\"args\":{\"target_ms\":%.3f,\"late_ms\":%.3f}}",
+			        r.frameNumber, TRACK_DISPLAY, trace.toUs(r.t[TRACE_LANDED_VSYNC]), trace.toMs(r.t[TRACE_PRESENT_TARGET]),
+			        trace.toMs(r.t[TRACE_LANDED_VSYNC]) - trace.toMs(r.t[TRACE_PRESENT_TARGET]));
+		}
+	}
+	fprintf(out, "\n]}\n");
+	return true;
+}
+
+static bool endsWith(const std::string &s, const char *suffix) {
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <trace.bin> <out.csv|out.json>\n", argv[0]);
+		return 2;
+	}
+
+	Trace trace;
+	if (!load(argv[1], trace)) {
+		return 1;
+	}
+
+	std::string outPath = argv[2];
+	bool json = endsWith(outPath, ".json");
+	if (!json && !endsWith(outPath, ".csv")) {
+		fprintf(stderr, "output must end in .csv or .json\n");
+		return 2;
+	}
+
+	FILE *out = fopen(outPath.c_str(), "w");
+	if (!out) {
+		fprintf(stderr, "can't create %s\n", outPath.c_str());
+		return 1;
+	}
+	bool ok = json ? writeChromeTrace(trace, out) : writeCsv(trace, out);
+	ok = (fclose(out) == 0) && ok;
+
+	printf("%zu frames, %.3fs, written to %s\n", trace.records.size(),
+	       trace.records.empty() ? 0.0 : trace.toMs(trace.records.back().t[TRACE_DECODE_START]) / 1000.0,
+	       outPath.c_str());
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+// Runs the frame pacing scenarios of Streaming/PacerSimulator.h against the app's pacing code (PacerCore,
+// FrameQueue, FramePool and the components PacerCore owns) and checks the results, headless.
+//
+// Builds anywhere FFmpeg's libavutil is installed, as one command wrapped here:
+//   g++ -std=c++17 -O2 -Wall -o PacerSim PacerSim.cpp ../../Streaming/PacerSimulator.cpp ../../Streaming/PacerCore.cpp
+//       ../../Streaming/FrameQueue.cpp ../../Streaming/FramePool.cpp ../../Streaming/FrameCadence.cpp
+//       ../../Streaming/QueueDepthController.cpp ../../Streaming/HostClockEstimator.cpp
+//       ../../Streaming/VsyncTracker.cpp ../../Streaming/PresentSlotScheduler.cpp
+//       ../../Streaming/RenderCostPredictor.cpp $(pkg-config --cflags --libs libavutil)
+//
+// Usage:
+//   PacerSim       run every case, prints one line per scenario and exits 1 if a check fails
+//   PacerSim -v    also print the full reports and what the pacing code logs
+//
+// Each scenario is deterministic for its PacerSimConfig, so the bounds below only leave room for changes
+// in the pacing code that don't change its behavior noticeably. A change that moves a result past its
+// bound should update the bound together with the reason in the same commit.
+//
+// Every scenario bounds missed presents: the render loop reserves time for rendering before each vblank,
+// so apart from the first iterations, before the render cost is known, Present() must be on time.
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include "../../Streaming/PacerSimulator.h"
+#include "../../Streaming/PresentSlotScheduler.h"
+
+static bool g_verbose = false;
+static int g_failures = 0;
+
+// PacingLog.h, the pacing code's log only clutters the results unless asked for
+void PacingLogf(const char *fmt, ...) {
+	if (!g_verbose) {
+		return;
+	}
+	va_list args;
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+}
+
+static void expect(const char *scenario, bool ok, const char *condition) {
+	if (!ok) {
+		fprintf(stderr, "FAIL [%s]: %s\n", scenario, condition);
+		g_failures++;
+	}
+}
+
+#define EXPECT(scenario, cond) expect(scenario, (cond), #cond)
+
+static PacerSimReport run(const char *scenario, const PacerSimConfig &config) {
+	const PacerSimReport r = PacerSimulator().run(config);
+	printf("%-44s displayed %d/%d, dropped %d, repeated vblanks %d, missed presents %d, skipped presents %d, judder %.3fms, latency p95 %.2fms\n",
+	       scenario, r.framesDisplayed, r.framesSubmitted, r.framesDropped, r.repeatedVblanks, r.missedPresents, r.skippedPresents, r.judderMs,
+	       r.latencyP95Ms);
+	if (g_verbose) {
+		r.log(scenario);
+	}
+	return r;
+}
+
+// A clean stream at the display rate shows every frame once
+static void steady60on60() {
+	const char *name = "60fps on 60Hz";
+	PacerSimConfig cfg;
+	const PacerSimReport r = run(name, cfg);
+	EXPECT(name, r.framesDropped <= 2);
+	EXPECT(name, r.repeatedVblanks <= 2);
+	EXPECT(name, r.missedPresents <= 2);
+	EXPECT(name, r.judderMs < 0.5);
+	// Nothing to absorb, the queue comes down to the frame being rendered
+	EXPECT(name, r.queueDepth == 1);
+}
+
+// The documented example: 0.1% too few vblanks for the stream, about 4 frames a minute have to go, and
+// the jitter must not add more than a few drops and repeats on top
+static void jitter60on5994() {
+	const char *name = "60fps on 59.94Hz, 2ms jitter";
+	PacerSimConfig cfg;
+	cfg.streamFps = 60.0;
+	cfg.displayHz = 59.94;
+	cfg.arrivalJitterMs = 2.0;
+	const PacerSimReport r = run(name, cfg);
+	EXPECT(name, r.framesDropped >= 3);
+	EXPECT(name, r.framesDropped <= cfg.frameCount / 100);
+	EXPECT(name, r.repeatedVblanks <= cfg.frameCount / 100);
+	EXPECT(name, r.missedPresents <= cfg.frameCount / 100);
+	EXPECT(name, r.judderMs < 1.0);
+}
+
+// The documented Xbox 120 Hz mode, where frame statistics only tick at 60 Hz. Present slots put every
+// frame on its own vblank.
+static void slots120on120() {
+	const char *name = "120fps, 120Hz output with 60Hz stats";
+	PacerSimConfig cfg;
+	cfg.streamFps = 120.0;
+	cfg.displayHz = 120.0;
+	cfg.statsEveryVblanks = 2;
+	const PacerSimReport r = run(name, cfg);
+	EXPECT(name, r.repeatedVblanks == 0);
+	EXPECT(name, r.framesDropped == 0);
+	EXPECT(name, r.missedPresents <= 2);
+	EXPECT(name, r.judderMs < 0.5);
+}
+
+// Display-locked 24 fps settles on 3:2 pulldown, each frame is on screen for 50 or 33.3ms instead of
+// 41.7ms, so judder is exactly 8.33ms and nothing is dropped
+static void pulldown24on60() {
+	const char *name = "24fps on 60Hz, display-locked";
+	PacerSimConfig cfg;
+	cfg.streamFps = 24.0;
+	cfg.frameCount = 1440;
+	cfg.pacingMode = PacingMode::DisplayLocked;
+	const PacerSimReport r = run(name, cfg);
+	EXPECT(name, r.framesDropped == 0);
+	EXPECT(name, r.missedPresents <= 2);
+	EXPECT(name, std::abs(r.judderMs - 25.0 / 3.0) < 0.5);
+}
+
+// Host timestamps with a millisecond of error move the measured ratio in and out of the pattern's
+// tolerance. The lock rides that out and 3:2 pulldown holds.
+static void pulldownJitter24on60() {
+	const char *name = "24fps on 60Hz, display-locked, pts jitter";
+	PacerSimConfig cfg;
+	cfg.streamFps = 24.0;
+	cfg.frameCount = 1440;
+	cfg.ptsJitterMs = 1.0;
+	cfg.pacingMode = PacingMode::DisplayLocked;
+	const PacerSimReport r = run(name, cfg);
+	EXPECT(name, r.patternBreaks <= 1);
+	EXPECT(name, r.framesDropped == 0);
+	EXPECT(name, r.missedPresents <= 2);
+	EXPECT(name, std::abs(r.judderMs - 25.0 / 3.0) < 0.5);
+}
+
+// Latency budget mode at half the display rate holds each frame back a vblank when the budget allows, so
+// every frame is on screen for two vblanks. The held vblank still presents the current frame, skipping
+// Present() corrupts the picture on Xbox One.
+static void budget30on60() {
+	const char *name = "30fps on 60Hz, 40ms latency budget";
+	PacerSimConfig cfg;
+	cfg.streamFps = 30.0;
+	cfg.frameCount = 1800;
+	cfg.pacingMode = PacingMode::LatencyBudget;
+	cfg.latencyBudgetMs = 40.0;
+	const PacerSimReport r = run(name, cfg);
+	EXPECT(name, r.skippedPresents == 0);
+	EXPECT(name, r.framesDropped <= 2);
+	EXPECT(name, std::abs(r.repeatedVblanks - r.framesDisplayed) <= 2);
+	EXPECT(name, r.missedPresents <= 2);
+	EXPECT(name, r.judderMs < 1.0);
+	EXPECT(name, r.latencyMaxMs <= cfg.latencyBudgetMs);
+}
+
+// HostClockEstimator finds a host clock running 50 ppm fast within a few ppm over ten minutes
+static void hostClockSkew() {
+	const char *name = "60fps on 60Hz, host clock +50 ppm";
+	PacerSimConfig cfg;
+	cfg.hostClockPpm = 50.0;
+	cfg.frameCount = 36000;
+	const PacerSimReport r = run(name, cfg);
+	EXPECT(name, std::abs(r.hostClockPpm - cfg.hostClockPpm) < 5.0);
+	EXPECT(name, r.framesDropped <= cfg.frameCount / 1000);
+	EXPECT(name, r.missedPresents <= 2);
+}
+
+// Slot counts of PresentSlotScheduler: reported refreshes per measured vblank, capped by the stream
+// framerate and clamped to 1..MAX_SLOTS
+static int slotsFor(double reportedHz, double streamFps, double measuredHz) {
+	const int64_t freq = 10000000;
+	PresentSlotScheduler slots;
+	slots.configure(reportedHz, streamFps);
+	return slots.slotsFor(std::llround(freq / measuredHz), freq);
+}
+
+// VsyncTracker measures the vblank period from frame statistics however stale or sparse they are, the
+// refresh counts step once per reported vblank so the period is that of every Nth vblank
+static void vsyncStats() {
+	static const int kVariants[][2] = {{0, 1}, {2, 1}, {6, 1}, {2, 2}, {1, 4}}; // lag, every
+	for (const auto &variant : kVariants) {
+		char name[64];
+		snprintf(name, sizeof(name), "60fps on 59.94Hz, stats lag %d, every %d", variant[0], variant[1]);
+		PacerSimConfig cfg;
+		cfg.displayHz = 59.94;
+		cfg.statsLagVblanks = variant[0];
+		cfg.statsEveryVblanks = variant[1];
+		const PacerSimReport r = run(name, cfg);
+		EXPECT(name, std::abs(r.vsyncPeriodMs - variant[1] * 1000.0 / cfg.displayHz) < 0.005);
+		EXPECT(name, r.missedPresents <= 2);
+	}
+}
+
+static void presentSlots() {
+	const char *name = "present slots";
+	const int failures = g_failures;
+	EXPECT(name, slotsFor(120.0, 120.0, 60.0) == 2);   // Xbox 120 Hz mode with 60 Hz stats
+	EXPECT(name, slotsFor(240.0, 240.0, 60.0) == 4);   // 240 Hz reported as 60 Hz
+	EXPECT(name, slotsFor(480.0, 480.0, 60.0) == PresentSlotScheduler::MAX_SLOTS);
+	EXPECT(name, slotsFor(120.0, 60.0, 60.0) == 1);    // the stream can't fill a second slot
+	EXPECT(name, slotsFor(60.0, 60.0, 60.0) == 1);
+	EXPECT(name, slotsFor(60.0, 60.0, 59.94) == 1);    // 60 fps on 59.94 Hz stays in the slack
+	EXPECT(name, PresentSlotScheduler().slotsFor(0, 10000000) == 1); // no measurement yet
+
+	// Two slots of a 100 tick vblank ending at 1000 start at 900 and 950
+	EXPECT(name, PresentSlotScheduler::nextSlotAfter(900, 1000, 100, 2) == 950);
+	EXPECT(name, PresentSlotScheduler::nextSlotAfter(949, 1000, 100, 2) == 950);
+	EXPECT(name, PresentSlotScheduler::nextSlotAfter(950, 1000, 100, 2) == 1000);
+	EXPECT(name, PresentSlotScheduler::nextSlotAfter(900, 1000, 100, 1) == 1000);
+	printf("%-44s %s\n", name, g_failures == failures ? "ok" : "failed");
+}
+
+int main(int argc, char **argv) {
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-v")) {
+			g_verbose = true;
+		} else {
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	steady60on60();
+	jitter60on5994();
+	slots120on120();
+	pulldown24on60();
+	pulldownJitter24on60();
+	budget30on60();
+	hostClockSkew();
+	vsyncStats();
+	presentSlots();
+
+	if (g_failures) {
+		fprintf(stderr, "%d check(s) failed\n", g_failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,424 @@
+// Checks the CPU side of VideoRenderer headless: the repack of software decoded frames into the upload
+// textures (Streaming/SoftwareFrameUpload.h), the CSC table (Streaming/ColorConversion.h) and the upscalers'
+// CPU reference (Streaming/Upscaler.h).
+//
+// Builds anywhere FFmpeg's headers are installed, as one command wrapped here:
+//   g++ -std=c++17 -O2 -Wall -o RenderCheck RenderCheck.cpp ../../Streaming/SoftwareFrameUpload.cpp
+//       ../../Streaming/Upscaler.cpp $(pkg-config --cflags libavutil)
+//
+// Usage:
+//   RenderCheck       run every check, prints one line per case and exits 1 if a check fails
+//   RenderCheck -v    also print the largest error of every CSC variant
+//
+// Each upload case fills a frame of the given format with known colors, encoded by the standard's definition
+// (ColorConversion::encode), copies it into texture-sized buffers through SoftwareUploadLayout and samples
+// those the way d3d11_yuv420_pixel_array.hlsl does: point sampling, 8-bit planes read as R8/R8G8_UNORM and
+// 10-bit ones as R16/R16G16_UNORM, then the table's offsets and matrix. The result has to be the color the
+// frame was made from, within the rounding of the code values. 4:2:0 frames repeat a color per 2x2 block,
+// 4:4:4 frames give every pixel its own, so a 4:4:4 frame that loses chroma resolution fails.
+//
+// The upscaler cases check properties of Lanczos, EASU and RCAS that hold for any correct implementation:
+// flat areas stay flat, nothing over- or undershoots its neighborhood, edges keep their orientation and a
+// mirrored input gives a mirrored output. The shaders follow the reference operation for operation; the
+// renderer doesn't compare them on the GPU, so a change to either side has to be made in both.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "../../Streaming/ColorConversion.h"
+#include "../../Streaming/SoftwareFrameUpload.h"
+#include "../../Streaming/Upscaler.h"
+
+static bool g_verbose = false;
+static int g_failures = 0;
+
+static void expect(const char *scenario, bool ok, const char *condition) {
+	if (!ok) {
+		fprintf(stderr, "FAIL [%s]: %s\n", scenario, condition);
+		g_failures++;
+	}
+}
+
+#define EXPECT(scenario, cond) expect(scenario, (cond), #cond)
+
+// Fill value of the texture buffers, bytes past what the layout copies must keep it
+constexpr uint8_t GUARD = 0xCD;
+
+static const char *colorspaceName(CscColorspace colorspace) {
+	return colorspace == CscColorspace::Rec709 ? "Rec709" : colorspace == CscColorspace::Rec2020 ? "Rec2020" : "Rec601";
+}
+
+static const char *formatName(AVPixelFormat format) {
+	switch (format) {
+	case AV_PIX_FMT_NV12:
+		return "NV12";
+	case AV_PIX_FMT_P010:
+		return "P010";
+	case AV_PIX_FMT_NV24:
+		return "NV24";
+	case AV_PIX_FMT_P410:
+		return "P410";
+	default:
+		return "?";
+	}
+}
+
+// Deterministic colors, black and white first so the range endpoints are always covered
+static CscRgb colorAt(int index) {
+	if (index == 0) {
+		return {0.0, 0.0, 0.0};
+	}
+	if (index == 1) {
+		return {1.0, 1.0, 1.0};
+	}
+	uint32_t h = (uint32_t)index * 2654435761u;
+	h ^= h >> 15;
+	h *= 2246822519u;
+	h ^= h >> 13;
+	return {(h & 0x3FF) / 1023.0, ((h >> 10) & 0x3FF) / 1023.0, ((h >> 20) & 0x3FF) / 1023.0};
+}
+
+// A frame the way FFmpeg lays it out: plane 0 luma, plane 1 interleaved U/V, 10-bit samples MSB aligned
+struct TestFrame {
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> data[2];
+	int linesize[2] = {};
+};
+
+static void putSample(uint8_t *p, bool tenBit, int value) {
+	if (tenBit) {
+		const uint16_t v = (uint16_t)(value << 6);
+		memcpy(p, &v, 2);
+	} else {
+		*p = (uint8_t)value;
+	}
+}
+
+static double readUnorm(const uint8_t *p, bool tenBit) {
+	if (tenBit) {
+		uint16_t v;
+		memcpy(&v, p, 2);
+		return v / 65535.0;
+	}
+	return *p / 255.0;
+}
+
+static int colorIndex(int x, int y, int width, bool fullChroma) {
+	return fullChroma ? y * width + x : (y / 2) * ((width + 1) / 2) + x / 2;
+}
+
+static TestFrame makeFrame(AVPixelFormat format, int width, int height, CscColorspace colorspace, bool fullRange) {
+	const bool tenBit = format == AV_PIX_FMT_P010 || format == AV_PIX_FMT_P410;
+	const bool fullChroma = format == AV_PIX_FMT_NV24 || format == AV_PIX_FMT_P410;
+	const int sampleBytes = tenBit ? 2 : 1;
+	const int bits = tenBit ? 10 : 8;
+	const int chromaWidth = fullChroma ? width : (width + 1) / 2;
+	const int chromaHeight = fullChroma ? height : (height + 1) / 2;
+
+	// FFmpeg pads lines, the padding has to stay out of the textures' visible area
+	TestFrame f;
+	f.width = width;
+	f.height = height;
+	f.linesize[0] = (width * sampleBytes + 63) & ~31;
+	f.linesize[1] = (chromaWidth * 2 * sampleBytes + 63) & ~31;
+	f.data[0].assign((size_t)f.linesize[0] * height, 0x55);
+	f.data[1].assign((size_t)f.linesize[1] * chromaHeight, 0x55);
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			const CscRgb c = colorAt(colorIndex(x, y, width, fullChroma));
+			const ColorConversion::Yuv yuv = ColorConversion::encode(colorspace, fullRange, bits, c.r, c.g, c.b);
+			putSample(&f.data[0][(size_t)y * f.linesize[0] + x * sampleBytes], tenBit, yuv.y);
+			if (fullChroma || (x % 2 == 0 && y % 2 == 0)) {
+				const int cx = fullChroma ? x : x / 2;
+				const int cy = fullChroma ? y : y / 2;
+				uint8_t *uv = &f.data[1][(size_t)cy * f.linesize[1] + cx * 2 * sampleBytes];
+				putSample(uv, tenBit, yuv.u);
+				putSample(uv + sampleBytes, tenBit, yuv.v);
+			}
+		}
+	}
+	return f;
+}
+
+// Largest difference to the source colors over every pixel, -1 if the upload itself was wrong
+static double uploadAndSample(const char *scenario, AVPixelFormat format, const TestFrame &f, int variant) {
+	SoftwareUploadLayout layout;
+	if (!layout.init(format, f.width, f.height)) {
+		expect(scenario, false, "layout.init(format, f.width, f.height)");
+		return -1.0;
+	}
+
+	const bool fullChroma = layout.fullChroma;
+	const size_t sampleBytes = layout.tenBit ? 2 : 1;
+	EXPECT(scenario, layout.width % 2 == 0 && layout.height % 2 == 0);
+	EXPECT(scenario, layout.planes[0].width == layout.width && layout.planes[0].height == layout.height);
+	EXPECT(scenario, layout.planes[1].width == (fullChroma ? layout.width : layout.width / 2));
+	EXPECT(scenario, layout.planes[1].height == (fullChroma ? layout.height : layout.height / 2));
+	EXPECT(scenario, layout.planes[0].rowBytes == layout.planes[0].width * sampleBytes);
+	EXPECT(scenario, layout.planes[1].rowBytes == layout.planes[1].width * sampleBytes * 2);
+
+	// Every row of the frame and nothing past it, a wrong count would copy out of the buffers below
+	const int frameRows[2] = {f.height, fullChroma ? f.height : (f.height + 1) / 2};
+	for (int plane = 0; plane < 2; plane++) {
+		if (layout.planes[plane].rows != frameRows[plane] || (uint32_t)frameRows[plane] > layout.planes[plane].height) {
+			expect(scenario, false, "layout.planes[plane].rows == frameRows[plane]");
+			return -1.0;
+		}
+	}
+
+	// Mapped textures pitch their rows wider than the data, like drivers do
+	std::vector<uint8_t> textures[2];
+	size_t pitch[2];
+	for (int plane = 0; plane < 2; plane++) {
+		pitch[plane] = (layout.planes[plane].rowBytes + 255) & ~(size_t)255;
+		textures[plane].assign(pitch[plane] * layout.planes[plane].height, GUARD);
+		layout.copyPlane(plane, f.data[plane].data(), f.linesize[plane], textures[plane].data(), pitch[plane]);
+
+		// Rows past the frame's own are left alone, the frame has nothing there
+		bool guardKept = true;
+		for (uint32_t row = 0; row < layout.planes[plane].height; row++) {
+			const size_t from = (int)row < frameRows[plane] ? layout.planes[plane].rowBytes : 0;
+			for (size_t i = from; i < pitch[plane]; i++) {
+				guardKept &= textures[plane][row * pitch[plane] + i] == GUARD;
+			}
+		}
+		EXPECT(scenario, guardKept);
+	}
+
+	// The pixel shader at every texel center of the frame
+	const CscConstants &c = kCscTable[variant];
+	double maxError = 0.0;
+	for (int y = 0; y < f.height; y++) {
+		for (int x = 0; x < f.width; x++) {
+			const int cx = fullChroma ? x : x / 2;
+			const int cy = fullChroma ? y : y / 2;
+			const uint8_t *luma = &textures[0][y * pitch[0] + x * sampleBytes];
+			const uint8_t *chroma = &textures[1][cy * pitch[1] + cx * 2 * sampleBytes];
+			const double yuv[3] = {readUnorm(luma, layout.tenBit) - c.offsets[0], readUnorm(chroma, layout.tenBit) - c.offsets[1],
+			                       readUnorm(chroma + sampleBytes, layout.tenBit) - c.offsets[2]};
+			double rgb[3] = {};
+			for (int i = 0; i < 3; i++) {
+				for (int j = 0; j < 3; j++) {
+					rgb[i] += yuv[j] * c.matrix[i * 4 + j];
+				}
+			}
+
+			const CscRgb want = colorAt(colorIndex(x, y, f.width, fullChroma));
+			maxError = std::max({maxError, std::fabs(rgb[0] - want.r), std::fabs(rgb[1] - want.g), std::fabs(rgb[2] - want.b)});
+		}
+	}
+	return maxError;
+}
+
+static void checkUpload(AVPixelFormat format, int width, int height) {
+	char scenario[64];
+	snprintf(scenario, sizeof(scenario), "upload %s %dx%d", formatName(format), width, height);
+
+	const bool tenBit = format == AV_PIX_FMT_P010 || format == AV_PIX_FMT_P410;
+	const int bits = tenBit ? 10 : 8;
+
+	// Rounding of the code values, the chroma step carries into R and B up to twice. 16-bit UNORM reads
+	// a 10-bit sample as value * 64 / 65535 where the table expects value / 1023, under 0.1% apart.
+	const double tolerance = tenBit ? 0.005 : 0.008;
+
+	double worst = 0.0;
+	for (int cs = 0; cs < ColorConversion::kColorspaceCount; cs++) {
+		for (bool fullRange : {false, true}) {
+			const CscColorspace colorspace = (CscColorspace)cs;
+			const int variant = ColorConversion::index(colorspace, fullRange, bits);
+			const TestFrame f = makeFrame(format, width, height, colorspace, fullRange);
+			const double error = uploadAndSample(scenario, format, f, variant);
+			if (g_verbose) {
+				printf("    %s %s %d-bit: max error %.5f\n", colorspaceName(colorspace), fullRange ? "full" : "limited", bits, error);
+			}
+			if (error < 0.0) {
+				return;
+			}
+			EXPECT(scenario, error <= tolerance);
+			worst = std::max(worst, error);
+		}
+	}
+	printf("%-28s max error %.5f over %d CSC variants\n", scenario, worst, ColorConversion::kColorspaceCount * 2);
+}
+
+static void checkFormats() {
+	const char *scenario = "formats";
+	SoftwareUploadLayout layout;
+	EXPECT(scenario, !layout.init(AV_PIX_FMT_NONE, 1280, 720));
+	EXPECT(scenario, layout.init(AV_PIX_FMT_NV12, 1280, 720) && !layout.tenBit && !layout.fullChroma);
+	EXPECT(scenario, layout.init(AV_PIX_FMT_P010, 1280, 720) && layout.tenBit && !layout.fullChroma);
+	EXPECT(scenario, layout.init(AV_PIX_FMT_NV24, 1280, 720) && !layout.tenBit && layout.fullChroma);
+	EXPECT(scenario, layout.init(AV_PIX_FMT_P410, 1280, 720) && layout.tenBit && layout.fullChroma);
+	printf("%-28s ok\n", scenario);
+}
+
+using UpscaleFn = void (*)(const UpscaleImage &, UpscaleImage &);
+
+static void rcasDefault(const UpscaleImage &src, UpscaleImage &dst) {
+	Upscaler::rcas(src, dst, Upscaler::rcasScale(Upscaler::kRcasSharpness));
+}
+
+struct UpscalerCase {
+	const char *name;
+	UpscaleFn fn;
+	bool scales;      // false for RCAS, which sharpens at the output size
+	bool separable;   // EASU's diamond of taps weights the columns differently depending on the row offset
+	bool antiRinging; // RCAS darkens the dark side of an edge on purpose
+};
+
+const UpscalerCase kUpscalers[] = {
+    {"Lanczos", Upscaler::lanczos, true, true, true},
+    {"EASU", Upscaler::easu, true, false, true},
+    {"RCAS", rcasDefault, false, true, false},
+};
+
+static UpscaleImage upscale(const UpscalerCase &u, const UpscaleImage &src, int dstWidth, int dstHeight) {
+	UpscaleImage dst = u.scales ? UpscaleImage(dstWidth, dstHeight) : UpscaleImage(src.width, src.height);
+	u.fn(src, dst);
+	return dst;
+}
+
+static UpscaleImage mirrored(const UpscaleImage &image) {
+	UpscaleImage out(image.width, image.height);
+	for (int y = 0; y < image.height; y++) {
+		for (int x = 0; x < image.width; x++) {
+			std::copy(image.at(x, y), image.at(x, y) + 3, out.at(image.width - 1 - x, y));
+		}
+	}
+	return out;
+}
+
+static float maxDifference(const UpscaleImage &a, const UpscaleImage &b) {
+	float error = 0.0f;
+	for (size_t i = 0; i < a.pixels.size(); i++) {
+		error = std::max(error, std::fabs(a.pixels[i] - b.pixels[i]));
+	}
+	return error;
+}
+
+static void checkUpscaler(const UpscalerCase &u) {
+	char scenario[64];
+	snprintf(scenario, sizeof(scenario), "upscale %s", u.name);
+	const int srcWidth = 64, srcHeight = 48, dstWidth = 100, dstHeight = 75;
+
+	// Flat input, every weight sums up to the same color
+	UpscaleImage flat(srcWidth, srcHeight);
+	for (size_t i = 0; i < flat.pixels.size(); i += 3) {
+		flat.pixels[i] = 0.3f;
+		flat.pixels[i + 1] = 0.6f;
+		flat.pixels[i + 2] = 0.9f;
+	}
+	const UpscaleImage flatOut = upscale(u, flat, dstWidth, dstHeight);
+	float flatError = 0.0f;
+	for (size_t i = 0; i < flatOut.pixels.size(); i++) {
+		flatError = std::max(flatError, std::fabs(flatOut.pixels[i] - flat.pixels[i % 3]));
+	}
+	EXPECT(scenario, flatError <= 1e-5f);
+
+	// The test pattern stays in range and finite
+	const UpscaleImage pattern = Upscaler::testPattern(srcWidth, srcHeight);
+	const UpscaleImage patternOut = upscale(u, pattern, dstWidth, dstHeight);
+	bool inRange = true;
+	for (float v : patternOut.pixels) {
+		inRange &= v >= 0.0f && v <= 1.0f;
+	}
+	EXPECT(scenario, inRange);
+
+	// A vertical step edge: rows the same for separable filters, no ringing and the far sides untouched
+	UpscaleImage step(srcWidth, srcHeight);
+	for (int y = 0; y < srcHeight; y++) {
+		for (int x = 0; x < srcWidth; x++) {
+			float *c = step.at(x, y);
+			c[0] = c[1] = c[2] = x < srcWidth / 2 ? 0.1f : 0.8f;
+		}
+	}
+	const UpscaleImage stepOut = upscale(u, step, dstWidth, dstHeight);
+	bool rowsEqual = true, monotonic = true;
+	for (int y = 0; y < stepOut.height; y++) {
+		for (int x = 0; x < stepOut.width; x++) {
+			rowsEqual &= std::fabs(stepOut.at(x, y)[0] - stepOut.at(x, 0)[0]) <= 1e-5f;
+			if (x > 0) {
+				monotonic &= stepOut.at(x, y)[0] >= stepOut.at(x - 1, y)[0] - 1e-5f;
+			}
+		}
+	}
+	EXPECT(scenario, rowsEqual || !u.separable);
+	EXPECT(scenario, monotonic || !u.antiRinging);
+	EXPECT(scenario, std::fabs(stepOut.at(0, 0)[0] - 0.1f) <= 1e-5f);
+	EXPECT(scenario, std::fabs(stepOut.at(stepOut.width - 1, 0)[0] - 0.8f) <= 1e-5f);
+
+	// Mirroring commutes with scaling, output pixel i and width - 1 - i sample mirrored positions
+	const float mirrorError = maxDifference(mirrored(patternOut), upscale(u, mirrored(pattern), dstWidth, dstHeight));
+	EXPECT(scenario, mirrorError <= 1e-4f);
+
+	printf("%-28s flat error %.2e, mirror error %.2e\n", scenario, flatError, mirrorError);
+}
+
+static void checkUpscalerProperties() {
+	const char *scenario = "upscale Lanczos 1:1";
+	// At the source size every output pixel sits on a texel center, where Lanczos2 only weights that texel
+	const UpscaleImage pattern = Upscaler::testPattern(64, 48);
+	UpscaleImage same(pattern.width, pattern.height);
+	Upscaler::lanczos(pattern, same);
+	EXPECT(scenario, maxDifference(same, pattern) <= 1e-6f);
+	printf("%-28s ok\n", scenario);
+
+	scenario = "upscale RCAS";
+	// The corners of a blurred edge get sharper, no lobe leaves it unchanged
+	UpscaleImage ramp(16, 4);
+	for (int y = 0; y < ramp.height; y++) {
+		for (int x = 0; x < ramp.width; x++) {
+			float *c = ramp.at(x, y);
+			c[0] = c[1] = c[2] = std::min(std::max((x - 6) / 4.0f, 0.0f), 1.0f) * 0.6f + 0.2f;
+		}
+	}
+	UpscaleImage sharpened(ramp.width, ramp.height), unchanged(ramp.width, ramp.height);
+	rcasDefault(ramp, sharpened);
+	Upscaler::rcas(ramp, unchanged, 0.0f);
+	EXPECT(scenario, maxDifference(unchanged, ramp) <= 1e-6f);
+	EXPECT(scenario, sharpened.at(6, 0)[0] < ramp.at(6, 0)[0] && sharpened.at(10, 0)[0] > ramp.at(10, 0)[0]);
+	printf("%-28s ok\n", scenario);
+
+	scenario = "upscale choose";
+	EXPECT(scenario, Upscaler::choose(UpscaleFilter::FSR, UpscaleDevice::XboxSeriesX, 3840, 2160, 3840, 2160, 60) == UpscaleFilter::Bilinear);
+	EXPECT(scenario, Upscaler::choose(UpscaleFilter::FSR, UpscaleDevice::XboxSeriesX, 2560, 1440, 3840, 2160, 60) == UpscaleFilter::FSR);
+	EXPECT(scenario, Upscaler::choose(UpscaleFilter::FSR, UpscaleDevice::XboxSeriesS, 2560, 1440, 3840, 2160, 60) == UpscaleFilter::Lanczos);
+	EXPECT(scenario, Upscaler::choose(UpscaleFilter::Lanczos, UpscaleDevice::XboxOne, 1920, 1080, 3840, 2160, 60) == UpscaleFilter::Bilinear);
+	EXPECT(scenario, Upscaler::choose(UpscaleFilter::FSR, UpscaleDevice::Other, 1280, 720, 3840, 2160, 120) == UpscaleFilter::FSR);
+	for (UpscaleFilter filter : {UpscaleFilter::Bilinear, UpscaleFilter::Lanczos, UpscaleFilter::FSR}) {
+		EXPECT(scenario, Upscaler::parse(Upscaler::name(filter)) == filter);
+	}
+	printf("%-28s ok\n", scenario);
+}
+
+int main(int argc, char **argv) {
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-v")) {
+			g_verbose = true;
+		} else {
+			fprintf(stderr, "usage: RenderCheck [-v]\n");
+			return 2;
+		}
+	}
+
+	checkFormats();
+	for (AVPixelFormat format : {AV_PIX_FMT_NV12, AV_PIX_FMT_P010, AV_PIX_FMT_NV24, AV_PIX_FMT_P410}) {
+		checkUpload(format, 64, 36);
+		checkUpload(format, 7, 5); // odd sizes, the textures round up to even
+	}
+	for (const UpscalerCase &u : kUpscalers) {
+		checkUpscaler(u);
+	}
+	checkUpscalerProperties();
+
+	if (g_failures) {
+		fprintf(stderr, "%d check(s) failed\n", g_failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}